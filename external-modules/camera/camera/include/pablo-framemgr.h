@@ -13,6 +13,7 @@
 #define IS_FRAME_MGR_H
 
 #include <linux/kthread.h>
+#include <linux/sched/clock.h>
 #include <linux/videodev2.h>
 #include "is-time.h"
 #include "is-config.h"
@@ -56,9 +57,11 @@
 	do {							\
 		this->sindex |= index;				\
 		spin_lock_irqsave(&this->slock, flag);		\
+		framemgr_lock_enter(this);			\
 	} while (0)
 #define framemgr_x_barrier_irqr(this, index, flag)		\
 	do {							\
+		framemgr_lock_exit(this);			\
 		spin_unlock_irqrestore(&this->slock, flag);	\
 		this->sindex &= ~index;				\
 	} while (0)
@@ -66,9 +69,11 @@
 	do {							\
 		this->sindex |= index;				\
 		spin_lock_irq(&this->slock);			\
+		framemgr_lock_enter(this);			\
 	} while (0)
 #define framemgr_x_barrier_irq(this, index)			\
 	do {							\
+		framemgr_lock_exit(this);			\
 		spin_unlock_irq(&this->slock);			\
 		this->sindex &= ~index;				\
 	} while (0)
@@ -76,9 +81,11 @@
 	do {							\
 		this->sindex |= index;				\
 		spin_lock(&this->slock);			\
+		framemgr_lock_enter(this);			\
 	} while (0)
 #define framemgr_x_barrier(this, index)				\
 	do {							\
+		framemgr_lock_exit(this);			\
 		spin_unlock(&this->slock);			\
 		this->sindex &= ~index;				\
 	} while (0)
@@ -121,9 +128,41 @@ struct is_framemgr {
 	u32			queued_count[NR_FRAME_STATE];
 	struct list_head	queued_list[NR_FRAME_STATE];
 
+	/*
+	 * fcount index of each state queue, a slot per (fcount & fcount_mask).
+	 * It is only a hint, a slot is used after checking that the frame
+	 * is still in the state with the fcount looked up.
+	 */
+	struct is_frame		**fcount_index;
+	u32			fcount_mask;
+	u32			fcount_shift;
+	u64			fcount_hit;
+	u64			fcount_miss;
+
+	/* slock hold time in ns, taken by framemgr_e_barrier*() */
+	u64			lock_enter;
+	u64			lock_count;
+	u64			lock_hold_sum;
+	u64			lock_hold_max;
+
 	u32 batch_num;
 };
 
+static inline void framemgr_lock_enter(struct is_framemgr *this)
+{
+	this->lock_enter = local_clock();
+}
+
+static inline void framemgr_lock_exit(struct is_framemgr *this)
+{
+	u64 hold = local_clock() - this->lock_enter;
+
+	this->lock_count++;
+	this->lock_hold_sum += hold;
+	if (hold > this->lock_hold_max)
+		this->lock_hold_max = hold;
+}
+
 static const char * const hw_frame_state_name[NR_FRAME_STATE] = {
 	"Free",
 	"Request",
@@ -153,6 +192,8 @@ struct is_frame *peek_frame_tail(struct is_framemgr *this,
 struct is_frame *find_frame(struct is_framemgr *this,
 			enum is_frame_state state,
 			ulong (*fn)(struct is_frame *, void *), void *data);
+struct is_frame *find_frame_fcount(struct is_framemgr *this,
+			enum is_frame_state state, u32 fcount);
 void print_frame_queue(struct is_framemgr *this,
 			enum is_frame_state state);
 
@@ -163,6 +204,7 @@ int frame_manager_flush(struct is_framemgr *this);
 void frame_manager_print_queues(struct is_framemgr *this);
 void frame_manager_dump_queues(struct is_framemgr *this);
 void frame_manager_print_info_queues(struct is_framemgr *this);
+void frame_manager_print_stats(struct is_framemgr *this);
 int frame_manager_reinit(struct is_framemgr *this);
 
 #endif
@@ -58,6 +58,7 @@ enum pmio_formatter_type {
 	PMIO_FORMATTER_INC,
 	PMIO_FORMATTER_PAIR,
 	PMIO_FORMATTER_RPT,
+	PMIO_FORMATTER_AUTO,
 	PMIO_FORMATTER_FULL,
 };
 
@@ -66,6 +67,7 @@ static const char * const pmio_formatter_names[] = {
 	"inc",
 	"pair",
 	"rpt",
+	"auto",
 	"full",
 };
 
@@ -341,6 +343,10 @@ struct pmio_range_cfg {
  *			This is helpful to improve the overall performance of
  *			format-sync.
  * @use_ext_hdr:	Use extended header for repeat address mode, if supports.
+ * @use_delta:		Format-sync only the registers changed since the last
+ *			format-sync, for flat caches. A register written to
+ *			the HW directly is written again by the next one.
+ *			pmio_reset_cache() is needed after the HW is reset.
  *
  */
 struct pmio_config {
@@ -381,6 +387,7 @@ struct pmio_config {
 	phys_addr_t phys_base;
 	bool ignore_phys_base;
 	bool use_ext_hdr;
+	bool use_delta;
 };
 
 struct pablo_mmio *pmio_init(void *dev, void *ctx, const struct pmio_config *config);
@@ -27,6 +27,7 @@
 #include <videodev2_exynos_camera.h>
 #include <linux/v4l2-mediabus.h>
 #include <linux/bug.h>
+#include <linux/log2.h>
 
 #include "is-core.h"
 #include "is-cmd.h"
@@ -38,6 +39,50 @@ ulong frame_fcount(struct is_frame *frame, void *data)
 }
 EXPORT_SYMBOL_GPL(frame_fcount);
 
+static inline struct is_frame **__fcount_slot(struct is_framemgr *this,
+			enum is_frame_state state, u32 fcount)
+{
+	return &this->fcount_index[(state << this->fcount_shift) +
+					(fcount & this->fcount_mask)];
+}
+
+static void __fcount_index_add(struct is_framemgr *this, struct is_frame *frame)
+{
+	struct is_frame **slot, *cur;
+
+	if (!this->fcount_index)
+		return;
+
+	/* keep the earlier one to find the same frame as the queue order */
+	slot = __fcount_slot(this, frame->state, frame->fcount);
+	cur = *slot;
+	if (!cur || cur->state != frame->state ||
+	    __fcount_slot(this, cur->state, cur->fcount) != slot)
+		*slot = frame;
+}
+
+static void __fcount_index_del(struct is_framemgr *this, struct is_frame *frame)
+{
+	struct is_frame **slot;
+
+	if (!this->fcount_index)
+		return;
+
+	slot = __fcount_slot(this, frame->state, frame->fcount);
+	if (*slot == frame)
+		*slot = NULL;
+}
+
+static void __fcount_index_reset(struct is_framemgr *this)
+{
+	if (this->fcount_index)
+		memset(this->fcount_index, 0, array_size(sizeof(*this->fcount_index),
+				NR_FRAME_STATE << this->fcount_shift));
+
+	this->fcount_hit = 0;
+	this->fcount_miss = 0;
+}
+
 int put_frame(struct is_framemgr *this, struct is_frame *frame,
 			enum is_frame_state state)
 {
@@ -50,6 +95,7 @@ int put_frame(struct is_framemgr *this, struct is_frame *frame,
 	}
 
 	frame->state = state;
+	__fcount_index_add(this, frame);
 
 	list_add_tail(&frame->list, &this->queued_list[state]);
 	this->queued_count[state]++;
@@ -75,6 +121,7 @@ struct is_frame *get_frame(struct is_framemgr *this,
 
 	frame = list_first_entry(&this->queued_list[state],
 						struct is_frame, list);
+	__fcount_index_del(this, frame);
 	list_del(&frame->list);
 	this->queued_count[state]--;
 
@@ -101,6 +148,7 @@ int trans_frame(struct is_framemgr *this, struct is_frame *frame,
 		return -EINVAL;
 	}
 
+	__fcount_index_del(this, frame);
 	list_del(&frame->list);
 	this->queued_count[frame->state]--;
 
@@ -148,6 +196,9 @@ struct is_frame *find_frame(struct is_framemgr *this,
 	if (!this->queued_count[state])
 		return NULL;
 
+	if (fn == frame_fcount && (ulong)data <= U32_MAX)
+		return find_frame_fcount(this, state, (u32)(ulong)data);
+
 	list_for_each_entry(frame, &this->queued_list[state], list) {
 		if (!fn(frame, data))
 			return frame;
@@ -157,6 +208,40 @@ struct is_frame *find_frame(struct is_framemgr *this,
 }
 EXPORT_SYMBOL_GPL(find_frame);
 
+struct is_frame *find_frame_fcount(struct is_framemgr *this,
+		enum is_frame_state state, u32 fcount)
+{
+	struct is_frame *frame, **slot = NULL;
+
+	if (state == FS_INVALID)
+		return NULL;
+
+	if (!this->queued_count[state])
+		return NULL;
+
+	if (this->fcount_index) {
+		slot = __fcount_slot(this, state, fcount);
+		frame = *slot;
+		if (frame && frame->state == state && frame->fcount == fcount) {
+			this->fcount_hit++;
+			return frame;
+		}
+		this->fcount_miss++;
+	}
+
+	/* collided, or the fcount was changed after the frame was queued */
+	list_for_each_entry(frame, &this->queued_list[state], list) {
+		if (frame->fcount == fcount) {
+			if (slot)
+				*slot = frame;
+			return frame;
+		}
+	}
+
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(find_frame_fcount);
+
 void print_frame_queue(struct is_framemgr *this,
 			enum is_frame_state state)
 {
@@ -207,6 +292,7 @@ int frame_manager_probe(struct is_framemgr *this, const char *name)
 	snprintf(this->name, sizeof(this->name), "%s", name);
 	spin_lock_init(&this->slock);
 	this->frames = NULL;
+	this->fcount_index = NULL;
 
 	return 0;
 }
@@ -269,7 +355,7 @@ static void default_frame_dwork_fn(struct kthread_work *work)
 
 int frame_manager_open(struct is_framemgr *this, u32 buffers, bool need_param)
 {
-	u32 i;
+	u32 i, slots;
 	unsigned long flag;
 
 	/*
@@ -296,9 +382,25 @@ int frame_manager_open(struct is_framemgr *this, u32 buffers, bool need_param)
 		}
 	}
 
+	/* twice the frames to keep the collisions rare, lookups work without it */
+	if (this->fcount_index)
+		vfree(this->fcount_index);
+
+	slots = roundup_pow_of_two(max_t(u32, buffers, 1) * 2);
+	this->fcount_shift = ilog2(slots);
+	this->fcount_mask = slots - 1;
+	this->fcount_index = vzalloc(array_size(sizeof(*this->fcount_index),
+					NR_FRAME_STATE << this->fcount_shift));
+	if (!this->fcount_index)
+		warn("failed to allocate fcount index");
+
 	spin_lock_irqsave(&this->slock, flag);
 
 	this->num_frames = buffers;
+	__fcount_index_reset(this);
+	this->lock_count = 0;
+	this->lock_hold_sum = 0;
+	this->lock_hold_max = 0;
 
 	for (i = 0; i < NR_FRAME_STATE; i++) {
 		this->queued_count[i] = 0;
@@ -339,6 +441,11 @@ int frame_manager_close(struct is_framemgr *this)
 		this->parameters = NULL;
 	}
 
+	if (this->fcount_index) {
+		is_vfree_atomic(this->fcount_index);
+		this->fcount_index = NULL;
+	}
+
 	for (i = 0; i < NR_FRAME_STATE; i++) {
 		this->queued_count[i] = 0;
 		INIT_LIST_HEAD(&this->queued_list[i]);
@@ -380,9 +487,22 @@ void frame_manager_print_queues(struct is_framemgr *this)
 
 	for (i = 0; i < NR_FRAME_STATE; i++)
 		print_frame_queue(this, (enum is_frame_state)i);
+
+	frame_manager_print_stats(this);
 }
 EXPORT_SYMBOL_GPL(frame_manager_print_queues);
 
+void frame_manager_print_stats(struct is_framemgr *this)
+{
+	u64 avg = this->lock_count ?
+		div64_u64(this->lock_hold_sum, this->lock_count) : 0;
+
+	is_info("[FRM] %s: fcount %llu hit, %llu miss / lock %llu times, avg %lluns, max %lluns\n",
+		this->name, this->fcount_hit, this->fcount_miss,
+		this->lock_count, avg, this->lock_hold_max);
+}
+EXPORT_SYMBOL_GPL(frame_manager_print_stats);
+
 void dump_frame_queue(struct is_framemgr *this,
 			enum is_frame_state state)
 {
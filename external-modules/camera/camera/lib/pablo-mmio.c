@@ -401,6 +401,7 @@ struct pablo_mmio *pmio_init(void *dev, void *ctx, const struct pmio_config *con
 	pmio->phys_base = config->phys_base;
 	pmio->ignore_phys_base = config->ignore_phys_base;
 	pmio->use_ext_hdr = config->use_ext_hdr;
+	pmio->use_delta = config->use_delta;
 
 	if (config->reg_read)
 		pmio->reg_read = config->reg_read;
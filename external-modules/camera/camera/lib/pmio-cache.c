@@ -38,6 +38,10 @@ struct pmio_cache_flat_ctx {
 	unsigned int *cache_default;
 	unsigned long *cache_dirty_bitmap;
 
+	/* values of the last format-sync, with use_delta */
+	unsigned int *cache_committed;
+	unsigned long *cache_committed_bitmap;
+
 	/* flat cache family privates */
 	unsigned long cache_state;
 };
@@ -75,8 +79,22 @@ static int pmio_cache_flat_init(struct pablo_mmio *pmio)
 				      array_size(ctx->cache_count, sizeof(unsigned int)),
 				      GFP_KERNEL);
 
+	if (pmio->use_delta) {
+		ctx->cache_committed = kvcalloc(ctx->cache_count, sizeof(unsigned int),
+						GFP_KERNEL);
+		ctx->cache_committed_bitmap = bitmap_zalloc(pmio->max_register, GFP_KERNEL);
+		if (!ctx->cache_committed || !ctx->cache_committed_bitmap)
+			goto err_alloc_cache_committed;
+	}
+
 	return 0;
 
+err_alloc_cache_committed:
+	bitmap_free(ctx->cache_committed_bitmap);
+	kvfree(ctx->cache_committed);
+	kvfree(ctx->cache_default);
+	bitmap_free(ctx->cache_dirty_bitmap);
+
 err_alloc_cache_dirty_bitmap:
 	kvfree(ctx->cache);
 
@@ -95,6 +113,8 @@ static int pmio_cache_flat_exit(struct pablo_mmio *pmio)
 	if (!ctx)
 		return 0;
 
+	bitmap_free(ctx->cache_committed_bitmap);
+	kvfree(ctx->cache_committed);
 	bitmap_free(ctx->cache_dirty_bitmap);
 	kvfree(ctx->cache_default);
 	kvfree(ctx->cache);
@@ -104,6 +124,16 @@ static int pmio_cache_flat_exit(struct pablo_mmio *pmio)
 	return 0;
 }
 
+/* a register written to the HW directly has to be written again by fsync */
+static inline void pmio_cache_flat_uncommit(struct pablo_mmio *pmio,
+					    unsigned int idx, unsigned int count)
+{
+	struct pmio_cache_flat_ctx *ctx = pmio->cache;
+
+	if (ctx->cache_committed_bitmap && !pmio->cache_only)
+		bitmap_clear(ctx->cache_committed_bitmap, idx, count);
+}
+
 static int pmio_cache_flat_reset(struct pablo_mmio *pmio)
 {
 	struct pmio_cache_flat_ctx *ctx = pmio->cache;
@@ -122,6 +152,8 @@ static int pmio_cache_flat_reset(struct pablo_mmio *pmio)
 	}
 
 	bitmap_clear(ctx->cache_dirty_bitmap, 0, pmio->max_register);
+	if (ctx->cache_committed_bitmap)
+		bitmap_clear(ctx->cache_committed_bitmap, 0, pmio->max_register);
 
 	return 0;
 }
@@ -145,6 +177,7 @@ static int pmio_cache_flat_write(struct pablo_mmio *pmio,
 
 	ctx->cache[idx] = value;
 	bitmap_set(ctx->cache_dirty_bitmap, idx, 1);
+	pmio_cache_flat_uncommit(pmio, idx, 1);
 
 	return 0;
 }
@@ -157,6 +190,7 @@ static int pmio_cache_flat_raw_write(struct pablo_mmio *pmio, unsigned int reg,
 
 	memcpy((void *)&ctx->cache[idx], val, len);
 	bitmap_set(ctx->cache_dirty_bitmap, idx, len / PMIO_REG_STRIDE);
+	pmio_cache_flat_uncommit(pmio, idx, len / PMIO_REG_STRIDE);
 
 	return 0;
 }
@@ -174,8 +208,74 @@ static int pmio_cache_flat_sync(struct pablo_mmio *pmio, unsigned int min,
 			return ret;
 
 		bitmap_clear(ctx->cache_dirty_bitmap, rs, re - rs);
+		if (ctx->cache_committed_bitmap)
+			bitmap_clear(ctx->cache_committed_bitmap, rs, re - rs);
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the first register in [start, end) which differs from its committed
+ * value, or is the same as that with !diff. Equal registers are skipped a long
+ * at a time.
+ */
+static unsigned int pmio_cache_delta_next(struct pmio_cache_flat_ctx *ctx,
+					  unsigned int start, unsigned int end,
+					  bool diff)
+{
+	const unsigned int step = sizeof(unsigned long) / sizeof(unsigned int);
+	const unsigned int *a = ctx->cache;
+	const unsigned int *b = ctx->cache_committed;
+	unsigned int i = start;
+
+	if (diff) {
+		for (; i < end && (i % step); i++)
+			if (a[i] != b[i])
+				return i;
+
+		for (; i + step <= end; i += step)
+			if (*(const unsigned long *)&a[i] != *(const unsigned long *)&b[i])
+				break;
+	}
+
+	for (; i < end; i++)
+		if ((a[i] != b[i]) == diff)
+			return i;
+
+	return end;
+}
+
+static int pmio_cache_flat_fsync_delta(struct pablo_mmio *pmio, void *buf,
+				       enum pmio_formatter_type fmt,
+				       unsigned int rs, unsigned int re)
+{
+	struct pmio_cache_flat_ctx *ctx = pmio->cache;
+	unsigned long *committed = ctx->cache_committed_bitmap;
+	unsigned int s, e, ce;
+	int ret;
+
+	for (s = rs; s < re; s = e) {
+		if (!test_bit(s, committed)) {
+			/* nothing to compare with */
+			e = find_next_bit(committed, re, s);
+		} else {
+			ce = find_next_zero_bit(committed, re, s);
+			s = pmio_cache_delta_next(ctx, s, ce, true);
+			e = pmio_cache_delta_next(ctx, s, ce, false);
+			if (s == e)
+				continue;
+		}
+
+		ret = pmio_cache_fsync_block(pmio, ctx->cache, 0, buf, fmt, s, e);
+		if (ret)
+			return ret;
 	}
 
+	memcpy(&ctx->cache_committed[rs], &ctx->cache[rs],
+	       array_size(re - rs, sizeof(unsigned int)));
+	bitmap_set(committed, rs, re - rs);
+
 	return 0;
 }
 
@@ -191,8 +291,11 @@ static int pmio_cache_flat_fsync(struct pablo_mmio *pmio, void *buf,
 	int ret;
 
 	bitmap_for_each_set_region(ctx->cache_dirty_bitmap, rs, re, min, max) {
-		ret = pmio_cache_fsync_block(pmio, ctx->cache, 0,
-					     buf, fmt, rs, re);
+		if (ctx->cache_committed)
+			ret = pmio_cache_flat_fsync_delta(pmio, buf, fmt, rs, re);
+		else
+			ret = pmio_cache_fsync_block(pmio, ctx->cache, 0,
+						     buf, fmt, rs, re);
 		if (ret)
 			return ret;
 
@@ -249,6 +352,7 @@ static int pmio_cache_flat_thin_write(struct pablo_mmio *pmio,
 		ctx->cache[idx] = value;
 		bitmap_set(ctx->cache_dirty_bitmap, idx, 1);
 	}
+	pmio_cache_flat_uncommit(pmio, idx, 1);
 
 	return 0;
 }
@@ -294,6 +398,7 @@ static int pmio_cache_flat_eager_write(struct pablo_mmio *pmio,
 	} else if (test_bit(PMIO_CACHE_S_SYNC_TO_DEV, &ctx->cache_state)) {
 		bitmap_set(ctx->cache_dirty_bitmap, idx, 1);
 	}
+	pmio_cache_flat_uncommit(pmio, idx, 1);
 
 	return 0;
 }
@@ -947,12 +1052,18 @@ int pmio_cache_fsync_region(struct pablo_mmio *pmio, void *buf,
 			    enum pmio_formatter_type fmt,
 			    unsigned int min, unsigned int max)
 {
+	struct c_loader_buffer *clb = (struct c_loader_buffer *)buf;
+	unsigned int headers = 0;
 	int ret = 0;
 	bool bypass;
 
 	if (!pmio->cache_ops)
 		return -EINVAL;
 
+	if (clb)
+		headers = clb->num_of_headers + !!clb->num_of_pairs;
+	pmio->fsync_regs = 0;
+
 	bypass = pmio->cache_bypass;
 	if (min == 0 && max == pmio->max_register)
 		pr_debug("(%s) syncing %s cache to formatter: %d\n",
@@ -978,6 +1089,10 @@ no_need_sync:
 	pmio->cache_bypass = bypass;
 	pmio->no_sync_defaults = false;
 
+	if (clb)
+		headers = clb->num_of_headers + !!clb->num_of_pairs - headers;
+	trace_pmio_cache_fsync_stat(pmio, fmt, pmio->fsync_regs,
+			headers * (sizeof(struct c_loader_header) + SIZE_OF_CLD_PAYLOAD));
 	trace_pmio_cache_fsync_region(pmio, pmio->cache_ops->name, fmt, min, max, "stop");
 
 	return ret;
@@ -1262,6 +1377,7 @@ static int inc_addr_formatter_flush(struct pablo_mmio *pmio, const void **data,
 		return 0;
 
 	count = (cur - base) / PMIO_REG_STRIDE;
+	pmio->fsync_regs += count;
 
 	pr_debug("(%s) writing %zu bytes for %zu registers from 0x%x-0x%x\n",
 				pmio->name,
@@ -1312,6 +1428,7 @@ static int pair_formatter_flush(struct pablo_mmio *pmio, const void **data,
 		return 0;
 
 	count = (cur - base) / PMIO_REG_STRIDE;
+	pmio->fsync_regs += count;
 
 	pr_debug("(%s) writing %zu bytes for %zu registers from 0x%x-0x%x\n",
 				pmio->name,
@@ -1349,6 +1466,42 @@ static int pair_formatter_flush(struct pablo_mmio *pmio, const void **data,
 	return 0;
 }
 
+/*
+ * A header with a full payload costs as much as NUM_OF_CLD_PAIRS pairs, so
+ * shorter runs go to pairs sharing a header and longer ones to inc headers.
+ */
+static int auto_formatter_flush(struct pablo_mmio *pmio, const void **data,
+				void *buf, unsigned int base, unsigned int cur)
+{
+	struct c_loader_buffer *clb = (struct c_loader_buffer *)buf;
+	struct c_loader_header *clh;
+	struct c_loader_payload *clp;
+	const void *val = *data;
+	size_t count, rem;
+	unsigned int split;
+
+	if (*data == NULL)
+		return 0;
+
+	count = (cur - base) / PMIO_REG_STRIDE;
+	if (count < NUM_OF_CLD_PAIRS)
+		return pair_formatter_flush(pmio, data, buf, base, cur);
+
+	/* close the pair header being filled */
+	test_and_inc_c_loader_header(clb, &clh, &clp, (clb->num_of_pairs > 0));
+
+	rem = count % NUM_OF_CLD_VALUES;
+	split = (rem < NUM_OF_CLD_PAIRS) ? cur - rem * PMIO_REG_STRIDE : cur;
+
+	inc_addr_formatter_flush(pmio, data, buf, base, split);
+	if (split == cur)
+		return 0;
+
+	*data = val + (split - base);
+
+	return pair_formatter_flush(pmio, data, buf, split, cur);
+}
+
 static int pmio_cache_fsync_block_raw(struct pablo_mmio *pmio, void *block,
 				      unsigned int block_base,
 				      void *buf, enum pmio_formatter_type fmt,
@@ -1364,6 +1517,8 @@ static int pmio_cache_fsync_block_raw(struct pablo_mmio *pmio, void *block,
 
 	if (fmt == PMIO_FORMATTER_INC)
 		formatter_flush = inc_addr_formatter_flush;
+	else if (fmt == PMIO_FORMATTER_AUTO)
+		formatter_flush = auto_formatter_flush;
 	else
 		formatter_flush = pair_formatter_flush;
 
@@ -1417,6 +1572,7 @@ static int rpt_addr_formatter_flush(struct pablo_mmio *pmio, const void **data,
 
 	pr_debug("(%s) writing %zu bytes for noinc register: 0x%x\n",
 			pmio->name, count * PMIO_REG_STRIDE, base);
+	pmio->fsync_regs += count;
 
 	test_and_inc_c_loader_header(clb, &clh, &clp, (clb->num_of_pairs > 0));
 
@@ -1460,6 +1616,7 @@ static int rpt_addr_formatter_flush_ext_hdr(struct pablo_mmio *pmio,
 
 	pr_debug("(%s) writing %zu bytes for noinc register: 0x%x\n",
 			pmio->name, count * PMIO_REG_STRIDE, base);
+	pmio->fsync_regs += count;
 
 	test_and_inc_c_loader_header(clb, &clh, &clp, (clb->num_of_pairs > 0));
 
@@ -76,6 +76,10 @@ struct pablo_mmio {
 	phys_addr_t phys_base;
 	bool ignore_phys_base;
 	bool use_ext_hdr;
+	bool use_delta;
+
+	/* registers written by the current format-sync */
+	unsigned int fsync_regs;
 
 	struct pmio_field **fields;
 };
@@ -137,6 +137,26 @@ TRACE_EVENT(pmio_cache_fsync_region,
 		(unsigned int)__entry->to, __get_str(status))
 );
 
+TRACE_EVENT(pmio_cache_fsync_stat,
+	TP_PROTO(struct pablo_mmio *pmio, enum pmio_formatter_type fmt,
+		 unsigned int regs, unsigned int bytes),
+	TP_ARGS(pmio, fmt, regs, bytes),
+	TP_STRUCT__entry(
+		__string(	name,		pmio_name(pmio)	)
+		__string(fmt,		pmio_formatter_name(fmt))
+		__field(	unsigned int,	regs		)
+		__field(	unsigned int,	bytes		)
+	),
+	TP_fast_assign(
+		__assign_str(name, pmio_name(pmio));
+		__assign_str(fmt, pmio_formatter_name(fmt));
+		__entry->regs = regs;
+		__entry->bytes = bytes;
+	),
+	TP_printk("%s %s %u regs %u bytes", __get_str(name), __get_str(fmt),
+		(unsigned int)__entry->regs, (unsigned int)__entry->bytes)
+);
+
 TRACE_EVENT(pmio_cache_drop_region,
 	TP_PROTO(struct pablo_mmio *pmio, const char *type,
 		 unsigned int from, unsigned int to),
@@ -19,6 +19,7 @@
 
 #define PKT_FRAMEMGR_NAME	"PKT_FRMGR"
 #define PKT_FRAMEMGR_FRM_NUM	3
+#define PKT_FRAMEMGR_BENCH_LOOP	1000
 
 static struct pablo_kunit_test_ctx {
 	struct is_framemgr *framemgr;
@@ -293,6 +294,146 @@ static void pablo_framemgr_find_frame_kunit_test(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, frame->fcount, fcount);
 }
 
+/* not frame_fcount, to take the linear scan of find_frame() */
+static ulong pkt_frame_fcount(struct is_frame *frame, void *data)
+{
+	return (ulong)frame->fcount - (ulong)data;
+}
+
+static void pablo_framemgr_find_frame_fcount_kunit_test(struct kunit *test)
+{
+	struct is_framemgr *framemgr;
+	struct is_frame *frame;
+	u32 i, num = 8;
+	int ret;
+
+	/* a few more frames than queued for TC #5 and #6 */
+
+	framemgr = vzalloc(sizeof(struct is_framemgr));
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, framemgr);
+	frame_manager_probe(framemgr, PKT_FRAMEMGR_NAME);
+	ret = frame_manager_open(framemgr, num + 2, false);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, framemgr->fcount_index);
+
+	for (i = 0; i < num; i++) {
+		frame = get_frame(framemgr, FS_FREE);
+		frame->fcount = 100 + i;
+		put_frame(framemgr, frame, FS_REQUEST);
+	}
+
+	/* TC #1. Find every queued frame from the index */
+	for (i = 0; i < num; i++) {
+		frame = find_frame_fcount(framemgr, FS_REQUEST, 100 + i);
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, frame);
+		KUNIT_EXPECT_EQ(test, frame->fcount, 100 + i);
+	}
+	KUNIT_EXPECT_EQ(test, framemgr->fcount_hit, (u64)num);
+	KUNIT_EXPECT_EQ(test, framemgr->fcount_miss, (u64)0);
+
+	/* TC #2. Not in the queue */
+	frame = find_frame_fcount(framemgr, FS_REQUEST, 99);
+	KUNIT_EXPECT_TRUE(test, (frame == NULL));
+	frame = find_frame_fcount(framemgr, FS_PROCESS, 100);
+	KUNIT_EXPECT_TRUE(test, (frame == NULL));
+
+	/* TC #3. Follow the frame to the next state */
+	frame = find_frame(framemgr, FS_REQUEST, frame_fcount, (void *)(ulong)103);
+	ret = trans_frame(framemgr, frame, FS_PROCESS);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	KUNIT_EXPECT_TRUE(test, (find_frame_fcount(framemgr, FS_REQUEST, 103) == NULL));
+	KUNIT_EXPECT_PTR_EQ(test, find_frame_fcount(framemgr, FS_PROCESS, 103), frame);
+
+	/* TC #4. fcount is changed after the frame was queued */
+	frame = find_frame_fcount(framemgr, FS_REQUEST, 104);
+	frame->fcount = 200;
+	KUNIT_EXPECT_PTR_EQ(test, find_frame_fcount(framemgr, FS_REQUEST, 200), frame);
+	KUNIT_EXPECT_TRUE(test, (find_frame_fcount(framemgr, FS_REQUEST, 104) == NULL));
+
+	/* TC #5. Same fcount in a queue, the first one is found like the list */
+	frame = get_frame(framemgr, FS_FREE);
+	frame->fcount = 105;
+	put_frame(framemgr, frame, FS_REQUEST);
+	frame = find_frame_fcount(framemgr, FS_REQUEST, 105);
+	KUNIT_EXPECT_PTR_EQ(test, frame,
+		find_frame(framemgr, FS_REQUEST, pkt_frame_fcount, (void *)(ulong)105));
+	KUNIT_EXPECT_PTR_NE(test, frame, peek_frame_tail(framemgr, FS_REQUEST));
+
+	/* TC #6. Colliding fcounts */
+	frame = get_frame(framemgr, FS_FREE);
+	frame->fcount = 100 + framemgr->fcount_mask + 1;
+	put_frame(framemgr, frame, FS_REQUEST);
+	KUNIT_EXPECT_PTR_EQ(test, find_frame_fcount(framemgr, FS_REQUEST, frame->fcount), frame);
+	KUNIT_EXPECT_EQ(test, find_frame_fcount(framemgr, FS_REQUEST, 100)->fcount, (u32)100);
+
+	frame_manager_print_stats(framemgr);
+
+	ret = frame_manager_flush(framemgr);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	frame_manager_close(framemgr);
+	KUNIT_EXPECT_TRUE(test, (framemgr->fcount_index == NULL));
+	vfree(framemgr);
+}
+
+static void pkt_framemgr_bench(struct kunit *test, u32 fps, u32 depth)
+{
+	struct is_framemgr *framemgr;
+	struct is_frame *frame, *found;
+	u64 t_list = 0, t_index = 0, t;
+	u32 i, loop, fcount;
+	int ret;
+
+	framemgr = vzalloc(sizeof(struct is_framemgr));
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, framemgr);
+	frame_manager_probe(framemgr, PKT_FRAMEMGR_NAME);
+	ret = frame_manager_open(framemgr, depth, false);
+	KUNIT_ASSERT_EQ(test, ret, 0);
+
+	for (i = 0; i < depth; i++) {
+		frame = get_frame(framemgr, FS_FREE);
+		frame->fcount = i + 1;
+		put_frame(framemgr, frame, FS_PROCESS);
+	}
+
+	for (loop = 0; loop < PKT_FRAMEMGR_BENCH_LOOP; loop++) {
+		/* multi-group pipelines look up frames all over the queue */
+		fcount = ((loop * 7) % depth) + 1;
+
+		t = local_clock();
+		frame = find_frame(framemgr, FS_PROCESS, pkt_frame_fcount,
+				   (void *)(ulong)fcount);
+		t_list += local_clock() - t;
+
+		t = local_clock();
+		found = find_frame(framemgr, FS_PROCESS, frame_fcount,
+				   (void *)(ulong)fcount);
+		t_index += local_clock() - t;
+
+		KUNIT_ASSERT_PTR_EQ(test, found, frame);
+
+		/* recycle the frame to the tail like a completed shot */
+		trans_frame(framemgr, frame, FS_COMPLETE);
+		trans_frame(framemgr, frame, FS_PROCESS);
+	}
+
+	kunit_info(test, "%3ufps depth %2u: list %llu ns, index %llu ns per lookup (%llu hit, %llu miss)\n",
+		   fps, depth, t_list / PKT_FRAMEMGR_BENCH_LOOP,
+		   t_index / PKT_FRAMEMGR_BENCH_LOOP,
+		   framemgr->fcount_hit, framemgr->fcount_miss);
+	KUNIT_EXPECT_EQ(test, framemgr->fcount_miss, (u64)0);
+
+	frame_manager_close(framemgr);
+	vfree(framemgr);
+}
+
+static void pablo_framemgr_find_frame_bench_kunit_test(struct kunit *test)
+{
+	/* queue depth grows with the number of in-flight frames */
+	pkt_framemgr_bench(test, 60, 8);
+	pkt_framemgr_bench(test, 120, 16);
+	pkt_framemgr_bench(test, 240, 32);
+}
+
 static void pablo_framemgr_print_queues_kunit_test(struct kunit *test)
 {
 	struct is_framemgr *framemgr = pkt_ctx.framemgr;
@@ -402,6 +543,8 @@ static struct kunit_case pablo_framemgr_kunit_test_cases[] = {
 	KUNIT_CASE(pablo_framemgr_peek_frame_kunit_test),
 	KUNIT_CASE(pablo_framemgr_peek_frame_tail_kunit_test),
 	KUNIT_CASE(pablo_framemgr_find_frame_kunit_test),
+	KUNIT_CASE(pablo_framemgr_find_frame_fcount_kunit_test),
+	KUNIT_CASE(pablo_framemgr_find_frame_bench_kunit_test),
 	KUNIT_CASE(pablo_framemgr_print_queues_kunit_test),
 	KUNIT_CASE(pablo_framemgr_dump_queues_kunit_test),
 	KUNIT_CASE(pablo_framemgr_print_info_queues_kunit_test),
@@ -1232,6 +1232,158 @@ static void pablo_lib_pmio_cache_fsync_noinc_kunit_test(struct kunit *test)
 	kunit_pmio_post(test);
 }
 
+#define KUNIT_DELTA_FRAMES	8
+#define KUNIT_DELTA_REGS	((KUNIT_R_LAST - KUNIT_R_WR_BULK) / PMIO_REG_STRIDE + 1)
+
+/* play a c-loader buffer back on a register image as the HW would do */
+static void kunit_c_loader_apply(struct kunit *test, struct c_loader_buffer *clb, u32 *image)
+{
+	u32 num_of_headers = clb->num_of_headers + !!clb->num_of_pairs;
+	struct c_loader_header *clh;
+	struct c_loader_payload *clp;
+	u32 h, i, count, addr, format;
+
+	for (h = 0; h < num_of_headers; h++) {
+		clh = &clb->clh[h];
+		clp = &clb->clp[h];
+		count = hweight32(clh->type_map);
+		format = clh->mode.format;
+
+		if (format == C_LOADER_FMT_INC_ADDR) {
+			addr = clh->cr_addr - kunit_pmio_config.phys_base;
+			for (i = 0; i < count; i++)
+				image[(addr >> 2) + i] = clp->values[i];
+		} else {
+			KUNIT_ASSERT_EQ(test, format, (u32)C_LOADER_FMT_PAIR);
+			for (i = 0; i < count / 2; i++) {
+				addr = clp->pairs[i].addr - kunit_pmio_config.phys_base;
+				image[addr >> 2] = clp->pairs[i].val;
+			}
+		}
+	}
+}
+
+static struct c_loader_buffer *kunit_c_loader_alloc(struct kunit *test)
+{
+	struct c_loader_buffer *clb;
+
+	clb = kunit_kzalloc(test, sizeof(*clb), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, clb);
+	clb->clh = kunit_kzalloc(test, SZ_4K, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, clb->clh);
+	clb->clp = kunit_kzalloc(test, SZ_16K, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, clb->clp);
+
+	return clb;
+}
+
+static void kunit_c_loader_free(struct kunit *test, struct c_loader_buffer *clb)
+{
+	kunit_kfree(test, clb->clh);
+	kunit_kfree(test, clb->clp);
+	kunit_kfree(test, clb);
+}
+
+static void pablo_lib_pmio_cache_fsync_delta_kunit_test(struct kunit *test)
+{
+	struct pablo_mmio *full, *delta;
+	struct c_loader_buffer *clb;
+	u32 *setfile, *image_full, *image_delta;
+	u32 f, i, k, headers_full, headers_delta;
+	int ret;
+
+	setfile = kunit_kzalloc(test, KUNIT_DELTA_REGS * PMIO_REG_STRIDE, GFP_KERNEL);
+	image_full = kunit_kzalloc(test, KUNIT_R_LAST + PMIO_REG_STRIDE, GFP_KERNEL);
+	image_delta = kunit_kzalloc(test, KUNIT_R_LAST + PMIO_REG_STRIDE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, setfile);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, image_full);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, image_delta);
+
+	kunit_memory = kunit_kzalloc(test, MMIO_LIMIT, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, kunit_memory);
+
+	kunit_pmio_config_preset(PMIO_CACHE_FLAT);
+	full = pmio_init(NULL, kunit_memory, &kunit_pmio_config);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, full);
+	kunit_pmio_config.use_delta = true;
+	delta = pmio_init(NULL, kunit_memory, &kunit_pmio_config);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, delta);
+
+	pmio_cache_set_only(full, true);
+	pmio_cache_set_only(delta, true);
+
+	for (i = 0; i < KUNIT_DELTA_REGS; i++)
+		setfile[i] = TEST_VAL + i;
+
+	for (f = 0; f < KUNIT_DELTA_FRAMES; f++) {
+		/* a few scattered registers and a run of them change per frame */
+		if (f) {
+			for (k = 0; k < 4; k++)
+				setfile[(f * 37 + k * 101) % KUNIT_DELTA_REGS] ^= f << 16;
+			for (k = 0; k < 20 + f; k++)
+				setfile[(f * 50 + k) % KUNIT_DELTA_REGS] += f;
+		}
+
+		/* the whole block is programmed every frame */
+		ret = pmio_raw_write(full, KUNIT_R_WR_BULK, setfile,
+				     KUNIT_DELTA_REGS * PMIO_REG_STRIDE);
+		KUNIT_EXPECT_EQ(test, ret, 0);
+		ret = pmio_raw_write(delta, KUNIT_R_WR_BULK, setfile,
+				     KUNIT_DELTA_REGS * PMIO_REG_STRIDE);
+		KUNIT_EXPECT_EQ(test, ret, 0);
+
+		clb = kunit_c_loader_alloc(test);
+		ret = pmio_cache_fsync(full, clb, PMIO_FORMATTER_PAIR);
+		KUNIT_EXPECT_EQ(test, ret, 0);
+		KUNIT_EXPECT_EQ(test, full->fsync_regs, (u32)KUNIT_DELTA_REGS);
+		kunit_c_loader_apply(test, clb, image_full);
+		headers_full = clb->num_of_headers + !!clb->num_of_pairs;
+		kunit_c_loader_free(test, clb);
+
+		clb = kunit_c_loader_alloc(test);
+		ret = pmio_cache_fsync(delta, clb, PMIO_FORMATTER_AUTO);
+		KUNIT_EXPECT_EQ(test, ret, 0);
+		kunit_c_loader_apply(test, clb, image_delta);
+		headers_delta = clb->num_of_headers + !!clb->num_of_pairs;
+		kunit_c_loader_free(test, clb);
+
+		/* SUB TC: the HW ends up in the same state as with a full sync */
+		KUNIT_EXPECT_EQ(test, memcmp(image_full, image_delta,
+					     KUNIT_R_LAST + PMIO_REG_STRIDE), 0);
+
+		/* SUB TC: only the changed registers are written after the 1st frame */
+		if (f) {
+			KUNIT_EXPECT_LE(test, delta->fsync_regs, 4 + 20 + f);
+			KUNIT_EXPECT_LT(test, headers_delta, headers_full);
+		} else {
+			KUNIT_EXPECT_EQ(test, delta->fsync_regs, (u32)KUNIT_DELTA_REGS);
+			/* inc headers are denser for a whole block */
+			KUNIT_EXPECT_LT(test, headers_delta, headers_full);
+		}
+	}
+
+	/* SUB TC: a register written to the HW directly is written again */
+	pmio_cache_set_only(delta, false);
+	ret = pmio_write(delta, KUNIT_R_WR_BULK, setfile[0] + 1);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	pmio_cache_set_only(delta, true);
+	ret = pmio_write(delta, KUNIT_R_WR_BULK, setfile[0]);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+
+	clb = kunit_c_loader_alloc(test);
+	ret = pmio_cache_fsync(delta, clb, PMIO_FORMATTER_AUTO);
+	KUNIT_EXPECT_EQ(test, ret, 0);
+	KUNIT_EXPECT_EQ(test, delta->fsync_regs, (u32)1);
+	kunit_c_loader_free(test, clb);
+
+	pmio_exit(delta);
+	pmio_exit(full);
+	kunit_kfree(test, kunit_memory);
+	kunit_kfree(test, image_delta);
+	kunit_kfree(test, image_full);
+	kunit_kfree(test, setfile);
+}
+
 static void pablo_lib_pmio_cache_set_bypass_kunit_test(struct kunit *test)
 {
 	bool bypass_enable;
@@ -1346,6 +1498,7 @@ static struct kunit_case pablo_lib_pmio_kunit_test_cases[] = {
 	KUNIT_CASE(pablo_lib_pmio_cache_fsync_kunit_test),
 	KUNIT_CASE(pablo_lib_pmio_cache_fsync_ext_kunit_test),
 	KUNIT_CASE(pablo_lib_pmio_cache_fsync_noinc_kunit_test),
+	KUNIT_CASE(pablo_lib_pmio_cache_fsync_delta_kunit_test),
 	KUNIT_CASE(pablo_lib_pmio_cache_set_bypass_kunit_test),
 	KUNIT_CASE(pablo_lib_pmio_cache_mark_dirty_kunit_test),
 	KUNIT_CASE(pablo_lib_pmio_cache_lookup_reg_kunit_test),
@@ -1186,6 +1186,7 @@ error_sync:
 static void __exit amdgpu_exit(void)
 {
 	platform_driver_unregister(&sgpu_kms_driver);
+	sgpu_swap_fini();
 	amdgpu_sync_fini();
 	amdgpu_fence_slab_fini();
 	mmu_notifier_synchronize();
@@ -701,6 +701,9 @@ struct amdgpu_ttm_tt {
 	size_t                  kernel_size;
 	void			*kernel_vaddr;
 	dma_addr_t		kernel_dma_addr;
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+	struct sgpu_zswap_tt	*zswap;
+#endif
 };
 
 unsigned long amdgpu_ttm_tt_get_start_addr(struct ttm_tt *ttm)
@@ -710,6 +713,15 @@ unsigned long amdgpu_ttm_tt_get_start_addr(struct ttm_tt *ttm)
 	return gtt->userptr;
 }
 
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+struct sgpu_zswap_tt **amdgpu_ttm_tt_zswap(struct ttm_tt *ttm)
+{
+	struct amdgpu_ttm_tt *gtt = container_of(ttm, typeof(*gtt), ttm);
+
+	return &gtt->zswap;
+}
+#endif
+
 /**
  * amdgpu_ttm_tt_set_user_pages - Copy pages in, putting old pages as necessary.
  *
@@ -1573,6 +1585,12 @@ int amdgpu_ttm_init(struct amdgpu_device *adev)
 
 	device_initialize(&sync_dev);
 
+	r = sgpu_page_pool_init();
+	if (r) {
+		DRM_ERROR("Failed initializing page pool.\n");
+		return r;
+	}
+
 	return 0;
 }
 
@@ -1611,6 +1629,7 @@ void amdgpu_ttm_fini(struct amdgpu_device *adev)
 	ttm_range_man_fini(&adev->mman.bdev, AMDGPU_PL_GWS);
 	ttm_range_man_fini(&adev->mman.bdev, AMDGPU_PL_OA);
 	ttm_device_fini(&adev->mman.bdev);
+	sgpu_page_pool_fini();
 	adev->mman.initialized = false;
 	DRM_INFO("amdgpu: ttm finalized\n");
 }
@@ -137,6 +137,10 @@ int amdgpu_ttm_recover_gart(struct ttm_buffer_object *tbo);
 uint64_t amdgpu_ttm_domain_start(struct amdgpu_device *adev, uint32_t type);
 
 unsigned long amdgpu_ttm_tt_get_start_addr(struct ttm_tt *ttm);
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+struct sgpu_zswap_tt;
+struct sgpu_zswap_tt **amdgpu_ttm_tt_zswap(struct ttm_tt *ttm);
+#endif
 
 void amdgpu_ttm_tt_set_user_pages(struct ttm_tt *ttm, struct page **pages);
 int amdgpu_ttm_tt_set_userptr(struct ttm_buffer_object *bo,
@@ -164,6 +168,13 @@ int amdgpu_ttm_debugfs_init(struct amdgpu_device *adev);
 
 int sgpu_ttm_page_alloc(struct ttm_tt *tt);
 void sgpu_ttm_free_pages(struct ttm_tt *tt);
+#ifdef CONFIG_DRM_SGPU_PAGE_POOL
+int sgpu_page_pool_init(void);
+void sgpu_page_pool_fini(void);
+#else
+#define sgpu_page_pool_init() 0
+#define sgpu_page_pool_fini() do { } while (0)
+#endif
 #ifdef CONFIG_DEBUG_FS
 void sgpu_debugfs_pagealloc_init(struct amdgpu_device *adev);
 #else
@@ -12,6 +12,11 @@
 #include <linux/list.h>
 #include <linux/shmem_fs.h>
 #include <linux/workqueue.h>
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+#include <linux/highmem.h>
+#include <linux/lz4.h>
+#include <linux/zsmalloc.h>
+#endif
 
 #include <drm/drm_print.h>
 #include <drm/ttm/ttm_tt.h>
@@ -30,10 +35,311 @@ unsigned long sgpu_get_nr_swap_pages(void)
 
 #define SGPU_TTM_TT_FLAG_SWAPPED BIT(30)
 
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+/*
+ * Swapped pages are compressed straight into a zsmalloc pool instead of being
+ * copied to a shmem file which is reclaimed to the swap device afterwards.
+ * A slot of len 0 is a same-filled page whose pattern is kept in handle, a
+ * slot of len PAGE_SIZE is stored uncompressed.
+ */
+struct sgpu_zswap_slot {
+	unsigned long handle;
+	unsigned int len;
+};
+
+struct sgpu_zswap_tt {
+	unsigned long nr_pages;
+	unsigned long comp_size;
+	unsigned long nr_same;
+	struct sgpu_zswap_slot slots[];
+};
+
+/* pages decompressed by a worker at least, and the number of workers at most */
+#define SGPU_ZSWAP_BATCH	512
+#define SGPU_ZSWAP_MAX_WORKERS	8
+
+static struct zs_pool *sgpu_zswap_pool;
+
+static bool sgpu_zswap_same_filled(void *ptr, unsigned long *value)
+{
+	unsigned long *page = ptr;
+	unsigned long val = page[0];
+	unsigned int pos, last = PAGE_SIZE / sizeof(*page) - 1;
+
+	if (val != page[last])
+		return false;
+
+	for (pos = 1; pos < last; pos++)
+		if (page[pos] != val)
+			return false;
+
+	*value = val;
+
+	return true;
+}
+
+static void sgpu_zswap_free(struct sgpu_zswap_tt *zt)
+{
+	unsigned long i;
+
+	for (i = 0; i < zt->nr_pages; i++)
+		if (zt->slots[i].len)
+			zs_free(sgpu_zswap_pool, zt->slots[i].handle);
+
+	kvfree(zt);
+}
+
+static int sgpu_zswap_store(struct sgpu_zswap_tt *zt, struct ttm_tt *ttm,
+			    void *buf, void *wrkmem)
+{
+	/* no direct reclaim, the shmem backend is used instead */
+	gfp_t gfp = __GFP_KSWAPD_RECLAIM | __GFP_NOWARN | __GFP_HIGHMEM | __GFP_MOVABLE;
+	unsigned long i;
+
+	for (i = 0; i < zt->nr_pages; i++) {
+		struct sgpu_zswap_slot *slot = &zt->slots[i];
+		struct page *page = ttm->pages[i];
+		void *src, *dst, *from;
+		int len;
+
+		/* a hole reads back as zeroes from shmem as well */
+		if (unlikely(page == NULL)) {
+			zt->nr_same++;
+			continue;
+		}
+
+		src = kmap_local_page(page);
+		if (sgpu_zswap_same_filled(src, &slot->handle)) {
+			kunmap_local(src);
+			zt->nr_same++;
+			continue;
+		}
+
+		len = LZ4_compress_default(src, buf, PAGE_SIZE, PAGE_SIZE, wrkmem);
+		if (len <= 0 || len >= PAGE_SIZE) {
+			len = PAGE_SIZE;
+			from = src;
+		} else {
+			from = buf;
+		}
+
+		slot->handle = zs_malloc(sgpu_zswap_pool, len, gfp);
+		if (IS_ERR_VALUE(slot->handle)) {
+			slot->handle = 0;
+			kunmap_local(src);
+			return -ENOMEM;
+		}
+
+		dst = zs_map_object(sgpu_zswap_pool, slot->handle, ZS_MM_WO);
+		memcpy(dst, from, len);
+		zs_unmap_object(sgpu_zswap_pool, slot->handle);
+		kunmap_local(src);
+
+		slot->len = len;
+		zt->comp_size += len;
+	}
+
+	return 0;
+}
+
+static int sgpu_zswap_load(struct sgpu_zswap_tt *zt, struct ttm_tt *ttm,
+			   unsigned long start, unsigned long end)
+{
+	unsigned long i;
+	int ret = 0;
+
+	for (i = start; i < end && !ret; i++) {
+		struct sgpu_zswap_slot *slot = &zt->slots[i];
+		struct page *page = ttm->pages[i];
+		void *src, *dst;
+
+		if (unlikely(page == NULL))
+			return -ENOMEM;
+
+		dst = kmap_local_page(page);
+		if (!slot->len) {
+			memset_l(dst, slot->handle, PAGE_SIZE / sizeof(unsigned long));
+		} else {
+			src = zs_map_object(sgpu_zswap_pool, slot->handle, ZS_MM_RO);
+			if (slot->len == PAGE_SIZE)
+				memcpy(dst, src, PAGE_SIZE);
+			else if (LZ4_decompress_safe(src, dst, slot->len,
+						     PAGE_SIZE) != PAGE_SIZE)
+				ret = -EIO;
+			zs_unmap_object(sgpu_zswap_pool, slot->handle);
+		}
+		kunmap_local(dst);
+	}
+
+	return ret;
+}
+
+struct sgpu_zswap_work {
+	struct work_struct work;
+	struct sgpu_zswap_tt *zt;
+	struct ttm_tt *ttm;
+	unsigned long start;
+	unsigned long end;
+	int ret;
+};
+
+static void sgpu_zswap_load_work(struct work_struct *work)
+{
+	struct sgpu_zswap_work *w = container_of(work, typeof(*w), work);
+
+	w->ret = sgpu_zswap_load(w->zt, w->ttm, w->start, w->end);
+}
+
+/* large buffers are split into batches decompressed on the unbound workqueue */
+static int sgpu_zswap_load_all(struct sgpu_zswap_tt *zt, struct ttm_tt *ttm)
+{
+	unsigned long nr_work = DIV_ROUND_UP(zt->nr_pages, SGPU_ZSWAP_BATCH);
+	struct sgpu_zswap_work *works;
+	unsigned long per, i;
+	int ret;
+
+	nr_work = min_t(unsigned long, nr_work, num_online_cpus());
+	nr_work = min_t(unsigned long, nr_work, SGPU_ZSWAP_MAX_WORKERS);
+	if (nr_work <= 1)
+		return sgpu_zswap_load(zt, ttm, 0, zt->nr_pages);
+
+	works = kcalloc(nr_work, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return sgpu_zswap_load(zt, ttm, 0, zt->nr_pages);
+
+	per = DIV_ROUND_UP(zt->nr_pages, nr_work);
+	for (i = 1; i < nr_work; i++) {
+		works[i].zt = zt;
+		works[i].ttm = ttm;
+		works[i].start = i * per;
+		works[i].end = min(works[i].start + per, zt->nr_pages);
+		INIT_WORK(&works[i].work, sgpu_zswap_load_work);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+
+	ret = sgpu_zswap_load(zt, ttm, 0, per);
+
+	for (i = 1; i < nr_work; i++) {
+		flush_work(&works[i].work);
+		if (!ret)
+			ret = works[i].ret;
+	}
+	kfree(works);
+
+	return ret;
+}
+
+static int sgpu_tt_zswapin(struct ttm_tt *ttm, struct sgpu_zswap_tt **ztp)
+{
+	struct sgpu_zswap_tt *zt = *ztp;
+	int ret;
+
+	ret = sgpu_zswap_load_all(zt, ttm);
+	if (ret)
+		return ret;
+
+	*ztp = NULL;
+	sgpu_zswap_free(zt);
+	ttm->page_flags &= ~SGPU_TTM_TT_FLAG_SWAPPED;
+
+	atomic_long_sub(ttm->num_pages, &sgpu_swap_pages);
+
+	return 0;
+}
+
+static void sgpu_tt_unpopulate(struct ttm_device *bdev, struct ttm_tt *ttm);
+
+static int sgpu_tt_zswapout(struct ttm_device *bdev, struct ttm_tt *ttm)
+{
+	struct sgpu_zswap_tt *zt;
+	void *buf, *wrkmem;
+	int ret = -ENOMEM;
+
+	if (!sgpu_zswap_pool)
+		return -ENOMEM;
+
+	zt = kvzalloc(struct_size(zt, slots, ttm->num_pages), GFP_KERNEL);
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	wrkmem = kmalloc(LZ4_MEM_COMPRESS, GFP_KERNEL);
+	if (!zt || !buf || !wrkmem)
+		goto out;
+
+	zt->nr_pages = ttm->num_pages;
+	ret = sgpu_zswap_store(zt, ttm, buf, wrkmem);
+	if (ret)
+		goto out;
+
+	sgpu_tt_unpopulate(bdev, ttm);
+
+	*amdgpu_ttm_tt_zswap(ttm) = zt;
+	ttm->page_flags |= SGPU_TTM_TT_FLAG_SWAPPED;
+
+	atomic_long_add(ttm->num_pages, &sgpu_swap_pages);
+
+	zt = NULL;
+	ret = ttm->num_pages;
+out:
+	if (zt)
+		sgpu_zswap_free(zt);
+	kfree(wrkmem);
+	kfree(buf);
+
+	return ret;
+}
+
+static void sgpu_zswap_stat(struct ttm_tt *ttm, size_t *comp_size, size_t *nr_same)
+{
+	struct sgpu_zswap_tt *zt = *amdgpu_ttm_tt_zswap(ttm);
+
+	if (zt) {
+		*comp_size += zt->comp_size;
+		*nr_same += zt->nr_same;
+	} else {
+		/* in shmem, counted as not compressed */
+		*comp_size += (size_t)ttm->num_pages << PAGE_SHIFT;
+	}
+}
+
+/* the pool is shared by all devices and lives as long as the module */
+static void sgpu_zswap_init(void)
+{
+	if (sgpu_zswap_pool)
+		return;
+
+	sgpu_zswap_pool = zs_create_pool("sgpu_zswap");
+	if (!sgpu_zswap_pool)
+		DRM_WARN("Failed to create zswap pool, using shmem for swap\n");
+}
+
+static void sgpu_zswap_fini(void)
+{
+	if (!sgpu_zswap_pool)
+		return;
+
+	zs_destroy_pool(sgpu_zswap_pool);
+	sgpu_zswap_pool = NULL;
+}
+#else
+#define sgpu_tt_zswapout(bdev, ttm) (-ENOMEM)
+#define sgpu_zswap_stat(ttm, comp_size, nr_same) \
+	(*(comp_size) += (size_t)(ttm)->num_pages << PAGE_SHIFT)
+#define sgpu_zswap_init() do { } while (0)
+#define sgpu_zswap_fini() do { } while (0)
+#endif
+
 void sgpu_tt_destroy_notify(struct ttm_tt *ttm)
 {
-	if (unlikely(!!(ttm->page_flags & SGPU_TTM_TT_FLAG_SWAPPED)))
+	if (unlikely(!!(ttm->page_flags & SGPU_TTM_TT_FLAG_SWAPPED))) {
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+		struct sgpu_zswap_tt **ztp = amdgpu_ttm_tt_zswap(ttm);
+
+		if (*ztp) {
+			sgpu_zswap_free(*ztp);
+			*ztp = NULL;
+		}
+#endif
 		atomic_long_sub(ttm->num_pages, &sgpu_swap_pages);
+	}
 }
 
 int sgpu_tt_swapin(struct ttm_tt *ttm)
@@ -48,6 +354,11 @@ int sgpu_tt_swapin(struct ttm_tt *ttm)
 	if (likely(!(ttm->page_flags & SGPU_TTM_TT_FLAG_SWAPPED)))
 		return 0;
 
+#ifdef CONFIG_DRM_SGPU_GRAPHIC_MEMORY_ZSWAP
+	if (*amdgpu_ttm_tt_zswap(ttm))
+		return sgpu_tt_zswapin(ttm, amdgpu_ttm_tt_zswap(ttm));
+#endif
+
 	swap_storage = ttm->swap_storage;
 	BUG_ON(swap_storage == NULL);
 
@@ -124,6 +435,10 @@ static int sgpu_tt_swapout(struct ttm_device *bdev, struct ttm_tt *ttm, gfp_t gf
 	if (!ttm_tt_is_populated(ttm))
 		return 0;
 
+	ret = sgpu_tt_zswapout(bdev, ttm);
+	if (ret != -ENOMEM)
+		return ret;
+
 	swap_storage = shmem_file_setup("sgpu swap", size, 0);
 	if (IS_ERR(swap_storage)) {
 		DRM_ERROR("Failed allocating swap storage\n");
@@ -289,6 +604,8 @@ struct sgpu_proc_node {
 	unsigned long req_amount;
 	struct work_struct swapout_work_item;
 	struct work_struct swapin_work_item;
+	u64 swapout_us;
+	u64 swapin_us;
 };
 
 static struct sgpu_sysfs_proc_struct {
@@ -507,6 +824,7 @@ static void sgpu_swap_proc(struct sgpu_proc_node *proc, unsigned long val)
 	struct swap_stat stat = { 0 };
 	ktime_t begin = ktime_get();
 	const char *opname = "";
+	u64 delta;
 
 	if (swapin) {
 		swap_func = &sgpu_proc_swapin;
@@ -524,12 +842,15 @@ static void sgpu_swap_proc(struct sgpu_proc_node *proc, unsigned long val)
 			break;
 	}
 
-	if (swapin)
-		trace_gmr_swapin(proc->tgid, stat.nr_byte_swapped / PAGE_SIZE,
-				 ktime_us_delta(ktime_get(), begin));
-	else
+	delta = ktime_us_delta(ktime_get(), begin);
+	if (swapin) {
+		WRITE_ONCE(proc->swapin_us, delta);
+		trace_gmr_swapin(proc->tgid, stat.nr_byte_swapped / PAGE_SIZE, delta);
+	} else {
+		WRITE_ONCE(proc->swapout_us, delta);
 		trace_gmr_swapout(proc->tgid, val / PAGE_SIZE, 0, stat.nr_byte_swapped / PAGE_SIZE,
-				  ktime_us_delta(ktime_get(), begin));
+				  delta);
+	}
 
 	DRM_INFO("TGID %d Swap-%s: %u/%u buffers, %u/%u bytes\n", proc->tgid, opname,
 		 stat.nr_bo_swapped, stat.nr_bo_tried, stat.nr_byte_tried, stat.nr_byte_swapped);
@@ -612,6 +933,7 @@ static ssize_t summary_show(struct kobject *kobj, struct kobj_attribute *attr, c
 	struct sgpu_proc_ctx *ctx;
 	size_t total = 0;
 	size_t populated = 0;
+	size_t swapped = 0, comp_size = 0, nr_same = 0;
 	int nr_buffer = 0, nr_context = 0;
 
 	mutex_lock(&proc->lock);
@@ -627,6 +949,15 @@ static ssize_t summary_show(struct kobject *kobj, struct kobj_attribute *attr, c
 			total += tbo->base.size;
 			if (ttm && ttm_tt_is_populated(ttm))
 				populated += ttm->num_pages;
+			/* skip the buffers being swapped in or out right now */
+			if (ttm && (ttm->page_flags & SGPU_TTM_TT_FLAG_SWAPPED) &&
+			    dma_resv_trylock(tbo->base.resv)) {
+				if (ttm->page_flags & SGPU_TTM_TT_FLAG_SWAPPED) {
+					swapped += ttm->num_pages;
+					sgpu_zswap_stat(ttm, &comp_size, &nr_same);
+				}
+				dma_resv_unlock(tbo->base.resv);
+			}
 			ttm_bo_put(tbo);
 
 			nr_buffer++;
@@ -636,8 +967,14 @@ static ssize_t summary_show(struct kobject *kobj, struct kobj_attribute *attr, c
 	}
 	mutex_unlock(&proc->lock);
 
-	return sysfs_emit(buf, "TOTAL %d contexts, %d buffers, %zu bytes, %zu bytes populated\n",
-			  nr_context, nr_buffer, total, populated << PAGE_SHIFT);
+	swapped <<= PAGE_SHIFT;
+
+	return sysfs_emit(buf, "TOTAL %d contexts, %d buffers, %zu bytes, %zu bytes populated\n"
+			  "SWAP %zu bytes swapped, %zu bytes stored (%zu%%), %zu same-filled pages\n"
+			  "LATENCY swap-out %llu us, swap-in %llu us\n",
+			  nr_context, nr_buffer, total, populated << PAGE_SHIFT,
+			  swapped, comp_size, swapped ? comp_size * 100 / swapped : 0, nr_same,
+			  READ_ONCE(proc->swapout_us), READ_ONCE(proc->swapin_us));
 }
 
 static void sgpu_proc_release(struct kobject *kobj)
@@ -786,6 +1123,7 @@ int sgpu_sysfs_proc_init(struct kobject *gpu_root)
 	int ret;
 
 	INIT_LIST_HEAD(&sgpu_sysfs_proc.list);
+	sgpu_zswap_init();
 
 	ret = kobject_init_and_add(&sgpu_sysfs_proc.kobj, &sgpu_sysfs_proc_ktype, gpu_root, "proc");
 	if (ret)
@@ -794,6 +1132,12 @@ int sgpu_sysfs_proc_init(struct kobject *gpu_root)
 	return ret;
 }
 
+/* called on module exit, once every BO and with it every zswap slot is gone */
+void sgpu_swap_fini(void)
+{
+	sgpu_zswap_fini();
+}
+
 static ssize_t sgpu_swap_ctrl_store(struct kobject *kobj, struct kobj_attribute *attr,
 				    const char *buf, size_t count)
 {
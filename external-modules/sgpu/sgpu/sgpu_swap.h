@@ -25,6 +25,7 @@ struct amdgpu_fpriv;
 struct amdgpu_bo;
 
 int sgpu_sysfs_proc_init(struct kobject *gpu_root);
+void sgpu_swap_fini(void);
 int sgpu_proc_add_context(struct amdgpu_fpriv *fpriv);
 void sgpu_proc_remove_context(struct amdgpu_fpriv *fpriv);
 
@@ -46,6 +47,8 @@ static inline int sgpu_sysfs_proc_init(struct kobject *gpu_root)
 	return 0;
 }
 
+#define sgpu_swap_fini() do { } while (0)
+
 static inline int sgpu_proc_add_context(struct amdgpu_fpriv *fpriv)
 {
 	return 0;
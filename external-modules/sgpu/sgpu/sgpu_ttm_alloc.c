@@ -2,6 +2,11 @@
 
 #include <linux/kernel.h>
 #include <linux/atomic.h>
+#include <linux/highmem.h>
+#include <linux/ktime.h>
+#include <linux/shrinker.h>
+#include <linux/sizes.h>
+#include <linux/workqueue.h>
 #include <drm/ttm/ttm_tt.h>
 #include <drm/ttm/ttm_bo.h>
 
@@ -9,21 +14,270 @@
 
 static atomic_t sgpu_page_alloc_count[NR_PAGE_ORDERS];
 
+#ifdef CONFIG_DRM_SGPU_PAGE_POOL
+/*
+ * Freed pages are kept per order up to the watermark of their size class and
+ * zeroed in the background, so most populations are served without the page
+ * allocator and without clearing on the critical path.
+ */
+enum {
+	SGPU_POOL_DIRTY,
+	SGPU_POOL_ZEROED,
+	SGPU_POOL_STATES,
+};
+
+enum {
+	SGPU_POOL_SMALL,	/* 4KB */
+	SGPU_POOL_MEDIUM,	/* up to 32KB */
+	SGPU_POOL_LARGE,
+	SGPU_POOL_CLASSES,
+};
+
+/* in pages */
+static const unsigned long sgpu_page_pool_high[SGPU_POOL_CLASSES] = {
+	[SGPU_POOL_SMALL] = SZ_16M >> PAGE_SHIFT,
+	[SGPU_POOL_MEDIUM] = SZ_32M >> PAGE_SHIFT,
+	[SGPU_POOL_LARGE] = SZ_64M >> PAGE_SHIFT,
+};
+
+struct sgpu_page_pool {
+	spinlock_t lock;
+	struct list_head pages[SGPU_POOL_STATES];
+	unsigned long nr[SGPU_POOL_STATES];
+	atomic_long_t hit;
+	atomic_long_t miss;
+};
+
+static struct sgpu_page_pool sgpu_page_pools[NR_PAGE_ORDERS];
+static atomic_long_t sgpu_page_pool_pages[SGPU_POOL_CLASSES];
+
+enum {
+	SGPU_POOL_ZERO_BG,
+	SGPU_POOL_ZERO_SYNC,
+	SGPU_POOL_ZERO_TYPES,
+};
+static atomic64_t sgpu_page_pool_zero_ns[SGPU_POOL_ZERO_TYPES];
+static atomic_long_t sgpu_page_pool_zeroed[SGPU_POOL_ZERO_TYPES];
+
+static inline int sgpu_page_pool_class(unsigned int order)
+{
+	if (order == 0)
+		return SGPU_POOL_SMALL;
+	if (order <= 3)
+		return SGPU_POOL_MEDIUM;
+	return SGPU_POOL_LARGE;
+}
+
+static void sgpu_page_pool_clear(struct page *p, unsigned int order, int type)
+{
+	ktime_t start = ktime_get();
+	unsigned int i;
+
+	for (i = 0; i < (1 << order); i++)
+		clear_highpage(p + i);
+
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &sgpu_page_pool_zero_ns[type]);
+	atomic_long_add(1 << order, &sgpu_page_pool_zeroed[type]);
+}
+
+static struct page *sgpu_page_pool_pop(unsigned int order, int state)
+{
+	struct sgpu_page_pool *pool = &sgpu_page_pools[order];
+	struct page *p = NULL;
+
+	spin_lock(&pool->lock);
+	if (!list_empty(&pool->pages[state])) {
+		p = list_first_entry(&pool->pages[state], struct page, lru);
+		list_del(&p->lru);
+		pool->nr[state]--;
+	}
+	spin_unlock(&pool->lock);
+
+	return p;
+}
+
+static void sgpu_page_pool_push(unsigned int order, int state, struct page *p)
+{
+	struct sgpu_page_pool *pool = &sgpu_page_pools[order];
+
+	spin_lock(&pool->lock);
+	list_add_tail(&p->lru, &pool->pages[state]);
+	pool->nr[state]++;
+	spin_unlock(&pool->lock);
+}
+
+static struct page *sgpu_page_pool_get(unsigned int order, bool zero)
+{
+	int state = zero ? SGPU_POOL_ZEROED : SGPU_POOL_DIRTY;
+	struct page *p;
+
+	p = sgpu_page_pool_pop(order, state);
+	if (!p) {
+		state = !state;
+		p = sgpu_page_pool_pop(order, state);
+	}
+
+	if (!p) {
+		atomic_long_inc(&sgpu_page_pools[order].miss);
+		return NULL;
+	}
+
+	atomic_long_sub(1 << order, &sgpu_page_pool_pages[sgpu_page_pool_class(order)]);
+	atomic_long_inc(&sgpu_page_pools[order].hit);
+
+	/* the background zeroing has not reached it yet */
+	if (zero && state == SGPU_POOL_DIRTY)
+		sgpu_page_pool_clear(p, order, SGPU_POOL_ZERO_SYNC);
+
+	return p;
+}
+
+static bool sgpu_page_pool_put(struct page *p, unsigned int order)
+{
+	atomic_long_t *nr = &sgpu_page_pool_pages[sgpu_page_pool_class(order)];
+
+	/* someone else still holds it */
+	if (page_ref_count(p) != 1)
+		return false;
+
+	if (atomic_long_add_return(1 << order, nr) >
+	    sgpu_page_pool_high[sgpu_page_pool_class(order)]) {
+		atomic_long_sub(1 << order, nr);
+		return false;
+	}
+
+	sgpu_page_pool_push(order, SGPU_POOL_DIRTY, p);
+
+	return true;
+}
+
+static void sgpu_page_pool_zero_work(struct work_struct *work)
+{
+	int order;
+
+	for (order = 0; order < NR_PAGE_ORDERS; order++) {
+		struct page *p;
+
+		while ((p = sgpu_page_pool_pop(order, SGPU_POOL_DIRTY))) {
+			sgpu_page_pool_clear(p, order, SGPU_POOL_ZERO_BG);
+			sgpu_page_pool_push(order, SGPU_POOL_ZEROED, p);
+			cond_resched();
+		}
+	}
+}
+static DECLARE_WORK(sgpu_page_pool_work, sgpu_page_pool_zero_work);
+
+static inline void sgpu_page_pool_kick(void)
+{
+	queue_work(system_unbound_wq, &sgpu_page_pool_work);
+}
+
+static unsigned long sgpu_page_pool_count_pages(void)
+{
+	unsigned long count = 0;
+	int i;
+
+	for (i = 0; i < SGPU_POOL_CLASSES; i++)
+		count += atomic_long_read(&sgpu_page_pool_pages[i]);
+
+	return count;
+}
+
+/* dirty pages first, their zeroing is not spent yet */
+static unsigned long sgpu_page_pool_release(unsigned long nr_to_free)
+{
+	unsigned long freed = 0;
+	int state, order;
+
+	for (state = SGPU_POOL_DIRTY; state < SGPU_POOL_STATES; state++) {
+		for (order = NR_PAGE_ORDERS - 1; order >= 0; order--) {
+			struct page *p;
+
+			while (freed < nr_to_free &&
+			       (p = sgpu_page_pool_pop(order, state))) {
+				atomic_long_sub(1 << order,
+					&sgpu_page_pool_pages[sgpu_page_pool_class(order)]);
+				__free_pages(p, order);
+				freed += 1 << order;
+			}
+		}
+	}
+
+	return freed;
+}
+
+static unsigned long sgpu_page_pool_shrink_count(struct shrinker *shrinker,
+						 struct shrink_control *sc)
+{
+	unsigned long count = sgpu_page_pool_count_pages();
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long sgpu_page_pool_shrink_scan(struct shrinker *shrinker,
+						struct shrink_control *sc)
+{
+	unsigned long freed = sgpu_page_pool_release(sc->nr_to_scan);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker sgpu_page_pool_shrinker = {
+	.count_objects = sgpu_page_pool_shrink_count,
+	.scan_objects = sgpu_page_pool_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
+int sgpu_page_pool_init(void)
+{
+	int order, state;
+
+	for (order = 0; order < NR_PAGE_ORDERS; order++) {
+		struct sgpu_page_pool *pool = &sgpu_page_pools[order];
+
+		spin_lock_init(&pool->lock);
+		for (state = 0; state < SGPU_POOL_STATES; state++)
+			INIT_LIST_HEAD(&pool->pages[state]);
+	}
+
+	return register_shrinker(&sgpu_page_pool_shrinker, "sgpu-page-pool");
+}
+
+void sgpu_page_pool_fini(void)
+{
+	unregister_shrinker(&sgpu_page_pool_shrinker);
+	cancel_work_sync(&sgpu_page_pool_work);
+	sgpu_page_pool_release(ULONG_MAX);
+}
+#else
+#define sgpu_page_pool_get(order, zero) NULL
+#define sgpu_page_pool_put(p, order) false
+#define sgpu_page_pool_kick() do { } while (0)
+#endif /* CONFIG_DRM_SGPU_PAGE_POOL */
+
 static void sgpu_free_pages(struct page **pages, unsigned long nr_pages)
 {
 	unsigned long freed_pages = 0;
+	bool pooled = false;
 
 	while (nr_pages != freed_pages) {
 		struct page *p = *pages;
 		unsigned long pgcount = 1 << p->private;
 
 		atomic_dec(&sgpu_page_alloc_count[p->private]);
-		__free_pages(p, p->private);
+		if (sgpu_page_pool_put(p, p->private))
+			pooled = true;
+		else
+			__free_pages(p, p->private);
 		pages += pgcount;
 		freed_pages += pgcount;
 	}
 
 	WARN_ON(nr_pages != freed_pages);
+
+	if (pooled)
+		sgpu_page_pool_kick();
 }
 
 int sgpu_ttm_page_alloc(struct ttm_tt *tt)
@@ -54,7 +308,9 @@ int sgpu_ttm_page_alloc(struct ttm_tt *tt)
 		while (nr_remained >= nr_pages) {
 			unsigned int i;
 
-			p = alloc_pages(gfp_flags, order);
+			p = sgpu_page_pool_get(order, !!(gfp_flags & __GFP_ZERO));
+			if (!p)
+				p = alloc_pages(gfp_flags, order);
 			if (!p)
 				break;
 
@@ -106,6 +362,37 @@ static int sgpu_page_pool_stat_show(struct seq_file *m, void *unused)
 	}
 	seq_printf(m, "\nTOTAL: %zu\n", total);
 
+#ifdef CONFIG_DRM_SGPU_PAGE_POOL
+	seq_puts(m, "\nPOOL:  ");
+	for (i = 0; i < NR_PAGE_ORDERS; i++)
+		seq_printf(m, " %8lu", sgpu_page_pools[i].nr[SGPU_POOL_DIRTY] +
+			   sgpu_page_pools[i].nr[SGPU_POOL_ZEROED]);
+	seq_puts(m, "\nZEROED:");
+	for (i = 0; i < NR_PAGE_ORDERS; i++)
+		seq_printf(m, " %8lu", sgpu_page_pools[i].nr[SGPU_POOL_ZEROED]);
+	seq_puts(m, "\nHIT:   ");
+	for (i = 0; i < NR_PAGE_ORDERS; i++)
+		seq_printf(m, " %8ld", atomic_long_read(&sgpu_page_pools[i].hit));
+	seq_puts(m, "\nMISS:  ");
+	for (i = 0; i < NR_PAGE_ORDERS; i++)
+		seq_printf(m, " %8ld", atomic_long_read(&sgpu_page_pools[i].miss));
+	seq_printf(m, "\nPOOLED: %lu (small %ld/%lu medium %ld/%lu large %ld/%lu)\n",
+		   sgpu_page_pool_count_pages(),
+		   atomic_long_read(&sgpu_page_pool_pages[SGPU_POOL_SMALL]),
+		   sgpu_page_pool_high[SGPU_POOL_SMALL],
+		   atomic_long_read(&sgpu_page_pool_pages[SGPU_POOL_MEDIUM]),
+		   sgpu_page_pool_high[SGPU_POOL_MEDIUM],
+		   atomic_long_read(&sgpu_page_pool_pages[SGPU_POOL_LARGE]),
+		   sgpu_page_pool_high[SGPU_POOL_LARGE]);
+	seq_printf(m, "ZEROING: background %ld pages %lld us, on alloc %ld pages %lld us\n",
+		   atomic_long_read(&sgpu_page_pool_zeroed[SGPU_POOL_ZERO_BG]),
+		   div_s64(atomic64_read(&sgpu_page_pool_zero_ns[SGPU_POOL_ZERO_BG]),
+			   NSEC_PER_USEC),
+		   atomic_long_read(&sgpu_page_pool_zeroed[SGPU_POOL_ZERO_SYNC]),
+		   div_s64(atomic64_read(&sgpu_page_pool_zero_ns[SGPU_POOL_ZERO_SYNC]),
+			   NSEC_PER_USEC));
+#endif
+
 	return 0;
 }
 DEFINE_SHOW_ATTRIBUTE(sgpu_page_pool_stat);
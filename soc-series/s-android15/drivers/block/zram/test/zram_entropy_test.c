@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks the classes the entropy estimate of zram gives to random, text
+ * like and same-filled pages with the default thresholds.
+ */
+
+#include <kunit/test.h>
+#include <linux/highmem.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+
+#include "zram_test.h"
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+
+#define ENTROPY_TEST_PAGES	64
+
+static struct zram *entropy_test_zram(struct kunit *test)
+{
+	struct zram *zram = kunit_kzalloc(test, sizeof(*zram), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, zram);
+	zram->entropy_low = ZRAM_ENTROPY_LOW_DEFAULT;
+	zram->entropy_high = ZRAM_ENTROPY_HIGH_DEFAULT;
+
+	return zram;
+}
+
+static struct page *entropy_test_page(struct kunit *test)
+{
+	struct page *page = alloc_page(GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, page);
+
+	return page;
+}
+
+static void zram_entropy_random_test(struct kunit *test)
+{
+	struct zram *zram = entropy_test_zram(test);
+	struct page *page = entropy_test_page(test);
+	void *mem = page_address(page);
+	int i;
+
+	for (i = 0; i < ENTROPY_TEST_PAGES; i++) {
+		get_random_bytes(mem, PAGE_SIZE);
+		KUNIT_EXPECT_EQ(test, (int)ZRAM_ENTROPY_HIGH, (int)zram_entropy_class(zram, page));
+	}
+
+	__free_page(page);
+}
+
+static void zram_entropy_text_test(struct kunit *test)
+{
+	static const char text[] = "static void zram_entropy_text_test(struct kunit *test)\n";
+	struct zram *zram = entropy_test_zram(test);
+	struct page *page = entropy_test_page(test);
+	char *mem = page_address(page);
+	int i;
+
+	for (i = 0; i < PAGE_SIZE; i++)
+		mem[i] = text[i % (sizeof(text) - 1)];
+
+	KUNIT_EXPECT_EQ(test, (int)ZRAM_ENTROPY_LOW, (int)zram_entropy_class(zram, page));
+
+	__free_page(page);
+}
+
+static void zram_entropy_same_test(struct kunit *test)
+{
+	struct page *page = entropy_test_page(test);
+	void *mem = page_address(page);
+
+	memset(mem, 0x5a, PAGE_SIZE);
+	KUNIT_EXPECT_EQ(test, 0U, zram_page_entropy(mem));
+
+	__free_page(page);
+}
+
+static struct kunit_case zram_entropy_test_cases[] = {
+	KUNIT_CASE(zram_entropy_random_test),
+	KUNIT_CASE(zram_entropy_text_test),
+	KUNIT_CASE(zram_entropy_same_test),
+	{}
+};
+
+static struct kunit_suite zram_entropy_test_suite = {
+	.name = "zram_entropy",
+	.test_cases = zram_entropy_test_cases,
+};
+
+kunit_test_suites(&zram_entropy_test_suite);
+
+MODULE_LICENSE("GPL");
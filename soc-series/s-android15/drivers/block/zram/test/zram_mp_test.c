@@ -0,0 +1,384 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compares storing anonymous-like pages one by one against storing them
+ * in multi-page units: compressed size and zsmalloc objects used, and the
+ * swap-in latency of the first page of a unit and of a whole unit.
+ *
+ * The corpus is synthetic (heap words, text and random pages mixed the
+ * way they are in a swapped out process) so runs are reproducible; the
+ * numbers are printed with kunit_info for comparison between builds.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/prandom.h>
+#include <linux/vmalloc.h>
+
+#include "zram_test.h"
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+
+#define MP_TEST_PAGES	512
+#define MP_TEST_SEED	0x7a72616d
+
+static const char * const mp_test_algs[] = { "lz4", "lzo-rle" };
+
+static const char * const mp_test_words[] = {
+	"the", "binder", "surface", "activity", "null", "true", "window",
+	"layout", "android", "config", "service", "0x", "=", "{", "}", ";",
+};
+
+struct mp_test_store {
+	void *data;		/* compressed copy, PAGE_SIZE per page */
+	unsigned int *len;	/* per page, or per unit at the first page */
+	u64 bytes;
+	u64 objs;
+};
+
+/* ~40% zero, ~30% pointers into one region, ~20% small ints, rest noise */
+static void mp_test_fill_heap(struct rnd_state *rnd, u64 *words)
+{
+	u64 base = 0xffffff8000000000ULL |
+		   ((u64)prandom_u32_state(rnd) << 12);
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(u64); i++) {
+		u32 r = prandom_u32_state(rnd) % 10;
+
+		if (r < 4)
+			words[i] = 0;
+		else if (r < 7)
+			words[i] = base + (prandom_u32_state(rnd) % 4096) * 16;
+		else if (r < 9)
+			words[i] = prandom_u32_state(rnd) % 256;
+		else
+			words[i] = ((u64)prandom_u32_state(rnd) << 32) |
+				   prandom_u32_state(rnd);
+	}
+}
+
+static void mp_test_fill_text(struct rnd_state *rnd, char *mem)
+{
+	unsigned int off = 0;
+
+	while (off < PAGE_SIZE) {
+		const char *w = mp_test_words[prandom_u32_state(rnd) %
+					      ARRAY_SIZE(mp_test_words)];
+		unsigned int len = min_t(unsigned int, strlen(w),
+					 PAGE_SIZE - off);
+
+		memcpy(mem + off, w, len);
+		off += len;
+		if (off < PAGE_SIZE)
+			mem[off++] = ' ';
+	}
+}
+
+static void mp_test_fill(struct rnd_state *rnd, void *corpus)
+{
+	int i;
+
+	for (i = 0; i < MP_TEST_PAGES; i++) {
+		void *mem = corpus + ((size_t)i << PAGE_SHIFT);
+
+		switch (i % 8) {
+		case 5:
+		case 6:
+			mp_test_fill_text(rnd, mem);
+			break;
+		case 7:
+			prandom_bytes_state(rnd, mem, PAGE_SIZE);
+			break;
+		default:
+			mp_test_fill_heap(rnd, mem);
+			break;
+		}
+	}
+}
+
+static void mp_test_store_page(struct zcomp *comp, struct mp_test_store *st,
+			       const void *corpus, int i)
+{
+	void *src = (void *)corpus + ((size_t)i << PAGE_SHIFT);
+	void *dst = st->data + ((size_t)i << PAGE_SHIFT);
+	struct zcomp_strm *zstrm;
+	unsigned int len;
+
+	zstrm = zcomp_stream_get(comp);
+	if (zcomp_compress(zstrm, src, &len) || len >= PAGE_SIZE) {
+		len = PAGE_SIZE;
+		memcpy(dst, src, PAGE_SIZE);
+	} else {
+		memcpy(dst, zstrm->buffer, len);
+	}
+	zcomp_stream_put(comp);
+
+	st->len[i] = len;
+	st->bytes += len;
+	st->objs++;
+}
+
+static int mp_test_load_page(struct zcomp *comp, struct mp_test_store *st,
+			     struct page *page, int i)
+{
+	void *src = st->data + ((size_t)i << PAGE_SHIFT);
+	void *dst = page_address(page);
+	struct zcomp_strm *zstrm;
+	int ret = 0;
+
+	if (st->len[i] == PAGE_SIZE) {
+		memcpy(dst, src, PAGE_SIZE);
+		return 0;
+	}
+
+	zstrm = zcomp_stream_get(comp);
+	ret = zcomp_decompress(zstrm, src, st->len[i], dst, page);
+	zcomp_stream_put(comp);
+
+	return ret;
+}
+
+/*
+ * Same rules as zram_mp_write(): a unit is kept only if it saves at least
+ * one object, otherwise its pages are stored one by one. A kept unit has
+ * its length at its first page and 0 for the other pages.
+ */
+static bool mp_test_store_unit(struct zcomp *comp, struct mp_test_store *st,
+			       const void *corpus, int first, unsigned int nr)
+{
+	struct zcomp_strm *zstrm;
+	unsigned int len, nr_objs;
+	int i, ret;
+
+	zstrm = zcomp_stream_get(comp);
+	memcpy(zstrm->mp_input, corpus + ((size_t)first << PAGE_SHIFT),
+	       nr << PAGE_SHIFT);
+	ret = zcomp_compress_multi(zstrm, nr, &len);
+	nr_objs = DIV_ROUND_UP(len, PAGE_SIZE);
+	if (!ret && nr_objs < nr)
+		memcpy(st->data + ((size_t)first << PAGE_SHIFT),
+		       zstrm->mp_buffer, len);
+	zcomp_stream_put(comp);
+
+	if (ret || nr_objs >= nr) {
+		for (i = 0; i < nr; i++)
+			mp_test_store_page(comp, st, corpus, first + i);
+		return false;
+	}
+
+	for (i = 0; i < nr; i++)
+		st->len[first + i] = 0;
+	st->len[first] = len;
+	st->bytes += len;
+	st->objs += nr_objs;
+	return true;
+}
+
+/* Decompress the whole unit, then hand out pages the way mp_cache does */
+static int mp_test_load_unit(struct zcomp *comp, struct mp_test_store *st,
+			     void *scratch, struct page *page, int first,
+			     unsigned int nr, u64 *first_ns)
+{
+	struct zcomp_strm *zstrm;
+	u64 start = ktime_get_ns();
+	int i, ret;
+
+	zstrm = zcomp_stream_get(comp);
+	memcpy(zstrm->mp_buffer, st->data + ((size_t)first << PAGE_SHIFT),
+	       st->len[first]);
+	ret = zcomp_decompress_multi(zstrm, st->len[first], scratch, nr);
+	zcomp_stream_put(comp);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < nr; i++) {
+		memcpy(page_address(page), scratch + ((size_t)i << PAGE_SHIFT),
+		       PAGE_SIZE);
+		if (!i)
+			*first_ns += ktime_get_ns() - start;
+	}
+
+	return 0;
+}
+
+static void mp_test_check(struct kunit *test, const void *corpus,
+			  struct page *page, int i)
+{
+	KUNIT_EXPECT_EQ(test, memcmp(page_address(page),
+			corpus + ((size_t)i << PAGE_SHIFT), PAGE_SIZE), 0);
+}
+
+static u64 mp_test_per_page(struct kunit *test, struct zcomp *comp,
+			    struct mp_test_store *st, const void *corpus,
+			    struct page *page)
+{
+	u64 start, ns = 0;
+	int i;
+
+	for (i = 0; i < MP_TEST_PAGES; i++)
+		mp_test_store_page(comp, st, corpus, i);
+
+	for (i = 0; i < MP_TEST_PAGES; i++) {
+		start = ktime_get_ns();
+		if (mp_test_load_page(comp, st, page, i)) {
+			KUNIT_FAIL(test, "page %d does not decompress", i);
+			break;
+		}
+		ns += ktime_get_ns() - start;
+		mp_test_check(test, corpus, page, i);
+	}
+
+	return ns;
+}
+
+static void mp_test_units(struct kunit *test, struct zcomp *comp,
+			  const char *alg, const void *corpus,
+			  struct page *page, unsigned int nr,
+			  const struct mp_test_store *ref, u64 ref_ns)
+{
+	struct mp_test_store st = {};
+	unsigned int nr_units = 0, nr_fallback = 0;
+	u64 start, ns = 0, first_ns = 0;
+	void *scratch;
+	int i, j;
+
+	st.data = vmalloc((size_t)MP_TEST_PAGES << PAGE_SHIFT);
+	st.len = kunit_kcalloc(test, MP_TEST_PAGES, sizeof(*st.len),
+			       GFP_KERNEL);
+	scratch = vmalloc(nr << PAGE_SHIFT);
+	if (!st.data || !st.len || !scratch) {
+		KUNIT_FAIL(test, "no memory for %u-page units", nr);
+		goto out;
+	}
+
+	for (i = 0; i < MP_TEST_PAGES; i += nr) {
+		if (mp_test_store_unit(comp, &st, corpus, i, nr))
+			nr_units++;
+		else
+			nr_fallback++;
+	}
+
+	for (i = 0; i < MP_TEST_PAGES; i += nr) {
+		start = ktime_get_ns();
+		if (st.len[i] && !st.len[i + 1]) {
+			if (mp_test_load_unit(comp, &st, scratch, page, i, nr,
+					      &first_ns)) {
+				KUNIT_FAIL(test, "unit %d does not decompress", i);
+				goto out;
+			}
+			ns += ktime_get_ns() - start;
+			/* scratch still holds the whole unit */
+			for (j = 0; j < nr; j++)
+				KUNIT_EXPECT_EQ(test, memcmp(scratch +
+						((size_t)j << PAGE_SHIFT),
+						corpus + ((size_t)(i + j) << PAGE_SHIFT),
+						PAGE_SIZE), 0);
+			continue;
+		}
+
+		for (j = 0; j < nr; j++) {
+			if (mp_test_load_page(comp, &st, page, i + j)) {
+				KUNIT_FAIL(test, "page %d does not decompress",
+					   i + j);
+				goto out;
+			}
+			if (!j)
+				first_ns += ktime_get_ns() - start;
+		}
+		ns += ktime_get_ns() - start;
+		for (j = 0; j < nr; j++) {
+			mp_test_load_page(comp, &st, page, i + j);
+			mp_test_check(test, corpus, page, i + j);
+		}
+	}
+
+	/* a unit is only kept if it saves objects */
+	KUNIT_EXPECT_LE(test, st.objs, ref->objs);
+
+	kunit_info(test,
+		   "%s %u-page units: %llu bytes in %llu objs (%llu%% of per page), %u units %u fallback\n",
+		   alg, nr, st.bytes, st.objs,
+		   div64_u64(st.objs * 100, ref->objs), nr_units, nr_fallback);
+	kunit_info(test,
+		   "%s %u-page units: swap-in first page %llu ns, %llu ns/page (per page %llu ns/page)\n",
+		   alg, nr, div64_u64(first_ns, MP_TEST_PAGES / nr),
+		   div64_u64(ns, MP_TEST_PAGES),
+		   div64_u64(ref_ns, MP_TEST_PAGES));
+out:
+	vfree(scratch);
+	vfree(st.data);
+}
+
+static void zram_mp_bench_test(struct kunit *test)
+{
+	struct rnd_state rnd;
+	struct page *page;
+	void *corpus;
+	int a, runs = 0;
+
+	corpus = vmalloc((size_t)MP_TEST_PAGES << PAGE_SHIFT);
+	page = alloc_page(GFP_KERNEL);
+	if (!corpus || !page) {
+		vfree(corpus);
+		if (page)
+			__free_page(page);
+		KUNIT_FAIL(test, "no memory for the corpus");
+		return;
+	}
+
+	prandom_seed_state(&rnd, MP_TEST_SEED);
+	mp_test_fill(&rnd, corpus);
+
+	for (a = 0; a < ARRAY_SIZE(mp_test_algs); a++) {
+		struct mp_test_store ref = {};
+		struct zcomp *comp;
+		u64 ref_ns;
+
+		comp = zcomp_create(mp_test_algs[a], ZRAM_MP_MAX_PAGES);
+		if (IS_ERR(comp))
+			continue;
+
+		ref.data = vmalloc((size_t)MP_TEST_PAGES << PAGE_SHIFT);
+		ref.len = kunit_kcalloc(test, MP_TEST_PAGES, sizeof(*ref.len),
+					GFP_KERNEL);
+		if (ref.data && ref.len) {
+			ref_ns = mp_test_per_page(test, comp, &ref, corpus,
+						  page);
+			kunit_info(test,
+				   "%s per page: %lu -> %llu bytes in %llu objs\n",
+				   mp_test_algs[a],
+				   (unsigned long)MP_TEST_PAGES << PAGE_SHIFT,
+				   ref.bytes, ref.objs);
+
+			mp_test_units(test, comp, mp_test_algs[a], corpus, page,
+				      ZRAM_MP_MIN_PAGES, &ref, ref_ns);
+			mp_test_units(test, comp, mp_test_algs[a], corpus, page,
+				      ZRAM_MP_MAX_PAGES, &ref, ref_ns);
+			runs++;
+		}
+
+		vfree(ref.data);
+		zcomp_destroy(comp);
+	}
+
+	__free_page(page);
+	vfree(corpus);
+
+	if (!runs)
+		kunit_skip(test, "no usable compressor");
+}
+
+static struct kunit_case zram_mp_test_cases[] = {
+	KUNIT_CASE_SLOW(zram_mp_bench_test),
+	{}
+};
+
+static struct kunit_suite zram_mp_test_suite = {
+	.name = "zram_multi_pages",
+	.test_cases = zram_mp_test_cases,
+};
+
+kunit_test_suites(&zram_mp_test_suite);
+
+MODULE_LICENSE("GPL");
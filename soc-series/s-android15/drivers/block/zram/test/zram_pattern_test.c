@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compares the memcmp()/memchr_inv() based pattern detection of zram with
+ * a word by word scan, in the style of page_same_filled(), on periodic,
+ * sparse and non-matching pages. Both must classify every page the same;
+ * the cost of each in ns/page is printed with kunit_info.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/prandom.h>
+#include <linux/vmalloc.h>
+
+#include "zram_test.h"
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+
+#define PATTERN_TEST_PAGES	64
+#define PATTERN_TEST_ROUNDS	16
+#define PATTERN_TEST_SEED	0x70617474
+#define PAGE_WORDS		(PAGE_SIZE / sizeof(unsigned long))
+
+enum pattern_test_kind {
+	PATTERN_PERIOD_2,
+	PATTERN_PERIOD_4,
+	PATTERN_PERIOD_8,
+	PATTERN_SPARSE,
+	/* 8-periodic except for the last word, both scans read it all */
+	PATTERN_LATE_MISS,
+	/* one nonzero word too many for a sparse page, spread out */
+	PATTERN_DENSE,
+	PATTERN_RANDOM,
+	NR_PATTERN_KINDS,
+};
+
+static const char * const pattern_test_names[] = {
+	"period 2", "period 4", "period 8", "sparse", "late miss", "dense",
+	"random",
+};
+
+static unsigned long pattern_test_word(struct rnd_state *rnd)
+{
+	/* never 0, so that periodic pages are not same-filled or sparse */
+	return ((unsigned long)prandom_u32_state(rnd) << 32) |
+		prandom_u32_state(rnd) | 1;
+}
+
+static void pattern_test_fill(struct rnd_state *rnd, unsigned long *page,
+			      enum pattern_test_kind kind)
+{
+	unsigned int i, nr, period = 2 << kind;
+
+	switch (kind) {
+	case PATTERN_PERIOD_2:
+	case PATTERN_PERIOD_4:
+	case PATTERN_PERIOD_8:
+	case PATTERN_LATE_MISS:
+		if (kind == PATTERN_LATE_MISS)
+			period = ZRAM_PATTERN_MAX;
+		for (i = 0; i < period; i++)
+			page[i] = pattern_test_word(rnd);
+		/* make sure a shorter period does not match as well */
+		page[period - 1] = ~page[period / 2 - 1];
+		for (i = period; i < PAGE_WORDS; i++)
+			page[i] = page[i - period];
+		if (kind == PATTERN_LATE_MISS)
+			page[PAGE_WORDS - 1] = ~page[PAGE_WORDS - 1];
+		break;
+	case PATTERN_SPARSE:
+	case PATTERN_DENSE:
+		memset(page, 0, PAGE_SIZE);
+		if (kind == PATTERN_DENSE)
+			nr = ZRAM_PATTERN_MAX + 1;
+		else
+			nr = prandom_u32_state(rnd) % ZRAM_PATTERN_MAX + 1;
+		/* one word somewhere in each of nr equal slices */
+		for (i = 0; i < nr; i++)
+			page[i * (PAGE_WORDS / nr) + prandom_u32_state(rnd) %
+			     (PAGE_WORDS / nr)] = pattern_test_word(rnd);
+		break;
+	default:
+		prandom_bytes_state(rnd, page, PAGE_SIZE);
+		break;
+	}
+}
+
+static bool scalar_pattern_periodic(unsigned long *page,
+				    struct zram_pattern *pat)
+{
+	unsigned int period, pos;
+
+	for (period = 2; period <= ZRAM_PATTERN_MAX; period <<= 1) {
+		for (pos = period; pos < PAGE_WORDS; pos++) {
+			if (page[pos] != page[pos - period])
+				break;
+		}
+		if (pos == PAGE_WORDS) {
+			pat->period = period;
+			pat->nr = period;
+			memcpy(pat->words, page, period * sizeof(*page));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool scalar_pattern_sparse(unsigned long *page,
+				  struct zram_pattern *pat)
+{
+	unsigned int pos, nr = 0;
+
+	for (pos = 0; pos < PAGE_WORDS; pos++) {
+		if (!page[pos])
+			continue;
+		if (nr == ZRAM_PATTERN_MAX)
+			return false;
+		pat->pos[nr] = pos;
+		pat->words[nr++] = page[pos];
+	}
+
+	pat->period = 0;
+	pat->nr = nr;
+	return true;
+}
+
+static bool scalar_pattern_filled(void *ptr, struct zram_pattern *pat)
+{
+	return scalar_pattern_periodic(ptr, pat) ||
+		scalar_pattern_sparse(ptr, pat);
+}
+
+static void pattern_test_compare(struct kunit *test, void *page,
+				 enum pattern_test_kind kind)
+{
+	struct zram_pattern vec = {}, ref = {};
+	bool found = page_pattern_filled(page, &vec);
+
+	KUNIT_EXPECT_EQ(test, found, kind < PATTERN_LATE_MISS);
+	if (found != scalar_pattern_filled(page, &ref)) {
+		KUNIT_FAIL(test, "%s: detectors disagree",
+			   pattern_test_names[kind]);
+		return;
+	}
+	if (!found)
+		return;
+
+	KUNIT_EXPECT_EQ(test, vec.period, ref.period);
+	KUNIT_EXPECT_EQ(test, vec.nr, ref.nr);
+	if (vec.nr != ref.nr)
+		return;
+	KUNIT_EXPECT_EQ(test, memcmp(vec.words, ref.words,
+				     ref.nr * sizeof(ref.words[0])), 0);
+	if (!ref.period)
+		KUNIT_EXPECT_EQ(test, memcmp(vec.pos, ref.pos,
+					     ref.nr * sizeof(ref.pos[0])), 0);
+}
+
+static u64 pattern_test_time(void *pages,
+			     bool (*filled)(void *, struct zram_pattern *))
+{
+	struct zram_pattern pat;
+	unsigned int found = 0;
+	u64 start;
+	int r, i;
+
+	start = ktime_get_ns();
+	for (r = 0; r < PATTERN_TEST_ROUNDS; r++) {
+		for (i = 0; i < PATTERN_TEST_PAGES; i++)
+			found += filled(pages + ((size_t)i << PAGE_SHIFT), &pat);
+	}
+	/* keep the results alive */
+	OPTIMIZER_HIDE_VAR(found);
+
+	return div64_u64(ktime_get_ns() - start,
+			 PATTERN_TEST_ROUNDS * PATTERN_TEST_PAGES);
+}
+
+static void zram_pattern_bench_test(struct kunit *test)
+{
+	struct rnd_state rnd;
+	void *pages;
+	int kind, i;
+
+	pages = vmalloc((size_t)PATTERN_TEST_PAGES << PAGE_SHIFT);
+	KUNIT_ASSERT_NOT_NULL(test, pages);
+
+	prandom_seed_state(&rnd, PATTERN_TEST_SEED);
+	for (kind = 0; kind < NR_PATTERN_KINDS; kind++) {
+		u64 vec_ns, ref_ns;
+
+		for (i = 0; i < PATTERN_TEST_PAGES; i++) {
+			void *page = pages + ((size_t)i << PAGE_SHIFT);
+
+			pattern_test_fill(&rnd, page, kind);
+			pattern_test_compare(test, page, kind);
+		}
+
+		vec_ns = pattern_test_time(pages, page_pattern_filled);
+		ref_ns = pattern_test_time(pages, scalar_pattern_filled);
+		kunit_info(test, "%-9s: %llu ns/page, word by word %llu ns/page\n",
+			   pattern_test_names[kind], vec_ns, ref_ns);
+	}
+
+	vfree(pages);
+}
+
+static struct kunit_case zram_pattern_test_cases[] = {
+	KUNIT_CASE_SLOW(zram_pattern_bench_test),
+	{}
+};
+
+static struct kunit_suite zram_pattern_test_suite = {
+	.name = "zram_pattern",
+	.test_cases = zram_pattern_test_cases,
+};
+
+kunit_test_suites(&zram_pattern_test_suite);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _ZRAM_TEST_H
+#define _ZRAM_TEST_H
+
+#include "zram_drv.h"
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+extern unsigned int zram_page_entropy(const u8 *mem);
+extern enum zram_entropy_class zram_entropy_class(struct zram *zram,
+						  struct page *page);
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+extern bool page_pattern_filled(void *ptr, struct zram_pattern *pat);
+#endif
+
+#endif /* _ZRAM_TEST_H */
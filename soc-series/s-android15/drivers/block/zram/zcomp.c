@@ -11,6 +11,8 @@
 #include <linux/sched.h>
 #include <linux/cpu.h>
 #include <linux/crypto.h>
+#include <linux/vmalloc.h>
+#include <kunit/visibility.h>
 
 #include <soc/samsung/exynos_hw_decomp.h>
 
@@ -48,6 +50,12 @@ static void zcomp_strm_free(struct zcomp_strm *zstrm)
 		zstrm->tmpbuf = NULL;
 	}
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	vfree(zstrm->mp_input);
+	vfree(zstrm->mp_buffer);
+	zstrm->mp_input = NULL;
+	zstrm->mp_buffer = NULL;
+#endif
 }
 
 /*
@@ -72,6 +80,16 @@ static int zcomp_strm_init(struct zcomp_strm *zstrm, struct zcomp *comp)
 		zcomp_strm_free(zstrm);
 		return -ENOMEM;
 	}
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	if (comp->mp_pages) {
+		zstrm->mp_input = vmalloc(comp->mp_pages << PAGE_SHIFT);
+		zstrm->mp_buffer = vmalloc(comp->mp_pages << PAGE_SHIFT);
+		if (!zstrm->mp_input || !zstrm->mp_buffer) {
+			zcomp_strm_free(zstrm);
+			return -ENOMEM;
+		}
+	}
 #endif
 	return 0;
 }
@@ -123,11 +141,13 @@ struct zcomp_strm *zcomp_stream_get(struct zcomp *comp)
 	local_lock(&comp->stream->lock);
 	return this_cpu_ptr(comp->stream);
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_stream_get);
 
 void zcomp_stream_put(struct zcomp *comp)
 {
 	local_unlock(&comp->stream->lock);
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_stream_put);
 
 int zcomp_compress(struct zcomp_strm *zstrm,
 		const void *src, unsigned int *dst_len)
@@ -152,6 +172,44 @@ int zcomp_compress(struct zcomp_strm *zstrm,
 			src, PAGE_SIZE,
 			zstrm->buffer, dst_len);
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_compress);
+
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+/*
+ * Compress the unit staged in ->mp_input. Unlike zcomp_compress() the
+ * destination is only as large as the unit itself: a unit that does not
+ * compress below its own size is of no use, and the caller falls back to
+ * per-page compression on any error.
+ */
+int zcomp_compress_multi(struct zcomp_strm *zstrm,
+		unsigned int nr_pages, unsigned int *dst_len)
+{
+	*dst_len = nr_pages << PAGE_SHIFT;
+
+	return crypto_comp_compress(zstrm->tfm,
+			zstrm->mp_input, nr_pages << PAGE_SHIFT,
+			zstrm->mp_buffer, dst_len);
+}
+EXPORT_SYMBOL_IF_KUNIT(zcomp_compress_multi);
+
+/*
+ * Decompress a unit whose compressed data was gathered in ->mp_buffer.
+ * The HW decompressor works on single pages only, so always use crypto.
+ */
+int zcomp_decompress_multi(struct zcomp_strm *zstrm,
+		unsigned int src_len, void *dst, unsigned int nr_pages)
+{
+	unsigned int dst_len = nr_pages << PAGE_SHIFT;
+	int ret;
+
+	ret = crypto_comp_decompress(zstrm->tfm, zstrm->mp_buffer, src_len,
+			dst, &dst_len);
+	if (!ret && dst_len != nr_pages << PAGE_SHIFT)
+		ret = -EINVAL;
+	return ret;
+}
+EXPORT_SYMBOL_IF_KUNIT(zcomp_decompress_multi);
+#endif
 
 #if IS_ENABLED(CONFIG_VENDOR_ZRAM_LZO_HW_DECOMP)
 static inline int _zcomp_decompress(struct zcomp_strm *zstrm,
@@ -181,6 +239,7 @@ int zcomp_decompress(struct zcomp_strm *zstrm,
 {
 	return _zcomp_decompress(zstrm, src, src_len, dst, page);
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_decompress);
 
 int zcomp_cpu_up_prepare(unsigned int cpu, struct hlist_node *node)
 {
@@ -261,6 +320,7 @@ void zcomp_destroy(struct zcomp *comp)
 	free_percpu(comp->stream);
 	kfree(comp);
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_destroy);
 
 /*
  * search available compressors for requested algorithm.
@@ -270,7 +330,7 @@ void zcomp_destroy(struct zcomp *comp)
  * case of allocation error, or any other error potentially
  * returned by zcomp_init().
  */
-struct zcomp *zcomp_create(const char *alg)
+struct zcomp *zcomp_create(const char *alg, unsigned int mp_pages)
 {
 	struct zcomp *comp;
 	int error;
@@ -288,6 +348,7 @@ struct zcomp *zcomp_create(const char *alg)
 		return ERR_PTR(-ENOMEM);
 
 	comp->name = alg;
+	comp->mp_pages = mp_pages;
 	error = zcomp_init(comp);
 	if (error) {
 		kfree(comp);
@@ -295,3 +356,4 @@ struct zcomp *zcomp_create(const char *alg)
 	}
 	return comp;
 }
+EXPORT_SYMBOL_IF_KUNIT(zcomp_create);
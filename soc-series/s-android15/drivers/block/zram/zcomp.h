@@ -16,6 +16,11 @@ struct zcomp_strm {
 #ifdef CONFIG_ZRAM_EXT
 	void *tmpbuf;
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	/* linear copy of a multi-page unit and its compressed data */
+	void *mp_input;
+	void *mp_buffer;
+#endif
 #if IS_ENABLED(CONFIG_VENDOR_ZRAM_LZO_HW_DECOMP)
 	int (*lzo_hw_decompress)(const unsigned char *src, size_t src_len,
 					unsigned char *dst, struct page *page);
@@ -26,6 +31,8 @@ struct zcomp_strm {
 struct zcomp {
 	struct zcomp_strm __percpu *stream;
 	const char *name;
+	/* size of the multi-page unit buffers, 0 if unused */
+	unsigned int mp_pages;
 	struct hlist_node node;
 };
 
@@ -34,7 +41,7 @@ int zcomp_cpu_dead(unsigned int cpu, struct hlist_node *node);
 ssize_t zcomp_available_show(const char *comp, char *buf);
 bool zcomp_available_algorithm(const char *comp);
 
-struct zcomp *zcomp_create(const char *alg);
+struct zcomp *zcomp_create(const char *alg, unsigned int mp_pages);
 void zcomp_destroy(struct zcomp *comp);
 
 struct zcomp_strm *zcomp_stream_get(struct zcomp *comp);
@@ -46,5 +53,13 @@ int zcomp_compress(struct zcomp_strm *zstrm,
 int zcomp_decompress(struct zcomp_strm *zstrm,
 		const void *src, unsigned int src_len, void *dst, struct page *page);
 
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+int zcomp_compress_multi(struct zcomp_strm *zstrm,
+		unsigned int nr_pages, unsigned int *dst_len);
+
+int zcomp_decompress_multi(struct zcomp_strm *zstrm,
+		unsigned int src_len, void *dst, unsigned int nr_pages);
+#endif
+
 bool zcomp_set_max_streams(struct zcomp *comp, int num_strm);
 #endif /* _ZCOMP_H_ */
@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * zram_dedup
+ *
+ * Copyright (C) 2024 Samsung Electronics
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/xxhash.h>
+
+#include "zram_drv.h"
+
+static inline struct zram_dedup_bucket *zram_dedup_bucket(struct zram *zram,
+		u32 checksum)
+{
+	return &zram->dedup_table[checksum & zram->dedup_mask];
+}
+
+u32 zram_dedup_checksum(const void *mem, unsigned int len)
+{
+	return xxh32(mem, len, 0);
+}
+
+/*
+ * Look up an object with the same compressed data. Compression is
+ * deterministic for a given algorithm, so identical pages compressed by
+ * the primary algorithm are byte identical. The checksum only narrows
+ * down the candidates, the data itself is always compared.
+ * On a hit the entry gets a reference for the caller's slot.
+ */
+struct zram_dedup_entry *zram_dedup_find(struct zram *zram, const void *mem,
+		unsigned int len, u32 checksum)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct zram_dedup_entry *entry;
+	void *obj;
+	bool match;
+
+	spin_lock(&bucket->lock);
+	hlist_for_each_entry(entry, &bucket->head, node) {
+		if (entry->checksum != checksum || entry->len != len)
+			continue;
+
+		obj = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+		match = !memcmp(obj, mem, len);
+		zs_unmap_object(zram->mem_pool, entry->handle);
+		if (!match)
+			continue;
+
+		entry->refcount++;
+		spin_unlock(&bucket->lock);
+		atomic64_add(len, &zram->stats.dup_data_size);
+		atomic64_inc(&zram->stats.dup_pages);
+		return entry;
+	}
+	spin_unlock(&bucket->lock);
+
+	return NULL;
+}
+
+/*
+ * Register a newly stored object so that later writes can share it.
+ * Failing to allocate the entry only means the object is not shared.
+ */
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, u32 checksum)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram, checksum);
+	struct zram_dedup_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->len = len;
+	entry->checksum = checksum;
+	entry->refcount = 1;
+
+	spin_lock(&bucket->lock);
+	hlist_add_head(&entry->node, &bucket->head);
+	spin_unlock(&bucket->lock);
+	atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+
+	return entry;
+}
+
+/*
+ * Drop a slot's reference. Returns true if the object is still used by
+ * other slots, in which case the caller must not free the handle.
+ */
+bool zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	struct zram_dedup_bucket *bucket = zram_dedup_bucket(zram,
+							      entry->checksum);
+	unsigned int len = entry->len;
+
+	spin_lock(&bucket->lock);
+	if (--entry->refcount) {
+		spin_unlock(&bucket->lock);
+		atomic64_sub(len, &zram->stats.dup_data_size);
+		atomic64_dec(&zram->stats.dup_pages);
+		return true;
+	}
+	hlist_del(&entry->node);
+	spin_unlock(&bucket->lock);
+
+	atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	kfree(entry);
+
+	return false;
+}
+
+int zram_dedup_init(struct zram *zram, size_t num_pages)
+{
+	unsigned long nr_buckets;
+	unsigned long i;
+
+	/* one bucket per 64 pages keeps the chains short */
+	nr_buckets = roundup_pow_of_two(max_t(size_t, num_pages >> 6, 1));
+	zram->dedup_table = kvmalloc_array(nr_buckets,
+					   sizeof(*zram->dedup_table),
+					   GFP_KERNEL);
+	if (!zram->dedup_table)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_buckets; i++) {
+		spin_lock_init(&zram->dedup_table[i].lock);
+		INIT_HLIST_HEAD(&zram->dedup_table[i].head);
+	}
+	zram->dedup_mask = nr_buckets - 1;
+
+	return 0;
+}
+
+void zram_dedup_fini(struct zram *zram)
+{
+	kvfree(zram->dedup_table);
+	zram->dedup_table = NULL;
+	zram->dedup_mask = 0;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+struct zram;
+
+/*
+ * A compressed object that may be shared by several slots storing the
+ * same data. Slots referencing it keep the object's zsmalloc handle as
+ * usual and point to the entry through zram_table_entry.dedup.
+ */
+struct zram_dedup_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	unsigned int len;
+	u32 checksum;
+	unsigned long refcount;	/* protected by the bucket lock */
+};
+
+struct zram_dedup_bucket {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
+u32 zram_dedup_checksum(const void *mem, unsigned int len);
+struct zram_dedup_entry *zram_dedup_find(struct zram *zram, const void *mem,
+		unsigned int len, u32 checksum);
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		unsigned long handle, unsigned int len, u32 checksum);
+bool zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry);
+int zram_dedup_init(struct zram *zram, size_t num_pages);
+void zram_dedup_fini(struct zram *zram);
+#endif
+#endif
@@ -33,7 +33,9 @@
 #include <linux/debugfs.h>
 #include <linux/cpuhotplug.h>
 #include <linux/part_stat.h>
+#include <linux/wait_bit.h>
 #include <trace/hooks/mm.h>
+#include <kunit/visibility.h>
 
 #include "zram_drv.h"
 
@@ -99,6 +101,149 @@ static bool page_same_filled(void *ptr, unsigned long *element)
 	return true;
 }
 
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+/*
+ * Scans are done with memcmp() and memchr_inv(), which are vectorised by
+ * the arch code, rather than word by word.
+ */
+static bool page_pattern_periodic(void *ptr, struct zram_pattern *pat)
+{
+	unsigned long *page = ptr;
+	unsigned int period;
+
+	if (memcmp(page, page + ZRAM_PATTERN_MAX,
+		   PAGE_SIZE - ZRAM_PATTERN_MAX * sizeof(*page)))
+		return false;
+
+	/* The page repeats its first 8 words, look for a shorter period */
+	for (period = 2; period < ZRAM_PATTERN_MAX; period <<= 1) {
+		if (!memcmp(page, page + period,
+			    (ZRAM_PATTERN_MAX - period) * sizeof(*page)))
+			break;
+	}
+
+	pat->period = period;
+	pat->nr = period;
+	memcpy(pat->words, page, period * sizeof(*page));
+	return true;
+}
+
+static bool page_pattern_sparse(void *ptr, struct zram_pattern *pat)
+{
+	unsigned long *page = ptr;
+	unsigned int pos = 0, nr = 0;
+	void *found;
+
+	while ((found = memchr_inv(page + pos, 0,
+				   PAGE_SIZE - pos * sizeof(*page)))) {
+		if (nr == ZRAM_PATTERN_MAX)
+			return false;
+		pos = (found - ptr) / sizeof(*page);
+		pat->pos[nr] = pos;
+		pat->words[nr++] = page[pos++];
+	}
+
+	pat->period = 0;
+	pat->nr = nr;
+	return true;
+}
+
+/* Should be called after page_same_filled() */
+VISIBLE_IF_KUNIT bool page_pattern_filled(void *ptr, struct zram_pattern *pat)
+{
+	return page_pattern_periodic(ptr, pat) ||
+		page_pattern_sparse(ptr, pat);
+}
+EXPORT_SYMBOL_IF_KUNIT(page_pattern_filled);
+
+static unsigned int zram_pattern_size(struct zram_pattern *pat)
+{
+	return offsetof(struct zram_pattern, words) +
+		pat->nr * sizeof(pat->words[0]);
+}
+
+static void zram_fill_pattern(void *ptr, struct zram_pattern *pat)
+{
+	unsigned long *page = ptr;
+	unsigned int i;
+
+	if (!pat->period) {
+		memset(ptr, 0, PAGE_SIZE);
+		for (i = 0; i < pat->nr; i++)
+			page[pat->pos[i]] = pat->words[i];
+		return;
+	}
+
+	for (i = 0; i < PAGE_SIZE / sizeof(*page); i += pat->period)
+		memcpy(page + i, pat->words, pat->period * sizeof(*page));
+}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+/*
+ * 32 bytes out of every 256. With the 16 of the btrfs heuristic, random
+ * data scores only ~87% and stays below the default high threshold.
+ */
+#define ZRAM_ENTROPY_STEP	256
+#define ZRAM_ENTROPY_LEN	32
+#define ZRAM_ENTROPY_SAMPLES	(PAGE_SIZE / ZRAM_ENTROPY_STEP * ZRAM_ENTROPY_LEN)
+
+static DEFINE_PER_CPU(u16 [256], zram_entropy_hist);
+
+/* Integer log2 of n^4, to keep a few fractional bits */
+static inline u32 ilog2_w(u64 n)
+{
+	return ilog2(n * n * n * n);
+}
+
+/* Shannon entropy of a sample of the page, in percent of 8 bits per byte */
+VISIBLE_IF_KUNIT unsigned int zram_page_entropy(const u8 *mem)
+{
+	const u32 entropy_max = 8 * ilog2_w(2);
+	u32 sz_base = ilog2_w(ZRAM_ENTROPY_SAMPLES);
+	u32 entropy_sum = 0;
+	unsigned int i, j;
+	u16 *hist;
+
+	hist = get_cpu_ptr(zram_entropy_hist);
+	memset(hist, 0, 256 * sizeof(*hist));
+	for (i = 0; i < PAGE_SIZE; i += ZRAM_ENTROPY_STEP)
+		for (j = 0; j < ZRAM_ENTROPY_LEN; j++)
+			hist[mem[i + j]]++;
+
+	for (i = 0; i < 256; i++) {
+		if (hist[i])
+			entropy_sum += hist[i] * (sz_base - ilog2_w(hist[i]));
+	}
+	put_cpu_ptr(zram_entropy_hist);
+
+	entropy_sum /= ZRAM_ENTROPY_SAMPLES;
+	return entropy_sum * 100 / entropy_max;
+}
+EXPORT_SYMBOL_IF_KUNIT(zram_page_entropy);
+
+VISIBLE_IF_KUNIT enum zram_entropy_class zram_entropy_class(struct zram *zram,
+							    struct page *page)
+{
+	enum zram_entropy_class class = ZRAM_ENTROPY_LOW;
+	unsigned int entropy;
+	void *mem;
+
+	mem = kmap_atomic(page);
+	entropy = zram_page_entropy(mem);
+	kunmap_atomic(mem);
+
+	if (entropy >= READ_ONCE(zram->entropy_high))
+		class = ZRAM_ENTROPY_HIGH;
+	else if (entropy >= READ_ONCE(zram->entropy_low))
+		class = ZRAM_ENTROPY_MEDIUM;
+
+	atomic64_inc(&zram->stats.entropy_pages[class]);
+	return class;
+}
+EXPORT_SYMBOL_IF_KUNIT(zram_entropy_class);
+#endif
+
 static ssize_t initstate_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -562,6 +707,7 @@ static ssize_t writeback_store(struct device *dev,
 
 		if (zram_test_flag(zram, index, ZRAM_WB) ||
 				zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_PATTERN) ||
 				zram_test_flag(zram, index, ZRAM_UNDER_WB))
 			goto next;
 
@@ -995,6 +1141,134 @@ static ssize_t recomp_algorithm_store(struct device *dev,
 }
 #endif
 
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+static ssize_t multi_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int val;
+
+	down_read(&zram->init_lock);
+	val = zram->mp_max_pages;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", val);
+}
+
+static ssize_t multi_pages_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int val;
+
+	if (kstrtouint(buf, 10, &val))
+		return -EINVAL;
+
+	if (val && val != ZRAM_MP_MIN_PAGES && val != ZRAM_MP_MAX_PAGES)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change multi_pages for initialized device\n");
+		return -EBUSY;
+	}
+	zram->mp_max_pages = val;
+	up_write(&zram->init_lock);
+
+	return len;
+}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+static ssize_t async_write_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(zram->async_write));
+}
+
+static ssize_t async_write_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	if (val && !zram->comp_wq)
+		return -ENODEV;
+
+	WRITE_ONCE(zram->async_write, val);
+
+	return len;
+}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(zram->use_dedup));
+}
+
+/*
+ * Only new writes are affected. Objects already shared stay shared until
+ * the slots referencing them are freed.
+ */
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (kstrtobool(buf, &val))
+		return -EINVAL;
+
+	WRITE_ONCE(zram->use_dedup, val);
+
+	return len;
+}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+static ssize_t adaptive_comp_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u %u\n",
+			 READ_ONCE(zram->entropy_low),
+			 READ_ONCE(zram->entropy_high));
+}
+
+/*
+ * Takes the "low high" entropy thresholds in percent. Writing "100 101"
+ * sends every page to the primary algorithm.
+ */
+static ssize_t adaptive_comp_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	unsigned int low, high;
+
+	if (sscanf(buf, "%u %u", &low, &high) != 2)
+		return -EINVAL;
+
+	if (low > high || high > 101)
+		return -EINVAL;
+
+	WRITE_ONCE(zram->entropy_low, low);
+	WRITE_ONCE(zram->entropy_high, high);
+
+	return len;
+}
+#endif
+
 static ssize_t compact_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
@@ -1050,7 +1324,7 @@ static ssize_t mm_stat_show(struct device *dev,
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8lu %8llu %8llu",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
@@ -1060,64 +1334,521 @@ static ssize_t mm_stat_show(struct device *dev,
 			atomic_long_read(&pool_stats.pages_compacted),
 			(u64)atomic64_read(&zram->stats.huge_pages),
 			(u64)atomic64_read(&zram->stats.huge_pages_since));
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu %8llu",
+			(u64)atomic64_read(&zram->stats.periodic_pages),
+			(u64)atomic64_read(&zram->stats.sparse_pages));
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	/* units stored and pages in them; the rest are single pages */
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu %8llu",
+			(u64)atomic64_read(&zram->stats.mp_units),
+			(u64)atomic64_read(&zram->stats.mp_pages));
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu %8llu %8llu",
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.dup_pages),
+			(u64)atomic64_read(&zram->stats.meta_data_size));
+#endif
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\n");
 #ifdef CONFIG_ZRAM_EXT
 	ret += zram_error_count_show(zram, buf + ret, PAGE_SIZE - ret);
 #endif
 	up_read(&zram->init_lock);
 
-	return ret;
-}
+	return ret;
+}
+
+#ifdef CONFIG_VENDOR_ZRAM_WRITEBACK
+#ifndef CONFIG_ZRAM_EXT
+#define FOUR_K(x) ((x) * (1 << (PAGE_SHIFT - 12)))
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+		"%8llu %8llu %8llu\n",
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+#endif
+
+static ssize_t debug_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int version = 1;
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"version: %d\n%8llu %8llu %8llu %8llu %8llu",
+			version,
+			(u64)atomic64_read(&zram->stats.writestall),
+			(u64)atomic64_read(&zram->stats.miss_free),
+			(u64)atomic64_read(&zram->stats.stall_reserve),
+			(u64)atomic64_read(&zram->stats.stall_kept),
+			(u64)atomic64_read(&zram->stats.stall_recompress));
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, " %8llu %8llu",
+			(u64)atomic64_read(&zram->stats.mp_cache_hits),
+			(u64)atomic64_read(&zram->stats.mp_cache_misses));
+#endif
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\n");
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+/*
+ * First line: pages queued now, max pages queued, pages written
+ * asynchronously and reads which had to wait for a queued store.
+ * Second line: queue to store latency histogram, see async_lat_hist.
+ */
+static ssize_t async_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+	int i;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE, "%8d %8llu %8llu %8llu\n",
+			atomic_read(&zram->async_depth),
+			(u64)atomic64_read(&zram->stats.async_max_depth),
+			(u64)atomic64_read(&zram->stats.async_pages),
+			(u64)atomic64_read(&zram->stats.async_read_waits));
+	for (i = 0; i < ZRAM_ASYNC_LAT_BUCKETS; i++)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%8llu ",
+				(u64)atomic64_read(&zram->stats.async_lat_hist[i]));
+	ret += scnprintf(buf + ret, PAGE_SIZE - ret, "\n");
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+/* One line per entropy class: pages, then compression time in usec */
+static ssize_t adaptive_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret = 0;
+	int i;
+
+	for (i = 0; i < NR_ZRAM_ENTROPY_CLASSES; i++)
+		ret += scnprintf(buf + ret, PAGE_SIZE - ret, "%8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.entropy_pages[i]),
+			(u64)atomic64_read(&zram->stats.entropy_ns[i]) /
+			NSEC_PER_USEC);
+
+	return ret;
+}
+#endif
+
+static DEVICE_ATTR_RO(io_stat);
+static DEVICE_ATTR_RO(mm_stat);
+#ifdef CONFIG_VENDOR_ZRAM_WRITEBACK
+#ifdef CONFIG_ZRAM_EXT
+static DEVICE_ATTR_RW(bd_stat);
+#else
+static DEVICE_ATTR_RO(bd_stat);
+#endif
+#endif
+static DEVICE_ATTR_RO(debug_stat);
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+static DEVICE_ATTR_RO(async_stat);
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+static DEVICE_ATTR_RO(adaptive_stat);
+#endif
+
+static inline int zram_reserve_bucket(unsigned int size)
+{
+	return (size - 1) / ZRAM_RESERVE_GRAIN;
+}
+
+static void zram_reserve_refill(struct work_struct *work)
+{
+	struct zram_handle_reserve *r = container_of(work,
+			struct zram_handle_reserve, refill_work);
+	struct zram *zram = r->zram;
+	unsigned long handle;
+	int bucket;
+
+	for (bucket = 0; bucket < ZRAM_RESERVE_BUCKETS; bucket++) {
+		while (READ_ONCE(r->count[bucket]) < ZRAM_RESERVE_DEPTH) {
+			handle = zs_malloc(zram->mem_pool,
+					(bucket + 1) * ZRAM_RESERVE_GRAIN,
+					GFP_NOIO | __GFP_NOWARN |
+					__GFP_HIGHMEM | __GFP_MOVABLE |
+					__GFP_CMA);
+			if (IS_ERR_VALUE(handle))
+				return;
+
+			spin_lock(&r->lock);
+			if (r->count[bucket] < ZRAM_RESERVE_DEPTH) {
+				r->handles[bucket][r->count[bucket]++] = handle;
+				handle = 0;
+			}
+			spin_unlock(&r->lock);
+
+			if (handle)
+				zs_free(zram->mem_pool, handle);
+		}
+	}
+}
+
+/*
+ * Take an object for @size bytes from the reserve of this CPU. Should be
+ * called with the compression stream held, which pins the CPU.
+ */
+static unsigned long zram_reserve_get(struct zram *zram, unsigned int size)
+{
+	struct zram_handle_reserve *r = this_cpu_ptr(zram->reserve);
+	int bucket = zram_reserve_bucket(size);
+	unsigned long handle = -ENOMEM;
+
+	spin_lock(&r->lock);
+	if (r->count[bucket])
+		handle = r->handles[bucket][--r->count[bucket]];
+	spin_unlock(&r->lock);
+
+	if (!IS_ERR_VALUE(handle)) {
+		atomic64_inc(&zram->stats.stall_reserve);
+		queue_work(system_unbound_wq, &r->refill_work);
+	}
+	return handle;
+}
+
+static void zram_reserve_free(struct zram *zram)
+{
+	struct zram_handle_reserve *r;
+	int cpu, bucket;
+
+	for_each_possible_cpu(cpu) {
+		r = per_cpu_ptr(zram->reserve, cpu);
+		cancel_work_sync(&r->refill_work);
+		for (bucket = 0; bucket < ZRAM_RESERVE_BUCKETS; bucket++)
+			while (r->count[bucket])
+				zs_free(zram->mem_pool,
+					r->handles[bucket][--r->count[bucket]]);
+	}
+	free_percpu(zram->reserve);
+	zram->reserve = NULL;
+	mempool_destroy(zram->stash_pool);
+	zram->stash_pool = NULL;
+}
+
+static bool zram_reserve_alloc(struct zram *zram)
+{
+	struct zram_handle_reserve *r;
+	int cpu;
+
+	zram->reserve = alloc_percpu(struct zram_handle_reserve);
+	if (!zram->reserve)
+		return false;
+
+	zram->stash_pool = mempool_create_kmalloc_pool(ZRAM_STASH_POOL_SIZE,
+						       PAGE_SIZE);
+	if (!zram->stash_pool) {
+		free_percpu(zram->reserve);
+		zram->reserve = NULL;
+		return false;
+	}
+
+	for_each_possible_cpu(cpu) {
+		r = per_cpu_ptr(zram->reserve, cpu);
+		spin_lock_init(&r->lock);
+		INIT_WORK(&r->refill_work, zram_reserve_refill);
+		r->zram = zram;
+		queue_work(system_unbound_wq, &r->refill_work);
+	}
+	return true;
+}
+
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+static inline unsigned int zram_mp_max_pages(struct zram *zram)
+{
+	return zram->mp_max_pages;
+}
+
+static void zram_mp_cache_free(struct zram *zram)
+{
+	int i;
+
+	if (!zram->mp_cache)
+		return;
+
+	for (i = 0; i < ZRAM_MP_CACHE_SIZE; i++)
+		vfree(zram->mp_cache[i].buffer);
+	kfree(zram->mp_cache);
+	zram->mp_cache = NULL;
+}
+
+static bool zram_mp_cache_alloc(struct zram *zram)
+{
+	int i;
+
+	if (!zram->mp_max_pages)
+		return true;
+
+	zram->mp_cache = kcalloc(ZRAM_MP_CACHE_SIZE, sizeof(*zram->mp_cache),
+				 GFP_KERNEL);
+	if (!zram->mp_cache)
+		return false;
+
+	for (i = 0; i < ZRAM_MP_CACHE_SIZE; i++) {
+		spin_lock_init(&zram->mp_cache[i].lock);
+		zram->mp_cache[i].buffer = vmalloc(zram->mp_max_pages << PAGE_SHIFT);
+		if (!zram->mp_cache[i].buffer) {
+			zram_mp_cache_free(zram);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Neighbouring units of a large folio land in different cache entries */
+static struct zram_mp_cache *zram_mp_cache_slot(struct zram *zram,
+						struct zram_mp_unit *unit)
+{
+	return &zram->mp_cache[(unit->index / unit->nr_pages) %
+			       ZRAM_MP_CACHE_SIZE];
+}
+
+/*
+ * Drop the reference of a member slot, freeing the unit with the last one.
+ * Caller should hold the slot lock of that member.
+ */
+static void zram_mp_put(struct zram *zram, struct zram_mp_unit *unit)
+{
+	struct zram_mp_cache *cache;
+	int i;
+
+	atomic64_dec(&zram->stats.mp_pages);
+	if (!atomic_dec_and_test(&unit->refcount))
+		return;
+
+	cache = zram_mp_cache_slot(zram, unit);
+	spin_lock(&cache->lock);
+	if (cache->unit == unit)
+		cache->unit = NULL;
+	spin_unlock(&cache->lock);
+
+	for (i = 0; i < unit->nr_objs; i++)
+		zs_free(zram->mem_pool, unit->handles[i]);
+
+	atomic64_sub(unit->comp_len, &zram->stats.compr_data_size);
+	atomic64_dec(&zram->stats.mp_units);
+	kfree(unit);
+}
+
+/*
+ * Reads a page of a multi-page unit. The whole unit is decompressed into
+ * the cache once, so that the sibling slots (typically read right after
+ * as part of the same large folio) are served by a memcpy.
+ * Corresponding ZRAM slot should be locked.
+ */
+static int zram_mp_read(struct zram *zram, struct page *page, u32 index)
+{
+	struct zram_mp_unit *unit;
+	struct zram_mp_cache *cache;
+	struct zcomp_strm *zstrm;
+	unsigned int size, off = 0;
+	void *src, *dst;
+	int i, ret;
+
+	unit = (struct zram_mp_unit *)zram_get_handle(zram, index);
+	cache = zram_mp_cache_slot(zram, unit);
+
+	spin_lock(&cache->lock);
+	if (cache->unit == unit) {
+		atomic64_inc(&zram->stats.mp_cache_hits);
+		goto copy;
+	}
+
+	cache->unit = NULL;
+	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
+	for (i = 0; i < unit->nr_objs; i++) {
+		size = min_t(unsigned int, unit->comp_len - off, PAGE_SIZE);
+		src = zs_map_object(zram->mem_pool, unit->handles[i], ZS_MM_RO);
+		memcpy(zstrm->mp_buffer + off, src, size);
+		zs_unmap_object(zram->mem_pool, unit->handles[i]);
+		off += size;
+	}
+	ret = zcomp_decompress_multi(zstrm, unit->comp_len, cache->buffer,
+				     unit->nr_pages);
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+	/* Should NEVER happen. */
+	if (unlikely(ret)) {
+		spin_unlock(&cache->lock);
+		pr_err("%s Decompression failed! err=%d, index=%u, unit=%u+%u, len=%u\n",
+			zram->comps[ZRAM_PRIMARY_COMP]->name, ret, index,
+			unit->index, unit->nr_pages, unit->comp_len);
+#ifdef CONFIG_ZRAM_EXT
+		zram_error_count_store(zram, ERR_TYPE1);
+#endif
+		return ret;
+	}
+	cache->unit = unit;
+	atomic64_inc(&zram->stats.mp_cache_misses);
+copy:
+	dst = kmap_atomic(page);
+	memcpy(dst, cache->buffer + ((index - unit->index) << PAGE_SHIFT),
+	       PAGE_SIZE);
+	kunmap_atomic(dst);
+	spin_unlock(&cache->lock);
+
+	return 0;
+}
+
+/*
+ * Returns the size of the unit that can be built from the bio at @index,
+ * trying the largest one first, or 0 if the pages should go one by one.
+ */
+static unsigned int zram_mp_unit_pages(struct zram *zram,
+				       struct bvec_iter *iter,
+				       u32 index, u32 offset)
+{
+	unsigned int nr_pages;
+
+	if (!zram->mp_max_pages || offset)
+		return 0;
+
+	for (nr_pages = zram->mp_max_pages; nr_pages >= ZRAM_MP_MIN_PAGES;
+	     nr_pages /= ZRAM_MP_MIN_PAGES) {
+		if (IS_ALIGNED(index, nr_pages) &&
+		    iter->bi_size >= nr_pages << PAGE_SHIFT)
+			return nr_pages;
+	}
+	return 0;
+}
+
+/*
+ * Compress @nr_pages full pages of @bio, starting at slot @index, as one
+ * unit. Any error means that the unit did not pay off (or could not be
+ * stored without sleeping) and the caller should store the pages one by
+ * one instead, which has its own slow path.
+ */
+static int zram_mp_write(struct zram *zram, struct bio *bio,
+			 struct bvec_iter iter, u32 index,
+			 unsigned int nr_pages)
+{
+	struct zram_mp_unit *unit;
+	struct zcomp_strm *zstrm;
+	unsigned int comp_len, nr_objs, size, off = 0;
+	unsigned long alloced_pages;
+	void *dst;
+	int i, ret;
+
+	unit = kmalloc(struct_size(unit, handles, nr_pages - 1),
+		       GFP_NOIO | __GFP_NOWARN);
+	if (!unit)
+		return -ENOMEM;
+
+	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
+	for (i = 0; i < nr_pages; i++) {
+		struct bio_vec bv = bio_iter_iovec(bio, iter);
+
+		if (bv.bv_len != PAGE_SIZE) {
+			ret = -EINVAL;
+			goto out_put;
+		}
+		memcpy_from_bvec(zstrm->mp_input + (i << PAGE_SHIFT), &bv);
+		bio_advance_iter_single(bio, &iter, PAGE_SIZE);
+	}
+
+	ret = zcomp_compress_multi(zstrm, nr_pages, &comp_len);
+	if (ret)
+		goto out_put;
+
+	/* Not worth it unless the unit saves at least one object */
+	nr_objs = DIV_ROUND_UP(comp_len, PAGE_SIZE);
+	if (nr_objs >= nr_pages) {
+		ret = -E2BIG;
+		goto out_put;
+	}
+
+	for (i = 0; i < nr_objs; i++) {
+		size = min_t(unsigned int, comp_len - off, PAGE_SIZE);
+		unit->handles[i] = zs_malloc(zram->mem_pool, size,
+				__GFP_KSWAPD_RECLAIM |
+				__GFP_NOWARN |
+				__GFP_HIGHMEM |
+				__GFP_MOVABLE |
+				__GFP_CMA);
+		if (IS_ERR_VALUE(unit->handles[i])) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+
+		dst = zs_map_object(zram->mem_pool, unit->handles[i], ZS_MM_WO);
+		memcpy(dst, zstrm->mp_buffer + off, size);
+		zs_unmap_object(zram->mem_pool, unit->handles[i]);
+		off += size;
+	}
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
 
-#ifdef CONFIG_VENDOR_ZRAM_WRITEBACK
-#ifndef CONFIG_ZRAM_EXT
-#define FOUR_K(x) ((x) * (1 << (PAGE_SHIFT - 12)))
-static ssize_t bd_stat_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
-{
-	struct zram *zram = dev_to_zram(dev);
-	ssize_t ret;
+	alloced_pages = zs_get_total_pages(zram->mem_pool);
+	update_used_max(zram, alloced_pages);
 
-	down_read(&zram->init_lock);
-	ret = scnprintf(buf, PAGE_SIZE,
-		"%8llu %8llu %8llu\n",
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_writes)));
-	up_read(&zram->init_lock);
+	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		while (i--)
+			zs_free(zram->mem_pool, unit->handles[i]);
+		kfree(unit);
+		return -ENOMEM;
+	}
 
-	return ret;
-}
-#endif
-#endif
+	atomic_set(&unit->refcount, nr_pages);
+	unit->index = index;
+	unit->nr_pages = nr_pages;
+	unit->nr_objs = nr_objs;
+	unit->comp_len = comp_len;
+	atomic64_add(comp_len, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.mp_units);
 
-static ssize_t debug_stat_show(struct device *dev,
-		struct device_attribute *attr, char *buf)
-{
-	int version = 1;
-	struct zram *zram = dev_to_zram(dev);
-	ssize_t ret;
+	for (i = 0; i < nr_pages; i++) {
+		zram_slot_lock(zram, index + i);
+		zram_free_page(zram, index + i);
+		zram_set_flag(zram, index + i, ZRAM_MULTI_PAGES);
+		zram_set_handle(zram, index + i, (unsigned long)unit);
+		zram_accessed(zram, index + i);
+		zram_slot_unlock(zram, index + i);
+	}
 
-	down_read(&zram->init_lock);
-	ret = scnprintf(buf, PAGE_SIZE,
-			"version: %d\n%8llu %8llu\n",
-			version,
-			(u64)atomic64_read(&zram->stats.writestall),
-			(u64)atomic64_read(&zram->stats.miss_free));
-	up_read(&zram->init_lock);
+	atomic64_add(nr_pages, &zram->stats.pages_stored);
+	atomic64_add(nr_pages, &zram->stats.mp_pages);
+	return 0;
 
+out_free:
+	while (i--)
+		zs_free(zram->mem_pool, unit->handles[i]);
+out_put:
+	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+	kfree(unit);
 	return ret;
 }
-
-static DEVICE_ATTR_RO(io_stat);
-static DEVICE_ATTR_RO(mm_stat);
-#ifdef CONFIG_VENDOR_ZRAM_WRITEBACK
-#ifdef CONFIG_ZRAM_EXT
-static DEVICE_ATTR_RW(bd_stat);
 #else
-static DEVICE_ATTR_RO(bd_stat);
-#endif
+static inline unsigned int zram_mp_max_pages(struct zram *zram)
+{
+	return 0;
+}
+
+static bool zram_mp_cache_alloc(struct zram *zram) { return true; };
+static void zram_mp_cache_free(struct zram *zram) {};
 #endif
-static DEVICE_ATTR_RO(debug_stat);
 
 static void zram_meta_free(struct zram *zram, u64 disksize)
 {
@@ -1128,6 +1859,11 @@ static void zram_meta_free(struct zram *zram, u64 disksize)
 	for (index = 0; index < num_pages; index++)
 		zram_free_page(zram, index);
 
+	zram_reserve_free(zram);
+	zram_mp_cache_free(zram);
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	zram_dedup_fini(zram);
+#endif
 	zs_destroy_pool(zram->mem_pool);
 	vfree(zram->table);
 }
@@ -1142,14 +1878,35 @@ static bool zram_meta_alloc(struct zram *zram, u64 disksize)
 		return false;
 
 	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
-	if (!zram->mem_pool) {
-		vfree(zram->table);
-		return false;
-	}
+	if (!zram->mem_pool)
+		goto out_free_table;
+
+	if (!zram_mp_cache_alloc(zram))
+		goto out_destroy_pool;
+
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	if (zram_dedup_init(zram, num_pages))
+		goto out_free_mp_cache;
+#endif
+
+	if (!zram_reserve_alloc(zram))
+		goto out_free_dedup;
 
 	if (!huge_class_size)
 		huge_class_size = zs_huge_class_size(zram->mem_pool);
 	return true;
+
+out_free_dedup:
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	zram_dedup_fini(zram);
+out_free_mp_cache:
+#endif
+	zram_mp_cache_free(zram);
+out_destroy_pool:
+	zs_destroy_pool(zram->mem_pool);
+out_free_table:
+	vfree(zram->table);
+	return false;
 }
 
 /*
@@ -1175,6 +1932,9 @@ void zram_free_page(struct zram *zram, size_t index)
 	if (zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
 		zram_clear_flag(zram, index, ZRAM_INCOMPRESSIBLE);
 
+	if (zram_test_flag(zram, index, ZRAM_READAHEAD))
+		zram_clear_flag(zram, index, ZRAM_READAHEAD);
+
 	zram_set_priority(zram, index, 0);
 
 	if (zram_test_flag(zram, index, ZRAM_WB)) {
@@ -1183,6 +1943,28 @@ void zram_free_page(struct zram *zram, size_t index)
 		goto out;
 	}
 
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	if (zram_test_flag(zram, index, ZRAM_MULTI_PAGES)) {
+		zram_clear_flag(zram, index, ZRAM_MULTI_PAGES);
+		zram_mp_put(zram, (struct zram_mp_unit *)zram_get_handle(zram, index));
+		goto out;
+	}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	/* The object is freed below like a compressed one */
+	if (zram_test_flag(zram, index, ZRAM_PATTERN)) {
+		struct zram_pattern *pat;
+
+		handle = zram_get_handle(zram, index);
+		pat = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+		atomic64_dec(pat->period ? &zram->stats.periodic_pages :
+					   &zram->stats.sparse_pages);
+		zs_unmap_object(zram->mem_pool, handle);
+		zram_clear_flag(zram, index, ZRAM_PATTERN);
+	}
+#endif
+
 	/*
 	 * No memory is allocated for same element filled pages.
 	 * Simply clear same page flag.
@@ -1197,6 +1979,17 @@ void zram_free_page(struct zram *zram, size_t index)
 	if (!handle)
 		return;
 
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	if (zram->table[index].dedup) {
+		bool shared = zram_dedup_put(zram, zram->table[index].dedup);
+
+		zram->table[index].dedup = NULL;
+		/* The object stays with the other slots sharing it */
+		if (shared)
+			goto out;
+	}
+#endif
+
 	zs_free(zram->mem_pool, handle);
 
 	atomic64_sub(zram_get_obj_size(zram, index),
@@ -1206,7 +1999,8 @@ out:
 	zram_set_handle(zram, index, 0);
 	zram_set_obj_size(zram, index, 0);
 	WARN_ON_ONCE(zram->table[index].flags &
-		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB));
+		~(1UL << ZRAM_LOCK | 1UL << ZRAM_UNDER_WB |
+		  1UL << ZRAM_UNDER_COMP));
 }
 
 /*
@@ -1223,6 +2017,27 @@ static int zram_read_from_zspool(struct zram *zram, struct page *page,
 	u32 prio;
 	int ret;
 
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	if (zram_test_flag(zram, index, ZRAM_MULTI_PAGES))
+		return zram_mp_read(zram, page, index);
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	if (zram_test_flag(zram, index, ZRAM_PATTERN)) {
+		struct zram_pattern pat;
+
+		handle = zram_get_handle(zram, index);
+		src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
+		memcpy(&pat, src, zram_get_obj_size(zram, index));
+		zs_unmap_object(zram->mem_pool, handle);
+
+		dst = kmap_atomic(page);
+		zram_fill_pattern(dst, &pat);
+		kunmap_atomic(dst);
+		return 0;
+	}
+#endif
+
 	handle = zram_get_handle(zram, index);
 	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
 		unsigned long value;
@@ -1267,6 +2082,63 @@ static int zram_read_from_zspool(struct zram *zram, struct page *page,
 	return ret;
 }
 
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+/*
+ * A read must not see the data older than a write which was submitted
+ * before it, so wait for the queued store of the slot to be done.
+ */
+static void zram_async_wait(struct zram *zram, u32 index)
+{
+	unsigned long *flags = &zram->table[index].flags;
+
+	if (likely(!test_bit(ZRAM_UNDER_COMP, flags)))
+		return;
+
+	atomic64_inc(&zram->stats.async_read_waits);
+	wait_var_event(&zram->async_depth, !test_bit(ZRAM_UNDER_COMP, flags));
+}
+
+/*
+ * A slot has at most one queued store, so that a later write can never be
+ * overwritten by an older one completing after it. Called from the
+ * submitter, which may sleep.
+ */
+static void zram_async_claim(struct zram *zram, u32 index)
+{
+	unsigned long *flags = &zram->table[index].flags;
+
+	for (;;) {
+		zram_slot_lock(zram, index);
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_COMP)) {
+			zram_set_flag(zram, index, ZRAM_UNDER_COMP);
+			zram_slot_unlock(zram, index);
+			return;
+		}
+		zram_slot_unlock(zram, index);
+		wait_var_event(&zram->async_depth,
+			       !test_bit(ZRAM_UNDER_COMP, flags));
+	}
+}
+
+/* A synchronous write waits for the queued stores of its slots */
+static void zram_async_drain(struct zram *zram, struct bvec_iter iter)
+{
+	u32 index = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	u32 end = (iter.bi_sector + (iter.bi_size >> SECTOR_SHIFT) - 1) >>
+		  SECTORS_PER_PAGE_SHIFT;
+
+	if (!zram->comp_wq || !iter.bi_size)
+		return;
+
+	for (; index <= end; index++) {
+		unsigned long *flags = &zram->table[index].flags;
+
+		wait_var_event(&zram->async_depth,
+			       !test_bit(ZRAM_UNDER_COMP, flags));
+	}
+}
+#endif
+
 static int zram_read_page(struct zram *zram, struct page *page, u32 index,
 			  struct bio *parent)
 {
@@ -1275,9 +2147,18 @@ static int zram_read_page(struct zram *zram, struct page *page, u32 index,
 	unsigned long timeout = jiffies + usecs_to_jiffies(100);
 
 retry:
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	zram_async_wait(zram, index);
 #endif
 	zram_slot_lock(zram, index);
 	if (!zram_test_flag(zram, index, ZRAM_WB)) {
+#ifdef CONFIG_ZRAM_EXT
+		if (zram_test_flag(zram, index, ZRAM_READAHEAD)) {
+			zram_clear_flag(zram, index, ZRAM_READAHEAD);
+			zram_readahead_hit(zram);
+		}
+#endif
 		/* Slot should be locked through out the function call */
 		ret = zram_read_from_zspool(zram, page, index);
 		zram_slot_unlock(zram, index);
@@ -1335,9 +2216,24 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 	unsigned long handle = -ENOMEM;
 	unsigned int comp_len = 0;
 	void *src, *dst, *mem;
+	void *stash = NULL;
 	struct zcomp_strm *zstrm;
 	unsigned long element = 0;
 	enum zram_pageflags flags = 0;
+	u32 prio = ZRAM_PRIMARY_COMP;
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	struct zram_dedup_entry *entry = NULL;
+	bool use_dedup = READ_ONCE(zram->use_dedup);
+	u32 checksum = 0;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	struct zram_pattern pattern;
+	bool pattern_filled, pattern_stored = false;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	enum zram_entropy_class class;
+	u64 start;
+#endif
 
 	mem = kmap_atomic(page);
 	if (page_same_filled(mem, &element)) {
@@ -1347,16 +2243,74 @@ static int zram_write_page(struct zram *zram, struct page *page, u32 index)
 		atomic64_inc(&zram->stats.same_pages);
 		goto out;
 	}
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	pattern_filled = page_pattern_filled(mem, &pattern);
+#endif
 	kunmap_atomic(mem);
 
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	/*
+	 * The pattern is stored and accounted like a compressed object.
+	 * Compress the page anyway if there is no object for it right now.
+	 */
+	if (pattern_filled) {
+		comp_len = zram_pattern_size(&pattern);
+		handle = zs_malloc(zram->mem_pool, comp_len,
+				__GFP_KSWAPD_RECLAIM |
+				__GFP_NOWARN |
+				__GFP_HIGHMEM |
+				__GFP_MOVABLE |
+				__GFP_CMA);
+		if (!IS_ERR_VALUE(handle)) {
+			alloced_pages = zs_get_total_pages(zram->mem_pool);
+			update_used_max(zram, alloced_pages);
+
+			if (zram->limit_pages &&
+			    alloced_pages > zram->limit_pages) {
+				zs_free(zram->mem_pool, handle);
+				return -ENOMEM;
+			}
+
+			dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
+			memcpy(dst, &pattern, comp_len);
+			zs_unmap_object(zram->mem_pool, handle);
+			atomic64_add(comp_len, &zram->stats.compr_data_size);
+			atomic64_inc(pattern.period ? &zram->stats.periodic_pages :
+						      &zram->stats.sparse_pages);
+			pattern_stored = true;
+			goto out;
+		}
+		comp_len = 0;
+	}
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	class = zram_entropy_class(zram, page);
+	if (class == ZRAM_ENTROPY_MEDIUM && zram->comps[ZRAM_SECONDARY_COMP])
+		prio = ZRAM_SECONDARY_COMP;
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	/* Only objects of the primary algorithm are shared */
+	if (prio != ZRAM_PRIMARY_COMP)
+		use_dedup = false;
+#endif
+#endif
+
 compress_again:
-	zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
+	zstrm = zcomp_stream_get(zram->comps[prio]);
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	start = ktime_get_ns();
+	/* Likely incompressible, do not waste time trying */
+	if (class == ZRAM_ENTROPY_HIGH) {
+		comp_len = PAGE_SIZE;
+		goto compressed;
+	}
+#endif
 	src = kmap_atomic(page);
 	ret = zcomp_compress(zstrm, src, &comp_len);
 	kunmap_atomic(src);
 
 	if (unlikely(ret)) {
-		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+		zcomp_stream_put(zram->comps[prio]);
 		pr_err("Compression failed! err=%d\n", ret);
 		zs_free(zram->mem_pool, handle);
 		return ret;
@@ -1364,15 +2318,44 @@ compress_again:
 
 	if (comp_len >= huge_class_size)
 		comp_len = PAGE_SIZE;
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+compressed:
+	atomic64_add(ktime_get_ns() - start, &zram->stats.entropy_ns[class]);
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	if (use_dedup) {
+		src = zstrm->buffer;
+		if (comp_len == PAGE_SIZE)
+			src = kmap_atomic(page);
+		checksum = zram_dedup_checksum(src, comp_len);
+		entry = zram_dedup_find(zram, src, comp_len, checksum);
+		if (comp_len == PAGE_SIZE)
+			kunmap_atomic(src);
+
+		/* Share the existing object, nothing new to store */
+		if (entry) {
+			zcomp_stream_put(zram->comps[prio]);
+			if (!IS_ERR_VALUE(handle))
+				zs_free(zram->mem_pool, handle);
+			handle = entry->handle;
+			goto out;
+		}
+	}
+#endif
 	/*
-	 * handle allocation has 2 paths:
+	 * handle allocation has 3 paths:
 	 * a) fast path is executed with preemption disabled (for
 	 *  per-cpu streams) and has __GFP_DIRECT_RECLAIM bit clear,
 	 *  since we can't sleep;
-	 * b) slow path enables preemption and attempts to allocate
+	 * b) if that fails, an object is taken from the per-cpu reserve,
+	 *  which is refilled from a worker that may sleep;
+	 * c) slow path enables preemption and attempts to allocate
 	 *  the page with __GFP_DIRECT_RECLAIM bit set. we have to
-	 *  put per-cpu compression stream and, thus, to re-do
-	 *  the compression once handle is allocated.
+	 *  put per-cpu compression stream, so the compressed data is
+	 *  kept in a stash buffer meanwhile. only if there is none
+	 *  left we have to re-do the compression once handle is
+	 *  allocated.
 	 *
 	 * if we have a 'non-null' handle here then we are coming
 	 * from the slow path and handle has already been allocated.
@@ -1384,17 +2367,33 @@ compress_again:
 				__GFP_HIGHMEM |
 				__GFP_MOVABLE |
 				__GFP_CMA);
+	if (IS_ERR_VALUE(handle))
+		handle = zram_reserve_get(zram, comp_len);
 	if (IS_ERR_VALUE(handle)) {
-		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+		/* Incompressible data is copied from the page itself */
+		if (comp_len != PAGE_SIZE) {
+			stash = mempool_alloc(zram->stash_pool,
+					      GFP_NOWAIT | __GFP_NOWARN);
+			if (stash)
+				memcpy(stash, zstrm->buffer, comp_len);
+		}
+		zcomp_stream_put(zram->comps[prio]);
 		atomic64_inc(&zram->stats.writestall);
 		handle = zs_malloc(zram->mem_pool, comp_len,
 				GFP_NOIO | __GFP_HIGHMEM |
 				__GFP_MOVABLE | __GFP_CMA);
-		if (IS_ERR_VALUE(handle))
+		if (IS_ERR_VALUE(handle)) {
+			if (stash)
+				mempool_free(stash, zram->stash_pool);
 			return PTR_ERR((void *)handle);
+		}
 
-		if (comp_len != PAGE_SIZE)
+		if (comp_len != PAGE_SIZE && !stash) {
+			atomic64_inc(&zram->stats.stall_recompress);
 			goto compress_again;
+		}
+		if (stash)
+			atomic64_inc(&zram->stats.stall_kept);
 		/*
 		 * If the page is not compressible, you need to acquire the
 		 * lock and execute the code below. The zcomp_stream_get()
@@ -1402,30 +2401,38 @@ compress_again:
 		 * zstrm buffer back. It is necessary that the dereferencing
 		 * of the zstrm variable below occurs correctly.
 		 */
-		zstrm = zcomp_stream_get(zram->comps[ZRAM_PRIMARY_COMP]);
+		zstrm = zcomp_stream_get(zram->comps[prio]);
 	}
 
 	alloced_pages = zs_get_total_pages(zram->mem_pool);
 	update_used_max(zram, alloced_pages);
 
 	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
-		zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+		zcomp_stream_put(zram->comps[prio]);
 		zs_free(zram->mem_pool, handle);
+		if (stash)
+			mempool_free(stash, zram->stash_pool);
 		return -ENOMEM;
 	}
 
 	dst = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
 
-	src = zstrm->buffer;
+	src = stash ?: zstrm->buffer;
 	if (comp_len == PAGE_SIZE)
 		src = kmap_atomic(page);
 	memcpy(dst, src, comp_len);
 	if (comp_len == PAGE_SIZE)
 		kunmap_atomic(src);
 
-	zcomp_stream_put(zram->comps[ZRAM_PRIMARY_COMP]);
+	zcomp_stream_put(zram->comps[prio]);
 	zs_unmap_object(zram->mem_pool, handle);
+	if (stash)
+		mempool_free(stash, zram->stash_pool);
 	atomic64_add(comp_len, &zram->stats.compr_data_size);
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	if (use_dedup)
+		entry = zram_dedup_insert(zram, handle, comp_len, checksum);
+#endif
 out:
 	/*
 	 * Free memory associated with this sector
@@ -1446,6 +2453,14 @@ out:
 	} else {
 		zram_set_handle(zram, index, handle);
 		zram_set_obj_size(zram, index, comp_len);
+		zram_set_priority(zram, index, prio);
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+		zram->table[index].dedup = entry;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+		if (pattern_stored)
+			zram_set_flag(zram, index, ZRAM_PATTERN);
+#endif
 	}
 	zram_slot_unlock(zram, index);
 
@@ -1728,6 +2743,8 @@ static ssize_t recompress_store(struct device *dev,
 		if (zram_test_flag(zram, index, ZRAM_WB) ||
 		    zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
 		    zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_PATTERN) ||
+		    zram_test_flag(zram, index, ZRAM_MULTI_PAGES) ||
 		    zram_test_flag(zram, index, ZRAM_INCOMPRESSIBLE))
 			goto next;
 
@@ -1819,23 +2836,37 @@ static void zram_bio_read(struct zram *zram, struct bio *bio)
 	bio_endio(bio);
 }
 
-static void zram_bio_write(struct zram *zram, struct bio *bio)
+/*
+ * Stores the part of @bio described by @iter.
+ * Returns 0 on success or the error of the first failed page.
+ */
+static int zram_bio_write_iter(struct zram *zram, struct bio *bio,
+			       struct bvec_iter iter)
 {
-	unsigned long start_time = bio_start_io_acct(bio);
-	struct bvec_iter iter = bio->bi_iter;
+	int ret;
 
 	do {
 		u32 index = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
 		u32 offset = (iter.bi_sector & (SECTORS_PER_PAGE - 1)) <<
 				SECTOR_SHIFT;
 		struct bio_vec bv = bio_iter_iovec(bio, iter);
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+		unsigned int nr_pages = zram_mp_unit_pages(zram, &iter,
+							   index, offset);
+
+		if (nr_pages &&
+		    !zram_mp_write(zram, bio, iter, index, nr_pages)) {
+			bio_advance_iter(bio, &iter, nr_pages << PAGE_SHIFT);
+			continue;
+		}
+#endif
 
 		bv.bv_len = min_t(u32, bv.bv_len, PAGE_SIZE - offset);
 
-		if (zram_bvec_write(zram, &bv, index, offset, bio) < 0) {
+		ret = zram_bvec_write(zram, &bv, index, offset, bio);
+		if (ret < 0) {
 			atomic64_inc(&zram->stats.failed_writes);
-			bio->bi_status = BLK_STS_IOERR;
-			break;
+			return ret;
 		}
 
 		zram_slot_lock(zram, index);
@@ -1845,6 +2876,144 @@ static void zram_bio_write(struct zram *zram, struct bio *bio)
 		bio_advance_iter_single(bio, &iter, bv.bv_len);
 	} while (iter.bi_size);
 
+	return 0;
+}
+
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+static void zram_async_update_max_depth(struct zram *zram, s64 depth)
+{
+	s64 cur_max = atomic64_read(&zram->stats.async_max_depth);
+
+	do {
+		if (cur_max >= depth)
+			return;
+	} while (!atomic64_try_cmpxchg(&zram->stats.async_max_depth,
+				       &cur_max, depth));
+}
+
+static void zram_async_account(struct zram *zram, ktime_t queued)
+{
+	s64 us = ktime_us_delta(ktime_get(), queued);
+	int bucket = 0;
+
+	if (us >= 16)
+		bucket = min_t(int, ilog2(us) - 3, ZRAM_ASYNC_LAT_BUCKETS - 1);
+	atomic64_inc(&zram->stats.async_lat_hist[bucket]);
+}
+
+static void zram_async_write_work(struct work_struct *work)
+{
+	struct zram_async_work *aw = container_of(work, struct zram_async_work,
+						  work);
+	struct zram_async_bio *ab = aw->ab;
+	struct zram *zram = aw->zram;
+	struct bio *bio = ab->bio;
+	u32 index = aw->iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	unsigned int i, nr_pages = aw->iter.bi_size >> PAGE_SHIFT;
+
+	if (zram_bio_write_iter(zram, bio, aw->iter))
+		WRITE_ONCE(bio->bi_status, BLK_STS_IOERR);
+
+	for (i = 0; i < nr_pages; i++) {
+		zram_slot_lock(zram, index + i);
+		zram_clear_flag(zram, index + i, ZRAM_UNDER_COMP);
+		zram_slot_unlock(zram, index + i);
+	}
+	atomic_sub(nr_pages, &zram->async_depth);
+	wake_up_var(&zram->async_depth);
+	zram_async_account(zram, aw->queued);
+
+	if (atomic_dec_and_test(&ab->pending)) {
+		bio_end_io_acct(bio, ab->start_time);
+		bio_endio(bio);
+		kfree(ab);
+	}
+}
+
+/*
+ * Split a page aligned write into batches and hand them over to the
+ * compression workers, so that the submitter (typically kswapd) can go on
+ * reclaiming while the other cores compress. The bio completes when the
+ * last batch is stored. Returns false if the bio should be written
+ * synchronously instead.
+ */
+static bool zram_async_write(struct zram *zram, struct bio *bio)
+{
+	struct bvec_iter iter = bio->bi_iter;
+	struct zram_async_bio *ab;
+	unsigned int i, nr_works, bytes;
+	u32 index, start, end;
+	ktime_t now;
+
+	if (!READ_ONCE(zram->async_write) || !zram->comp_wq)
+		return false;
+
+	/* Partial IO needs the read-modify-write of the sync path */
+	if (!IS_ALIGNED(iter.bi_sector, SECTORS_PER_PAGE) ||
+	    !IS_ALIGNED(iter.bi_size, PAGE_SIZE))
+		return false;
+
+	start = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	end = start + (iter.bi_size >> PAGE_SHIFT);
+	nr_works = DIV_ROUND_UP(end, ZRAM_ASYNC_BATCH) -
+		   start / ZRAM_ASYNC_BATCH;
+
+	ab = kmalloc(struct_size(ab, works, nr_works), GFP_NOIO | __GFP_NOWARN);
+	if (!ab)
+		return false;
+
+	ab->bio = bio;
+	ab->start_time = bio_start_io_acct(bio);
+	atomic_set(&ab->pending, nr_works);
+
+	for (index = start; index < end; index++)
+		zram_async_claim(zram, index);
+
+	now = ktime_get();
+	for (i = 0; i < nr_works; i++) {
+		struct zram_async_work *aw = &ab->works[i];
+
+		index = iter.bi_sector >> SECTORS_PER_PAGE_SHIFT;
+		bytes = min_t(unsigned int, iter.bi_size,
+			      (round_up(index + 1, ZRAM_ASYNC_BATCH) - index) <<
+			      PAGE_SHIFT);
+
+		INIT_WORK(&aw->work, zram_async_write_work);
+		aw->zram = zram;
+		aw->ab = ab;
+		aw->iter = iter;
+		aw->iter.bi_size = bytes;
+		aw->queued = now;
+		bio_advance_iter(bio, &iter, bytes);
+	}
+
+	atomic64_add(end - start, &zram->stats.async_pages);
+	zram_async_update_max_depth(zram,
+			atomic_add_return(end - start, &zram->async_depth));
+
+	/* ab may be gone as soon as the last work is queued */
+	for (i = 0; i < nr_works; i++)
+		queue_work(zram->comp_wq, &ab->works[i].work);
+
+	return true;
+}
+#endif
+
+static void zram_bio_write(struct zram *zram, struct bio *bio)
+{
+	unsigned long start_time;
+
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	if (zram_async_write(zram, bio))
+		return;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	zram_async_drain(zram, bio->bi_iter);
+#endif
+	start_time = bio_start_io_acct(bio);
+	if (zram_bio_write_iter(zram, bio, bio->bi_iter))
+		bio->bi_status = BLK_STS_IOERR;
+
 	bio_end_io_acct(bio, start_time);
 	bio_endio(bio);
 }
@@ -1919,6 +3088,11 @@ static void zram_reset_device(struct zram *zram)
 	set_capacity_and_notify(zram->disk, 0);
 	part_stat_set_all(zram->disk->part0, 0);
 
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	/* queued batches still store into the meta */
+	if (zram->comp_wq)
+		flush_workqueue(zram->comp_wq);
+#endif
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(zram, zram->disksize);
 	zram->disksize = 0;
@@ -1960,7 +3134,9 @@ static ssize_t disksize_store(struct device *dev,
 		if (!zram->comp_algs[prio])
 			continue;
 
-		comp = zcomp_create(zram->comp_algs[prio]);
+		comp = zcomp_create(zram->comp_algs[prio],
+				    prio == ZRAM_PRIMARY_COMP ?
+				    zram_mp_max_pages(zram) : 0);
 		if (IS_ERR(comp)) {
 			pr_err("Cannot initialise %s compressing backend\n",
 			       zram->comp_algs[prio]);
@@ -2065,6 +3241,18 @@ static DEVICE_ATTR_RW(writeback_limit_enable);
 static DEVICE_ATTR_RW(recomp_algorithm);
 static DEVICE_ATTR_WO(recompress);
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+static DEVICE_ATTR_RW(multi_pages);
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+static DEVICE_ATTR_RW(async_write);
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+static DEVICE_ATTR_RW(use_dedup);
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+static DEVICE_ATTR_RW(adaptive_comp);
+#endif
 
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
@@ -2093,6 +3281,20 @@ static struct attribute *zram_disk_attrs[] = {
 #ifdef CONFIG_VENDOR_ZRAM_MULTI_COMP
 	&dev_attr_recomp_algorithm.attr,
 	&dev_attr_recompress.attr,
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	&dev_attr_multi_pages.attr,
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	&dev_attr_async_write.attr,
+	&dev_attr_async_stat.attr,
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	&dev_attr_use_dedup.attr,
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	&dev_attr_adaptive_comp.attr,
+	&dev_attr_adaptive_stat.attr,
 #endif
 	NULL,
 };
@@ -2124,6 +3326,13 @@ static int zram_add(void)
 #ifdef CONFIG_ZRAM_EXT
 	spin_lock_init(&zram->refcount_lock);
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	zram->use_dedup = true;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	zram->entropy_low = ZRAM_ENTROPY_LOW_DEFAULT;
+	zram->entropy_high = ZRAM_ENTROPY_HIGH_DEFAULT;
+#endif
 
 	/* gendisk structure */
 	zram->disk = blk_alloc_disk(NUMA_NO_NODE);
@@ -2178,6 +3387,19 @@ static int zram_add(void)
 
 	comp_algorithm_set(zram, ZRAM_PRIMARY_COMP, default_compressor);
 
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	/*
+	 * Unbound so that the batches spread over the idle cores; WQ_SYSFS
+	 * allows to confine the workers to a cluster through the cpumask.
+	 */
+	zram->comp_wq = alloc_workqueue("%s_comp",
+			WQ_UNBOUND | WQ_HIGHPRI | WQ_MEM_RECLAIM | WQ_SYSFS,
+			0, zram->disk->disk_name);
+	if (!zram->comp_wq)
+		pr_warn("%s: async write is not available\n",
+			zram->disk->disk_name);
+#endif
+
 	zram_debugfs_register(zram);
 	pr_info("Added device: %s\n", zram->disk->disk_name);
 	return device_id;
@@ -2234,6 +3456,10 @@ static int zram_remove(struct zram *zram)
 	 */
 	zram_reset_device(zram);
 
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	if (zram->comp_wq)
+		destroy_workqueue(zram->comp_wq);
+#endif
 	put_disk(zram->disk);
 	kfree(zram);
 	return 0;
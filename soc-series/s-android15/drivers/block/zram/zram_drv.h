@@ -16,12 +16,14 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/rwsem.h>
+#include <linux/mempool.h>
 #include <linux/zsmalloc.h>
 #include <linux/crypto.h>
 #include <linux/sec_mm.h>
 
 #include "zcomp.h"
 #include "zram_ext.h"
+#include "zram_dedup.h"
 
 #define SECTORS_PER_PAGE_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
@@ -57,6 +59,10 @@ enum zram_pageflags {
 	ZRAM_HUGE,	/* Incompressible page */
 	ZRAM_IDLE,	/* not accessed page since last idle marking */
 	ZRAM_INCOMPRESSIBLE, /* none of the algorithms could compress it */
+	ZRAM_MULTI_PAGES,	/* page is part of a multi-page compression unit */
+	ZRAM_UNDER_COMP,	/* page is queued for async compression */
+	ZRAM_PATTERN,	/* page consists of a short pattern, not compressed */
+	ZRAM_READAHEAD,	/* moved back from backing_device, not read since */
 
 	ZRAM_COMP_PRIORITY_BIT1, /* First bit of comp priority index */
 	ZRAM_COMP_PRIORITY_BIT2, /* Second bit of comp priority index */
@@ -76,7 +82,110 @@ struct zram_table_entry {
 #ifdef CONFIG_VENDOR_ZRAM_MEMORY_TRACKING
 	ktime_t ac_time;
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	struct zram_dedup_entry *dedup;
+#endif
+};
+
+#define ZRAM_RESERVE_BUCKETS	8
+#define ZRAM_RESERVE_GRAIN	(PAGE_SIZE / ZRAM_RESERVE_BUCKETS)
+#define ZRAM_RESERVE_DEPTH	2
+#define ZRAM_STASH_POOL_SIZE	4
+
+/*
+ * Per-CPU zsmalloc objects allocated ahead of time, so that a write does
+ * not have to sleep when the non-blocking zs_malloc() fails. Bucket i
+ * holds objects of (i + 1) * ZRAM_RESERVE_GRAIN bytes.
+ */
+struct zram_handle_reserve {
+	spinlock_t lock;
+	u8 count[ZRAM_RESERVE_BUCKETS];
+	unsigned long handles[ZRAM_RESERVE_BUCKETS][ZRAM_RESERVE_DEPTH];
+	struct work_struct refill_work;
+	struct zram *zram;
+};
+
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+#define ZRAM_PATTERN_MAX	8
+
+/*
+ * A page repeating a run of 2, 4 or 8 words, or one which is zero except
+ * for up to ZRAM_PATTERN_MAX words. Slots with ZRAM_PATTERN set keep it in
+ * their zsmalloc object, up to the last valid word, instead of compressed
+ * data.
+ */
+struct zram_pattern {
+	u16 period;	/* repeat period in words, 0 for a sparse page */
+	u16 nr;		/* no. of valid words[] */
+	u16 pos[ZRAM_PATTERN_MAX];	/* word offsets of a sparse page */
+	unsigned long words[ZRAM_PATTERN_MAX];
+};
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+#define ZRAM_MP_MIN_PAGES	4U
+#define ZRAM_MP_MAX_PAGES	16U
+#define ZRAM_MP_CACHE_SIZE	4
+
+/*
+ * A run of contiguous slots compressed as one unit. Every member slot has
+ * ZRAM_MULTI_PAGES set and its handle pointing to the unit. The compressed
+ * data is split into page sized zsmalloc objects, which are freed when the
+ * last member slot goes away.
+ */
+struct zram_mp_unit {
+	atomic_t refcount;	/* no. of member slots still stored */
+	u32 index;		/* first slot of the unit */
+	u16 nr_pages;		/* no. of member slots */
+	u16 nr_objs;		/* no. of zsmalloc objects in handles[] */
+	u32 comp_len;		/* compressed size of the whole unit */
+	unsigned long handles[];
+};
+
+/* Decompressed copy of a recently read unit, serving its sibling slots */
+struct zram_mp_cache {
+	spinlock_t lock;
+	struct zram_mp_unit *unit;
+	void *buffer;
+};
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+/* Classes of the byte entropy estimate of a page, see zram_entropy_class() */
+enum zram_entropy_class {
+	ZRAM_ENTROPY_LOW,	/* compressed with the primary algorithm */
+	ZRAM_ENTROPY_MEDIUM,	/* compressed with the secondary algorithm */
+	ZRAM_ENTROPY_HIGH,	/* stored uncompressed */
+	NR_ZRAM_ENTROPY_CLASSES,
+};
+
+#define ZRAM_ENTROPY_LOW_DEFAULT	60
+#define ZRAM_ENTROPY_HIGH_DEFAULT	90
+#endif
+
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+/* A work item covers at most this many pages, aligned to the same size */
+#define ZRAM_ASYNC_BATCH	16U
+#define ZRAM_ASYNC_LAT_BUCKETS	12
+
+struct zram_async_bio;
+
+struct zram_async_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct zram_async_bio *ab;
+	struct bvec_iter iter;
+	ktime_t queued;
+};
+
+/* A write bio split into work items, completed by the last of them */
+struct zram_async_bio {
+	struct bio *bio;
+	unsigned long start_time;
+	atomic_t pending;
+	struct zram_async_work works[];
 };
+#endif
 
 #ifdef CONFIG_ZRAM_EXT
 enum zram_error_types {
@@ -99,6 +208,35 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t stall_reserve;	/* no. of stalls avoided by the reserve */
+	atomic64_t stall_kept;		/* no. of stalls without recompression */
+	atomic64_t stall_recompress;	/* no. of stalls with recompression */
+#ifdef CONFIG_VENDOR_ZRAM_PATTERN
+	atomic64_t periodic_pages;	/* no. of pages repeating a pattern */
+	atomic64_t sparse_pages;	/* no. of mostly zero pages */
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	atomic64_t mp_units;		/* no. of multi-page units stored */
+	atomic64_t mp_pages;		/* no. of pages stored in units */
+	atomic64_t mp_cache_hits;	/* no. of unit reads served cached */
+	atomic64_t mp_cache_misses;	/* no. of unit decompressions */
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	atomic64_t entropy_pages[NR_ZRAM_ENTROPY_CLASSES];
+	atomic64_t entropy_ns[NR_ZRAM_ENTROPY_CLASSES];	/* compression time */
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	atomic64_t async_pages;		/* no. of pages written asynchronously */
+	atomic64_t async_max_depth;	/* max no. of pages queued at once */
+	atomic64_t async_read_waits;	/* no. of reads waiting for a store */
+	/* queue to store latency, bucket i: [8 << i, 16 << i) usec */
+	atomic64_t async_lat_hist[ZRAM_ASYNC_LAT_BUCKETS];
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	atomic64_t dup_data_size;	/* compressed size saved by dedup */
+	atomic64_t dup_pages;		/* no. of pages sharing an object */
+	atomic64_t meta_data_size;	/* size of the dedup entries */
+#endif
 #ifdef	CONFIG_VENDOR_ZRAM_WRITEBACK
 	atomic64_t bd_count;		/* no. of pages in backing device */
 	atomic64_t bd_reads;		/* no. of reads from backing device */
@@ -111,6 +249,9 @@ struct zram_stats {
 	atomic64_t bd_max_size;
 	atomic64_t bd_objreads;
 	atomic64_t bd_objwrites;
+	atomic64_t bd_ra_pages;		/* no. of pages moved back by readahead */
+	atomic64_t bd_ra_hits;		/* no. of them read before being freed */
+	atomic64_t bd_compacted;	/* no. of sparse chunks rewritten */
 	atomic64_t error_count[NR_ERR_TYPES];
 #endif
 };
@@ -128,6 +269,9 @@ struct zram_stats {
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
+	struct zram_handle_reserve __percpu *reserve;
+	/* keeps compressed data alive across a sleeping zs_malloc() */
+	mempool_t *stash_pool;
 	struct zcomp *comps[ZRAM_MAX_COMPS];
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
@@ -161,6 +305,26 @@ struct zram {
 #ifdef CONFIG_VENDOR_ZRAM_MEMORY_TRACKING
 	struct dentry *debugfs_dir;
 #endif
+#ifdef CONFIG_VENDOR_ZRAM_MULTI_PAGES
+	/* largest multi-page unit to build, 0 if disabled */
+	unsigned int mp_max_pages;
+	struct zram_mp_cache *mp_cache;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ADAPTIVE_COMP
+	/* entropy thresholds in percent, pages at or above are medium/high */
+	unsigned int entropy_low;
+	unsigned int entropy_high;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_ASYNC_WRITE
+	struct workqueue_struct *comp_wq;
+	atomic_t async_depth;	/* no. of pages queued, also the wait var */
+	bool async_write;
+#endif
+#ifdef CONFIG_VENDOR_ZRAM_DEDUP
+	struct zram_dedup_bucket *dedup_table;
+	unsigned long dedup_mask;
+	bool use_dedup;
+#endif
 #ifdef CONFIG_ZRAM_EXT
 	struct task_struct *prefetchd;
 	struct list_head prefetch_list;
@@ -175,7 +339,12 @@ struct zram {
 	unsigned long *falloc_bitmap;
 	unsigned long *read_bitmap;
 	u16 *refcount_table;
+	struct zram_chunk_stat *chunk_stat;
+	u32 wb_pass;
 	atomic_t nr_prefetch;
+	spinlock_t ra_lock;
+	struct zram_ra_state ra_state[1 << ZRAM_RA_HASH_BITS];
+	struct work_struct compact_work;
 #endif
 };
 
@@ -263,7 +432,9 @@ static inline bool zram_allocated(struct zram *zram, u32 index)
 {
 	return zram_get_obj_size(zram, index) ||
 			zram_test_flag(zram, index, ZRAM_SAME) ||
-			zram_test_flag(zram, index, ZRAM_WB);
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_MULTI_PAGES) ||
+			zram_test_flag(zram, index, ZRAM_PATTERN);
 }
 
 static inline void zram_set_priority(struct zram *zram, u32 index, u32 prio)
@@ -10,6 +10,7 @@
 #include <linux/bitops.h>
 #include <linux/blkdev.h>
 #include <linux/freezer.h>
+#include <linux/hash.h>
 #include <linux/highmem.h>
 #include <linux/kernel.h>
 #include <linux/loop.h>
@@ -41,11 +42,14 @@ retry:
 	return chunk_idx;
 }
 
-static void free_chunk_bdev(struct zram *zram, unsigned long chunk_idx)
+static void free_chunk_bdev(struct zram *zram, unsigned long chunk_idx,
+		int size)
 {
 	unsigned long flags;
 
 	spin_lock_irqsave(&zram->refcount_lock, flags);
+	if (zram->chunk_stat)
+		zram->chunk_stat[chunk_idx].live -= size;
 	if (zram->refcount_table && !--zram->refcount_table[chunk_idx]) {
 		clear_bit(chunk_idx, zram->chunk_bitmap);
 		atomic64_sub(NR_ZWBS, &zram->stats.bd_count);
@@ -61,7 +65,7 @@ void free_block_bdev(struct zram *zram, unsigned long handle)
 		atomic64_sub(size, &zram->stats.bd_size);
 		atomic64_dec(&zram->stats.bd_objcnt);
 	}
-	free_chunk_bdev(zram, blk_to_chunk_idx(handle >> IDX_SHIFT));
+	free_chunk_bdev(zram, blk_to_chunk_idx(handle >> IDX_SHIFT), size);
 }
 
 static void pin_chunk_bdev(struct zram *zram, unsigned long chunk_idx)
@@ -76,7 +80,7 @@ static void pin_chunk_bdev(struct zram *zram, unsigned long chunk_idx)
 
 static void unpin_chunk_bdev(struct zram *zram, unsigned long chunk_idx)
 {
-	free_chunk_bdev(zram, chunk_idx);
+	free_chunk_bdev(zram, chunk_idx, 0);
 }
 
 static void copy_to_buf(struct page **pages, void *dst,
@@ -230,7 +234,8 @@ static int zram_hook_read_work(struct zram *zram, struct page *page,
 }
 
 static void zram_move_entry(struct zram *zram, struct page **pages,
-		int idx, unsigned long blk_idx, int offset, int size, u32 index)
+		int idx, unsigned long blk_idx, int offset, int size, u32 index,
+		bool readahead)
 {
 	unsigned long handle = -ENOMEM;
 	unsigned long expected = to_handle(blk_idx + idx, offset, size);
@@ -273,12 +278,20 @@ retry:
 		zram_set_flag(zram, index, ZRAM_HUGE);
 		atomic64_inc(&zram->stats.huge_pages);
 	}
+	if (readahead) {
+		zram_set_flag(zram, index, ZRAM_READAHEAD);
+		atomic64_inc(&zram->stats.bd_ra_pages);
+	}
 	zram_slot_unlock(zram, index);
 	atomic64_inc(&zram->stats.pages_stored);
 }
 
+/*
+ * Entries further than @window slots from @fault_index are left on the
+ * backing device, unless the window is ZRAM_RA_MAX_WINDOW.
+ */
 static void zram_move_to_zspool(struct zram *zram, struct page **pages,
-				unsigned long blk_idx)
+		unsigned long blk_idx, u32 fault_index, unsigned int window)
 {
 	struct zram_wb_header *zhdr;
 	int size, offset = 0, idx = 0;
@@ -305,7 +318,12 @@ static void zram_move_to_zspool(struct zram *zram, struct page **pages,
 			break;
 
 		/* store entry in zspool */
-		zram_move_entry(zram, pages, idx, blk_idx, offset, size, index);
+		if (window >= ZRAM_RA_MAX_WINDOW ||
+				abs((long)index - (long)fault_index) <= window)
+			zram_move_entry(zram, pages, idx, blk_idx, offset,
+					size, index,
+					fault_index != UINT_MAX &&
+					index != fault_index);
 
 		offset += (size + header_sz);
 		idx += (offset / PAGE_SIZE);
@@ -339,7 +357,9 @@ static void zram_read_done_work(struct work_struct *work)
 	}
 
 	if (!errno)
-		zram_move_to_zspool(zram, zw->src_page, blk_idx);
+		zram_move_to_zspool(zram, zw->src_page, blk_idx,
+				    dst_page ? zw->index : UINT_MAX,
+				    zw->ra_window);
 	clear_bit(chunk_idx, zram->read_bitmap);
 	zram_free_read_work(zram, zw, chunk_idx);
 	unpin_chunk_bdev(zram, chunk_idx);
@@ -363,8 +383,54 @@ static void zram_read_end_io(struct bio *bio)
 	schedule_work(&zw->work);
 }
 
+static struct zram_ra_state *zram_ra_state(struct zram *zram)
+{
+	return &zram->ra_state[hash_32(current->tgid, ZRAM_RA_HASH_BITS)];
+}
+
+/* Called for every chunk read on a fault, returns the readahead window */
+static unsigned int zram_ra_window(struct zram *zram)
+{
+	struct zram_ra_state *ra;
+	unsigned int window;
+
+	spin_lock(&zram->ra_lock);
+	ra = zram_ra_state(zram);
+	if (ra->tgid != current->tgid) {
+		/* Start from moving the whole chunk back */
+		ra->tgid = current->tgid;
+		ra->window = ZRAM_RA_MAX_WINDOW;
+	} else if (ra->hits) {
+		ra->window = min(ra->window * 2, ZRAM_RA_MAX_WINDOW);
+	} else {
+		ra->window = max(ra->window / 2, ZRAM_RA_MIN_WINDOW);
+	}
+	ra->hits = 0;
+	window = ra->window;
+	spin_unlock(&zram->ra_lock);
+
+	return window;
+}
+
+/*
+ * A slot moved back by readahead is read. Only the faulting slot would have
+ * been moved back without readahead, so this read would have gone to the
+ * backing device.
+ */
+void zram_readahead_hit(struct zram *zram)
+{
+	struct zram_ra_state *ra;
+
+	atomic64_inc(&zram->stats.bd_ra_hits);
+	spin_lock(&zram->ra_lock);
+	ra = zram_ra_state(zram);
+	if (ra->tgid == current->tgid && ra->hits < U16_MAX)
+		ra->hits++;
+	spin_unlock(&zram->ra_lock);
+}
+
 static bool zram_read_from_bdev(struct zram *zram, struct page *page,
-		unsigned long handle, struct bio *parent)
+		unsigned long handle, u32 index, struct bio *parent)
 {
 	struct zram_wb_work *zw;
 	struct bio *bio;
@@ -384,6 +450,9 @@ static bool zram_read_from_bdev(struct zram *zram, struct page *page,
 	zw->zram = zram;
 	zw->bio = bio;
 	zw->handle = handle;
+	zw->index = index;
+	/* prefetch requests move the whole chunk back */
+	zw->ra_window = page ? zram_ra_window(zram) : ZRAM_RA_MAX_WINDOW;
 	zw->nr_waits = 1;
 	bio->bi_end_io = zram_read_end_io;
 	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
@@ -438,7 +507,7 @@ int try_read_from_bdev(struct zram *zram, struct page *page,
 		return ret;
 	}
 	zram_slot_unlock(zram, index);
-	if (!zram_read_from_bdev(zram, page, handle, parent)) {
+	if (!zram_read_from_bdev(zram, page, handle, index, parent)) {
 		clear_bit(chunk_idx, zram->read_bitmap);
 		unpin_chunk_bdev(zram, chunk_idx);
 		return -EBUSY;
@@ -607,29 +676,66 @@ static void mark_end_of_page(struct zram_wb_buffer *buf)
 	}
 }
 
-static int zram_writeback_fill_page(struct zram *zram,
-		struct zram_wb_buffer *buf, u32 index)
+static void zram_writeback_copy(struct zram_wb_buffer *buf, u32 index,
+		void *src, int size)
 {
 	struct zram_wb_header *zhdr;
-	unsigned long handle;
 	int idx = buf->idx;
 	int offset = buf->off[idx];
-	int size, sizes[2];
 	int header_sz = sizeof(struct zram_wb_header);
-	void *src, *dst;
+	int sizes[2];
+	void *dst;
+
+	dst = kmap_atomic(buf->page[idx]);
+	zhdr = (struct zram_wb_header *)(dst + offset);
+	zhdr->index = index;
+	zhdr->size = size;
+	dst = (u8 *)(zhdr + 1);
+
+	if (offset + header_sz + size > PAGE_SIZE) {
+		sizes[0] = PAGE_SIZE - (offset + header_sz);
+		sizes[1] = size - sizes[0];
+		memcpy(dst, src, sizes[0]);
+		kunmap_atomic(dst);
+		dst = kmap_atomic(buf->page[idx + 1]);
+		memcpy(dst, src + sizes[0], sizes[1]);
+		buf->off[idx + 1] = sizes[1];
+	} else {
+		memcpy(dst, src, size);
+	}
+	kunmap_atomic(dst);
+}
+
+static inline bool zram_writeback_full(struct zram_wb_buffer *buf, int size)
+{
+	int idx = buf->idx;
+	int offset = buf->off[idx];
+	int header_sz = sizeof(struct zram_wb_header);
+
+	return (idx == NR_ZWBS - 1 && offset + header_sz + size > PAGE_SIZE) ||
+		offset + header_sz > PAGE_SIZE;
+}
+
+static int zram_writeback_fill_page(struct zram *zram,
+		struct zram_wb_buffer *buf, u32 index)
+{
+	unsigned long handle;
+	int size;
+	void *src;
 
 	zram_slot_lock(zram, index);
 	if (!zram_allocated(zram, index) ||
 			!zram_test_flag(zram, index, ZRAM_IDLE) ||
 			zram_test_flag(zram, index, ZRAM_WB) ||
 			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_PATTERN) ||
+			zram_test_flag(zram, index, ZRAM_MULTI_PAGES) ||
 			zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
 		zram_slot_unlock(zram, index);
 		return 0;
 	}
 	size = zram_get_obj_size(zram, index);
-	if ((idx == NR_ZWBS - 1 && offset + header_sz + size > PAGE_SIZE) ||
-			offset + header_sz > PAGE_SIZE) {
+	if (zram_writeback_full(buf, size)) {
 		zram_slot_unlock(zram, index);
 		return -ENOSPC;
 	}
@@ -649,24 +755,7 @@ static int zram_writeback_fill_page(struct zram *zram,
 		return -ENOENT;
 	}
 	src = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
-	dst = kmap_atomic(buf->page[idx]);
-	zhdr = (struct zram_wb_header *)(dst + offset);
-	zhdr->index = index;
-	zhdr->size = size;
-	dst = (u8 *)(zhdr + 1);
-
-	if (offset + header_sz + size > PAGE_SIZE) {
-		sizes[0] = PAGE_SIZE - (offset + header_sz);
-		sizes[1] = size - sizes[0];
-		memcpy(dst, src, sizes[0]);
-		kunmap_atomic(dst);
-		dst = kmap_atomic(buf->page[idx + 1]);
-		memcpy(dst, src + sizes[0], sizes[1]);
-		buf->off[idx + 1] = sizes[1];
-	} else {
-		memcpy(dst, src, size);
-	}
-	kunmap_atomic(dst);
+	zram_writeback_copy(buf, index, src, size);
 	check_marker(zram, NULL, 0, src, size, index);
 	zs_unmap_object(zram->mem_pool, handle);
 	zram_slot_unlock(zram, index);
@@ -674,6 +763,36 @@ static int zram_writeback_fill_page(struct zram *zram,
 	return size;
 }
 
+/*
+ * Same as zram_writeback_fill_page, but for an object of a sparse chunk
+ * which was read to @src, if the slot still points to it at @handle.
+ */
+static int zram_compact_fill_page(struct zram *zram,
+		struct zram_wb_buffer *buf, u32 index,
+		void *src, unsigned long handle)
+{
+	int size = handle & (PAGE_SIZE - 1) ? : PAGE_SIZE;
+
+	zram_slot_lock(zram, index);
+	if (!zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+			zram_get_element(zram, index) != handle) {
+		zram_slot_unlock(zram, index);
+		return 0;
+	}
+	if (zram_writeback_full(buf, size)) {
+		zram_slot_unlock(zram, index);
+		return -ENOSPC;
+	}
+	/* zram_writeback_done frees the old location */
+	zram_set_flag(zram, index, ZRAM_UNDER_WB);
+	zram_set_flag(zram, index, ZRAM_IDLE);
+	zram_writeback_copy(buf, index, src, size);
+	zram_slot_unlock(zram, index);
+
+	return size;
+}
+
 static void zram_clear_flags(struct zram *zram, struct zram_wb_buffer *buf)
 {
 	int i, j;
@@ -727,7 +846,7 @@ static void zram_writeback_done(struct zram *zram, struct zram_wb_entry *entry,
 		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 		zram_clear_flag(zram, index, ZRAM_IDLE);
 		atomic64_dec(&zram->stats.bd_objcnt);
-		free_chunk_bdev(zram, blk_to_chunk_idx(blk_idx));
+		free_chunk_bdev(zram, blk_to_chunk_idx(blk_idx), size);
 		zram_slot_unlock(zram, index);
 		return;
 	}
@@ -747,19 +866,25 @@ static void zram_writeback_done_work(struct work_struct *work)
 	struct zram_wb_buffer *buf = zw->buf;
 	struct zram *zram = zw->zram;
 	unsigned long blk_idx = zw->handle;
+	unsigned long chunk_idx = blk_to_chunk_idx(blk_idx);
 	unsigned long flags;
-	int count = 0;
+	int count = 0, live = 0;
 	int i, j;
 
-	for (i = 0; i < NR_ZWBS; i++)
+	for (i = 0; i < NR_ZWBS; i++) {
 		count += buf->cnt[i];
+		for (j = 0; j < buf->cnt[i]; j++)
+			live += buf->entry[i][j].size;
+	}
 
 	spin_lock_irqsave(&zram->refcount_lock, flags);
 	if (!zram->refcount_table) {
 		spin_unlock_irqrestore(&zram->refcount_lock, flags);
 		return;
 	}
-	zram->refcount_table[blk_to_chunk_idx(blk_idx)] = count;
+	zram->refcount_table[chunk_idx] = count;
+	zram->chunk_stat[chunk_idx].live = live;
+	zram->chunk_stat[chunk_idx].pass = READ_ONCE(zram->wb_pass);
 	spin_unlock_irqrestore(&zram->refcount_lock, flags);
 	atomic64_add(count, &zram->stats.bd_objwrites);
 	atomic64_add(count, &zram->stats.bd_objcnt);
@@ -830,9 +955,14 @@ static int zram_writeback_page(struct zram *zram, struct zram_wb_buffer *buf,
 	return 0;
 }
 
+/*
+ * Adds the object of slot @index to the buffer, taken from the zspool or,
+ * when compacting, from @src read at @handle of the backing device.
+ */
 static int zram_writeback_index(struct zram *zram,
 		struct zram_wb_buffer **bufptr, u32 index,
-		wait_queue_head_t *wq, atomic_t *refcount)
+		wait_queue_head_t *wq, atomic_t *refcount,
+		void *src, unsigned long handle)
 {
 	struct zram_wb_buffer *buf = *bufptr;
 	struct zram_wb_entry *entry;
@@ -847,7 +977,10 @@ retry:
 	}
 	i = buf->idx;
 
-	size = zram_writeback_fill_page(zram, buf, index);
+	if (src)
+		size = zram_compact_fill_page(zram, buf, index, src, handle);
+	else
+		size = zram_writeback_fill_page(zram, buf, index);
 	if (size > 0) {
 		entry = &buf->entry[i][buf->cnt[i]];
 		entry->index = index;
@@ -870,6 +1003,174 @@ retry:
 	return ret;
 }
 
+/* Writes the last, partially filled buffer and waits for all the writes */
+static void zram_writeback_finish(struct zram *zram,
+		struct zram_wb_buffer *buf, bool submit,
+		wait_queue_head_t *wq, atomic_t *refcount)
+{
+	if (submit && buf && buf->cnt[0] && zram_wb_available(zram)) {
+		/* mark end of pages */
+		for (; buf->idx < NR_ZWBS; buf->idx++)
+			mark_end_of_page(buf);
+		zram_writeback_page(zram, buf, wq, refcount);
+	} else if (buf) {
+		zram_clear_flags(zram, buf);
+		free_writeback_buffer(buf);
+	}
+	atomic_dec(refcount);
+	/* wait until all writeback requests are completed */
+	while (atomic_read(refcount) > 0)
+		wait_event_timeout(*wq, !atomic_read(refcount), HZ);
+}
+
+/*
+ * A chunk with no live object is either being written or about to be
+ * freed, so it is never counted as sparse. Chunks written by the current
+ * or previous writeback pass are left alone too: their objects have had
+ * no time to be freed yet, and the tail chunk of a pass is often only
+ * partly filled.
+ */
+static inline bool zram_chunk_sparse(struct zram *zram,
+		unsigned long chunk_idx)
+{
+	struct zram_chunk_stat *stat = &zram->chunk_stat[chunk_idx];
+	u16 count = READ_ONCE(zram->refcount_table[chunk_idx]);
+	u32 live = READ_ONCE(stat->live);
+
+	if (!count || READ_ONCE(zram->wb_pass) - READ_ONCE(stat->pass) < 2)
+		return false;
+	return live * 100ULL < (u64)NR_ZWBS * PAGE_SIZE * ZRAM_COMPACT_FILL_PCT;
+}
+
+static unsigned long zram_sparse_chunks(struct zram *zram)
+{
+	unsigned long max_idx = blk_to_chunk_idx(zram->nr_pages);
+	unsigned long chunk_idx, count = 0;
+
+	if (!zram->chunk_bitmap)
+		return 0;
+
+	for_each_set_bit(chunk_idx, zram->chunk_bitmap, max_idx)
+		if (zram_chunk_sparse(zram, chunk_idx))
+			count++;
+	return count;
+}
+
+/* Reads a sparse chunk and adds its live objects to the buffer */
+static int zram_compact_chunk(struct zram *zram, unsigned long chunk_idx,
+		struct page **pages, void *tmp, struct zram_wb_buffer **bufptr,
+		wait_queue_head_t *wq, atomic_t *refcount)
+{
+	unsigned long blk_idx = chunk_to_blk_idx(chunk_idx);
+	struct zram_wb_header *zhdr;
+	int size, offset = 0, idx = 0;
+	int header_sz = sizeof(struct zram_wb_header);
+	u32 index, max_index = zram->disksize >> PAGE_SHIFT;
+	struct bio *bio;
+	int i, ret;
+	u8 *mem;
+
+	bio = bio_alloc(zram->bdev, NR_ZWBS, REQ_OP_READ, GFP_KERNEL);
+	if (!bio)
+		return -ENOMEM;
+	bio->bi_iter.bi_sector = blk_idx * (PAGE_SIZE >> 9);
+	for (i = 0; i < NR_ZWBS; i++)
+		__bio_add_page(bio, pages[i], PAGE_SIZE, 0);
+
+	pin_chunk_bdev(zram, chunk_idx);
+	atomic64_add(NR_ZWBS, &zram->stats.bd_reads);
+	ret = submit_bio_wait(bio);
+	bio_put(bio);
+	if (ret) {
+		pr_err("%s read bio returned errno %d\n", __func__, ret);
+		goto out;
+	}
+
+	while (idx < NR_ZWBS) {
+		mem = kmap_atomic(pages[idx]);
+		zhdr = (struct zram_wb_header *)(mem + offset);
+		index = zhdr->index;
+		size = zhdr->size;
+		kunmap_atomic(mem);
+
+		/* last object */
+		if (index == UINT_MAX && size == 0) {
+			idx++;
+			offset = 0;
+			continue;
+		}
+
+		/* corrupted page */
+		if (index >= max_index || size > PAGE_SIZE)
+			break;
+
+		copy_to_buf(pages, tmp, idx, offset + header_sz, size);
+		ret = zram_writeback_index(zram, bufptr, index, wq, refcount,
+				tmp, to_handle(blk_idx + idx, offset, size));
+		if (ret)
+			goto out;
+
+		offset += (size + header_sz);
+		idx += (offset / PAGE_SIZE);
+		offset %= PAGE_SIZE;
+		/* check next offset again */
+		if (offset + header_sz > PAGE_SIZE) {
+			idx++;
+			offset = 0;
+		}
+	}
+	atomic64_inc(&zram->stats.bd_compacted);
+out:
+	unpin_chunk_bdev(zram, chunk_idx);
+	return ret;
+}
+
+/*
+ * Rewrites the live objects of sparse chunks densely into new chunks, so
+ * that the sparse ones get freed. The new chunks are charged against the
+ * writeback limit like any other writeback.
+ */
+static void zram_compact_bdev(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, compact_work);
+	unsigned long max_idx = blk_to_chunk_idx(zram->nr_pages);
+	unsigned long chunk_idx = 1;
+	struct zram_wb_buffer *buf = NULL;
+	struct page *pages[NR_ZWBS] = { NULL, };
+	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
+	atomic_t refcount = ATOMIC_INIT(1);
+	int nr = 0, ret = 0, i;
+	void *tmp;
+
+	tmp = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!tmp)
+		return;
+	for (i = 0; i < NR_ZWBS; i++) {
+		pages[i] = alloc_page(GFP_KERNEL | __GFP_HIGHMEM);
+		if (!pages[i])
+			goto out;
+	}
+
+	for_each_set_bit_from(chunk_idx, zram->chunk_bitmap, max_idx) {
+		if (nr == ZRAM_COMPACT_BATCH || am_app_launch ||
+				!zram_wb_available(zram))
+			break;
+		if (!zram_chunk_sparse(zram, chunk_idx) ||
+				test_bit(chunk_idx, zram->read_bitmap))
+			continue;
+		ret = zram_compact_chunk(zram, chunk_idx, pages, tmp,
+					 &buf, &wq, &refcount);
+		if (ret)
+			break;
+		nr++;
+	}
+	zram_writeback_finish(zram, buf, !ret, &wq, &refcount);
+out:
+	for (i = 0; i < NR_ZWBS && pages[i]; i++)
+		__free_page(pages[i]);
+	kfree(tmp);
+}
+
 int zram_writeback_list(struct zram *zram, struct list_head *list)
 {
 	struct zram_request *req;
@@ -879,6 +1180,7 @@ int zram_writeback_list(struct zram *zram, struct list_head *list)
 	int ret = 0;
 	u32 index;
 
+	WRITE_ONCE(zram->wb_pass, zram->wb_pass + 1);
 	while (!list_empty(list)) {
 		req = list_last_entry(list, struct zram_request, list);
 		while (req->first < req->last) {
@@ -890,25 +1192,16 @@ int zram_writeback_list(struct zram *zram, struct list_head *list)
 				zram_slot_unlock(zram, index);
 				continue;
 			}
-			zram_writeback_index(zram, &buf, index, &wq, &refcount);
+			zram_writeback_index(zram, &buf, index, &wq, &refcount,
+					     NULL, 0);
 		}
 		list_del_init(&req->list);
 		kvfree(req);
 	}
 
-	if (!ret && buf && buf->cnt[0] && zram_wb_available(zram)) {
-		/* mark end of pages */
-		for (; buf->idx < NR_ZWBS; buf->idx++)
-			mark_end_of_page(buf);
-		zram_writeback_page(zram, buf, &wq, &refcount);
-	} else if (buf) {
-		zram_clear_flags(zram, buf);
-		free_writeback_buffer(buf);
-	}
-	atomic_dec(&refcount);
-	/* wait until all writeback requests are completed */
-	while (atomic_read(&refcount) > 0)
-		wait_event_timeout(wq, !atomic_read(&refcount), HZ);
+	zram_writeback_finish(zram, buf, !ret, &wq, &refcount);
+	if (zram_sparse_chunks(zram) >= ZRAM_COMPACT_MIN_CHUNKS)
+		queue_work(system_unbound_wq, &zram->compact_work);
 	return ret;
 }
 
@@ -971,6 +1264,8 @@ void zram_request_writeback(struct zram *zram,
 			zram_test_flag(zram, index, ZRAM_IDLE) ||
 			zram_test_flag(zram, index, ZRAM_WB) ||
 			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_PATTERN) ||
+			zram_test_flag(zram, index, ZRAM_MULTI_PAGES) ||
 			zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
 		zram_slot_unlock(zram, index);
 		return;
@@ -1050,7 +1345,8 @@ ssize_t bd_stat_show(struct device *dev,
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
 			"%8d %8llu %8llu %8llu %8llu %8llu %8llu %8llu %8d "
-			"%8d %8d %8d %8d %8d %8d %8llu %8llu\n",
+			"%8d %8d %8d %8d %8d %8d %8llu %8llu %8llu %8llu "
+			"%8lu %8llu\n",
 			0,
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_count)),
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_reads)),
@@ -1061,7 +1357,12 @@ ssize_t bd_stat_show(struct device *dev,
 			(u64)(atomic64_read(&zram->stats.bd_max_size) >> PAGE_SHIFT),
 			0, 0, 0, 0, 0, 0, 0,
 			FOUR_K((u64)atomic64_read(&zram->stats.bd_objreads)),
-			FOUR_K((u64)atomic64_read(&zram->stats.bd_objwrites)));
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_objwrites)),
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_ra_pages)),
+			/* backing device page reads saved by readahead */
+			FOUR_K((u64)atomic64_read(&zram->stats.bd_ra_hits)),
+			zram_sparse_chunks(zram),
+			(u64)atomic64_read(&zram->stats.bd_compacted));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1137,7 +1438,10 @@ void deinit_zram_ext(struct zram *zram)
 {
 	unsigned long flags;
 	u16 *refcount_table = zram->refcount_table;
+	struct zram_chunk_stat *chunk_stat = zram->chunk_stat;
 
+	if (zram->chunk_bitmap)
+		cancel_work_sync(&zram->compact_work);
 	if (zram->read_work) {
 		kvfree(zram->read_work);
 		zram->read_work = NULL;
@@ -1156,9 +1460,11 @@ void deinit_zram_ext(struct zram *zram)
 	}
 	spin_lock_irqsave(&zram->refcount_lock, flags);
 	zram->refcount_table = NULL;
+	zram->chunk_stat = NULL;
 	spin_unlock_irqrestore(&zram->refcount_lock, flags);
 
 	kvfree(refcount_table);
+	kvfree(chunk_stat);
 	exit_zram_madvise();
 	unregister_trace_android_vh_smaps_swap_shared(zram_count_shared, zram);
 	unregister_trace_android_vh_show_smap_swap_shared(zram_show_shared, zram);
@@ -1174,6 +1480,8 @@ int init_zram_ext(struct zram *zram, unsigned long nr_pages, unsigned int size)
 	if (size < max_t(int, NR_FALLOC_PAGES, NR_ZWBS))
 		return -EINVAL;
 
+	/* deinit_zram_ext cancels it once chunk_bitmap is allocated */
+	INIT_WORK(&zram->compact_work, zram_compact_bdev);
 	zram->falloc_bitmap = kvzalloc(size / NR_FALLOC_PAGES, GFP_KERNEL);
 	if (!zram->falloc_bitmap)
 		goto out;
@@ -1191,10 +1499,15 @@ int init_zram_ext(struct zram *zram, unsigned long nr_pages, unsigned int size)
 	zram->refcount_table = kvzalloc(size, GFP_KERNEL);
 	if (!zram->refcount_table)
 		goto out;
+	size = blk_to_chunk_idx(nr_pages) * sizeof(*zram->chunk_stat);
+	zram->chunk_stat = kvzalloc(size, GFP_KERNEL);
+	if (!zram->chunk_stat)
+		goto out;
 	mutex_init(&zram->falloc_lock);
 	spin_lock_init(&zram->bitmap_lock);
 	spin_lock_init(&zram->prefetch_lock);
 	spin_lock_init(&zram->read_work_lock);
+	spin_lock_init(&zram->ra_lock);
 	INIT_LIST_HEAD(&zram->prefetch_list);
 	init_waitqueue_head(&zram->prefetch_wait);
 	zram->prefetchd = kthread_run(zram_prefetchd, zram,
@@ -14,6 +14,13 @@
 #define MAX_REQ_IDX 1018
 #define MADV_WRITEBACK	29
 #define MADV_PREFETCH	30
+#define ZRAM_RA_HASH_BITS 4
+#define ZRAM_RA_MIN_WINDOW 4
+#define ZRAM_RA_MAX_WINDOW 1024
+/* chunks filled below this percentage with live bytes are compacted */
+#define ZRAM_COMPACT_FILL_PCT 25
+#define ZRAM_COMPACT_MIN_CHUNKS 4
+#define ZRAM_COMPACT_BATCH 16
 
 #define chunk_to_blk_idx(idx) ((idx) * NR_ZWBS)
 #define blk_to_chunk_idx(idx) ((idx) / NR_ZWBS)
@@ -28,11 +35,32 @@ static inline unsigned long to_handle(unsigned long blk_idx,
 
 struct zram;
 
+/*
+ * Live compressed bytes of a chunk and the writeback pass that wrote it.
+ * Both are protected by zram->refcount_lock.
+ */
+struct zram_chunk_stat {
+	u32 live;
+	u32 pass;
+};
+
 struct zram_wb_header {
 	u32 index;
 	int size;
 };
 
+/*
+ * Readahead of a process faulting from the backing device. When a chunk is
+ * read, the slots within the window of the faulting one are moved back to
+ * the zspool. The window doubles if the process used the slots moved back
+ * by its previous chunk read and is halved otherwise.
+ */
+struct zram_ra_state {
+	pid_t tgid;
+	u16 window;	/* max slot distance, ZRAM_RA_MAX_WINDOW: whole chunk */
+	u16 hits;	/* readahead slots read since the last chunk read */
+};
+
 struct zram_wb_work {
 	struct work_struct work;
 	struct page *src_page[NR_ZWBS];
@@ -44,6 +72,8 @@ struct zram_wb_work {
 	unsigned long handle;
 	wait_queue_head_t *wq;
 	atomic_t *refcount;
+	u32 index;
+	u16 ra_window;
 	u16 nr_waits;
 };
 
@@ -78,6 +108,7 @@ void zram_request_writeback(struct zram *zram,
 /* zram_ext.c -> zram_drv.c */
 int try_read_from_bdev(struct zram *zram, struct page *page,
 		u32 index, struct bio *parent, bool wait);
+void zram_readahead_hit(struct zram *zram);
 
 /* zram_ext.c -> madvise.c */
 void init_zram_madvise(struct zram *zram);
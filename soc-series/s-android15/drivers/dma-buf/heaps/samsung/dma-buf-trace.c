@@ -16,6 +16,7 @@
 #include <linux/spinlock.h>
 #include <linux/sched/mm.h>
 #include <linux/sched/signal.h>
+#include <linux/shrinker.h>
 #include <linux/types.h>
 #include <linux/sort.h>
 #include <trace/hooks/mm.h>
@@ -129,6 +130,89 @@ void dmabuf_trace_unmap(struct dma_buf_attachment *a)
 	mutex_unlock(&trace_lock);
 }
 
+static atomic_long_t dmabuf_trace_iova_stat[DMABUF_TRACE_IOVA_NR_EVENTS];
+static atomic_long_t dmabuf_trace_iova_idle_cnt;
+
+void dmabuf_trace_iova_event(enum dmabuf_trace_iova_event event)
+{
+	atomic_long_inc(&dmabuf_trace_iova_stat[event]);
+}
+
+void dmabuf_trace_iova_idle(long diff)
+{
+	atomic_long_add(diff, &dmabuf_trace_iova_idle_cnt);
+}
+
+static unsigned long __dmabuf_trace_evict_iova(struct iommu_domain *domain,
+					       unsigned long idle_jiffies,
+					       unsigned long nr_to_evict)
+{
+	struct dmabuf_trace_buffer *buffer;
+	unsigned long nr_evicted = 0;
+
+	list_for_each_entry(buffer, &buffer_list, node) {
+		nr_evicted += dma_iova_evict(buffer->dmabuf, domain, idle_jiffies,
+					     nr_to_evict - nr_evicted);
+		if (nr_evicted == nr_to_evict)
+			break;
+	}
+
+	return nr_evicted;
+}
+
+/**
+ * dmabuf_trace_evict_iova - unmap idle iovm_maps of all buffers.
+ * @domain : iommu domain to get iova space back, or NULL for every domain.
+ * @idle_jiffies : minimum time the iovm_maps have been idle.
+ * @nr_to_evict : maximum number of iovm_maps to unmap.
+ *
+ * The buffers are walked in allocation order, so the iovm_maps of long-lived
+ * buffers go first. Returns the number of unmapped iovm_maps.
+ */
+unsigned long dmabuf_trace_evict_iova(struct iommu_domain *domain, unsigned long idle_jiffies,
+				      unsigned long nr_to_evict)
+{
+	unsigned long nr_evicted;
+
+	mutex_lock(&trace_lock);
+	nr_evicted = __dmabuf_trace_evict_iova(domain, idle_jiffies, nr_to_evict);
+	mutex_unlock(&trace_lock);
+
+	return nr_evicted;
+}
+
+/* iovm_maps used within a second are likely to be mapped again soon */
+#define DMABUF_IOVA_SHRINK_IDLE	HZ
+
+static unsigned long dmabuf_trace_iova_shrink_count(struct shrinker *shrinker,
+						    struct shrink_control *sc)
+{
+	long count = atomic_long_read(&dmabuf_trace_iova_idle_cnt);
+
+	return count > 0 ? count : SHRINK_EMPTY;
+}
+
+static unsigned long dmabuf_trace_iova_shrink_scan(struct shrinker *shrinker,
+						   struct shrink_control *sc)
+{
+	unsigned long nr_evicted;
+
+	/* trace_lock is held across allocations of the trace objects */
+	if (!mutex_trylock(&trace_lock))
+		return SHRINK_STOP;
+
+	nr_evicted = __dmabuf_trace_evict_iova(NULL, DMABUF_IOVA_SHRINK_IDLE, sc->nr_to_scan);
+	mutex_unlock(&trace_lock);
+
+	return nr_evicted ? nr_evicted : SHRINK_STOP;
+}
+
+static struct shrinker dmabuf_trace_iova_shrinker = {
+	.count_objects = dmabuf_trace_iova_shrink_count,
+	.scan_objects = dmabuf_trace_iova_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
 struct dmabuf_fd_iterdata {
 	int fd_ref_size;
 	int fd_ref_cnt;
@@ -232,6 +316,12 @@ void __show_dmabuf_trace_info(struct memlog_obj *obj)
 			 dev_name(attach_lists[i].dev), attach_lists[i].size / 1024,
 			 attach_lists[i].mapcnt);
 
+	prlogger(obj, "Iova cache: idle %ld hit %ld miss %ld evict %ld\n",
+		 atomic_long_read(&dmabuf_trace_iova_idle_cnt),
+		 atomic_long_read(&dmabuf_trace_iova_stat[DMABUF_TRACE_IOVA_HIT]),
+		 atomic_long_read(&dmabuf_trace_iova_stat[DMABUF_TRACE_IOVA_MISS]),
+		 atomic_long_read(&dmabuf_trace_iova_stat[DMABUF_TRACE_IOVA_EVICT]));
+
 	list_for_each_entry(buffer, &buffer_list, node) {
 		sorted_array[num_buffer++] = buffer->dmabuf->size;
 		if (num_buffer == num_sorted_array) {
@@ -1006,6 +1096,9 @@ int __init dmabuf_trace_create(void)
 	register_trace_android_vh_show_mem(show_dmabuf_trace_handler, NULL);
 	dmabuf_trace_memlog_register();
 
+	if (register_shrinker(&dmabuf_trace_iova_shrinker, "dmabuf-iova-cache"))
+		pr_info("dma-buf-trace failed to register iova shrinker\n");
+
 	pr_info("Initialized dma-buf trace successfully.\n");
 
 	return 0;
@@ -1013,6 +1106,7 @@ int __init dmabuf_trace_create(void)
 
 void dmabuf_trace_remove(void)
 {
+	unregister_shrinker(&dmabuf_trace_iova_shrinker);
 	dmabuf_trace_memlog_unregister();
 	misc_deregister(&dmabuf_trace_dev);
 
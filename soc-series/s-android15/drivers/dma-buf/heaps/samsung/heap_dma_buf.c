@@ -64,22 +64,72 @@ static void dma_iova_remove(struct dma_iovm_map *iovm_map)
 	kfree(iovm_map);
 }
 
+static void dma_iova_unmap(struct samsung_dma_buffer *buffer, struct dma_iovm_map *iovm_map)
+{
+	list_del(&iovm_map->list);
+	if (!dma_heap_secure_sysmmu_buffer(iovm_map->dev, buffer->flags))
+		dma_unmap_sgtable(iovm_map->dev, &iovm_map->table,
+				  DMA_TO_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
+	dma_iova_remove(iovm_map);
+}
+
 static void dma_iova_release(struct dma_buf *dmabuf)
 {
 	struct samsung_dma_buffer *buffer = dmabuf->priv;
 	struct dma_iovm_map *iovm_map, *tmp;
 
+	/* dma_iova_evict() walks the list until dmabuf_trace_free() */
+	mutex_lock(&buffer->lock);
 	list_for_each_entry_safe(iovm_map, tmp, &buffer->attachments, list) {
 		if (iovm_map->mapcnt)
 			WARN(1, "iova_map refcount leak found for %s\n",
 			     dev_name(iovm_map->dev));
+		else
+			dmabuf_trace_iova_idle(-1);
 
-		list_del(&iovm_map->list);
-		if (!dma_heap_secure_sysmmu_buffer(iovm_map->dev, buffer->flags))
-			dma_unmap_sgtable(iovm_map->dev, &iovm_map->table,
-					  DMA_TO_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
-		dma_iova_remove(iovm_map);
+		dma_iova_unmap(buffer, iovm_map);
+	}
+	mutex_unlock(&buffer->lock);
+}
+
+/*
+ * Unmapping is lazy, so the iovm_maps of a buffer stay mapped with no user until
+ * the buffer is released and are reused when the devices map it again. This
+ * unmaps the idle ones in @domain, or in any domain if @domain is NULL, that
+ * have not been used for @idle_jiffies to give back iova and page tables.
+ */
+unsigned long dma_iova_evict(struct dma_buf *dmabuf, struct iommu_domain *domain,
+			     unsigned long idle_jiffies, unsigned long nr_to_evict)
+{
+	struct samsung_dma_buffer *buffer = dmabuf->priv;
+	struct dma_iovm_map *iovm_map, *tmp;
+	unsigned long nr_evicted = 0;
+
+	if (!mutex_trylock(&buffer->lock))
+		return 0;
+
+	list_for_each_entry_safe(iovm_map, tmp, &buffer->attachments, list) {
+		if (nr_evicted == nr_to_evict)
+			break;
+
+		if (iovm_map->mapcnt ||
+		    dma_heap_secure_sysmmu_buffer(iovm_map->dev, buffer->flags))
+			continue;
+
+		if (domain && iommu_get_domain_for_dev(iovm_map->dev) != domain)
+			continue;
+
+		if (time_before(jiffies, iovm_map->last_used + idle_jiffies))
+			continue;
+
+		dma_iova_unmap(buffer, iovm_map);
+		dmabuf_trace_iova_idle(-1);
+		dmabuf_trace_iova_event(DMABUF_TRACE_IOVA_EVICT);
+		nr_evicted++;
 	}
+	mutex_unlock(&buffer->lock);
+
+	return nr_evicted;
 }
 
 #define DMA_MAP_ATTRS_MASK	DMA_ATTR_PRIVILEGED
@@ -139,12 +189,11 @@ static struct dma_iovm_map *dma_put_iovm_map(struct dma_buf_attachment *a)
 		iovm_map->mapcnt--;
 
 		if (!iovm_map->mapcnt && (a->dma_map_attrs & DMA_ATTR_SKIP_LAZY_UNMAP)) {
-			list_del(&iovm_map->list);
-			if (!dma_heap_secure_sysmmu_buffer(iovm_map->dev, buffer->flags))
-				dma_unmap_sgtable(iovm_map->dev, &iovm_map->table,
-						  DMA_TO_DEVICE, DMA_ATTR_SKIP_CPU_SYNC);
-			dma_iova_remove(iovm_map);
+			dma_iova_unmap(buffer, iovm_map);
 			iovm_map = NULL;
+		} else if (!iovm_map->mapcnt) {
+			iovm_map->last_used = jiffies;
+			dmabuf_trace_iova_idle(1);
 		}
 	}
 	mutex_unlock(&buffer->lock);
@@ -173,11 +222,14 @@ static struct dma_iovm_map *dma_get_iovm_map(struct dma_buf_attachment *a,
 	mutex_lock(&buffer->lock);
 	iovm_map = dma_find_iovm_map(a);
 	if (iovm_map) {
-		iovm_map->mapcnt++;
+		if (!iovm_map->mapcnt++)
+			dmabuf_trace_iova_idle(-1);
 		mutex_unlock(&buffer->lock);
+		dmabuf_trace_iova_event(DMABUF_TRACE_IOVA_HIT);
 		return iovm_map;
 	}
 	mutex_unlock(&buffer->lock);
+	dmabuf_trace_iova_event(DMABUF_TRACE_IOVA_MISS);
 
 	iovm_map = dma_iova_create(a);
 	if (!iovm_map)
@@ -191,8 +243,14 @@ static struct dma_iovm_map *dma_get_iovm_map(struct dma_buf_attachment *a,
 
 		iovm_map->table.nents = 1;
 	} else {
+		struct iommu_domain *domain = iommu_get_domain_for_dev(iovm_map->dev);
+
 		ret = dma_map_sgtable(iovm_map->dev, &iovm_map->table, direction,
 				      iovm_map->attrs | DMA_ATTR_SKIP_CPU_SYNC);
+		/* the idle iovm_maps of the domain may hold the iova space we need */
+		if (ret && domain && dmabuf_trace_evict_iova(domain, 0, ULONG_MAX))
+			ret = dma_map_sgtable(iovm_map->dev, &iovm_map->table, direction,
+					      iovm_map->attrs | DMA_ATTR_SKIP_CPU_SYNC);
 		if (ret) {
 			show_dmabuf_status(iovm_map->dev);
 			dma_iova_remove(iovm_map);
@@ -212,7 +270,8 @@ static struct dma_iovm_map *dma_get_iovm_map(struct dma_buf_attachment *a,
 		dma_iova_remove(iovm_map);
 		iovm_map = dup_iovm_map;
 	}
-	iovm_map->mapcnt++;
+	if (!iovm_map->mapcnt++ && iovm_map == dup_iovm_map)
+		dmabuf_trace_iova_idle(-1);
 	mutex_unlock(&buffer->lock);
 
 	return iovm_map;
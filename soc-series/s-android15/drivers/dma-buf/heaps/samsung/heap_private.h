@@ -31,6 +31,7 @@ struct dma_iovm_map {
 	struct sg_table table;
 	unsigned long attrs;
 	unsigned int mapcnt;
+	unsigned long last_used;
 };
 
 struct dmabuf_trace_buffer;
@@ -85,6 +86,7 @@ enum dma_heap_pool_event_type {
 	DMA_HEAP_POOL_EVENT_FREE,
 	DMA_HEAP_POOL_EVENT_SHRINK,
 	DMA_HEAP_POOL_EVENT_PREFETCH,
+	DMA_HEAP_POOL_EVENT_REFILL,
 };
 
 enum dma_heap_event_type {
@@ -94,6 +96,7 @@ enum dma_heap_event_type {
 	DMA_HEAP_EVENT_UNPROT,
 	DMA_HEAP_EVENT_FLUSH,
 	DMA_HEAP_EVENT_PAGE_POOL_ALLOC,
+	DMA_HEAP_EVENT_CLEAN,
 };
 
 #define dma_heap_event_begin() ktime_t begin  = ktime_get()
@@ -188,6 +191,20 @@ int dmabuf_trace_untrack_buffer(struct dma_buf *dmabuf);
 void dmabuf_trace_map(struct dma_buf_attachment *a);
 void dmabuf_trace_unmap(struct dma_buf_attachment *a);
 
+enum dmabuf_trace_iova_event {
+	DMABUF_TRACE_IOVA_HIT,
+	DMABUF_TRACE_IOVA_MISS,
+	DMABUF_TRACE_IOVA_EVICT,
+	DMABUF_TRACE_IOVA_NR_EVENTS,
+};
+
+void dmabuf_trace_iova_event(enum dmabuf_trace_iova_event event);
+void dmabuf_trace_iova_idle(long diff);
+unsigned long dmabuf_trace_evict_iova(struct iommu_domain *domain, unsigned long idle_jiffies,
+				      unsigned long nr_to_evict);
+unsigned long dma_iova_evict(struct dma_buf *dmabuf, struct iommu_domain *domain,
+			     unsigned long idle_jiffies, unsigned long nr_to_evict);
+
 static inline u64 samsung_heap_total_kbsize(struct samsung_dma_heap *heap)
 {
 	return div_u64(atomic_long_read(&heap->total_bytes), 1024);
@@ -240,6 +257,8 @@ struct secure_pool_info {
 
 int samsung_page_pool_init(void);
 void samsung_page_pool_destroy(void);
+void normal_pool_refill_init(struct device *dev);
+void normal_pool_debugfs_init(struct dentry *root);
 
 struct secure_pool_info *get_secure_pool_info(unsigned int protid);
 int add_secure_pool_info(const char *name, unsigned int protid);
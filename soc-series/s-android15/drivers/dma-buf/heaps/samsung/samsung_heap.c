@@ -6,6 +6,7 @@
  * Author: <hyesoo.yu@samsung.com> for Samsung
  */
 
+#include <linux/completion.h>
 #include <linux/debugfs.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-heap.h>
@@ -19,6 +20,8 @@
 #include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/rwlock.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
 
 #include <trace/hooks/mm.h>
 
@@ -35,6 +38,7 @@ static char * const dma_heap_pool_event_name[] = {
 	"free",
 	"shrink",
 	"prefetch",
+	"refill",
 };
 
 static struct dma_heap_pool_event {
@@ -69,6 +73,7 @@ static char * const dma_heap_event_name[] = {
 	"unprot",
 	"flush",
 	"page_pool_alloc",
+	"clean",
 };
 
 static struct dma_heap_event {
@@ -77,10 +82,11 @@ static struct dma_heap_event {
 	unsigned char heapname[16];
 	size_t size;
 	enum dma_heap_event_type type;
+	unsigned int nr_cpus;
 } dma_heap_events[MAX_EVENT_LOG];
 
-void __dma_heap_event_record(enum dma_heap_event_type type, const char *name,
-			     size_t size, ktime_t begin)
+static void dma_heap_event_record_cpus(enum dma_heap_event_type type, const char *name,
+				       size_t size, ktime_t begin, unsigned int nr_cpus)
 {
 	int idx = EVENT_CLAMP_ID(atomic_inc_return(&dma_heap_eventid));
 	struct dma_heap_event *event = &dma_heap_events[idx];
@@ -90,6 +96,13 @@ void __dma_heap_event_record(enum dma_heap_event_type type, const char *name,
 	strlcpy(event->heapname, name, sizeof(event->heapname));
 	event->size = size;
 	event->type = type;
+	event->nr_cpus = nr_cpus;
+}
+
+void __dma_heap_event_record(enum dma_heap_event_type type, const char *name,
+			     size_t size, ktime_t begin)
+{
+	dma_heap_event_record_cpus(type, name, size, begin, 1);
 }
 
 void dma_heap_event_record(enum dma_heap_event_type type, struct dma_buf *dmabuf, ktime_t begin)
@@ -97,6 +110,27 @@ void dma_heap_event_record(enum dma_heap_event_type type, struct dma_buf *dmabuf
 	__dma_heap_event_record(type, dmabuf->exp_name, dmabuf->size, begin);
 }
 
+/*
+ * Every allocation is cleaned, so only the cleans worth looking at are
+ * logged. Logging them all would push the alloc/free history out.
+ */
+#define HEAP_CLEAN_SLOW_US	1000
+
+static void dma_heap_event_record_clean(const char *name, size_t size,
+					ktime_t begin, unsigned int nr_cpus)
+{
+	if (nr_cpus == 1 && ktime_us_delta(ktime_get(), begin) < HEAP_CLEAN_SLOW_US)
+		return;
+
+	dma_heap_event_record_cpus(DMA_HEAP_EVENT_CLEAN, name, size, begin, nr_cpus);
+}
+
+/*
+ * Buffers of at least this size are cleaned and flushed by the idle cpus
+ * together with the allocating one. Zero keeps everything inline.
+ */
+static unsigned long heap_parallel_threshold = SZ_16M;
+
 #ifdef CONFIG_DEBUG_FS
 static int dma_heap_event_pool_show(struct seq_file *s, void *unused)
 {
@@ -140,8 +174,8 @@ static int dma_heap_event_show(struct seq_file *s, void *unused)
 	int index = EVENT_CLAMP_ID(atomic_read(&dma_heap_eventid) + 1);
 	int i = index;
 
-	seq_printf(s, "%14s %18s %16s %16s %10s\n",
-		   "timestamp", "event", "name", "size(kb)", "elapsed(us)");
+	seq_printf(s, "%14s %18s %16s %16s %10s %4s\n",
+		   "timestamp", "event", "name", "size(kb)", "elapsed(us)", "cpus");
 
 	do {
 		struct dma_heap_event *event = &dma_heap_events[EVENT_CLAMP_ID(i)];
@@ -152,8 +186,8 @@ static int dma_heap_event_show(struct seq_file *s, void *unused)
 			continue;
 
 		seq_printf(s, "[%06lld.%06ld]", ts.tv_sec, ts.tv_nsec / NSEC_PER_USEC);
-		seq_printf(s, "%18s %16s %16zd %10ld", dma_heap_event_name[event->type],
-			   event->heapname, event->size >> 10, elapsed);
+		seq_printf(s, "%18s %16s %16zd %10ld %4u", dma_heap_event_name[event->type],
+			   event->heapname, event->size >> 10, elapsed, event->nr_cpus);
 
 		if (elapsed > 100 * USEC_PER_MSEC)
 			seq_puts(s, " *");
@@ -190,6 +224,9 @@ void dma_heap_debug_init(void)
 
 	if (IS_ERR(debugfs_create_file("pool_event", 0444, root, NULL, &dma_heap_pool_event_fops)))
 		pr_err("Failed to create debug file for page pool\n");
+
+	debugfs_create_ulong("parallel_threshold", 0644, root, &heap_parallel_threshold);
+	normal_pool_debugfs_init(root);
 }
 #else
 void dma_heap_debug_init(void)
@@ -214,29 +251,162 @@ bool is_dma_heap_exception_page(struct page *page)
 	return false;
 }
 
-void heap_pages_flush(struct device *dev, struct list_head *page_list)
+#define HEAP_PARALLEL_MAX_CPUS	8
+
+typedef void (*heap_range_fn)(void *arg, unsigned long start, unsigned long end);
+
+struct heap_parallel_work {
+	struct work_struct work;
+	heap_range_fn fn;
+	void *arg;
+	unsigned long start;
+	unsigned long end;
+	atomic_t *pending;
+	struct completion *done;
+};
+
+static void heap_parallel_work_fn(struct work_struct *work)
 {
-	struct page *page, *tmp_page;
-	unsigned int total = 0;
+	struct heap_parallel_work *pw = container_of(work, struct heap_parallel_work, work);
 
-	dma_heap_event_begin();
+	pw->fn(pw->arg, pw->start, pw->end);
+	if (atomic_dec_and_test(pw->pending))
+		complete(pw->done);
+}
+
+/*
+ * Splits [0, nr) into even ranges and runs @fn on them from the idle cpus and
+ * the calling one, if the buffer of @size is large enough. Otherwise, or if
+ * no cpu is idle, @fn runs inline on the whole range. Returns the number of
+ * cpus used.
+ */
+static unsigned int heap_parallel_run(size_t size, unsigned long nr,
+				      heap_range_fn fn, void *arg)
+{
+	struct heap_parallel_work works[HEAP_PARALLEL_MAX_CPUS - 1];
+	int cpus[HEAP_PARALLEL_MAX_CPUS - 1];
+	unsigned long threshold = READ_ONCE(heap_parallel_threshold);
+	DECLARE_COMPLETION_ONSTACK(done);
+	unsigned int nr_works = 0, i;
+	unsigned long chunk;
+	atomic_t pending;
+	int cpu, this_cpu;
+
+	if (!threshold || size < threshold)
+		goto inline_run;
+
+	this_cpu = get_cpu();
+	for_each_online_cpu(cpu) {
+		if (nr_works == ARRAY_SIZE(works) || nr_works + 1 >= nr)
+			break;
+		if (cpu != this_cpu && idle_cpu(cpu))
+			cpus[nr_works++] = cpu;
+	}
+	put_cpu();
+
+	if (!nr_works)
+		goto inline_run;
+
+	chunk = DIV_ROUND_UP(nr, nr_works + 1);
+	atomic_set(&pending, nr_works);
+	for (i = 0; i < nr_works; i++) {
+		struct heap_parallel_work *pw = &works[i];
+
+		INIT_WORK_ONSTACK(&pw->work, heap_parallel_work_fn);
+		pw->fn = fn;
+		pw->arg = arg;
+		pw->start = min(nr, (i + 1) * chunk);
+		pw->end = min(nr, (i + 2) * chunk);
+		pw->pending = &pending;
+		pw->done = &done;
+		queue_work_on(cpus[i], system_highpri_wq, &pw->work);
+	}
+
+	fn(arg, 0, min(nr, chunk));
+	wait_for_completion(&done);
+
+	for (i = 0; i < nr_works; i++)
+		destroy_work_on_stack(&works[i].work);
+
+	return nr_works + 1;
+
+inline_run:
+	fn(arg, 0, nr);
+	return 1;
+}
 
-	list_for_each_entry_safe(page, tmp_page, page_list, lru) {
+struct heap_flush_arg {
+	struct device *dev;
+	void *data;
+};
+
+static void heap_pages_flush_range(void *arg, unsigned long start, unsigned long end)
+{
+	struct heap_flush_arg *flush = arg;
+	struct list_head *page_list = flush->data;
+	struct page *page;
+	unsigned long i = 0;
+
+	list_for_each_entry(page, page_list, lru) {
 		void *addr = page_address(page);
 		size_t size = page_size(page);
 		dma_addr_t dma_handle;
 
-		total += size;
+		if (i >= end)
+			break;
+		if (i++ < start)
+			continue;
+
+		dma_handle = dma_map_single(flush->dev, addr, size, DMA_TO_DEVICE);
+		dma_unmap_single(flush->dev, dma_handle, size, DMA_FROM_DEVICE);
+	}
+}
+
+void heap_pages_flush(struct device *dev, struct list_head *page_list)
+{
+	struct heap_flush_arg flush = { .dev = dev, .data = page_list };
+	struct page *page;
+	unsigned int total = 0;
+	unsigned long nr = 0;
+	unsigned int nr_cpus;
+
+	dma_heap_event_begin();
 
-		dma_handle = dma_map_single(dev, addr, size, DMA_TO_DEVICE);
-		dma_unmap_single(dev, dma_handle, size, DMA_FROM_DEVICE);
+	list_for_each_entry(page, page_list, lru) {
+		total += page_size(page);
+		nr++;
+	}
+
+	nr_cpus = heap_parallel_run(total, nr, heap_pages_flush_range, &flush);
+
+	dma_heap_event_record_cpus(DMA_HEAP_EVENT_FLUSH, dev_name(dev), total, begin, nr_cpus);
+}
+
+static void heap_sgtable_flush_range(void *arg, unsigned long start, unsigned long end)
+{
+	struct heap_flush_arg *flush = arg;
+	struct sg_table *sgt = flush->data;
+	struct scatterlist *sg;
+	dma_addr_t dma_handle;
+	int i;
+
+	for_each_sgtable_sg(sgt, sg, i) {
+		if (i < start)
+			continue;
+		if (i == end)
+			break;
+
+		dma_handle = dma_map_page(flush->dev, sg_page(sg), sg->offset,
+					  sg->length, DMA_TO_DEVICE);
+		dma_unmap_page(flush->dev, dma_handle, sg->length, DMA_FROM_DEVICE);
 	}
-	__dma_heap_event_record(DMA_HEAP_EVENT_FLUSH, dev_name(dev), total, begin);
 }
 
 void heap_cache_flush(struct samsung_dma_buffer *buffer)
 {
 	struct device *dev = dma_heap_get_dev(buffer->heap->dma_heap);
+	struct heap_flush_arg flush = { .dev = dev, .data = &buffer->sg_table };
+	unsigned int nr_cpus;
 
 	if (!dma_heap_skip_cache_ops(buffer->flags))
 		return;
@@ -250,26 +420,52 @@ void heap_cache_flush(struct samsung_dma_buffer *buffer)
 	 * protected from non-secure access to prevent the dirty write-back
 	 * to the protected area.
 	 */
-	dma_map_sgtable(dev, &buffer->sg_table, DMA_TO_DEVICE, 0);
-	dma_unmap_sgtable(dev, &buffer->sg_table, DMA_FROM_DEVICE, 0);
+	nr_cpus = heap_parallel_run(buffer->len, buffer->sg_table.orig_nents,
+				    heap_sgtable_flush_range, &flush);
 
-	__dma_heap_event_record(DMA_HEAP_EVENT_FLUSH, buffer->heap->name, buffer->len, begin);
+	dma_heap_event_record_cpus(DMA_HEAP_EVENT_FLUSH, buffer->heap->name, buffer->len,
+				   begin, nr_cpus);
 }
 
-void heap_sgtable_pages_clean(struct sg_table *sgt)
+static void heap_sgtable_clean_range(void *arg, unsigned long start, unsigned long end)
 {
-	struct sg_page_iter piter;
-	struct page *p;
+	struct sg_table *sgt = arg;
+	struct scatterlist *sg;
+	unsigned long j;
 	void *vaddr;
+	int i;
 
-	for_each_sgtable_page(sgt, &piter, 0) {
-		p = sg_page_iter_page(&piter);
-		vaddr = kmap_atomic(p);
-		memset(vaddr, 0, PAGE_SIZE);
-		kunmap_atomic(vaddr);
+	for_each_sgtable_sg(sgt, sg, i) {
+		if (i < start)
+			continue;
+		if (i == end)
+			break;
+
+		for (j = 0; j < sg->length >> PAGE_SHIFT; j++) {
+			vaddr = kmap_atomic(nth_page(sg_page(sg), j));
+			memset(vaddr, 0, PAGE_SIZE);
+			kunmap_atomic(vaddr);
+		}
 	}
 }
 
+void heap_sgtable_pages_clean(struct sg_table *sgt)
+{
+	struct scatterlist *sg;
+	unsigned int nr_cpus;
+	size_t total = 0;
+	int i;
+
+	dma_heap_event_begin();
+
+	for_each_sgtable_sg(sgt, sg, i)
+		total += sg->length;
+
+	nr_cpus = heap_parallel_run(total, sgt->orig_nents, heap_sgtable_clean_range, sgt);
+
+	dma_heap_event_record_clean("sgtable", total, begin, nr_cpus);
+}
+
 void set_sgtable_to_page_list(struct sg_table *sg_table, struct list_head *list)
 {
 	struct page *page;
@@ -284,21 +480,17 @@ void set_sgtable_to_page_list(struct sg_table *sg_table, struct list_head *list)
 	}
 }
 
-/*
- * It should be called by physically contiguous buffer.
- */
-void heap_page_clean(struct page *pages, unsigned long size)
+static void heap_page_clean_range(void *arg, unsigned long start, unsigned long end)
 {
-	unsigned long nr_pages, i;
+	struct page *pages = arg;
+	unsigned long i;
 
 	if (!PageHighMem(pages)) {
-		memset(page_address(pages), 0, size);
+		memset(page_address(&pages[start]), 0, (end - start) << PAGE_SHIFT);
 		return;
 	}
 
-	nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
-
-	for (i = 0; i < nr_pages; i++) {
+	for (i = start; i < end; i++) {
 		void *vaddr = kmap_atomic(&pages[i]);
 
 		memset(vaddr, 0, PAGE_SIZE);
@@ -306,6 +498,21 @@ void heap_page_clean(struct page *pages, unsigned long size)
 	}
 }
 
+/*
+ * It should be called by physically contiguous buffer.
+ */
+void heap_page_clean(struct page *pages, unsigned long size)
+{
+	unsigned long nr_pages = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	unsigned int nr_cpus;
+
+	dma_heap_event_begin();
+
+	nr_cpus = heap_parallel_run(size, nr_pages, heap_page_clean_range, pages);
+
+	dma_heap_event_record_clean("contig", size, begin, nr_cpus);
+}
+
 struct samsung_dma_buffer *samsung_dma_buffer_alloc(struct samsung_dma_heap *heap,
 						    unsigned long size)
 {
@@ -9,10 +9,18 @@
  * Author: <hyesoo.yu@samsung.com> for Samsung
  */
 
+#include <linux/debugfs.h>
+#include <linux/freezer.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mmzone.h>
+#include <linux/seq_file.h>
 #include <linux/shrinker.h>
+#include <linux/sizes.h>
 #include <linux/spinlock.h>
 #include <linux/swap.h>
+#include <linux/vmstat.h>
 #include <linux/sched/signal.h>
 
 #include "page_pool.h"
@@ -20,6 +28,26 @@
 
 struct dmabuf_page_pool *normal_pools[NUM_ORDERS];
 
+/**
+ * struct normal_pool_stat - per order statistics of the normal page pool
+ * @hit:	pages taken from the pool
+ * @miss:	pages allocated from the buddy because the pool was empty
+ * @refill:	pages put into the pool by the refill thread
+ * @last:	hit + miss at the previous refill period
+ * @rate:	average pages taken per refill period, in 1/8 page
+ * @watermark:	number of pages the refill thread keeps in the pool
+ */
+struct normal_pool_stat {
+	atomic_long_t hit;
+	atomic_long_t miss;
+	atomic_long_t refill;
+	unsigned long last;
+	unsigned long rate;
+	unsigned long watermark;
+};
+
+static struct normal_pool_stat normal_pool_stats[NUM_ORDERS];
+
 long get_normal_pool_size(void)
 {
 	long size = 0;
@@ -61,10 +89,13 @@ void normal_pool_free_pages(struct list_head *page_list, enum df_reason reason)
 					   size, get_normal_pool_size());
 }
 
+static void normal_pool_refill_kick(void);
+
 static struct page *alloc_largest_available(unsigned long size,
 					    unsigned int max_order)
 {
 	struct page *page;
+	bool hit;
 	int i;
 
 	for (i = 0; i < NUM_ORDERS; i++) {
@@ -73,9 +104,17 @@ static struct page *alloc_largest_available(unsigned long size,
 		if (max_order < orders[i])
 			continue;
 
+		hit = dmabuf_page_pool_get_size(normal_pools[i]) > 0;
 		page = dmabuf_page_pool_alloc(normal_pools[i]);
 		if (!page)
 			continue;
+
+		if (hit) {
+			atomic_long_inc(&normal_pool_stats[i].hit);
+		} else {
+			atomic_long_inc(&normal_pool_stats[i].miss);
+			normal_pool_refill_kick();
+		}
 		return page;
 	}
 	return NULL;
@@ -455,6 +494,249 @@ static int secure_page_pool_init_shrinker(void)
 #define LOW_ORDER_GFP (GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP)
 static gfp_t order_flags[] = {HIGH_ORDER_GFP, HIGH_ORDER_GFP, HIGH_ORDER_GFP, LOW_ORDER_GFP};
 
+/*
+ * The refill thread keeps every order of the normal pool filled up to a
+ * watermark derived from the pages taken from that order recently, so that
+ * bursts of allocation are served without the buddy allocator. Pages are
+ * zeroed by the pool gfp and flushed before they are put into the pool.
+ * It never reclaims, and stops for a while once free memory is down to the
+ * high watermarks or an allocation fails.
+ */
+#define REFILL_GFP(gfp)	(((gfp) | __GFP_NORETRY | __GFP_NOWARN) & ~__GFP_RECLAIM)
+#define REFILL_BATCH	16
+
+static unsigned long normal_pool_refill_limit = SZ_64M;
+static unsigned long normal_pool_refill_period_ms = 500;
+static unsigned long normal_pool_refill_backoff_ms = 2000;
+
+static struct task_struct *normal_pool_refill_task;
+static struct device *normal_pool_refill_dev;
+static DECLARE_WAIT_QUEUE_HEAD(normal_pool_refill_wait);
+static unsigned long normal_pool_refill_backoff;
+static bool normal_pool_refill_pending;
+
+static bool normal_pool_refill_throttled(void)
+{
+	return time_before(jiffies, READ_ONCE(normal_pool_refill_backoff));
+}
+
+static void normal_pool_refill_backoff_start(void)
+{
+	WRITE_ONCE(normal_pool_refill_backoff,
+		   jiffies + msecs_to_jiffies(normal_pool_refill_backoff_ms));
+}
+
+/*
+ * Only take pages kswapd would not have to reclaim back. CMA pages are left
+ * out, the pool pages are unmovable.
+ */
+static bool normal_pool_refill_low_memory(unsigned int nr_pages)
+{
+	unsigned long free = global_zone_page_state(NR_FREE_PAGES) -
+			     global_zone_page_state(NR_FREE_CMA_PAGES);
+	unsigned long high = 0;
+	struct zone *zone;
+
+	for_each_populated_zone(zone)
+		high += high_wmark_pages(zone);
+
+	return free < high + nr_pages;
+}
+
+static void normal_pool_refill_kick(void)
+{
+	if (!normal_pool_refill_task || normal_pool_refill_throttled())
+		return;
+
+	if (!READ_ONCE(normal_pool_refill_pending)) {
+		WRITE_ONCE(normal_pool_refill_pending, true);
+		wake_up(&normal_pool_refill_wait);
+	}
+}
+
+static unsigned int pool_count(int i)
+{
+	return dmabuf_page_pool_get_size(normal_pools[i]) >> (PAGE_SHIFT + orders[i]);
+}
+
+/*
+ * Update the watermark of each order from the pages taken since the previous
+ * period. The pool event log only keeps the total size of each allocation, so
+ * the per order rate is sampled from the hit and miss counters instead.
+ * normal_pool_refill_limit bounds the sum of all watermarks. If the rates ask
+ * for more, every watermark is scaled down by the same ratio.
+ */
+static void normal_pool_update_watermark(void)
+{
+	unsigned long limit = READ_ONCE(normal_pool_refill_limit);
+	u64 total = 0;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct normal_pool_stat *stat = &normal_pool_stats[i];
+		unsigned long taken = atomic_long_read(&stat->hit) + atomic_long_read(&stat->miss);
+		unsigned long delta = taken - stat->last;
+
+		stat->last = taken;
+		stat->rate = stat->rate - (stat->rate >> 2) + (delta << 1);
+		stat->watermark = DIV_ROUND_UP(stat->rate, 8);
+		total += (u64)stat->watermark << (PAGE_SHIFT + orders[i]);
+	}
+
+	if (total <= limit)
+		return;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct normal_pool_stat *stat = &normal_pool_stats[i];
+
+		stat->watermark = div64_u64((u64)stat->watermark * limit, total);
+	}
+}
+
+static void normal_pool_refill_order(int i, unsigned int nr)
+{
+	gfp_t gfp = REFILL_GFP(order_flags[i]);
+	struct page *page, *tmp_page;
+	struct list_head page_list;
+	unsigned int count = 0;
+
+	INIT_LIST_HEAD(&page_list);
+
+	while (count < nr) {
+		if (kthread_should_stop() || normal_pool_refill_throttled())
+			break;
+
+		if (normal_pool_refill_low_memory(1 << orders[i])) {
+			normal_pool_refill_backoff_start();
+			break;
+		}
+
+		page = alloc_pages(gfp, orders[i]);
+		if (!page) {
+			normal_pool_refill_backoff_start();
+			break;
+		}
+
+		if (is_dma_heap_exception_page(page)) {
+			__free_pages(page, orders[i]);
+			continue;
+		}
+
+		list_add_tail(&page->lru, &page_list);
+		count++;
+	}
+
+	if (!count)
+		return;
+
+	heap_pages_flush(normal_pool_refill_dev, &page_list);
+
+	list_for_each_entry_safe(page, tmp_page, &page_list, lru) {
+		list_del(&page->lru);
+		dmabuf_page_pool_free(normal_pools[i], page);
+	}
+	atomic_long_add(count, &normal_pool_stats[i].refill);
+
+	dma_heap_event_pool_record(DMA_HEAP_POOL_EVENT_REFILL, 0, 0,
+				   (long)count << (PAGE_SHIFT + orders[i]),
+				   get_normal_pool_size());
+}
+
+static int normal_pool_refill_thread(void *data)
+{
+	set_freezable();
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		int i;
+
+		wait_event_freezable_timeout(normal_pool_refill_wait,
+					     READ_ONCE(normal_pool_refill_pending) ||
+					     kthread_should_stop(),
+					     msecs_to_jiffies(normal_pool_refill_period_ms));
+		WRITE_ONCE(normal_pool_refill_pending, false);
+
+		normal_pool_update_watermark();
+
+		for (i = 0; i < NUM_ORDERS; i++) {
+			unsigned long watermark = normal_pool_stats[i].watermark;
+			unsigned int count = pool_count(i);
+
+			if (normal_pool_refill_throttled())
+				break;
+
+			if (count < watermark)
+				normal_pool_refill_order(i, min_t(unsigned long,
+						watermark - count, REFILL_BATCH));
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * The pages are flushed with the device of the system heap, so the refill
+ * thread is started once the system heap is registered.
+ */
+void normal_pool_refill_init(struct device *dev)
+{
+	struct task_struct *task;
+
+	if (normal_pool_refill_task)
+		return;
+
+	normal_pool_refill_dev = dev;
+
+	task = kthread_run(normal_pool_refill_thread, NULL, "dma_heap_refill");
+	if (IS_ERR(task)) {
+		pr_err("%s: failed to create refill thread (%ld)\n", __func__, PTR_ERR(task));
+		return;
+	}
+	normal_pool_refill_task = task;
+}
+
+static void normal_pool_refill_exit(void)
+{
+	if (!normal_pool_refill_task)
+		return;
+
+	kthread_stop(normal_pool_refill_task);
+	normal_pool_refill_task = NULL;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int normal_pool_stat_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "%5s %12s %12s %6s %12s %10s %10s\n",
+		   "order", "hit", "miss", "hit(%)", "refill", "watermark", "count");
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		struct normal_pool_stat *stat = &normal_pool_stats[i];
+		unsigned long hit = atomic_long_read(&stat->hit);
+		unsigned long miss = atomic_long_read(&stat->miss);
+
+		seq_printf(s, "%5u %12lu %12lu %6lu %12lu %10lu %10u\n", orders[i], hit, miss,
+			   (hit + miss) ? hit * 100 / (hit + miss) : 0,
+			   atomic_long_read(&stat->refill), stat->watermark, pool_count(i));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(normal_pool_stat);
+
+void normal_pool_debugfs_init(struct dentry *root)
+{
+	debugfs_create_file("pool_stat", 0444, root, NULL, &normal_pool_stat_fops);
+	debugfs_create_ulong("pool_refill_limit", 0644, root, &normal_pool_refill_limit);
+	debugfs_create_ulong("pool_refill_period_ms", 0644, root,
+			     &normal_pool_refill_period_ms);
+	debugfs_create_ulong("pool_refill_backoff_ms", 0644, root,
+			     &normal_pool_refill_backoff_ms);
+}
+#endif
+
 int samsung_page_pool_init(void)
 {
 	int i;
@@ -477,6 +759,8 @@ void samsung_page_pool_destroy(void)
 {
 	int i;
 
+	normal_pool_refill_exit();
+
 	for (i = 0; i < NUM_ORDERS; i++) {
 		if (normal_pools[i])
 			dmabuf_page_pool_destroy(normal_pools[i]);
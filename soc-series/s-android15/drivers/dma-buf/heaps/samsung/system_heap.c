@@ -138,6 +138,8 @@ int __init system_dma_heap_init(void)
 	if (ret)
 		return ret;
 
+	normal_pool_refill_init(dma_heap_get_dev(system_heap.dma_heap));
+
 	ret = samsung_heap_add(&system_uncached_heap);
 	if (ret)
 		return ret;
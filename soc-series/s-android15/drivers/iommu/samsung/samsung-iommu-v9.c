@@ -74,6 +74,28 @@ static struct iommu_ops samsung_sysmmu_ops;
 static struct iommu_domain_ops samsung_sysmmu_domain_ops;
 static struct platform_driver samsung_sysmmu_driver_v9;
 
+/*
+ * Unmapped ranges of a flush queue domain wait here until the dma-iommu flush
+ * queue calls flush_iotlb_all or SYSMMU_FQ_RANGES distinct ranges are pending.
+ * Ranges closer than SYSMMU_FQ_MERGE_GAP are merged into one invalidation.
+ */
+#define SYSMMU_FQ_RANGES	32
+#define SYSMMU_FQ_MERGE_GAP	SECT_SIZE
+
+struct sysmmu_fq_range {
+	dma_addr_t start;
+	dma_addr_t end;
+};
+
+struct samsung_sysmmu_fq {
+	spinlock_t lock; /* pending ranges, held across the invalidation */
+	int nr;
+	struct sysmmu_fq_range ranges[SYSMMU_FQ_RANGES];
+	u64 nr_inv;
+	u64 nr_merged;
+	u64 stat_time;
+};
+
 struct samsung_sysmmu_domain {
 	struct iommu_domain domain;
 	struct samsung_iommu_log log;
@@ -82,6 +104,8 @@ struct samsung_sysmmu_domain {
 	atomic_t *lv2entcnt;
 	spinlock_t pgtablelock;
 	bool cacheable_override;
+	struct samsung_iova_gaps *iova_gaps;
+	struct samsung_sysmmu_fq *fq;
 };
 
 static inline void samsung_iommu_write_event(struct samsung_iommu_log *iommu_log,
@@ -273,7 +297,7 @@ static inline void pgtable_flush(void *vastart, void *vaend)
 
 static bool samsung_sysmmu_capable(struct device *dev, enum iommu_cap cap)
 {
-	return cap == IOMMU_CAP_CACHE_COHERENCY;
+	return cap == IOMMU_CAP_CACHE_COHERENCY || cap == IOMMU_CAP_DEFERRED_FLUSH;
 }
 
 void __sysmmu_set_perf_measure(struct sysmmu_drvdata *drvdata)
@@ -455,6 +479,7 @@ static struct iommu_domain *samsung_sysmmu_domain_alloc(unsigned int type)
 
 	if (type != IOMMU_DOMAIN_UNMANAGED &&
 	    type != IOMMU_DOMAIN_DMA &&
+	    type != IOMMU_DOMAIN_DMA_FQ &&
 	    type != IOMMU_DOMAIN_IDENTITY) {
 		pr_err("invalid domain type %u\n", type);
 		return NULL;
@@ -498,6 +523,8 @@ static void samsung_sysmmu_domain_free(struct iommu_domain *dom)
 	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
 
 	samsung_iommu_deinit_log(&domain->log);
+	samsung_iova_gaps_destroy(domain->iova_gaps);
+	kfree(domain->fq);
 	kfree(domain->page_table);
 	kfree(domain->lv2entcnt);
 	kfree(domain);
@@ -636,6 +663,32 @@ static int samsung_sysmmu_set_domain_range(struct iommu_domain *dom,
 	return 0;
 }
 
+/*
+ * The core hands domain_alloc the type without __IOMMU_DOMAIN_DMA_FQ and sets
+ * the final type afterwards, so the flush queue is set up at attach.
+ */
+VISIBLE_IF_KUNIT int samsung_sysmmu_init_fq(struct iommu_domain *dom)
+{
+	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
+	struct samsung_sysmmu_fq *fq;
+
+	if (dom->type != IOMMU_DOMAIN_DMA_FQ || domain->fq)
+		return 0;
+
+	fq = kzalloc(sizeof(*fq), GFP_KERNEL);
+	if (!fq)
+		return -ENOMEM;
+
+	spin_lock_init(&fq->lock);
+	fq->stat_time = sched_clock();
+
+	/* it is kept until the domain is freed */
+	smp_store_release(&domain->fq, fq);
+
+	return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_sysmmu_init_fq);
+
 static int samsung_sysmmu_attach_dev(struct iommu_domain *dom, struct device *dev)
 {
 	struct iommu_fwspec *fwspec = dev_iommu_fwspec_get(dev);
@@ -659,6 +712,11 @@ static int samsung_sysmmu_attach_dev(struct iommu_domain *dom, struct device *de
 		return -ENODEV;
 	}
 
+	ret = samsung_sysmmu_init_fq(dom);
+	if (ret)
+		return ret;
+
+	ret = -EINVAL;
 	domain = to_sysmmu_domain(dom);
 	domain->group = group;
 	group_list = iommu_group_get_iommudata(group);
@@ -749,6 +807,7 @@ static inline void clear_lv2_page_table(sysmmu_pte_t *ent, int n)
 }
 
 #define IOMMU_PRIV_PROT_TO_PBHA(val)	(((val) >> IOMMU_PRIV_SHIFT) & 0x3)
+/* The caller flushes @sent once for all the sections it sets */
 static int lv1set_section(struct samsung_sysmmu_domain *domain,
 			  sysmmu_pte_t *sent, sysmmu_iova_t iova,
 			  phys_addr_t paddr, int prot, atomic_t *pgcnt)
@@ -780,7 +839,6 @@ static int lv1set_section(struct samsung_sysmmu_domain *domain,
 
 	attr |= pbha << FLPD_PBHA_SHIFT;
 	*sent = make_sysmmu_pte(paddr, SECT_FLAG, attr);
-	pgtable_flush(sent, sent + 1);
 
 	if (need_sync) {
 		struct iommu_iotlb_gather gather = {
@@ -788,17 +846,24 @@ static int lv1set_section(struct samsung_sysmmu_domain *domain,
 			.end = iova + SECT_SIZE,
 		};
 
+		pgtable_flush(sent, sent + 1);
 		iommu_iotlb_sync(&domain->domain, &gather);
 	}
 
 	return 0;
 }
 
-static int lv2set_page(sysmmu_pte_t *pent, phys_addr_t paddr, size_t size, int prot,
-		       atomic_t *pgcnt, bool cacheable_override)
+/*
+ * Set @count pages of @size from @pent, all in the same lv2 table, and flush
+ * the entries once.
+ */
+static int lv2set_pages(sysmmu_pte_t *pent, phys_addr_t paddr, size_t size, size_t count,
+			int prot, atomic_t *pgcnt, bool cacheable_override)
 {
 	int attr = !!(prot & IOMMU_CACHE) ? SLPD_SHAREABLE_FLAG : 0;
 	int pbha = IOMMU_PRIV_PROT_TO_PBHA(prot);
+	int flag = (size == SPAGE_SIZE) ? SPAGE_FLAG : LPAGE_FLAG;
+	unsigned long i, per_page = size / SPAGE_SIZE, nr = count * per_page;
 
 	if (cacheable_override) {
 		attr &= ~SLPD_CACHE_MASK;
@@ -807,144 +872,293 @@ static int lv2set_page(sysmmu_pte_t *pent, phys_addr_t paddr, size_t size, int p
 
 	attr |= pbha << SLPD_PBHA_SHIFT;
 
-	if (size == SPAGE_SIZE) {
-		if (WARN_ON(!lv2ent_unmapped(pent)))
+	for (i = 0; i < nr; i++) {
+		if (WARN_ON(!lv2ent_unmapped(pent + i))) {
+			clear_lv2_page_table(pent, i);
+			pgtable_flush(pent, pent + i);
 			return -EADDRINUSE;
-
-		*pent = make_sysmmu_pte(paddr, SPAGE_FLAG, attr);
-		pgtable_flush(pent, pent + 1);
-		atomic_inc(pgcnt);
-	} else {	/* size == LPAGE_SIZE */
-		unsigned long i;
-
-		for (i = 0; i < SPAGES_PER_LPAGE; i++, pent++) {
-			if (WARN_ON(!lv2ent_unmapped(pent))) {
-				clear_lv2_page_table(pent - i, i);
-				return -EADDRINUSE;
-			}
-
-			*pent = make_sysmmu_pte(paddr, LPAGE_FLAG, attr);
 		}
-		pgtable_flush(pent - SPAGES_PER_LPAGE, pent);
-		atomic_add(SPAGES_PER_LPAGE, pgcnt);
+
+		/* all the entries of a large page point to its base */
+		pent[i] = make_sysmmu_pte(paddr + (i / per_page) * size, flag, attr);
 	}
+	pgtable_flush(pent, pent + nr);
+	atomic_add(nr, pgcnt);
 
 	return 0;
 }
 
-static int samsung_sysmmu_map(struct iommu_domain *dom, unsigned long l_iova, phys_addr_t paddr,
-			      size_t size, int prot, gfp_t unused)
+static int samsung_sysmmu_map_pages(struct iommu_domain *dom, unsigned long l_iova,
+				    phys_addr_t paddr, size_t pgsize, size_t pgcount,
+				    int prot, gfp_t unused, size_t *mapped)
 {
 	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
 	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
-	atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(iova)];
-	sysmmu_pte_t *entry;
-	int ret = -ENOMEM;
+	size_t size = pgsize * pgcount, done = 0;
+	int ret = 0;
 
 	/* Do not use IO coherency if iOMMU_PRIV exists */
 	if (!!(prot & IOMMU_PRIV))
 		prot &= ~IOMMU_CACHE;
 
-	entry = section_entry(domain->page_table, iova);
+	while (done < size) {
+		sysmmu_iova_t cur = iova + done;
+		atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(cur)];
+		sysmmu_pte_t *sent = section_entry(domain->page_table, cur);
+		size_t len;
+
+		if (pgsize == SECT_SIZE) {
+			unsigned long i, nr = (size - done) / SECT_SIZE;
+
+			for (i = 0; i < nr; i++) {
+				ret = lv1set_section(domain, sent + i, cur + i * SECT_SIZE,
+						     paddr + done + i * SECT_SIZE, prot,
+						     lv2entcnt + i);
+				if (ret)
+					break;
+			}
+			if (i)
+				pgtable_flush(sent, sent + i);
+			len = i * SECT_SIZE;
+		} else {
+			sysmmu_pte_t *pent = alloc_lv2entry(domain, sent, cur, lv2entcnt);
 
-	if (size == SECT_SIZE) {
-		ret = lv1set_section(domain, entry, iova, paddr, prot, lv2entcnt);
-	} else {
-		sysmmu_pte_t *pent;
+			if (IS_ERR(pent)) {
+				ret = PTR_ERR(pent);
+				break;
+			}
 
-		pent = alloc_lv2entry(domain, entry, iova, lv2entcnt);
+			len = min_t(size_t, size - done, SECT_SIZE - section_offs(cur));
+			ret = lv2set_pages(pent, paddr + done, pgsize, len / pgsize, prot,
+					   lv2entcnt, domain->cacheable_override);
+			if (ret)
+				len = 0;
+		}
 
-		if (IS_ERR(pent))
-			ret = PTR_ERR(pent);
-		else
-			ret = lv2set_page(pent, paddr, size, prot, lv2entcnt,
-					  domain->cacheable_override);
+		done += len;
+		if (ret)
+			break;
 	}
 
+	*mapped = done;
+
 	if (ret)
-		pr_err("failed to map %#zx @ %#llx, ret:%d\n", size, iova, ret);
-	else
-		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_MAP, iova, iova + size);
+		pr_err("failed to map %#zx @ %#llx, ret:%d\n", size, iova + done, ret);
+
+	if (done)
+		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_MAP, iova, iova + done);
 
 	return ret;
 }
 
-static size_t samsung_sysmmu_unmap(struct iommu_domain *dom, unsigned long l_iova, size_t size,
-				   struct iommu_iotlb_gather *gather)
+/* Clear the entries of one lv2 table from @iova, returns the unmapped size */
+static size_t lv2clear_pages(sysmmu_pte_t *sent, sysmmu_iova_t iova, size_t size,
+			     atomic_t *lv2entcnt)
 {
-	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
-	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
-	atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(iova)];
-	sysmmu_pte_t *sent, *pent;
-	size_t err_pgsize;
+	sysmmu_pte_t *pent = page_entry(sent, iova);
+	unsigned long i = 0, nr = size / SPAGE_SIZE, cleared = 0;
+
+	while (i < nr) {
+		if (lv2ent_unmapped(pent + i)) {
+			i++;
+			continue;
+		}
 
-	sent = section_entry(domain->page_table, iova);
+		if (lv2ent_small(pent + i)) {
+			pent[i++] = 0;
+			cleared++;
+			continue;
+		}
 
-	if (lv1ent_section(sent)) {
-		if (WARN_ON(size < SECT_SIZE)) {
-			err_pgsize = SECT_SIZE;
-			goto err;
+		/* lv2ent_large(pent + i) == true here */
+		if (WARN_ON(nr - i < SPAGES_PER_LPAGE)) {
+			pr_err("failed: size(%#zx) @ %#llx is smaller than page size %#lx\n",
+			       size - i * SPAGE_SIZE, iova + i * SPAGE_SIZE, LPAGE_SIZE);
+			break;
 		}
 
-		*sent = 0;
-		pgtable_flush(sent, sent + 1);
-		size = SECT_SIZE;
-		goto done;
+		clear_lv2_page_table(pent + i, SPAGES_PER_LPAGE);
+		i += SPAGES_PER_LPAGE;
+		cleared += SPAGES_PER_LPAGE;
+	}
+
+	if (i)
+		pgtable_flush(pent, pent + i);
+	atomic_sub(cleared, lv2entcnt);
+
+	return i * SPAGE_SIZE;
+}
+
+static void samsung_sysmmu_fq_flush(struct samsung_sysmmu_domain *domain)
+{
+	struct samsung_sysmmu_fq *fq = domain->fq;
+	struct list_head *sysmmu_list;
+	struct sysmmu_drvdata *drvdata;
+	unsigned long flags;
+	u64 now, elapsed;
+	int i;
+
+	lockdep_assert_held(&fq->lock);
+
+	if (!fq->nr)
+		return;
+
+	/* without a group nothing could have been cached */
+	if (domain->group) {
+		sysmmu_list = iommu_group_get_iommudata(domain->group);
+
+		list_for_each_entry(drvdata, sysmmu_list, list) {
+			spin_lock_irqsave(&drvdata->lock, flags);
+			for (i = 0; i < fq->nr; i++) {
+				if (drvdata->attached_count && drvdata->rpm_count > 0)
+					__sysmmu_invalidate(drvdata, fq->ranges[i].start,
+							    fq->ranges[i].end);
+				SYSMMU_EVENT_LOG_RANGE(drvdata, SYSMMU_EVENT_IOTLB_SYNC,
+						       fq->ranges[i].start, fq->ranges[i].end);
+			}
+			spin_unlock_irqrestore(&drvdata->lock, flags);
+		}
 	}
 
-	if (unlikely(lv1ent_unmapped(sent))) {
-		if (size > SECT_SIZE)
-			size = SECT_SIZE;
-		goto done;
+	fq->nr_inv += fq->nr;
+	fq->nr = 0;
+
+	now = sched_clock();
+	elapsed = now - fq->stat_time;
+	if (elapsed >= NSEC_PER_SEC) {
+		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_FLUSH_QUEUE,
+				       div64_u64(fq->nr_inv * NSEC_PER_SEC, elapsed),
+				       div64_u64(fq->nr_merged * NSEC_PER_SEC, elapsed));
+		fq->nr_inv = 0;
+		fq->nr_merged = 0;
+		fq->stat_time = now;
 	}
+}
 
-	/* lv1ent_page(sent) == true here */
+static void samsung_sysmmu_fq_add(struct samsung_sysmmu_domain *domain,
+				  dma_addr_t start, dma_addr_t end)
+{
+	struct samsung_sysmmu_fq *fq = domain->fq;
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&fq->lock, flags);
 
-	pent = page_entry(sent, iova);
+	for (i = 0; i < fq->nr; i++) {
+		struct sysmmu_fq_range *range = &fq->ranges[i];
 
-	if (unlikely(lv2ent_unmapped(pent))) {
-		size = SPAGE_SIZE;
-		goto done;
+		if (start <= range->end + SYSMMU_FQ_MERGE_GAP &&
+		    range->start <= end + SYSMMU_FQ_MERGE_GAP) {
+			range->start = min(range->start, start);
+			range->end = max(range->end, end);
+			fq->nr_merged++;
+			goto out;
+		}
 	}
 
-	if (lv2ent_small(pent)) {
-		*pent = 0;
-		size = SPAGE_SIZE;
-		pgtable_flush(pent, pent + 1);
-		atomic_dec(lv2entcnt);
-		goto done;
+	if (fq->nr == SYSMMU_FQ_RANGES)
+		samsung_sysmmu_fq_flush(domain);
+
+	fq->ranges[fq->nr].start = start;
+	fq->ranges[fq->nr].end = end;
+	fq->nr++;
+out:
+	spin_unlock_irqrestore(&fq->lock, flags);
+}
+
+static size_t samsung_sysmmu_unmap_pages(struct iommu_domain *dom, unsigned long l_iova,
+					 size_t pgsize, size_t pgcount,
+					 struct iommu_iotlb_gather *gather)
+{
+	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
+	struct samsung_sysmmu_fq *fq = smp_load_acquire(&domain->fq);
+	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
+	size_t size = pgsize * pgcount, done = 0;
+
+	while (done < size) {
+		sysmmu_iova_t cur = iova + done;
+		sysmmu_pte_t *sent = section_entry(domain->page_table, cur);
+		size_t len = min_t(size_t, size - done, SECT_SIZE - section_offs(cur));
+
+		if (lv1ent_section(sent)) {
+			unsigned long i, nr = (size - done) / SECT_SIZE;
+
+			if (WARN_ON(!nr)) {
+				pr_err("failed: size(%#zx) @ %#llx is smaller than page size %#lx\n",
+				       size - done, cur, SECT_SIZE);
+				break;
+			}
+
+			for (i = 0; i < nr && lv1ent_section(sent + i); i++)
+				sent[i] = 0;
+			pgtable_flush(sent, sent + i);
+			len = i * SECT_SIZE;
+		} else if (lv1ent_page(sent)) {
+			size_t cleared = lv2clear_pages(sent, cur, len,
+						&domain->lv2entcnt[lv1ent_offset(cur)]);
+
+			done += cleared;
+			if (cleared < len)
+				break;
+			continue;
+		}
+
+		/* unmapped lv1 entry is skipped as a whole */
+		done += len;
 	}
 
-	/* lv1ent_large(pent) == true here */
-	if (WARN_ON(size < LPAGE_SIZE)) {
-		err_pgsize = LPAGE_SIZE;
-		goto err;
+	if (done) {
+		/* the flush queue keeps the iova until flush_iotlb_all */
+		if (fq && iommu_iotlb_gather_queued(gather))
+			samsung_sysmmu_fq_add(domain, iova, iova + done);
+		else
+			iommu_iotlb_gather_add_page(dom, gather, iova, done);
+		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_UNMAP, iova, iova + done);
 	}
 
-	clear_lv2_page_table(pent, SPAGES_PER_LPAGE);
-	pgtable_flush(pent, pent + SPAGES_PER_LPAGE);
-	size = LPAGE_SIZE;
-	atomic_sub(SPAGES_PER_LPAGE, lv2entcnt);
+	return done;
+}
 
-done:
-	iommu_iotlb_gather_add_page(dom, gather, iova, size);
-	SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_UNMAP, iova, iova + size);
+#if IS_ENABLED(CONFIG_KUNIT)
+int samsung_sysmmu_fq_pending(struct iommu_domain *dom)
+{
+	struct samsung_sysmmu_fq *fq = to_sysmmu_domain(dom)->fq;
+	unsigned long flags;
+	int nr;
 
-	return size;
+	if (!fq)
+		return -ENOENT;
 
-err:
-	pr_err("failed: size(%#zx) @ %#llx is smaller than page size %#zx\n",
-	       size, iova, err_pgsize);
-	return 0;
+	spin_lock_irqsave(&fq->lock, flags);
+	nr = fq->nr;
+	spin_unlock_irqrestore(&fq->lock, flags);
+
+	return nr;
 }
+EXPORT_SYMBOL_IF_KUNIT(samsung_sysmmu_fq_pending);
+#endif
 
 static void samsung_sysmmu_flush_iotlb_all(struct iommu_domain *dom)
 {
 	unsigned long flags;
 	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
+	struct samsung_sysmmu_fq *fq = smp_load_acquire(&domain->fq);
 	struct list_head *sysmmu_list;
 	struct sysmmu_drvdata *drvdata;
 
+	/*
+	 * Every unmap of a flush queue domain is either synced or pending,
+	 * so invalidating the pending ranges is enough. dma-iommu demotes the
+	 * domain to DMA if it fails to set up its queue, and then nothing is
+	 * ever pending.
+	 */
+	if (fq && dom->type == IOMMU_DOMAIN_DMA_FQ) {
+		spin_lock_irqsave(&fq->lock, flags);
+		samsung_sysmmu_fq_flush(domain);
+		spin_unlock_irqrestore(&fq->lock, flags);
+		return;
+	}
+
 	/*
 	 * domain->group might be NULL if flush_iotlb_all is called
 	 * before attach_dev. Just ignore it.
@@ -1318,8 +1532,17 @@ static int samsung_sysmmu_def_domain_type(struct device *dev)
 		return 0;
 	}
 
+	/*
+	 * Flush queues are opt-in per group. IOMMU_CAP_DEFERRED_FLUSH is
+	 * reported for every device, so the other groups ask for a strict
+	 * DMA domain explicitly, whatever iommu.strict says.
+	 */
 	if (of_property_read_bool(np, "samsung,unmanaged-domain"))
 		ret = IOMMU_DOMAIN_UNMANAGED;
+	else if (of_property_read_bool(np, "samsung,flush-queue"))
+		ret = IOMMU_DOMAIN_DMA_FQ;
+	else
+		ret = IOMMU_DOMAIN_DMA;
 
 	of_node_put(np);
 
@@ -1328,8 +1551,8 @@ static int samsung_sysmmu_def_domain_type(struct device *dev)
 
 static struct iommu_domain_ops	samsung_sysmmu_domain_ops = {
 	.attach_dev		= samsung_sysmmu_attach_dev,
-	.map			= samsung_sysmmu_map,
-	.unmap			= samsung_sysmmu_unmap,
+	.map_pages		= samsung_sysmmu_map_pages,
+	.unmap_pages		= samsung_sysmmu_unmap_pages,
 	.flush_iotlb_all	= samsung_sysmmu_flush_iotlb_all,
 	.iotlb_sync		= samsung_sysmmu_iotlb_sync,
 	.iova_to_phys		= samsung_sysmmu_iova_to_phys,
@@ -1724,48 +1947,24 @@ static void samsung_sysmmu_dma_info_to_prot(void *data, unsigned long attrs, int
 		*prot |= DMA_ATTR_TO_PRIV_PROT(attrs) << IOMMU_PRIV_SHIFT;
 }
 
-static struct iova *to_iova(struct rb_node *node)
-{
-	return rb_entry(node, struct iova, node);
-}
+/*
+ * android_vendor_data1 of a best fit iovad holds the free gaps of the domain
+ * besides the flags.
+ */
+#define IOVAD_VH_FLAGS		(IOVAD_VH_BESTFIT | IOVAD_VH_NO_SIZE_ALIGN)
 
-/* Insert the iova into domain rbtree by holding writer lock */
-static void iova_insert_rbtree(struct rb_root *root, struct iova *iova, struct rb_node *start)
+static struct samsung_iova_gaps *iovad_to_gaps(struct iova_domain *iovad)
 {
-	struct rb_node **new, *parent = NULL;
-
-	new = (start) ? &start : &(root->rb_node);
-	/* Figure out where to put new node */
-	while (*new) {
-		struct iova *this = to_iova(*new);
-
-		parent = *new;
-
-		if (iova->pfn_lo < this->pfn_lo)
-			new = &((*new)->rb_left);
-		else if (iova->pfn_lo > this->pfn_lo)
-			new = &((*new)->rb_right);
-		else {
-			WARN_ON(1); /* this should not happen */
-			return;
-		}
-	}
-	/* Add new node and rebalance tree. */
-	rb_link_node(&iova->node, parent, new);
-	rb_insert_color(&iova->node, root);
+	return (struct samsung_iova_gaps *)(unsigned long)
+		(iovad->android_vendor_data1 & ~(u64)IOVAD_VH_FLAGS);
 }
 
 static void alloc_insert_iova_best_fit(void *data, struct iova_domain *iovad,
 					  unsigned long size, unsigned long limit_pfn,
 					  struct iova *new_iova, bool size_aligned, int *ret)
 {
-	struct rb_node *curr, *prev;
-	struct iova *curr_iova, *prev_iova;
 	unsigned long flags;
 	unsigned long align_mask = ~0UL;
-	struct rb_node *candidate_rb_parent;
-	unsigned long new_pfn, candidate_pfn = ~0UL;
-	unsigned long gap, candidate_gap = ~0UL;
 
 	if (!(iovad->android_vendor_data1 & IOVAD_VH_BESTFIT)) {
 		*ret = -EINVAL;
@@ -1778,53 +1977,28 @@ static void alloc_insert_iova_best_fit(void *data, struct iova_domain *iovad,
 		align_mask <<= shift;
 	}
 
-	/* Walk the tree backwards */
 	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
-	curr = &iovad->anchor.node;
-	prev = rb_prev(curr);
-	for (; prev; curr = prev, prev = rb_prev(curr)) {
-		curr_iova = rb_entry(curr, struct iova, node);
-		prev_iova = rb_entry(prev, struct iova, node);
-
-		limit_pfn = min(limit_pfn, curr_iova->pfn_lo);
-		new_pfn = (limit_pfn - size) & align_mask;
-		gap = curr_iova->pfn_lo - prev_iova->pfn_hi - 1;
-		if ((limit_pfn >= size) && (new_pfn > prev_iova->pfn_hi)
-				&& (gap < candidate_gap)) {
-			candidate_gap = gap;
-			candidate_pfn = new_pfn;
-			candidate_rb_parent = curr;
-			if (gap == size)
-				goto insert;
-		}
-	}
+	*ret = samsung_iova_best_fit(iovad, iovad_to_gaps(iovad), size, limit_pfn,
+				     align_mask, new_iova);
+	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+}
 
-	curr_iova = rb_entry(curr, struct iova, node);
-	limit_pfn = min(limit_pfn, curr_iova->pfn_lo);
-	new_pfn = (limit_pfn - size) & align_mask;
-	gap = curr_iova->pfn_lo - iovad->start_pfn;
-	if (limit_pfn >= size && new_pfn >= iovad->start_pfn &&
-			gap < candidate_gap) {
-		candidate_gap = gap;
-		candidate_pfn = new_pfn;
-		candidate_rb_parent = curr;
-	}
+static void samsung_sysmmu_iovad_free_iova(void *data, struct iova_domain *iovad,
+					   dma_addr_t iova, size_t size)
+{
+	struct samsung_iova_gaps *gaps;
+	unsigned long flags;
 
-insert:
-	if (candidate_pfn == ~0UL) {
-		spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
-		*ret = -ENOMEM;
+	if (!(iovad->android_vendor_data1 & IOVAD_VH_BESTFIT))
 		return;
-	}
 
-	/* pfn_lo will point to size aligned address if size_aligned is set */
-	new_iova->pfn_lo = candidate_pfn;
-	new_iova->pfn_hi = new_iova->pfn_lo + size - 1;
+	gaps = iovad_to_gaps(iovad);
+	if (!gaps)
+		return;
 
-	/* If we have 'prev', it's a valid place to start the insertion. */
-	iova_insert_rbtree(&iovad->rbroot, new_iova, candidate_rb_parent);
+	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+	samsung_iova_gaps_release(iovad, gaps, iova_pfn(iovad, iova));
 	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
-	*ret = 0;
 }
 
 static void limit_align_shift(void *data, struct iova_domain *iovad, unsigned long size,
@@ -1836,9 +2010,23 @@ static void limit_align_shift(void *data, struct iova_domain *iovad, unsigned lo
 
 static void iovad_init_best_fit(void *data, struct device *dev, struct iova_domain *iovad)
 {
-	if (of_property_read_bool(dev->of_node, "sysmmu,best-fit"))
+	if (of_property_read_bool(dev->of_node, "sysmmu,best-fit")) {
+		struct iommu_domain *dom = iommu_get_domain_for_dev(dev);
+
 		iovad->android_vendor_data1 |= IOVAD_VH_BESTFIT;
 
+		/* the gaps live as long as the domain owning the iovad */
+		if (dom && dom->ops == &samsung_sysmmu_domain_ops) {
+			struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
+
+			if (!domain->iova_gaps)
+				domain->iova_gaps = samsung_iova_gaps_create();
+			if (domain->iova_gaps)
+				iovad->android_vendor_data1 |=
+					(unsigned long)domain->iova_gaps;
+		}
+	}
+
 	if (of_property_read_bool(dev->of_node, "sysmmu,no-size-align"))
 		iovad->android_vendor_data1 |= IOVAD_VH_NO_SIZE_ALIGN;
 }
@@ -1866,6 +2054,7 @@ static int __init samsung_sysmmu_init(void)
 	register_trace_android_rvh_iommu_dma_info_to_prot(samsung_sysmmu_dma_info_to_prot, NULL);
 	register_trace_android_rvh_iommu_iovad_init_alloc_algo(iovad_init_best_fit, NULL);
 	register_trace_android_rvh_iommu_alloc_insert_iova(alloc_insert_iova_best_fit, NULL);
+	register_trace_android_vh_iommu_iovad_free_iova(samsung_sysmmu_iovad_free_iova, NULL);
 	register_trace_android_rvh_iommu_limit_align_shift(limit_align_shift, NULL);
 
 	slpt_cache = kmem_cache_create("samsung-iommu-lv2table", LV2TABLE_SIZE, LV2TABLE_SIZE,
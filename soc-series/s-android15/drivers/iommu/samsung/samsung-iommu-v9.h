@@ -193,6 +193,8 @@ enum sysmmu_event_type {
 	/* event for iommu domain */
 	SYSMMU_EVENT_MAP,
 	SYSMMU_EVENT_UNMAP,
+	/* start: range invalidations/sec, end: merged ranges/sec */
+	SYSMMU_EVENT_FLUSH_QUEUE,
 };
 
 struct sysmmu_log {
@@ -262,4 +264,17 @@ struct sysmmu_clientdata {
 irqreturn_t samsung_sysmmu_irq_thread(int irq, void *dev_id);
 irqreturn_t samsung_sysmmu_irq(int irq, void *dev_id);
 
+struct iova;
+struct iova_domain;
+struct samsung_iova_gaps;
+
+int samsung_iova_best_fit(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			  unsigned long size, unsigned long limit_pfn,
+			  unsigned long align_mask, struct iova *new_iova);
+void samsung_iova_gaps_release(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			       unsigned long pfn);
+struct samsung_iova_gaps *samsung_iova_gaps_create(void);
+void samsung_iova_gaps_destroy(struct samsung_iova_gaps *gaps);
+int samsung_iova_gaps_settle(struct iova_domain *iovad, struct samsung_iova_gaps *gaps);
+
 #endif
@@ -647,6 +647,7 @@ static inline void clear_lv2_page_table(sysmmu_pte_t *ent, int n)
 	memset(ent, 0, sizeof(*ent) * n);
 }
 
+/* The caller flushes @sent once for all the sections it sets */
 static int lv1set_section(struct samsung_sysmmu_domain *domain,
 			  sysmmu_pte_t *sent, sysmmu_iova_t iova,
 			  phys_addr_t paddr, int prot, atomic_t *pgcnt)
@@ -671,7 +672,6 @@ static int lv1set_section(struct samsung_sysmmu_domain *domain,
 	}
 
 	*sent = make_sysmmu_pte(paddr, SECT_FLAG, attr);
-	pgtable_flush(sent, sent + 1);
 
 	if (need_sync) {
 		struct iommu_iotlb_gather gather = {
@@ -679,149 +679,187 @@ static int lv1set_section(struct samsung_sysmmu_domain *domain,
 			.end = iova + SECT_SIZE,
 		};
 
+		pgtable_flush(sent, sent + 1);
 		iommu_iotlb_sync(&domain->domain, &gather);
 	}
 
 	return 0;
 }
 
-static int lv2set_page(sysmmu_pte_t *pent, phys_addr_t paddr,
-		       size_t size, int prot, atomic_t *pgcnt)
+/*
+ * Set @count pages of @size from @pent, all in the same lv2 table, and flush
+ * the entries once.
+ */
+static int lv2set_pages(sysmmu_pte_t *pent, phys_addr_t paddr,
+			size_t size, size_t count, int prot, atomic_t *pgcnt)
 {
 	int attr = !!(prot & IOMMU_CACHE) ? SLPD_SHAREABLE_FLAG : 0;
+	int flag = (size == SPAGE_SIZE) ? SPAGE_FLAG : LPAGE_FLAG;
+	unsigned long i, per_page = size / SPAGE_SIZE, nr = count * per_page;
 
-	if (size == SPAGE_SIZE) {
-		if (WARN_ON(!lv2ent_unmapped(pent)))
+	for (i = 0; i < nr; i++) {
+		if (WARN_ON(!lv2ent_unmapped(pent + i))) {
+			clear_lv2_page_table(pent, i);
+			pgtable_flush(pent, pent + i);
 			return -EADDRINUSE;
-
-		*pent = make_sysmmu_pte(paddr, SPAGE_FLAG, attr);
-		pgtable_flush(pent, pent + 1);
-		atomic_inc(pgcnt);
-	} else {	/* size == LPAGE_SIZE */
-		unsigned long i;
-
-		for (i = 0; i < SPAGES_PER_LPAGE; i++, pent++) {
-			if (WARN_ON(!lv2ent_unmapped(pent))) {
-				clear_lv2_page_table(pent - i, i);
-				return -EADDRINUSE;
-			}
-
-			*pent = make_sysmmu_pte(paddr, LPAGE_FLAG, attr);
 		}
-		pgtable_flush(pent - SPAGES_PER_LPAGE, pent);
-		atomic_add(SPAGES_PER_LPAGE, pgcnt);
+
+		/* all the entries of a large page point to its base */
+		pent[i] = make_sysmmu_pte(paddr + (i / per_page) * size, flag, attr);
 	}
+	pgtable_flush(pent, pent + nr);
+	atomic_add(nr, pgcnt);
 
 	return 0;
 }
 
-static int samsung_sysmmu_map(struct iommu_domain *dom, unsigned long l_iova,
-			      phys_addr_t paddr, size_t size, int prot,
-			      gfp_t unused)
+static int samsung_sysmmu_map_pages(struct iommu_domain *dom, unsigned long l_iova,
+				    phys_addr_t paddr, size_t pgsize, size_t pgcount,
+				    int prot, gfp_t unused, size_t *mapped)
 {
 	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
 	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
-	atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(iova)];
-	sysmmu_pte_t *entry;
-	int ret = -ENOMEM;
+	size_t size = pgsize * pgcount, done = 0;
+	int ret = 0;
 
 	/* Do not use IO coherency if iOMMU_PRIV exists */
 	if (!!(prot & IOMMU_PRIV))
 		prot &= ~IOMMU_CACHE;
 
-	entry = section_entry(domain->page_table, iova);
+	while (done < size) {
+		sysmmu_iova_t cur = iova + done;
+		atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(cur)];
+		sysmmu_pte_t *sent = section_entry(domain->page_table, cur);
+		size_t len;
+
+		if (pgsize == SECT_SIZE) {
+			unsigned long i, nr = (size - done) / SECT_SIZE;
+
+			for (i = 0; i < nr; i++) {
+				ret = lv1set_section(domain, sent + i, cur + i * SECT_SIZE,
+						     paddr + done + i * SECT_SIZE, prot,
+						     lv2entcnt + i);
+				if (ret)
+					break;
+			}
+			if (i)
+				pgtable_flush(sent, sent + i);
+			len = i * SECT_SIZE;
+		} else {
+			sysmmu_pte_t *pent = alloc_lv2entry(domain, sent, cur, lv2entcnt);
 
-	if (size == SECT_SIZE) {
-		ret = lv1set_section(domain, entry, iova, paddr, prot,
-				     lv2entcnt);
-	} else {
-		sysmmu_pte_t *pent;
+			if (IS_ERR(pent)) {
+				ret = PTR_ERR(pent);
+				break;
+			}
 
-		pent = alloc_lv2entry(domain, entry, iova, lv2entcnt);
+			len = min_t(size_t, size - done, SECT_SIZE - section_offs(cur));
+			ret = lv2set_pages(pent, paddr + done, pgsize, len / pgsize, prot,
+					   lv2entcnt);
+			if (ret)
+				len = 0;
+		}
 
-		if (IS_ERR(pent))
-			ret = PTR_ERR(pent);
-		else
-			ret = lv2set_page(pent, paddr, size, prot, lv2entcnt);
+		done += len;
+		if (ret)
+			break;
 	}
 
+	*mapped = done;
+
 	if (ret)
-		pr_err("failed to map %#zx @ %#x, ret:%d\n", size, iova, ret);
-	else
-		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_MAP, iova, iova + size);
+		pr_err("failed to map %#zx @ %#llx, ret:%d\n", size, iova + done, ret);
+
+	if (done)
+		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_MAP, iova, iova + done);
 
 	return ret;
 }
 
-static size_t samsung_sysmmu_unmap(struct iommu_domain *dom,
-				   unsigned long l_iova, size_t size,
-				   struct iommu_iotlb_gather *gather)
+/* Clear the entries of one lv2 table from @iova, returns the unmapped size */
+static size_t lv2clear_pages(sysmmu_pte_t *sent, sysmmu_iova_t iova, size_t size,
+			     atomic_t *lv2entcnt)
 {
-	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
-	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
-	atomic_t *lv2entcnt = &domain->lv2entcnt[lv1ent_offset(iova)];
-	sysmmu_pte_t *sent, *pent;
-	size_t err_pgsize;
+	sysmmu_pte_t *pent = page_entry(sent, iova);
+	unsigned long i = 0, nr = size / SPAGE_SIZE, cleared = 0;
 
-	sent = section_entry(domain->page_table, iova);
+	while (i < nr) {
+		if (lv2ent_unmapped(pent + i)) {
+			i++;
+			continue;
+		}
 
-	if (lv1ent_section(sent)) {
-		if (WARN_ON(size < SECT_SIZE)) {
-			err_pgsize = SECT_SIZE;
-			goto err;
+		if (lv2ent_small(pent + i)) {
+			pent[i++] = 0;
+			cleared++;
+			continue;
 		}
 
-		*sent = 0;
-		pgtable_flush(sent, sent + 1);
-		size = SECT_SIZE;
-		goto done;
-	}
+		/* lv2ent_large(pent + i) == true here */
+		if (WARN_ON(nr - i < SPAGES_PER_LPAGE)) {
+			pr_err("failed: size(%#zx) @ %#llx is smaller than page size %#lx\n",
+			       size - i * SPAGE_SIZE, iova + i * SPAGE_SIZE, LPAGE_SIZE);
+			break;
+		}
 
-	if (unlikely(lv1ent_unmapped(sent))) {
-		if (size > SECT_SIZE)
-			size = SECT_SIZE;
-		goto done;
+		clear_lv2_page_table(pent + i, SPAGES_PER_LPAGE);
+		i += SPAGES_PER_LPAGE;
+		cleared += SPAGES_PER_LPAGE;
 	}
 
-	/* lv1ent_page(sent) == true here */
+	if (i)
+		pgtable_flush(pent, pent + i);
+	atomic_sub(cleared, lv2entcnt);
 
-	pent = page_entry(sent, iova);
+	return i * SPAGE_SIZE;
+}
 
-	if (unlikely(lv2ent_unmapped(pent))) {
-		size = SPAGE_SIZE;
-		goto done;
-	}
+static size_t samsung_sysmmu_unmap_pages(struct iommu_domain *dom, unsigned long l_iova,
+					 size_t pgsize, size_t pgcount,
+					 struct iommu_iotlb_gather *gather)
+{
+	struct samsung_sysmmu_domain *domain = to_sysmmu_domain(dom);
+	sysmmu_iova_t iova = (sysmmu_iova_t)l_iova;
+	size_t size = pgsize * pgcount, done = 0;
 
-	if (lv2ent_small(pent)) {
-		*pent = 0;
-		size = SPAGE_SIZE;
-		pgtable_flush(pent, pent + 1);
-		atomic_dec(lv2entcnt);
-		goto done;
-	}
+	while (done < size) {
+		sysmmu_iova_t cur = iova + done;
+		sysmmu_pte_t *sent = section_entry(domain->page_table, cur);
+		size_t len = min_t(size_t, size - done, SECT_SIZE - section_offs(cur));
 
-	/* lv1ent_large(pent) == true here */
-	if (WARN_ON(size < LPAGE_SIZE)) {
-		err_pgsize = LPAGE_SIZE;
-		goto err;
-	}
+		if (lv1ent_section(sent)) {
+			unsigned long i, nr = (size - done) / SECT_SIZE;
 
-	clear_lv2_page_table(pent, SPAGES_PER_LPAGE);
-	pgtable_flush(pent, pent + SPAGES_PER_LPAGE);
-	size = LPAGE_SIZE;
-	atomic_sub(SPAGES_PER_LPAGE, lv2entcnt);
+			if (WARN_ON(!nr)) {
+				pr_err("failed: size(%#zx) @ %#llx is smaller than page size %#lx\n",
+				       size - done, cur, SECT_SIZE);
+				break;
+			}
 
-done:
-	iommu_iotlb_gather_add_page(dom, gather, iova, size);
-	SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_UNMAP, iova, iova + size);
+			for (i = 0; i < nr && lv1ent_section(sent + i); i++)
+				sent[i] = 0;
+			pgtable_flush(sent, sent + i);
+			len = i * SECT_SIZE;
+		} else if (lv1ent_page(sent)) {
+			size_t cleared = lv2clear_pages(sent, cur, len,
+						&domain->lv2entcnt[lv1ent_offset(cur)]);
+
+			done += cleared;
+			if (cleared < len)
+				break;
+			continue;
+		}
 
-	return size;
+		/* unmapped lv1 entry is skipped as a whole */
+		done += len;
+	}
 
-err:
-	pr_err("failed: size(%#zx) @ %#x is smaller than page size %#zx\n",
-	       size, iova, err_pgsize);
+	if (done) {
+		iommu_iotlb_gather_add_page(dom, gather, iova, done);
+		SYSMMU_EVENT_LOG_RANGE(domain, SYSMMU_EVENT_UNMAP, iova, iova + done);
+	}
 
-	return 0;
+	return done;
 }
 
 static void samsung_sysmmu_flush_iotlb_all(struct iommu_domain *dom)
@@ -1204,8 +1242,8 @@ static struct iommu_ops samsung_sysmmu_ops = {
 	.domain_free		= samsung_sysmmu_domain_free,
 	.attach_dev		= samsung_sysmmu_attach_dev,
 	.detach_dev		= samsung_sysmmu_detach_dev,
-	.map			= samsung_sysmmu_map,
-	.unmap			= samsung_sysmmu_unmap,
+	.map_pages		= samsung_sysmmu_map_pages,
+	.unmap_pages		= samsung_sysmmu_unmap_pages,
 	.flush_iotlb_all	= samsung_sysmmu_flush_iotlb_all,
 	.iotlb_sync		= samsung_sysmmu_iotlb_sync,
 	.iova_to_phys		= samsung_sysmmu_iova_to_phys,
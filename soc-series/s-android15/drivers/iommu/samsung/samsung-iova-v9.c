@@ -0,0 +1,526 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (c) 2024 Samsung Electronics Co., Ltd.
+ */
+
+#define pr_fmt(fmt) "sysmmu: " fmt
+
+#include <kunit/visibility.h>
+#include <linux/iova.h>
+#include <linux/llist.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include "samsung-iommu-v9.h"
+
+/*
+ * Best fit allocation has to look at every gap between the iovas of a domain.
+ * To avoid walking the whole iova rbtree, the free gaps are also kept in two
+ * trees, one sorted by address to split and merge them and one sorted by size
+ * and then by descending address to find the best fit in the same order the
+ * backward walk of the iova rbtree does.
+ *
+ * The iova rbtree stays the reference. The free hook runs before an iova kept
+ * in the rcache or the flush queue leaves the rbtree, so those frees are only
+ * counted and the gaps are built again from the rbtree once there are many of
+ * them. Besides, a gap is checked against the iova rbtree before it is used
+ * and is fixed up if it has grown, and the gaps are built again before an
+ * allocation fails.
+ *
+ * The gap nodes are never allocated under iova_rbtree_lock. They are taken
+ * from a free list which a work refills. If the list runs dry, the gaps are
+ * dropped and the iova rbtree is walked until the work has run.
+ */
+struct samsung_iova_gap {
+	union {
+		struct rb_node addr_node;
+		struct llist_node free_node;	/* while in the free list */
+	};
+	struct rb_node size_node;
+	unsigned long pfn_lo;
+	unsigned long pfn_hi;
+};
+
+struct samsung_iova_gaps {
+	struct rb_root addr_root;
+	struct rb_root size_root;
+	struct llist_head free_list;
+	atomic_long_t nr_refill;
+	struct work_struct refill_work;
+	unsigned long nr_gaps;
+	unsigned long nr_deferred;
+	bool valid;
+};
+
+#define IOVA_GAPS_MIN_DEFERRED	64
+#define IOVA_GAPS_RESERVE	64
+
+#define gap_size(gap)	((gap)->pfn_hi - (gap)->pfn_lo + 1)
+
+static struct iova *to_iova(struct rb_node *node)
+{
+	return rb_entry(node, struct iova, node);
+}
+
+/* Insert the iova into domain rbtree by holding writer lock */
+static void iova_insert_rbtree(struct rb_root *root, struct iova *iova)
+{
+	struct rb_node **new = &root->rb_node, *parent = NULL;
+
+	/* Figure out where to put new node */
+	while (*new) {
+		struct iova *this = to_iova(*new);
+
+		parent = *new;
+
+		if (iova->pfn_lo < this->pfn_lo)
+			new = &((*new)->rb_left);
+		else if (iova->pfn_lo > this->pfn_lo)
+			new = &((*new)->rb_right);
+		else {
+			WARN_ON(1); /* this should not happen */
+			return;
+		}
+	}
+	/* Add new node and rebalance tree. */
+	rb_link_node(&iova->node, parent, new);
+	rb_insert_color(&iova->node, root);
+}
+
+/*
+ * Find the free range of the iova rbtree holding @pfn.
+ * Returns false if @pfn is in use.
+ */
+static bool iova_free_range(struct iova_domain *iovad, unsigned long pfn,
+			    unsigned long *lo, unsigned long *hi)
+{
+	struct rb_node *node = iovad->rbroot.rb_node;
+	struct iova *prev = NULL, *next = NULL;
+
+	while (node) {
+		struct iova *iova = to_iova(node);
+
+		if (pfn < iova->pfn_lo) {
+			next = iova;
+			node = node->rb_left;
+		} else if (pfn > iova->pfn_hi) {
+			prev = iova;
+			node = node->rb_right;
+		} else {
+			return false;
+		}
+	}
+
+	/* the anchor is above every pfn which is not in use */
+	*lo = prev ? prev->pfn_hi + 1 : iovad->start_pfn;
+	*hi = next->pfn_lo - 1;
+
+	return pfn >= *lo;
+}
+
+static bool iova_gap_fit(unsigned long lo, unsigned long hi, unsigned long size,
+			 unsigned long limit_pfn, unsigned long align_mask,
+			 unsigned long *pfn)
+{
+	unsigned long limit = min(limit_pfn, hi + 1);
+
+	if (limit < size)
+		return false;
+
+	*pfn = (limit - size) & align_mask;
+
+	return *pfn >= lo;
+}
+
+static void gap_insert_addr(struct samsung_iova_gaps *gaps, struct samsung_iova_gap *gap)
+{
+	struct rb_node **new = &gaps->addr_root.rb_node, *parent = NULL;
+
+	while (*new) {
+		struct samsung_iova_gap *this = rb_entry(*new, struct samsung_iova_gap, addr_node);
+
+		parent = *new;
+		if (gap->pfn_lo < this->pfn_lo)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	rb_link_node(&gap->addr_node, parent, new);
+	rb_insert_color(&gap->addr_node, &gaps->addr_root);
+}
+
+static void gap_insert_size(struct samsung_iova_gaps *gaps, struct samsung_iova_gap *gap)
+{
+	struct rb_node **new = &gaps->size_root.rb_node, *parent = NULL;
+	unsigned long size = gap_size(gap);
+
+	while (*new) {
+		struct samsung_iova_gap *this = rb_entry(*new, struct samsung_iova_gap, size_node);
+
+		parent = *new;
+		if (size < gap_size(this) ||
+		    (size == gap_size(this) && gap->pfn_lo > this->pfn_lo))
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	rb_link_node(&gap->size_node, parent, new);
+	rb_insert_color(&gap->size_node, &gaps->size_root);
+}
+
+static void iova_gaps_refill_work(struct work_struct *work)
+{
+	struct samsung_iova_gaps *gaps = container_of(work, struct samsung_iova_gaps,
+						      refill_work);
+	long nr = atomic_long_xchg(&gaps->nr_refill, 0);
+
+	while (nr-- > 0) {
+		struct samsung_iova_gap *gap = kmalloc(sizeof(*gap), GFP_KERNEL);
+
+		if (!gap)
+			break;
+		llist_add(&gap->free_node, &gaps->free_list);
+	}
+}
+
+/* Ask for @nr more nodes than are missing now, and a reserve for the splits */
+static void iova_gaps_refill(struct samsung_iova_gaps *gaps, unsigned long nr)
+{
+	atomic_long_add(nr + IOVA_GAPS_RESERVE, &gaps->nr_refill);
+	schedule_work(&gaps->refill_work);
+}
+
+static int gap_add(struct samsung_iova_gaps *gaps, unsigned long lo, unsigned long hi)
+{
+	struct samsung_iova_gap *gap;
+	struct llist_node *node;
+
+	/* consumers are serialized by iova_rbtree_lock */
+	node = llist_del_first(&gaps->free_list);
+	if (!node)
+		return -ENOMEM;
+
+	gap = llist_entry(node, struct samsung_iova_gap, free_node);
+	gap->pfn_lo = lo;
+	gap->pfn_hi = hi;
+	gap_insert_addr(gaps, gap);
+	gap_insert_size(gaps, gap);
+	gaps->nr_gaps++;
+
+	return 0;
+}
+
+static void gap_del(struct samsung_iova_gaps *gaps, struct samsung_iova_gap *gap)
+{
+	rb_erase(&gap->addr_node, &gaps->addr_root);
+	rb_erase(&gap->size_node, &gaps->size_root);
+	gaps->nr_gaps--;
+	llist_add(&gap->free_node, &gaps->free_list);
+}
+
+static void iova_gaps_clear(struct samsung_iova_gaps *gaps)
+{
+	struct samsung_iova_gap *gap, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(gap, tmp, &gaps->addr_root, addr_node)
+		llist_add(&gap->free_node, &gaps->free_list);
+
+	gaps->addr_root = RB_ROOT;
+	gaps->size_root = RB_ROOT;
+	gaps->nr_gaps = 0;
+	gaps->nr_deferred = 0;
+	gaps->valid = false;
+}
+
+/* Out of nodes, so walk the iova rbtree until the work has refilled them */
+static void iova_gaps_drop(struct samsung_iova_gaps *gaps)
+{
+	iova_gaps_clear(gaps);
+	iova_gaps_refill(gaps, 0);
+}
+
+/* Many frees may have been missed if many iovas were kept when they were freed */
+static bool iova_gaps_stale(struct samsung_iova_gaps *gaps)
+{
+	return gaps->nr_deferred > max(IOVA_GAPS_MIN_DEFERRED, gaps->nr_gaps >> 3);
+}
+
+static int iova_gaps_rebuild(struct iova_domain *iovad, struct samsung_iova_gaps *gaps)
+{
+	unsigned long lo = iovad->start_pfn, missing = 0;
+	struct rb_node *node;
+
+	/* the gaps are useless until the nodes asked for last time are there */
+	if (work_pending(&gaps->refill_work))
+		return -EBUSY;
+
+	iova_gaps_clear(gaps);
+
+	for (node = rb_first(&iovad->rbroot); node; node = rb_next(node)) {
+		struct iova *iova = to_iova(node);
+
+		if (iova->pfn_lo > lo && (missing || gap_add(gaps, lo, iova->pfn_lo - 1)))
+			missing++;
+		lo = iova->pfn_hi + 1;
+	}
+
+	if (missing) {
+		iova_gaps_clear(gaps);
+		iova_gaps_refill(gaps, missing);
+		return -ENOMEM;
+	}
+	gaps->valid = true;
+
+	return 0;
+}
+
+/* Replace the gaps overlapping the free range holding @pfn by the range */
+static int iova_gaps_sync(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			  unsigned long pfn)
+{
+	struct rb_node *node = gaps->addr_root.rb_node, *first = NULL;
+	unsigned long lo, hi;
+
+	if (!iova_free_range(iovad, pfn, &lo, &hi))
+		return -EINVAL;
+
+	/* gaps do not overlap, so they are sorted by pfn_hi as well */
+	while (node) {
+		struct samsung_iova_gap *gap = rb_entry(node, struct samsung_iova_gap, addr_node);
+
+		if (gap->pfn_hi >= lo) {
+			first = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	while (first) {
+		struct samsung_iova_gap *gap = rb_entry(first, struct samsung_iova_gap, addr_node);
+
+		if (gap->pfn_lo > hi)
+			break;
+
+		first = rb_next(first);
+		gap_del(gaps, gap);
+	}
+
+	return gap_add(gaps, lo, hi);
+}
+
+static int iova_gaps_split(struct samsung_iova_gaps *gaps, struct samsung_iova_gap *gap,
+			   unsigned long pfn_lo, unsigned long pfn_hi)
+{
+	unsigned long lo = gap->pfn_lo, hi = gap->pfn_hi;
+
+	gap_del(gaps, gap);
+
+	if (pfn_lo > lo && gap_add(gaps, lo, pfn_lo - 1))
+		return -ENOMEM;
+
+	if (pfn_hi < hi && gap_add(gaps, pfn_hi + 1, hi))
+		return -ENOMEM;
+
+	return 0;
+}
+
+static struct rb_node *iova_gaps_lower_bound(struct samsung_iova_gaps *gaps,
+					     unsigned long size)
+{
+	struct rb_node *node = gaps->size_root.rb_node, *found = NULL;
+
+	while (node) {
+		struct samsung_iova_gap *gap = rb_entry(node, struct samsung_iova_gap, size_node);
+
+		if (gap_size(gap) >= size) {
+			found = node;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return found;
+}
+
+/* Walk the tree backwards */
+static int iova_best_fit_linear(struct iova_domain *iovad, unsigned long size,
+				unsigned long limit_pfn, unsigned long align_mask,
+				unsigned long *pfn)
+{
+	struct rb_node *curr = &iovad->anchor.node, *prev;
+	unsigned long lo, hi, new_pfn, candidate_gap = ~0UL;
+	int ret = -ENOMEM;
+
+	do {
+		prev = rb_prev(curr);
+		lo = prev ? to_iova(prev)->pfn_hi + 1 : iovad->start_pfn;
+		hi = to_iova(curr)->pfn_lo;
+		curr = prev;
+
+		if (hi <= lo || hi - lo >= candidate_gap)
+			continue;
+
+		if (iova_gap_fit(lo, hi - 1, size, limit_pfn, align_mask, &new_pfn)) {
+			candidate_gap = hi - lo;
+			*pfn = new_pfn;
+			ret = 0;
+			if (candidate_gap == size)
+				break;
+		}
+	} while (curr);
+
+	return ret;
+}
+
+static int iova_best_fit_gaps(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			      unsigned long size, unsigned long limit_pfn,
+			      unsigned long align_mask, unsigned long *pfn)
+{
+	struct samsung_iova_gap *gap;
+	struct rb_node *node;
+	unsigned long lo, hi;
+	bool rebuilt = false;
+
+retry:
+	for (node = iova_gaps_lower_bound(gaps, size); node; node = rb_next(node)) {
+		gap = rb_entry(node, struct samsung_iova_gap, size_node);
+
+		if (!iova_gap_fit(gap->pfn_lo, gap->pfn_hi, size, limit_pfn, align_mask, pfn))
+			continue;
+
+		if (!iova_free_range(iovad, gap->pfn_lo, &lo, &hi) ||
+		    lo != gap->pfn_lo || hi != gap->pfn_hi) {
+			if (iova_gaps_sync(iovad, gaps, gap->pfn_lo)) {
+				iova_gaps_drop(gaps);
+				goto linear;
+			}
+			goto retry;
+		}
+
+		if (iova_gaps_split(gaps, gap, *pfn, *pfn + size - 1))
+			iova_gaps_drop(gaps);
+
+		return 0;
+	}
+
+	if (!rebuilt) {
+		rebuilt = true;
+		if (iova_gaps_rebuild(iovad, gaps))
+			goto linear;
+		goto retry;
+	}
+
+	return -ENOMEM;
+linear:
+	return iova_best_fit_linear(iovad, size, limit_pfn, align_mask, pfn);
+}
+
+/*
+ * Find the smallest free range fitting @size below @limit_pfn and insert
+ * @new_iova there. Without @gaps or if they could not be built, the iova
+ * rbtree is walked instead. The caller holds iova_rbtree_lock.
+ */
+int samsung_iova_best_fit(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			  unsigned long size, unsigned long limit_pfn,
+			  unsigned long align_mask, struct iova *new_iova)
+{
+	unsigned long pfn;
+	int ret;
+
+	if (gaps && (!gaps->valid || iova_gaps_stale(gaps)))
+		iova_gaps_rebuild(iovad, gaps);
+
+	if (gaps && gaps->valid)
+		ret = iova_best_fit_gaps(iovad, gaps, size, limit_pfn, align_mask, &pfn);
+	else
+		ret = iova_best_fit_linear(iovad, size, limit_pfn, align_mask, &pfn);
+
+	if (ret)
+		return ret;
+
+	/* pfn_lo will point to size aligned address if size_aligned is set */
+	new_iova->pfn_lo = pfn;
+	new_iova->pfn_hi = pfn + size - 1;
+	iova_insert_rbtree(&iovad->rbroot, new_iova);
+
+	return 0;
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_iova_best_fit);
+
+/*
+ * Called with iova_rbtree_lock held after the iova at @pfn is freed. If it is
+ * still in the rbtree, it has been kept in the rcache or the flush queue.
+ */
+void samsung_iova_gaps_release(struct iova_domain *iovad, struct samsung_iova_gaps *gaps,
+			       unsigned long pfn)
+{
+	unsigned long lo, hi;
+
+	if (!gaps->valid)
+		return;
+
+	if (!iova_free_range(iovad, pfn, &lo, &hi)) {
+		gaps->nr_deferred++;
+		return;
+	}
+
+	if (iova_gaps_sync(iovad, gaps, pfn))
+		iova_gaps_drop(gaps);
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_iova_gaps_release);
+
+#if IS_ENABLED(CONFIG_KUNIT)
+/* Wait for the nodes asked for so far and rebuild the gaps with them */
+int samsung_iova_gaps_settle(struct iova_domain *iovad, struct samsung_iova_gaps *gaps)
+{
+	unsigned long flags;
+	int ret, tries = 2;
+
+	do {
+		flush_work(&gaps->refill_work);
+		spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
+		ret = iova_gaps_rebuild(iovad, gaps);
+		spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
+	} while (ret && --tries);
+
+	return ret;
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_iova_gaps_settle);
+#endif
+
+struct samsung_iova_gaps *samsung_iova_gaps_create(void)
+{
+	struct samsung_iova_gaps *gaps = kzalloc(sizeof(*gaps), GFP_KERNEL);
+
+	if (!gaps)
+		return NULL;
+
+	gaps->addr_root = RB_ROOT;
+	gaps->size_root = RB_ROOT;
+	init_llist_head(&gaps->free_list);
+	INIT_WORK(&gaps->refill_work, iova_gaps_refill_work);
+
+	/* the first gaps are built before the work has ever run */
+	atomic_long_set(&gaps->nr_refill, IOVA_GAPS_RESERVE);
+	iova_gaps_refill_work(&gaps->refill_work);
+
+	return gaps;
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_iova_gaps_create);
+
+void samsung_iova_gaps_destroy(struct samsung_iova_gaps *gaps)
+{
+	struct samsung_iova_gap *gap, *tmp;
+
+	if (!gaps)
+		return;
+
+	cancel_work_sync(&gaps->refill_work);
+	iova_gaps_clear(gaps);
+	llist_for_each_entry_safe(gap, tmp, llist_del_all(&gaps->free_list), free_node)
+		kfree(gap);
+	kfree(gaps);
+}
+EXPORT_SYMBOL_IF_KUNIT(samsung_iova_gaps_destroy);
@@ -7,6 +7,10 @@
 
 #include <kunit/test.h>
 #include <kunit/visibility.h>
+#include <linux/iommu.h>
+#include <linux/ktime.h>
+#include <linux/platform_device.h>
+#include <linux/sizes.h>
 #include "samsung-iommu-v9.h"
 #include "sysmmu-exynos-test.h"
 
@@ -40,9 +44,116 @@ static void samsung_iommu_log_init_test(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, 0, 0);
 }
 
+#define SYSMMU_BENCH_IOVA	0x10000000UL
+#define SYSMMU_BENCH_PHYS	0x880000000ULL
+#define SYSMMU_BENCH_SIZE	SZ_64M
+
+/*
+ * Map and unmap SYSMMU_BENCH_SIZE in @chunk steps and return the time per MiB.
+ * Nothing is attached to the domain, so only the page table is updated.
+ */
+static void sysmmu_bench(struct kunit *test, struct iommu_domain *domain,
+			 unsigned long iova_offset, unsigned long phys_offset, size_t chunk,
+			 u64 *map_ns, u64 *unmap_ns)
+{
+	unsigned long iova = SYSMMU_BENCH_IOVA + iova_offset;
+	phys_addr_t phys = SYSMMU_BENCH_PHYS + phys_offset;
+	ktime_t begin;
+	size_t done;
+
+	begin = ktime_get();
+	for (done = 0; done < SYSMMU_BENCH_SIZE; done += chunk)
+		KUNIT_ASSERT_EQ(test, 0, iommu_map(domain, iova + done, phys + done, chunk,
+						   IOMMU_READ | IOMMU_WRITE, GFP_KERNEL));
+	*map_ns = ktime_to_ns(ktime_sub(ktime_get(), begin)) / (SYSMMU_BENCH_SIZE / SZ_1M);
+
+	begin = ktime_get();
+	for (done = 0; done < SYSMMU_BENCH_SIZE; done += chunk)
+		KUNIT_ASSERT_EQ(test, chunk, iommu_unmap(domain, iova + done, chunk));
+	*unmap_ns = ktime_to_ns(ktime_sub(ktime_get(), begin)) / (SYSMMU_BENCH_SIZE / SZ_1M);
+
+	KUNIT_EXPECT_EQ(test, 0, iommu_iova_to_phys(domain, iova));
+}
+
+static void samsung_iommu_map_pages_bench_test(struct kunit *test)
+{
+	struct iommu_domain *domain = iommu_domain_alloc(&platform_bus_type);
+	u64 map_ns, unmap_ns;
+
+	if (!domain)
+		kunit_skip(test, "no iommu domain on the platform bus");
+
+	/* iova and phys are never 64KiB aligned together, so only small pages are used */
+	sysmmu_bench(test, domain, SZ_4K, SZ_8K, SZ_4K, &map_ns, &unmap_ns);
+	kunit_info(test, "4KiB pages, per page:   map %llu ns/MiB, unmap %llu ns/MiB\n",
+		   map_ns, unmap_ns);
+	sysmmu_bench(test, domain, SZ_4K, SZ_8K, SYSMMU_BENCH_SIZE, &map_ns, &unmap_ns);
+	kunit_info(test, "4KiB pages, batched:    map %llu ns/MiB, unmap %llu ns/MiB\n",
+		   map_ns, unmap_ns);
+
+	sysmmu_bench(test, domain, 0, 0, SZ_64K, &map_ns, &unmap_ns);
+	kunit_info(test, "64KiB pages, per page:  map %llu ns/MiB, unmap %llu ns/MiB\n",
+		   map_ns, unmap_ns);
+	sysmmu_bench(test, domain, 0, 0, SYSMMU_BENCH_SIZE, &map_ns, &unmap_ns);
+	kunit_info(test, "1MiB sections, batched: map %llu ns/MiB, unmap %llu ns/MiB\n",
+		   map_ns, unmap_ns);
+
+	iommu_domain_free(domain);
+}
+
+#define SYSMMU_FQ_TEST_UNMAPS	4
+
+/* Unmaps of a DMA_FQ domain are pending until flush_iotlb_all */
+static void samsung_iommu_fq_test(struct kunit *test)
+{
+	struct iommu_domain *domain = iommu_domain_alloc(&platform_bus_type);
+	struct iommu_iotlb_gather gather;
+	unsigned long iova;
+	int i;
+
+	if (!domain)
+		kunit_skip(test, "no iommu domain on the platform bus");
+
+	/* the type the core gives the domain of a samsung,flush-queue group */
+	domain->type = IOMMU_DOMAIN_DMA_FQ;
+	KUNIT_ASSERT_EQ(test, 0, samsung_sysmmu_init_fq(domain));
+	KUNIT_ASSERT_EQ(test, 0, samsung_sysmmu_fq_pending(domain));
+
+	/* far enough from each other not to be merged */
+	for (i = 0; i < SYSMMU_FQ_TEST_UNMAPS; i++) {
+		iova = SYSMMU_BENCH_IOVA + i * SZ_4M;
+		KUNIT_ASSERT_EQ(test, 0, iommu_map(domain, iova, SYSMMU_BENCH_PHYS + i * SZ_64K,
+						   SZ_64K, IOMMU_READ | IOMMU_WRITE, GFP_KERNEL));
+	}
+
+	iommu_iotlb_gather_init(&gather);
+	gather.queued = true;
+	for (i = 0; i < SYSMMU_FQ_TEST_UNMAPS - 1; i++) {
+		iova = SYSMMU_BENCH_IOVA + i * SZ_4M;
+		KUNIT_EXPECT_EQ(test, SZ_64K, iommu_unmap_fast(domain, iova, SZ_64K, &gather));
+	}
+	KUNIT_EXPECT_EQ(test, SYSMMU_FQ_TEST_UNMAPS - 1, samsung_sysmmu_fq_pending(domain));
+	KUNIT_EXPECT_EQ(test, ULONG_MAX, gather.start);
+
+	iommu_flush_iotlb_all(domain);
+	KUNIT_EXPECT_EQ(test, 0, samsung_sysmmu_fq_pending(domain));
+
+	/* a strict unmap is gathered for iotlb_sync as before */
+	iommu_iotlb_gather_init(&gather);
+	iova = SYSMMU_BENCH_IOVA + (SYSMMU_FQ_TEST_UNMAPS - 1) * SZ_4M;
+	KUNIT_EXPECT_EQ(test, SZ_64K, iommu_unmap_fast(domain, iova, SZ_64K, &gather));
+	KUNIT_EXPECT_EQ(test, 0, samsung_sysmmu_fq_pending(domain));
+	KUNIT_EXPECT_EQ(test, iova, gather.start);
+	iommu_iotlb_sync(domain, &gather);
+
+	iommu_domain_free(domain);
+}
+
 static struct kunit_case samsung_iommu_test_cases[] = {
 	KUNIT_CASE(samsung_iommu_test),
 	KUNIT_CASE(samsung_iommu_log_init_test),
+	KUNIT_CASE(samsung_iommu_fq_test),
+	KUNIT_CASE_SLOW(samsung_iommu_map_pages_bench_test),
 	{}
 };
 
@@ -8,4 +8,6 @@
 
 void samsung_iommu_deinit_log(struct samsung_iommu_log *log);
 int samsung_iommu_init_log(struct samsung_iommu_log *log, int len);
+int samsung_sysmmu_init_fq(struct iommu_domain *dom);
+int samsung_sysmmu_fq_pending(struct iommu_domain *dom);
 #endif
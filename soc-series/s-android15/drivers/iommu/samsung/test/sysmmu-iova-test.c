@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Copyright (c) 2024 Samsung Electronics Co., Ltd.
+ */
+
+#define pr_fmt(fmt) "sysmmu: " fmt
+
+#include <kunit/test.h>
+#include <linux/iova.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/prandom.h>
+#include <linux/slab.h>
+#include "samsung-iommu-v9.h"
+
+#define IOVA_TEST_START_PFN	1
+#define IOVA_TEST_LIMIT_PFN	(1UL << 24)
+#define IOVA_TEST_ROUNDS	1000
+
+struct iova_test_domain {
+	struct iova_domain iovad;
+	struct samsung_iova_gaps *gaps;
+	struct iova **iovas;
+	unsigned int nr;
+};
+
+static struct iova_test_domain *iova_test_create(struct kunit *test, unsigned int max,
+						 bool gaps)
+{
+	struct iova_test_domain *dom = kunit_kzalloc(test, sizeof(*dom), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dom);
+
+	dom->iovas = kvcalloc(max, sizeof(*dom->iovas), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dom->iovas);
+
+	if (gaps) {
+		dom->gaps = samsung_iova_gaps_create();
+		KUNIT_ASSERT_NOT_ERR_OR_NULL(test, dom->gaps);
+	}
+
+	init_iova_domain(&dom->iovad, PAGE_SIZE, IOVA_TEST_START_PFN);
+
+	return dom;
+}
+
+static struct iova *iova_test_alloc(struct iova_test_domain *dom, unsigned long size,
+				    bool size_aligned)
+{
+	struct iova *iova = kzalloc(sizeof(*iova), GFP_KERNEL);
+	unsigned long align_mask = ~0UL;
+	unsigned long flags;
+	int ret;
+
+	if (!iova)
+		return NULL;
+
+	if (size_aligned)
+		align_mask <<= fls_long(size - 1);
+
+	spin_lock_irqsave(&dom->iovad.iova_rbtree_lock, flags);
+	ret = samsung_iova_best_fit(&dom->iovad, dom->gaps, size, IOVA_TEST_LIMIT_PFN,
+				    align_mask, iova);
+	spin_unlock_irqrestore(&dom->iovad.iova_rbtree_lock, flags);
+
+	if (ret) {
+		kfree(iova);
+		return NULL;
+	}
+	dom->iovas[dom->nr++] = iova;
+
+	return iova;
+}
+
+static void iova_test_free(struct iova_test_domain *dom, unsigned int idx)
+{
+	struct iova *iova = dom->iovas[idx];
+	unsigned long flags;
+
+	spin_lock_irqsave(&dom->iovad.iova_rbtree_lock, flags);
+	rb_erase(&iova->node, &dom->iovad.rbroot);
+	if (dom->gaps)
+		samsung_iova_gaps_release(&dom->iovad, dom->gaps, iova->pfn_lo);
+	spin_unlock_irqrestore(&dom->iovad.iova_rbtree_lock, flags);
+
+	kfree(iova);
+	dom->iovas[idx] = dom->iovas[--dom->nr];
+}
+
+static void iova_test_destroy(struct iova_test_domain *dom)
+{
+	while (dom->nr)
+		iova_test_free(dom, dom->nr - 1);
+
+	put_iova_domain(&dom->iovad);
+	samsung_iova_gaps_destroy(dom->gaps);
+	kvfree(dom->iovas);
+}
+
+/* Count the free ranges below the limit and find the largest one */
+static void iova_test_fragmentation(struct iova_test_domain *dom, unsigned long *nr_holes,
+				    unsigned long *largest)
+{
+	unsigned long lo = IOVA_TEST_START_PFN;
+	struct rb_node *node;
+
+	*nr_holes = 0;
+	*largest = 0;
+
+	for (node = rb_first(&dom->iovad.rbroot); node; node = rb_next(node)) {
+		struct iova *iova = rb_entry(node, struct iova, node);
+		unsigned long hi = min(iova->pfn_lo, IOVA_TEST_LIMIT_PFN);
+
+		if (hi > lo) {
+			(*nr_holes)++;
+			*largest = max(*largest, hi - lo);
+		}
+		lo = iova->pfn_hi + 1;
+	}
+}
+
+static void samsung_iova_best_fit_match_test(struct kunit *test)
+{
+	struct iova_test_domain *ref = iova_test_create(test, 4096, false);
+	struct iova_test_domain *dom = iova_test_create(test, 4096, true);
+	unsigned long ref_holes, ref_largest, holes, largest;
+	struct rnd_state rnd;
+	int i;
+
+	prandom_seed_state(&rnd, 0x5a5a);
+
+	for (i = 0; i < 50000; i++) {
+		u32 rand = prandom_u32_state(&rnd);
+
+		if (ref->nr == 4096 || (ref->nr && rand % 3 == 0)) {
+			unsigned int idx = prandom_u32_state(&rnd) % ref->nr;
+
+			iova_test_free(ref, idx);
+			iova_test_free(dom, idx);
+		} else {
+			unsigned long size = 1 + (rand >> 8) % 256;
+			bool size_aligned = rand & 0x10;
+			struct iova *a = iova_test_alloc(ref, size, size_aligned);
+			struct iova *b = iova_test_alloc(dom, size, size_aligned);
+
+			KUNIT_ASSERT_EQ(test, !a, !b);
+			if (a)
+				KUNIT_ASSERT_EQ(test, a->pfn_lo, b->pfn_lo);
+		}
+	}
+
+	iova_test_fragmentation(ref, &ref_holes, &ref_largest);
+	iova_test_fragmentation(dom, &holes, &largest);
+
+	KUNIT_EXPECT_EQ(test, ref_holes, holes);
+	KUNIT_EXPECT_EQ(test, ref_largest, largest);
+
+	kunit_info(test, "%u live iovas, %lu free ranges, largest %lu pages\n",
+		   dom->nr, holes, largest);
+
+	iova_test_destroy(ref);
+	iova_test_destroy(dom);
+}
+
+static u64 iova_test_measure(struct kunit *test, struct iova_test_domain *dom, u64 seed)
+{
+	struct rnd_state rnd;
+	u64 elapsed = 0;
+	int i;
+
+	prandom_seed_state(&rnd, seed);
+
+	for (i = 0; i < IOVA_TEST_ROUNDS; i++) {
+		unsigned long size = 1 + prandom_u32_state(&rnd) % 16;
+		ktime_t begin = ktime_get();
+
+		KUNIT_ASSERT_NOT_NULL(test, iova_test_alloc(dom, size, false));
+		elapsed += ktime_to_ns(ktime_sub(ktime_get(), begin));
+
+		iova_test_free(dom, prandom_u32_state(&rnd) % dom->nr);
+	}
+
+	return elapsed / IOVA_TEST_ROUNDS;
+}
+
+static void samsung_iova_best_fit_latency(struct kunit *test, unsigned int nr_live)
+{
+	unsigned int max = nr_live + nr_live / 2 + 1;
+	struct iova_test_domain *ref = iova_test_create(test, max, true);
+	struct iova_test_domain *dom = iova_test_create(test, max, true);
+	struct rnd_state rnd;
+	u64 linear, gaps;
+	unsigned int i;
+
+	prandom_seed_state(&rnd, nr_live);
+
+	/* populate with holes, with the gaps of both to keep it short */
+	for (i = 0; i < max - 1; i++) {
+		unsigned long size = 1 + prandom_u32_state(&rnd) % 16;
+
+		KUNIT_ASSERT_NOT_NULL(test, iova_test_alloc(ref, size, false));
+		KUNIT_ASSERT_NOT_NULL(test, iova_test_alloc(dom, size, false));
+	}
+
+	while (dom->nr > nr_live) {
+		unsigned int idx = prandom_u32_state(&rnd) % dom->nr;
+
+		iova_test_free(ref, idx);
+		iova_test_free(dom, idx);
+	}
+
+	samsung_iova_gaps_destroy(ref->gaps);
+	ref->gaps = NULL;
+	KUNIT_ASSERT_EQ(test, samsung_iova_gaps_settle(&dom->iovad, dom->gaps), 0);
+
+	linear = iova_test_measure(test, ref, nr_live);
+	gaps = iova_test_measure(test, dom, nr_live);
+
+	kunit_info(test, "%6u live iovas: walk %llu ns, gap tree %llu ns per allocation\n",
+		   nr_live, linear, gaps);
+
+	iova_test_destroy(ref);
+	iova_test_destroy(dom);
+}
+
+static void samsung_iova_best_fit_latency_test(struct kunit *test)
+{
+	samsung_iova_best_fit_latency(test, 1000);
+	samsung_iova_best_fit_latency(test, 10000);
+	samsung_iova_best_fit_latency(test, 50000);
+}
+
+static struct kunit_case samsung_iova_test_cases[] = {
+	KUNIT_CASE(samsung_iova_best_fit_match_test),
+	KUNIT_CASE_SLOW(samsung_iova_best_fit_latency_test),
+	{}
+};
+
+static struct kunit_suite samsung_iova_test_suite = {
+	.name = "sysmmu_exynos_iova",
+	.test_cases = samsung_iova_test_cases,
+};
+
+kunit_test_suites(&samsung_iova_test_suite);
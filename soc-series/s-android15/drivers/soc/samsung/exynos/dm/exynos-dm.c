@@ -28,19 +28,112 @@
 #endif
 #include <../drivers/soc/samsung/cal-if/acpm_dvfs.h>
 #include <soc/samsung/exynos-cpupm.h>
+#include <kunit/visibility.h>
 
 #include <soc/samsung/exynos-dm.h>
 
 #define DM_EMPTY	0xFF
-static struct exynos_dm_device *exynos_dm;
+VISIBLE_IF_KUNIT struct exynos_dm_device *exynos_dm;
+EXPORT_SYMBOL_IF_KUNIT(exynos_dm);
 static ATOMIC_NOTIFIER_HEAD(exynos_dm_fast_switch_notifier);
 
 static int dm_idle_ip_index;
 static int dm_fast_switch_idle_ip_index;
 static spinlock_t fast_switch_glb_lock;
 
+/* DM calls of different components run concurrently */
+static DEFINE_SPINLOCK(dm_idle_lock);
+static int dm_busy_count;
+
+/* bumped by dynamic disable, constraints are evaluated again */
+static atomic_t dm_gen;
+
 void exynos_dm_dynamic_disable(int flag);
 
+/*
+ * Component locking
+ *
+ * Domains are serialized only against the domains they are connected to
+ * by constraints. The components change when a constraint table is
+ * registered, with topology_sem write locked.
+ */
+static struct exynos_dm_comp *exynos_dm_comp_lock(struct exynos_dm_data *dm)
+{
+	struct exynos_dm_comp *comp;
+	bool contended;
+
+	percpu_down_read(&exynos_dm->topology_sem);
+
+	comp = &exynos_dm->comps[dm->comp_id];
+	contended = !mutex_trylock(&comp->lock);
+	if (contended) {
+		mutex_lock(&comp->lock);
+		dm->stat.contended++;
+	}
+
+	return comp;
+}
+
+static void exynos_dm_comp_unlock(struct exynos_dm_comp *comp)
+{
+	mutex_unlock(&comp->lock);
+	percpu_up_read(&exynos_dm->topology_sem);
+}
+
+/*
+ * exynos_dm_call_fast() stores governor_freq and then checks seq, while a
+ * propagation bumps seq and then loads governor_freq. Order the seq store
+ * before those loads, so that one of both always sees the other.
+ */
+static void exynos_dm_comp_write_begin(struct exynos_dm_comp *comp)
+{
+	raw_write_seqcount_begin(&comp->seq);
+	smp_mb();
+}
+
+static void exynos_dm_mark_dirty(struct exynos_dm_data *dm)
+{
+	dm->dirty = true;
+	WRITE_ONCE(exynos_dm->comps[dm->comp_id].dirty, true);
+}
+
+static void exynos_dm_comp_update_dirty(struct exynos_dm_comp *comp)
+{
+	bool dirty = false;
+	int i;
+
+	for (i = comp->start; i < comp->end; i++)
+		dirty |= exynos_dm->dm_data[exynos_dm->domain_order[i]].dirty;
+
+	WRITE_ONCE(comp->dirty, dirty);
+}
+
+/* evaluate the whole component once dynamic disable has changed */
+static void exynos_dm_comp_sync_gen(struct exynos_dm_comp *comp)
+{
+	int gen = atomic_read(&dm_gen);
+	int i;
+
+	if (comp->gen == gen)
+		return;
+
+	comp->gen = gen;
+	for (i = comp->start; i < comp->end; i++)
+		exynos_dm_mark_dirty(&exynos_dm->dm_data[exynos_dm->domain_order[i]]);
+}
+
+static void exynos_dm_set_busy(bool busy)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dm_idle_lock, flags);
+	if (busy && dm_busy_count++ == 0)
+		exynos_update_ip_idle_status(dm_idle_ip_index, 0);
+	else if (!busy && --dm_busy_count == 0)
+		exynos_update_ip_idle_status(dm_idle_ip_index, 1);
+	spin_unlock_irqrestore(&dm_idle_lock, flags);
+}
+
 /*
  * SYSFS for Debugging
  */
@@ -179,6 +272,16 @@ static ssize_t show_dm_policy(struct device *dev, struct device_attribute *attr,
 	count += snprintf(buf + count, PAGE_SIZE,
 			"gov_min = %u, governor_freq = %u\n", dm->gov_min, dm->governor_freq);
 	count += snprintf(buf + count, PAGE_SIZE, "current_freq = %u\n", dm->cur_freq);
+	count += snprintf(buf + count, PAGE_SIZE,
+			"-------------------------------------------------\n");
+	count += snprintf(buf + count, PAGE_SIZE,
+			"component = %s, dm_call = %llu, fast = %llu, contended = %llu\n",
+			exynos_dm->dm_data[dm->comp_id].dm_type_name, dm->stat.count,
+			(u64)atomic64_read(&dm->stat.fast), dm->stat.contended);
+	count += snprintf(buf + count, PAGE_SIZE,
+			"latency avg = %llu ns, max = %llu ns\n",
+			dm->stat.count ? div64_u64(dm->stat.lat_sum, dm->stat.count) : 0,
+			dm->stat.lat_max);
 	count += snprintf(buf + count, PAGE_SIZE,
 			"-------------------------------------------------\n");
 	count += snprintf(buf + count, PAGE_SIZE, "min constraint by\n");
@@ -380,6 +483,7 @@ static ssize_t store_fast_switch(struct device *dev,
 {
 	int domain, flag, ret = 0;
 	struct exynos_dm_data *data;
+	struct exynos_dm_comp *comp;
 
 	ret = sscanf(buf, "%u %u", &domain, &flag);
 	if (ret != 2)
@@ -390,9 +494,10 @@ static ssize_t store_fast_switch(struct device *dev,
 
 	data = &exynos_dm->dm_data[domain];
 
-	mutex_lock(&exynos_dm->lock);
+	comp = exynos_dm_comp_lock(data);
 	data->fast_switch = !!flag;
-	mutex_unlock(&exynos_dm->lock);
+	exynos_dm_mark_dirty(data);
+	exynos_dm_comp_unlock(comp);
 
 	return count;
 }
@@ -421,11 +526,10 @@ static struct attribute_group exynos_dm_attr_group = {
 
 void exynos_dm_dynamic_disable(int flag)
 {
-	mutex_lock(&exynos_dm->lock);
-
-	exynos_dm->dynamic_disable = !!flag;
+	WRITE_ONCE(exynos_dm->dynamic_disable, !!flag);
 
-	mutex_unlock(&exynos_dm->lock);
+	// Each component evaluates its constraints again on its next call
+	atomic_inc(&dm_gen);
 }
 EXPORT_SYMBOL(exynos_dm_dynamic_disable);
 
@@ -519,6 +623,11 @@ static int exynos_dm_parse_dt(struct device_node *np, struct exynos_dm_device *d
 		dev_err(dm->dev, "failed to allocate domain_order\n");
 		return -ENOMEM;
 	}
+	dm->comps = kzalloc(sizeof(struct exynos_dm_comp) * dm->domain_count, GFP_KERNEL);
+	if (!dm->comps) {
+		dev_err(dm->dev, "failed to allocate comps\n");
+		return -ENOMEM;
+	}
 
 	for_each_child_of_node(domain_np, child_np) {
 		int index;
@@ -604,16 +713,18 @@ int exynos_dm_data_init(int dm_type, void *data,
 			u32 min_freq, u32 max_freq, u32 cur_freq)
 {
 	struct exynos_dm_data *dm;
+	struct exynos_dm_comp *comp;
 	int ret = 0;
 
 	ret = exynos_dm_index_validate(dm_type);
 	if (ret)
 		return ret;
 
-	mutex_lock(&exynos_dm->lock);
-
 	dm = &exynos_dm->dm_data[dm_type];
 
+	comp = exynos_dm_comp_lock(dm);
+	exynos_dm_comp_write_begin(comp);
+
 	if (!dm->available) {
 		dev_err(exynos_dm->dev,
 			"This dm type(%d) is not available\n", dm_type);
@@ -626,14 +737,96 @@ int exynos_dm_data_init(int dm_type, void *data,
 	dm->governor_freq = dm->cur_freq = cur_freq;
 
 	dm->devdata = data;
+	exynos_dm_mark_dirty(dm);
 
 out:
-	mutex_unlock(&exynos_dm->lock);
+	raw_write_seqcount_end(&comp->seq);
+	exynos_dm_comp_unlock(comp);
 
 	return ret;
 }
 EXPORT_SYMBOL_GPL(exynos_dm_data_init);
 
+static int exynos_dm_comp_find(int *parent, int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+
+	return i;
+}
+
+static void exynos_dm_comp_union(int *parent, int a, int b)
+{
+	a = exynos_dm_comp_find(parent, a);
+	b = exynos_dm_comp_find(parent, b);
+
+	// The lowest dm_type names the component
+	if (a < b)
+		parent[b] = a;
+	else
+		parent[a] = b;
+}
+
+/*
+ * Split domain_order into connected components, keeping the topological
+ * order within each of them. Domains without any constraint follow as
+ * components of their own.
+ */
+static void exynos_dm_split_components(int *parent, int *orderQ, int count)
+{
+	struct exynos_dm_constraint *t;
+	int *resultQ = exynos_dm->domain_order;
+	int r_head = 0;
+	int i, j;
+
+	for (i = 0; i < exynos_dm->domain_count; i++) {
+		parent[i] = i;
+		exynos_dm->dm_data[i].comp_id = i;
+		exynos_dm->comps[i].start = -1;
+		exynos_dm->comps[i].end = -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct exynos_dm_data *dm = &exynos_dm->dm_data[orderQ[i]];
+
+		list_for_each_entry(t, &dm->min_slaves, master_domain)
+			exynos_dm_comp_union(parent, orderQ[i], t->dm_slave);
+		list_for_each_entry(t, &dm->max_slaves, master_domain)
+			exynos_dm_comp_union(parent, orderQ[i], t->dm_slave);
+	}
+
+	for (i = 0; i < exynos_dm->domain_count; i++) {
+		struct exynos_dm_data *dm = &exynos_dm->dm_data[i];
+
+		if (dm->available && list_empty(&dm->min_slaves) && list_empty(&dm->max_slaves)
+				&& list_empty(&dm->min_masters) && list_empty(&dm->max_masters))
+			orderQ[count++] = i;
+	}
+
+	for (i = 0; i < count; i++) {
+		int root = exynos_dm_comp_find(parent, orderQ[i]);
+		struct exynos_dm_comp *comp = &exynos_dm->comps[root];
+
+		if (comp->start >= 0)
+			continue;
+
+		comp->start = r_head;
+		for (j = i; j < count; j++) {
+			struct exynos_dm_data *dm = &exynos_dm->dm_data[orderQ[j]];
+
+			if (exynos_dm_comp_find(parent, orderQ[j]) != root)
+				continue;
+
+			resultQ[r_head] = orderQ[j];
+			dm->my_order = r_head++;
+			dm->comp_id = root;
+			dm->dirty = true;
+		}
+		comp->end = r_head;
+		comp->dirty = true;
+	}
+}
+
 /*
  * 	Initialize sequence Step.2
  */
@@ -684,7 +877,6 @@ static void exynos_dm_topological_sort(void)
 		poll = searchQ[s_rear++];
 		// Push the item which has 0 indegree into resultQ
 		resultQ[r_head++] = poll;
-		exynos_dm->dm_data[poll].my_order = r_head - 1;
 		// Decrease the indegree which indecated by poll item.
 		list_for_each_entry(t, &exynos_dm->dm_data[poll].min_slaves, master_domain) {
 			if (--indegree[t->dm_slave] == 0)
@@ -695,26 +887,33 @@ static void exynos_dm_topological_sort(void)
 	// Size of result queue means the number of domains which has constraint
 	exynos_dm->constraint_domain_count = r_head;
 
+	// Both queues are free now, reuse them for the components
+	memcpy(searchQ, resultQ, sizeof(int) * r_head);
+	exynos_dm_split_components(indegree, searchQ, r_head);
+
 	kfree(indegree);
 	kfree(searchQ);
 }
 
 int exynos_dm_change_freq_table(struct exynos_dm_constraint *constraint, int idx)
 {
+	struct exynos_dm_data *master = &exynos_dm->dm_data[constraint->dm_master];
+	struct exynos_dm_comp *comp;
 	int ret = -EINVAL;
 
-	mutex_lock(&exynos_dm->lock);
+	comp = exynos_dm_comp_lock(master);
 
 	if (!constraint->support_variable_freq_table || idx > constraint->num_table_index)
 		goto out;
 
 	constraint->freq_table = constraint->variable_freq_table[idx];
 	constraint->current_table_idx = idx;
+	exynos_dm_mark_dirty(master);
 
 	ret = 0;
 
 out:
-	mutex_unlock(&exynos_dm->lock);
+	exynos_dm_comp_unlock(comp);
 
 	return ret;
 }
@@ -765,7 +964,7 @@ int register_exynos_dm_constraint_table(int dm_type,
 	}
 
 
-	mutex_lock(&exynos_dm->lock);
+	percpu_down_write(&exynos_dm->topology_sem);
 
 	constraint->const_freq = 0;
 	constraint->gov_freq = 0;
@@ -830,7 +1029,7 @@ int register_exynos_dm_constraint_table(int dm_type,
 
 	exynos_dm_topological_sort();
 
-	mutex_unlock(&exynos_dm->lock);
+	percpu_up_write(&exynos_dm->topology_sem);
 
 	return 0;
 
@@ -840,7 +1039,7 @@ err_sub_const:
 	list_del(&constraint->master_domain);
 	list_del(&constraint->slave_domain);
 
-	mutex_unlock(&exynos_dm->lock);
+	percpu_up_write(&exynos_dm->topology_sem);
 
 	return ret;
 }
@@ -854,6 +1053,7 @@ EXPORT_SYMBOL_GPL(register_exynos_dm_constraint_table);
 int register_exynos_dm_freq_scaler(int dm_type,
 			int (*scaler_func)(int dm_type, void *devdata, u32 target_freq, unsigned int relation))
 {
+	struct exynos_dm_comp *comp;
 	int ret = 0;
 
 	ret = exynos_dm_index_validate(dm_type);
@@ -865,7 +1065,7 @@ int register_exynos_dm_freq_scaler(int dm_type,
 		return -EINVAL;
 	}
 
-	mutex_lock(&exynos_dm->lock);
+	comp = exynos_dm_comp_lock(&exynos_dm->dm_data[dm_type]);
 
 	if (!exynos_dm->dm_data[dm_type].available) {
 		dev_err(exynos_dm->dev,
@@ -874,11 +1074,13 @@ int register_exynos_dm_freq_scaler(int dm_type,
 		goto out;
 	}
 
-	if (!exynos_dm->dm_data[dm_type].freq_scaler)
+	if (!exynos_dm->dm_data[dm_type].freq_scaler) {
 		exynos_dm->dm_data[dm_type].freq_scaler = scaler_func;
+		exynos_dm_mark_dirty(&exynos_dm->dm_data[dm_type]);
+	}
 
 out:
-	mutex_unlock(&exynos_dm->lock);
+	exynos_dm_comp_unlock(comp);
 
 	return 0;
 }
@@ -886,13 +1088,14 @@ EXPORT_SYMBOL_GPL(register_exynos_dm_freq_scaler);
 
 int unregister_exynos_dm_freq_scaler(int dm_type)
 {
+	struct exynos_dm_comp *comp;
 	int ret = 0;
 
 	ret = exynos_dm_index_validate(dm_type);
 	if (ret)
 		return ret;
 
-	mutex_lock(&exynos_dm->lock);
+	comp = exynos_dm_comp_lock(&exynos_dm->dm_data[dm_type]);
 
 	if (!exynos_dm->dm_data[dm_type].available) {
 		dev_err(exynos_dm->dev,
@@ -905,7 +1108,7 @@ int unregister_exynos_dm_freq_scaler(int dm_type)
 		exynos_dm->dm_data[dm_type].freq_scaler = NULL;
 
 out:
-	mutex_unlock(&exynos_dm->lock);
+	exynos_dm_comp_unlock(comp);
 
 	return 0;
 }
@@ -931,6 +1134,7 @@ static int update_constraint_min(struct exynos_dm_constraint *constraint, u32 ma
 	struct exynos_dm_data *dm = &exynos_dm->dm_data[constraint->dm_slave];
 	struct exynos_dm_freq *const_table = constraint->freq_table;
 	struct exynos_dm_constraint *t;
+	u32 prev_const_min = dm->const_min;
 	int i;
 
 	// This constraint condition could be ignored when perf lock is disabled
@@ -955,6 +1159,9 @@ static int update_constraint_min(struct exynos_dm_constraint *constraint, u32 ma
 		dm->const_min = max(t->const_freq, dm->const_min);
 	}
 
+	if (dm->const_min != prev_const_min)
+		exynos_dm_mark_dirty(dm);
+
 	return 0;
 }
 
@@ -963,6 +1170,7 @@ static int update_constraint_max(struct exynos_dm_constraint *constraint, u32 ma
 	struct exynos_dm_data *dm = &exynos_dm->dm_data[constraint->dm_slave];
 	struct exynos_dm_freq *const_table = constraint->freq_table;
 	struct exynos_dm_constraint *t;
+	u32 prev_const_max = dm->const_max;
 	int i;
 
 	// Find constraint condition for max relationship
@@ -979,6 +1187,9 @@ static int update_constraint_max(struct exynos_dm_constraint *constraint, u32 ma
 		dm->const_max = min(t->const_freq, dm->const_max);
 	}
 
+	if (dm->const_max != prev_const_max)
+		exynos_dm_mark_dirty(dm);
+
 	return 0;
 }
 
@@ -991,6 +1202,7 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 	int size, ch_num;
 #endif
 	struct exynos_dm_data *domain;
+	struct exynos_dm_comp *comp;
 	u32 prev_min, prev_max, new_min, new_max;
 	int ret = 0, i;
 	struct exynos_dm_constraint *t;
@@ -998,10 +1210,11 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 
 	dbg_snapshot_dm(POLICY_IN, dm_type, min_freq, max_freq);
 
-	mutex_lock(&exynos_dm->lock);
-
 	dm = &exynos_dm->dm_data[dm_type];
 
+	comp = exynos_dm_comp_lock(dm);
+	exynos_dm_comp_write_begin(comp);
+
 	// Return if there has no min/max freq update
 	if (max_freq == 0 && min_freq == 0) {
 		ret = -EINVAL;
@@ -1024,6 +1237,7 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 		update_max_policy = true;
 	dm->policy_max = max_freq;
 	dm->policy_min = min_freq;
+	exynos_dm_mark_dirty(dm);
 
 	/*Send policy to FVP*/
 #if defined(CONFIG_EXYNOS_ACPM) || defined(CONFIG_EXYNOS_ACPM_MODULE) || IS_ENABLED(CONFIG_EXYNOS_ESCA)
@@ -1082,7 +1296,7 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 	if (new_min != prev_min) {
 		int min_freq, max_freq;
 
-		for (i = dm->my_order; i < exynos_dm->constraint_domain_count; i++) {
+		for (i = dm->my_order; i < comp->end; i++) {
 			domain = &exynos_dm->dm_data[exynos_dm->domain_order[i]];
 			min_freq = max(domain->policy_min, domain->const_min);
 			max_freq = min(domain->policy_max, domain->const_max);
@@ -1096,7 +1310,7 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 	if (new_max != prev_max) {
 		int max_freq;
 
-		for (i = dm->my_order; i >= 0; i--) {
+		for (i = dm->my_order; i >= comp->start; i--) {
 			domain = &exynos_dm->dm_data[exynos_dm->domain_order[i]];
 			max_freq = min(domain->policy_max, domain->const_max);
 			list_for_each_entry(t, &domain->max_slaves, master_domain) {
@@ -1105,7 +1319,8 @@ int policy_update_call_to_DM(int dm_type, u32 min_freq, u32 max_freq)
 		}
 	}
 out:
-	mutex_unlock(&exynos_dm->lock);
+	raw_write_seqcount_end(&comp->seq);
+	exynos_dm_comp_unlock(comp);
 
 	dbg_snapshot_dm(POLICY_OUT, dm_type, min_freq, max_freq);
 
@@ -1132,6 +1347,7 @@ static int update_gov_min(struct exynos_dm_constraint *constraint, u32 master_fr
 	struct exynos_dm_data *dm = &exynos_dm->dm_data[constraint->dm_slave];
 	struct exynos_dm_freq *const_table = constraint->freq_table;
 	struct exynos_dm_constraint *t;
+	u32 prev_gov_min = dm->gov_min;
 	int i;
 
 	// This constraint condition could be ignored when perf lock is disabled
@@ -1156,9 +1372,68 @@ static int update_gov_min(struct exynos_dm_constraint *constraint, u32 master_fr
 		dm->gov_min = max(t->gov_freq, dm->gov_min);
 	}
 
+	if (dm->gov_min != prev_gov_min)
+		exynos_dm_mark_dirty(dm);
+
 	return 0;
 }
 
+/*
+ * A request which leaves the next target frequency of its domain where it
+ * is moves no constraint. Only the governor frequency is recorded then,
+ * unless a propagation in the component ran meanwhile or is still pending.
+ * The propagation may sleep in freq_scaler, so this never waits for it.
+ */
+static bool exynos_dm_call_fast(struct exynos_dm_data *target_dm, unsigned long target_freq)
+{
+	struct exynos_dm_comp *comp;
+	u32 max_freq, min_freq, next_freq;
+	unsigned int seq;
+	bool fast = false;
+
+	if (target_freq == 0)
+		return false;
+
+	percpu_down_read(&exynos_dm->topology_sem);
+
+	comp = &exynos_dm->comps[target_dm->comp_id];
+	seq = raw_seqcount_begin(&comp->seq);
+
+	if (READ_ONCE(comp->dirty) || READ_ONCE(comp->gen) != atomic_read(&dm_gen))
+		goto out;
+
+	min_freq = max3(READ_ONCE(target_dm->policy_min), READ_ONCE(target_dm->const_min),
+			READ_ONCE(target_dm->gov_min));
+	min_freq = max_t(u32, min_freq, target_freq);
+	max_freq = min(READ_ONCE(target_dm->policy_max), READ_ONCE(target_dm->const_max));
+	next_freq = min(min_freq, max_freq);
+
+	if (next_freq != READ_ONCE(target_dm->next_target_freq) ||
+	    next_freq != READ_ONCE(target_dm->cur_freq))
+		goto out;
+
+	WRITE_ONCE(target_dm->governor_freq, target_freq);
+
+	// Pairs with exynos_dm_comp_write_begin(), the next propagation sees it
+	smp_mb();
+	fast = !read_seqcount_retry(&comp->seq, seq);
+	if (fast)
+		atomic64_inc(&target_dm->stat.fast);
+out:
+	percpu_up_read(&exynos_dm->topology_sem);
+
+	return fast;
+}
+
+static void exynos_dm_call_stat(struct exynos_dm_data *dm, u64 start)
+{
+	u64 lat = sched_clock() - start;
+
+	dm->stat.count++;
+	dm->stat.lat_sum += lat;
+	dm->stat.lat_max = max(dm->stat.lat_max, lat);
+}
+
 /*
  * DM CALL
  */
@@ -1166,16 +1441,26 @@ int __DM_CALL(int dm_type, unsigned long *target_freq)
 {
 	struct exynos_dm_data *target_dm;
 	struct exynos_dm_data *dm;
+	struct exynos_dm_comp *comp;
 	struct exynos_dm_constraint *t;
 	u32 max_freq, min_freq;
 	int i, ret = 0;
 	unsigned int relation = EXYNOS_DM_RELATION_L;
+	u64 start = sched_clock();
 
-	mutex_lock(&exynos_dm->lock);
+	target_dm = &exynos_dm->dm_data[dm_type];
 
-	exynos_update_ip_idle_status(dm_idle_ip_index, 0);
+	if (exynos_dm_call_fast(target_dm, *target_freq)) {
+		*target_freq = READ_ONCE(target_dm->cur_freq);
+		return 0;
+	}
 
-	target_dm = &exynos_dm->dm_data[dm_type];
+	comp = exynos_dm_comp_lock(target_dm);
+	exynos_dm_comp_write_begin(comp);
+
+	exynos_dm_set_busy(true);
+
+	exynos_dm_comp_sync_gen(comp);
 
 	if (*target_freq != 0) {
 		target_dm->governor_freq = *target_freq;
@@ -1201,12 +1486,21 @@ int __DM_CALL(int dm_type, unsigned long *target_freq)
 		ret = target_dm->freq_scaler(target_dm->dm_type, target_dm->devdata, target_dm->next_target_freq, relation);
 		if (!ret)
 			target_dm->cur_freq = target_dm->next_target_freq;
+		target_dm->dirty = target_dm->cur_freq != target_dm->next_target_freq;
 		goto out;
 	}
 
-	// Propagate the influence of new terget frequencies
-	for (i = 0; i < exynos_dm->constraint_domain_count; i++) {
+	exynos_dm_mark_dirty(target_dm);
+
+	/*
+	 * Propagate the influence of new target frequencies. Slaves come after
+	 * their min masters in domain_order, so a single pass reaches every
+	 * domain which gov_min has moved.
+	 */
+	for (i = comp->start; i < comp->end; i++) {
 		dm = &exynos_dm->dm_data[exynos_dm->domain_order[i]];
+		if (!dm->dirty)
+			continue;
 
 		// Update new target frequency from all min, max restricts.
 		update_new_target(dm->dm_type);
@@ -1225,20 +1519,30 @@ int __DM_CALL(int dm_type, unsigned long *target_freq)
 	}
 
 	// Perform frequency up scaling
-	for (i = exynos_dm->constraint_domain_count - 1; i >= 0; i--) {
+	for (i = comp->end - 1; i >= comp->start; i--) {
 		dm = &exynos_dm->dm_data[exynos_dm->domain_order[i]];
+		if (!dm->dirty)
+			continue;
+
 		if (dm->cur_freq < dm->next_target_freq && dm->freq_scaler && !dm->fast_switch) {
 			ret = dm->freq_scaler(dm->dm_type, dm->devdata, dm->next_target_freq, relation);
 			if (!ret)
 				dm->cur_freq = dm->next_target_freq;
 		}
 
+		// Left dirty only to retry a failed scaling
+		dm->dirty = dm->cur_freq != dm->next_target_freq &&
+				dm->freq_scaler && !dm->fast_switch;
 	}
 
 out:
-	exynos_update_ip_idle_status(dm_idle_ip_index, 1);
+	exynos_dm_comp_update_dirty(comp);
 
-	mutex_unlock(&exynos_dm->lock);
+	exynos_dm_set_busy(false);
+
+	raw_write_seqcount_end(&comp->seq);
+	exynos_dm_call_stat(target_dm, start);
+	exynos_dm_comp_unlock(comp);
 
 	*target_freq = target_dm->cur_freq;
 
@@ -1442,7 +1746,11 @@ static int exynos_dm_probe(struct platform_device *pdev)
 
 	dm->dev = &pdev->dev;
 
-	mutex_init(&dm->lock);
+	ret = percpu_init_rwsem(&dm->topology_sem);
+	if (ret) {
+		dev_err(dm->dev, "failed to init topology_sem\n");
+		goto err_topology_sem;
+	}
 
 	/* parsing devfreq dts data for exynos-dvfs-manager */
 	ret = exynos_dm_parse_dt(dm->dev->of_node, dm);
@@ -1451,6 +1759,11 @@ static int exynos_dm_probe(struct platform_device *pdev)
 		goto err_parse_dt;
 	}
 
+	for (i = 0; i < dm->domain_count; i++) {
+		mutex_init(&dm->comps[i].lock);
+		seqcount_init(&dm->comps[i].seq);
+	}
+
 	print_available_dm_data(dm);
 
 	ret = sysfs_create_group(&dm->dev->kobj, &exynos_dm_attr_group);
@@ -1492,6 +1805,9 @@ static int exynos_dm_probe(struct platform_device *pdev)
 
 	exynos_dm = dm;
 
+	/* every domain is a component of its own until constraints connect them */
+	exynos_dm_topological_sort();
+
 	dm_idle_ip_index = exynos_get_idle_ip_index(EXYNOS_DM_MODULE_NAME, 1);
 	exynos_update_ip_idle_status(dm_idle_ip_index, 1);
 
@@ -1505,7 +1821,11 @@ static int exynos_dm_probe(struct platform_device *pdev)
 	return 0;
 
 err_parse_dt:
-	mutex_destroy(&dm->lock);
+	kfree(dm->comps);
+	kfree(dm->domain_order);
+	kfree(dm->dm_data);
+	percpu_free_rwsem(&dm->topology_sem);
+err_topology_sem:
 	kfree(dm);
 err_device:
 
@@ -1517,7 +1837,10 @@ static int exynos_dm_remove(struct platform_device *pdev)
 	struct exynos_dm_device *dm = platform_get_drvdata(pdev);
 
 	sysfs_remove_group(&dm->dev->kobj, &exynos_dm_attr_group);
-	mutex_destroy(&dm->lock);
+	kfree(dm->comps);
+	kfree(dm->domain_order);
+	kfree(dm->dm_data);
+	percpu_free_rwsem(&dm->topology_sem);
 	kfree(dm);
 
 	return 0;
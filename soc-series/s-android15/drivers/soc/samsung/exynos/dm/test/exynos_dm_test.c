@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/slab.h>
+#include <kunit/test.h>
+#include "exynos_dm_test.h"
+
+/*
+ * A -> B and C -> D are min constraints, E has none. So there are three
+ * components: {A, B}, {C, D} and {E}.
+ */
+enum {
+	DM_TEST_A,
+	DM_TEST_B,
+	DM_TEST_C,
+	DM_TEST_D,
+	DM_TEST_E,
+	DM_TEST_DOMAINS,
+};
+
+static struct exynos_dm_freq dm_test_table[] = {
+	{ 1000,	800 },
+	{ 500,	400 },
+	{ 100,	100 },
+};
+
+static struct exynos_dm_constraint dm_test_const[2];
+static struct exynos_dm_device *dm_test_dev;
+static int dm_test_calls[DM_TEST_DOMAINS];
+
+static int dm_test_scaler(int dm_type, void *devdata, u32 target_freq, unsigned int relation)
+{
+	dm_test_calls[dm_type]++;
+
+	return 0;
+}
+
+static void dm_test_call(struct kunit *test, int dm_type, unsigned long freq)
+{
+	KUNIT_ASSERT_EQ(test, DM_CALL(dm_type, &freq), 0);
+}
+
+static int dm_test_init(struct kunit *test)
+{
+	struct exynos_dm_device *dm;
+	int i;
+
+	if (exynos_dm)
+		kunit_skip(test, "DVFS Manager is in use");
+
+	dm = kunit_kzalloc(test, sizeof(*dm), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, dm);
+	dm->domain_count = DM_TEST_DOMAINS;
+	dm->dm_data = kunit_kcalloc(test, DM_TEST_DOMAINS, sizeof(*dm->dm_data), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, dm->dm_data);
+	dm->domain_order = kunit_kcalloc(test, DM_TEST_DOMAINS, sizeof(int), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, dm->domain_order);
+	dm->comps = kunit_kcalloc(test, DM_TEST_DOMAINS, sizeof(*dm->comps), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, dm->comps);
+	KUNIT_ASSERT_EQ(test, percpu_init_rwsem(&dm->topology_sem), 0);
+
+	for (i = 0; i < DM_TEST_DOMAINS; i++) {
+		struct exynos_dm_data *data = &dm->dm_data[i];
+
+		data->dm_type = i;
+		data->available = true;
+		snprintf(data->dm_type_name, EXYNOS_DM_TYPE_NAME_LEN, "dm_test%d", i);
+		INIT_LIST_HEAD(&data->min_slaves);
+		INIT_LIST_HEAD(&data->max_slaves);
+		INIT_LIST_HEAD(&data->min_masters);
+		INIT_LIST_HEAD(&data->max_masters);
+		mutex_init(&dm->comps[i].lock);
+		seqcount_init(&dm->comps[i].seq);
+	}
+
+	dm_test_dev = dm;
+	exynos_dm = dm;
+
+	for (i = 0; i < ARRAY_SIZE(dm_test_const); i++) {
+		struct exynos_dm_constraint *constraint = &dm_test_const[i];
+
+		memset(constraint, 0, sizeof(*constraint));
+		constraint->dm_slave = i * 2 + 1;
+		constraint->constraint_type = CONSTRAINT_MIN;
+		constraint->table_length = ARRAY_SIZE(dm_test_table);
+		constraint->freq_table = dm_test_table;
+		KUNIT_ASSERT_EQ(test, register_exynos_dm_constraint_table(i * 2, constraint), 0);
+	}
+
+	for (i = 0; i < DM_TEST_DOMAINS; i++) {
+		KUNIT_ASSERT_EQ(test, exynos_dm_data_init(i, NULL, 100, 1000, 100), 0);
+		KUNIT_ASSERT_EQ(test, register_exynos_dm_freq_scaler(i, dm_test_scaler), 0);
+	}
+
+	memset(dm_test_calls, 0, sizeof(dm_test_calls));
+
+	return 0;
+}
+
+static void dm_test_exit(struct kunit *test)
+{
+	int i;
+
+	if (!dm_test_dev)
+		return;
+
+	exynos_dm = NULL;
+	for (i = 0; i < ARRAY_SIZE(dm_test_const); i++) {
+		kfree(dm_test_const[i].variable_freq_table);
+		dm_test_const[i].variable_freq_table = NULL;
+	}
+	for (i = 0; i < DM_TEST_DOMAINS; i++)
+		mutex_destroy(&dm_test_dev->comps[i].lock);
+	percpu_free_rwsem(&dm_test_dev->topology_sem);
+	dm_test_dev = NULL;
+}
+
+static void dm_test_split_components(struct kunit *test)
+{
+	struct exynos_dm_data *data = exynos_dm->dm_data;
+	struct exynos_dm_comp *comp;
+	int i;
+
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_A].comp_id, data[DM_TEST_B].comp_id);
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_C].comp_id, data[DM_TEST_D].comp_id);
+	KUNIT_EXPECT_NE(test, data[DM_TEST_A].comp_id, data[DM_TEST_C].comp_id);
+	KUNIT_EXPECT_NE(test, data[DM_TEST_E].comp_id, data[DM_TEST_A].comp_id);
+	KUNIT_EXPECT_NE(test, data[DM_TEST_E].comp_id, data[DM_TEST_C].comp_id);
+
+	// Masters are evaluated before their slaves
+	KUNIT_EXPECT_LT(test, data[DM_TEST_A].my_order, data[DM_TEST_B].my_order);
+	KUNIT_EXPECT_LT(test, data[DM_TEST_C].my_order, data[DM_TEST_D].my_order);
+
+	for (i = 0; i < DM_TEST_DOMAINS; i++) {
+		comp = &exynos_dm->comps[data[i].comp_id];
+		KUNIT_EXPECT_GE(test, data[i].my_order, comp->start);
+		KUNIT_EXPECT_LT(test, data[i].my_order, comp->end);
+		KUNIT_EXPECT_EQ(test, exynos_dm->domain_order[data[i].my_order], i);
+	}
+
+	comp = &exynos_dm->comps[data[DM_TEST_A].comp_id];
+	KUNIT_EXPECT_EQ(test, comp->end - comp->start, 2);
+	comp = &exynos_dm->comps[data[DM_TEST_C].comp_id];
+	KUNIT_EXPECT_EQ(test, comp->end - comp->start, 2);
+	comp = &exynos_dm->comps[data[DM_TEST_E].comp_id];
+	KUNIT_EXPECT_EQ(test, comp->end - comp->start, 1);
+}
+
+static void dm_test_dirty_propagation(struct kunit *test)
+{
+	struct exynos_dm_data *data = exynos_dm->dm_data;
+	struct exynos_dm_comp *comp = &exynos_dm->comps[data[DM_TEST_A].comp_id];
+	int i;
+
+	// Settle every component, which leaves no domain dirty
+	dm_test_call(test, DM_TEST_A, 200);
+	dm_test_call(test, DM_TEST_C, 200);
+	dm_test_call(test, DM_TEST_E, 200);
+	for (i = 0; i < DM_TEST_DOMAINS; i++) {
+		KUNIT_EXPECT_FALSE(test, data[i].dirty);
+		KUNIT_EXPECT_FALSE(test, READ_ONCE(exynos_dm->comps[data[i].comp_id].dirty));
+	}
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_B].cur_freq, 400U);
+
+	// Raising A raises B through gov_min, the other components stay put
+	memset(dm_test_calls, 0, sizeof(dm_test_calls));
+	dm_test_call(test, DM_TEST_A, 1000);
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_A].cur_freq, 1000U);
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_B].cur_freq, 800U);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_A], 1);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_B], 1);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_C], 0);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_D], 0);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_E], 0);
+	KUNIT_EXPECT_FALSE(test, READ_ONCE(comp->dirty));
+
+	// The same request moves no constraint and scales nothing
+	memset(dm_test_calls, 0, sizeof(dm_test_calls));
+	dm_test_call(test, DM_TEST_A, 1000);
+	for (i = 0; i < DM_TEST_DOMAINS; i++)
+		KUNIT_EXPECT_EQ(test, dm_test_calls[i], 0);
+
+	// Lowering A releases B again
+	memset(dm_test_calls, 0, sizeof(dm_test_calls));
+	dm_test_call(test, DM_TEST_A, 100);
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_A].cur_freq, 100U);
+	KUNIT_EXPECT_EQ(test, data[DM_TEST_B].cur_freq, 100U);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_A], 1);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_B], 1);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_C], 0);
+	KUNIT_EXPECT_EQ(test, dm_test_calls[DM_TEST_D], 0);
+	KUNIT_EXPECT_FALSE(test, READ_ONCE(comp->dirty));
+}
+
+static struct kunit_case dm_test_cases[] = {
+	KUNIT_CASE(dm_test_split_components),
+	KUNIT_CASE(dm_test_dirty_propagation),
+	{}
+};
+
+static struct kunit_suite dm_test_suite = {
+	.name = "dm_exynos",
+	.init = dm_test_init,
+	.exit = dm_test_exit,
+	.test_cases = dm_test_cases,
+};
+
+kunit_test_suites(&dm_test_suite);
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+MODULE_LICENSE("GPL");
@@ -0,0 +1,10 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#ifndef _EXYNOS_DM_TEST_H
+#define _EXYNOS_DM_TEST_H
+
+#include <soc/samsung/exynos-dm.h>
+
+extern struct exynos_dm_device *exynos_dm;
+
+#endif
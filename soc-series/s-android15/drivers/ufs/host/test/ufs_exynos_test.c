@@ -5,6 +5,9 @@
 #include <kunit/visibility.h>
 
 #include "ufs-exynos-dbg.h"
+#if IS_ENABLED(CONFIG_SCSI_UFS_PERF)
+#include "ufs-exynos-perf.h"
+#endif
 
 MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
 
@@ -27,8 +30,31 @@ static void ufs_exynos_dbg_test(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, 0, ret);
 }
 
+#if IS_ENABLED(CONFIG_SCSI_UFS_PERF)
+static void ufs_exynos_perf_percentile_test(struct kunit *test)
+{
+	u64 hist[UFS_PERF_LAT_BUCKETS] = {0,};
+
+	KUNIT_EXPECT_EQ(test, 0, ufs_perf_lat_percentile(hist, 500));
+
+	/* 990 in [64, 128)us, 9 in [1, 2)ms and 1 above */
+	hist[7] = 990;
+	hist[11] = 9;
+	hist[UFS_PERF_LAT_BUCKETS - 1] = 1;
+
+	KUNIT_EXPECT_EQ(test, 128, ufs_perf_lat_percentile(hist, 500));
+	KUNIT_EXPECT_EQ(test, 128, ufs_perf_lat_percentile(hist, 990));
+	KUNIT_EXPECT_EQ(test, 2048, ufs_perf_lat_percentile(hist, 999));
+	KUNIT_EXPECT_EQ(test, 1U << (UFS_PERF_LAT_BUCKETS - 1),
+			ufs_perf_lat_percentile(hist, 1000));
+}
+#endif
+
 static struct kunit_case ufs_exynos_test_cases[] = {
         KUNIT_CASE(ufs_exynos_dbg_test),
+#if IS_ENABLED(CONFIG_SCSI_UFS_PERF)
+        KUNIT_CASE(ufs_exynos_perf_percentile_test),
+#endif
         {}
 };
 
@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Replays synthetic io traces through the request pattern classifier and
+ * a model of the v1 heavy policy, scoring the share of heavy requests that
+ * ran boosted and the time spent boosted.
+ */
+
+#include <kunit/test.h>
+#include <linux/prandom.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+
+#include "ufs-exynos-perf.h"
+
+MODULE_IMPORT_NS(EXPORTED_FOR_KUNIT_TESTING);
+
+#define PRED_TEST_MAX_REQS	8192
+#define PRED_TEST_DISK_SECTORS	(64ULL << 21)	/* 64GB */
+
+struct pred_test_req {
+	struct ufs_perf_pred_req req;
+	bool heavy;
+};
+
+struct pred_test_trace {
+	struct pred_test_req *reqs;
+	u32 nr;
+	s64 time;
+	struct rnd_state rnd;
+};
+
+struct pred_test_score {
+	u32 heavy;
+	u32 hits;
+	s64 boosted_ns;
+};
+
+static void pred_test_add(struct pred_test_trace *trace, s64 time, u64 lba, u32 len,
+			  u8 op, u32 qd, bool sync, bool heavy)
+{
+	struct pred_test_req *r;
+
+	if (WARN_ON(trace->nr >= PRED_TEST_MAX_REQS))
+		return;
+
+	r = &trace->reqs[trace->nr++];
+	r->req.time = time;
+	r->req.lba = lba;
+	r->req.len = len;
+	r->req.qd = qd;
+	r->req.op = op;
+	r->req.sync = sync;
+	r->heavy = heavy;
+}
+
+static u64 pred_test_rand_lba(struct pred_test_trace *trace)
+{
+	return (prandom_u32_state(&trace->rnd) % (PRED_TEST_DISK_SECTORS >> 3)) << 3;
+}
+
+/* app launch: readahead of 4 x 128K every 2ms and page faults in between */
+static void pred_test_launch(struct pred_test_trace *trace, s64 dur)
+{
+	u64 lba = pred_test_rand_lba(trace);
+	s64 t;
+	int i;
+
+	for (t = 0; t < dur; t += 2 * NSEC_PER_MSEC) {
+		for (i = 0; i < 4; i++) {
+			pred_test_add(trace, trace->time + t + i * 10 * NSEC_PER_USEC, lba, SZ_128K,
+				      UFS_PERF_OP_R, i + 1, false, true);
+			lba += SZ_128K >> SECTOR_SHIFT;
+		}
+		for (i = 0; i < 6; i++)
+			pred_test_add(trace, trace->time + t + (i + 1) * 300 * NSEC_PER_USEC,
+				      pred_test_rand_lba(trace), prandom_u32_state(&trace->rnd) & 1 ? SZ_4K : SZ_16K,
+				      UFS_PERF_OP_R, 1, false, true);
+	}
+	trace->time += dur;
+}
+
+/* 8 random 4K reads queued every 1ms */
+static void pred_test_random(struct pred_test_trace *trace, s64 dur)
+{
+	s64 t;
+	int i;
+
+	for (t = 0; t < dur; t += NSEC_PER_MSEC)
+		for (i = 0; i < 8; i++)
+			pred_test_add(trace, trace->time + t + i * 5 * NSEC_PER_USEC,
+				      pred_test_rand_lba(trace), SZ_4K, UFS_PERF_OP_R, i + 1, false, true);
+	trace->time += dur;
+}
+
+/* camera burst: two 256K writes of a shot, its fua metadata write and flush */
+static void pred_test_burst(struct pred_test_trace *trace, s64 dur)
+{
+	u64 lba = pred_test_rand_lba(trace);
+	s64 t;
+
+	for (t = 0; t < dur; t += 3 * NSEC_PER_MSEC) {
+		pred_test_add(trace, trace->time + t, lba, SZ_256K, UFS_PERF_OP_W, 1, false, true);
+		pred_test_add(trace, trace->time + t + 10 * NSEC_PER_USEC, lba + 512, SZ_256K,
+			      UFS_PERF_OP_W, 2, false, true);
+		pred_test_add(trace, trace->time + t + 400 * NSEC_PER_USEC, pred_test_rand_lba(trace),
+			      SZ_4K, UFS_PERF_OP_W, 1, true, true);
+		pred_test_add(trace, trace->time + t + 500 * NSEC_PER_USEC, 0, 0,
+			      UFS_PERF_OP_S, 1, true, true);
+		lba += 1024;
+	}
+	trace->time += dur;
+}
+
+/* 8 x 512K reads queued every 2ms */
+static void pred_test_streaming(struct pred_test_trace *trace, s64 dur)
+{
+	u64 lba = pred_test_rand_lba(trace);
+	s64 t;
+	int i;
+
+	for (t = 0; t < dur; t += 2 * NSEC_PER_MSEC) {
+		for (i = 0; i < 8; i++) {
+			pred_test_add(trace, trace->time + t + i * 10 * NSEC_PER_USEC, lba, SZ_512K,
+				      UFS_PERF_OP_R, i + 1, false, true);
+			lba += SZ_512K >> SECTOR_SHIFT;
+		}
+	}
+	trace->time += dur;
+}
+
+/* background: sparse small io with an occasional fsync */
+static void pred_test_background(struct pred_test_trace *trace, s64 dur)
+{
+	s64 t;
+	int i = 0;
+
+	for (t = 0; t < dur; t += 40 * NSEC_PER_MSEC, i++) {
+		bool write = prandom_u32_state(&trace->rnd) & 1;
+
+		pred_test_add(trace, trace->time + t, pred_test_rand_lba(trace),
+			      write ? SZ_16K : SZ_4K,
+			      write ? UFS_PERF_OP_W : UFS_PERF_OP_R, 1, false, false);
+		if (!(i % 5))
+			pred_test_add(trace, trace->time + t + NSEC_PER_MSEC, 0, 0,
+				      UFS_PERF_OP_S, 1, true, false);
+	}
+	trace->time += dur;
+}
+
+/* media playback: a 128K sequential read every 20ms */
+static void pred_test_playback(struct pred_test_trace *trace, s64 dur)
+{
+	u64 lba = pred_test_rand_lba(trace);
+	s64 t;
+
+	for (t = 0; t < dur; t += 20 * NSEC_PER_MSEC) {
+		pred_test_add(trace, trace->time + t, lba, SZ_128K, UFS_PERF_OP_R, 1, false, false);
+		lba += SZ_128K >> SECTOR_SHIFT;
+	}
+	trace->time += dur;
+}
+
+static void pred_test_replay_pred(const struct pred_test_trace *trace,
+				  struct pred_test_score *score)
+{
+	struct ufs_perf_pred pred = {};
+	struct ufs_perf_pred_hist hist = {};
+	bool boosted = false;
+	s64 on = 0;
+	u32 i;
+
+	ufs_perf_pred_init_stats(&pred);
+
+	for (i = 0; i < trace->nr; i++) {
+		const struct pred_test_req *r = &trace->reqs[i];
+		bool boost;
+
+		/* the hold timer expired before this request */
+		if (boosted && r->req.time >= pred.hold_until) {
+			score->boosted_ns += pred.hold_until - on;
+			boosted = false;
+		}
+
+		boost = ufs_perf_pred_step(&pred, &hist, &r->req);
+		if (boost && !boosted) {
+			boosted = true;
+			on = r->req.time;
+		}
+
+		if (r->heavy) {
+			score->heavy++;
+			score->hits += boost;
+		}
+	}
+
+	if (boosted)
+		score->boosted_ns += pred.hold_until - on;
+}
+
+/* __policy_heavy() */
+static void pred_test_v1_policy(ufs_perf_stat_type *stats, s64 time, bool *boosted,
+				s64 *on, struct pred_test_score *score)
+{
+	ufs_freq_sts state_seq = stats[CHUNK_SEQ].freq_state;
+	ufs_freq_sts state_ran = stats[CHUNK_RAN].freq_state;
+
+	if (state_seq == FREQ_REACH || state_ran == FREQ_REACH) {
+		if (state_seq == FREQ_REACH)
+			stats[CHUNK_SEQ].freq_state = FREQ_DWELL;
+		if (state_ran == FREQ_REACH)
+			stats[CHUNK_RAN].freq_state = FREQ_DWELL;
+		if (!*boosted) {
+			*boosted = true;
+			*on = time;
+		}
+	} else if ((state_seq == FREQ_DROP &&
+		    (state_ran == FREQ_DROP || state_ran == FREQ_RARE)) ||
+		   (state_ran == FREQ_DROP &&
+		    (state_seq == FREQ_DROP || state_seq == FREQ_RARE))) {
+		if (state_seq == FREQ_DROP)
+			stats[CHUNK_SEQ].freq_state = FREQ_RARE;
+		if (state_ran == FREQ_DROP)
+			stats[CHUNK_RAN].freq_state = FREQ_RARE;
+		if (*boosted) {
+			score->boosted_ns += time - *on;
+			*boosted = false;
+		}
+	}
+}
+
+#define PRED_TEST_V1_RESET	(150 * NSEC_PER_MSEC)
+
+static void pred_test_replay_v1(const struct pred_test_trace *trace,
+				struct pred_test_score *score)
+{
+	ufs_perf_stat_type stats[CHUNK_NUM] = {};
+	s64 last = trace->reqs[0].req.time;
+	bool boosted = false;
+	s64 on = 0;
+	u32 i;
+	int index;
+
+	ufs_perf_v1_init_stats(stats, last);
+
+	for (i = 0; i < trace->nr; i++) {
+		const struct pred_test_req *r = &trace->reqs[i];
+		__chuck_type chunk = r->req.len >= SZ_512K ? CHUNK_SEQ : CHUNK_RAN;
+
+		/* the reset timer fired while idle */
+		if (r->req.time - last > PRED_TEST_V1_RESET) {
+			s64 time = last + PRED_TEST_V1_RESET;
+
+			for (index = 0; index < CHUNK_NUM; index++) {
+				stats[index].s_time_start = time;
+				stats[index].s_time_prev = time;
+				stats[index].freq_state = FREQ_DROP;
+				stats[index].s_count = 0;
+			}
+			pred_test_v1_policy(stats, time, &boosted, &on, score);
+		}
+		last = r->req.time;
+
+		if (r->req.op != UFS_PERF_OP_S) {
+			ufs_perf_v1_update_stat(&stats[chunk], chunk, r->req.time);
+			pred_test_v1_policy(stats, r->req.time, &boosted, &on, score);
+		}
+
+		if (r->heavy) {
+			score->heavy++;
+			score->hits += boosted;
+		}
+	}
+
+	if (boosted)
+		score->boosted_ns += last + PRED_TEST_V1_RESET - on;
+}
+
+struct pred_test_case {
+	const char *name;
+	void (*gen)(struct pred_test_trace *trace, s64 dur);
+	s64 dur_in_ms;
+	bool heavy;
+};
+
+static const struct pred_test_case pred_test_cases[] = {
+	{ "launch", pred_test_launch, 300, true },
+	{ "random", pred_test_random, 200, true },
+	{ "burst", pred_test_burst, 300, true },
+	{ "streaming", pred_test_streaming, 300, true },
+	{ "background", pred_test_background, 3000, false },
+	{ "playback", pred_test_playback, 3000, false },
+};
+
+static struct pred_test_trace *pred_test_trace_alloc(struct kunit *test)
+{
+	struct pred_test_trace *trace = kunit_kzalloc(test, sizeof(*trace), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, trace);
+	trace->reqs = kunit_kcalloc(test, PRED_TEST_MAX_REQS, sizeof(*trace->reqs),
+				    GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, trace->reqs);
+	prandom_seed_state(&trace->rnd, 0x5a5a);
+	trace->time = NSEC_PER_SEC;
+
+	return trace;
+}
+
+static void pred_test_report(struct kunit *test, const char *name,
+			     const struct pred_test_score *v1,
+			     const struct pred_test_score *pred)
+{
+	kunit_info(test, "%-10s v1 hit %3u%% boosted %5lld ms, pred hit %3u%% boosted %5lld ms\n",
+		   name,
+		   v1->heavy ? v1->hits * 100 / v1->heavy : 0,
+		   v1->boosted_ns / NSEC_PER_MSEC,
+		   pred->heavy ? pred->hits * 100 / pred->heavy : 0,
+		   pred->boosted_ns / NSEC_PER_MSEC);
+}
+
+static void ufs_perf_pred_replay_test(struct kunit *test)
+{
+	struct pred_test_trace *trace = pred_test_trace_alloc(test);
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pred_test_cases); i++) {
+		const struct pred_test_case *c = &pred_test_cases[i];
+		struct pred_test_score v1 = {}, pred = {};
+
+		trace->nr = 0;
+		c->gen(trace, c->dur_in_ms * NSEC_PER_MSEC);
+		pred_test_replay_v1(trace, &v1);
+		pred_test_replay_pred(trace, &pred);
+		pred_test_report(test, c->name, &v1, &pred);
+
+		if (c->heavy) {
+			KUNIT_EXPECT_GE(test, pred.hits, v1.hits);
+			KUNIT_EXPECT_GE(test, pred.hits * 10, pred.heavy * 9);
+		} else {
+			KUNIT_EXPECT_EQ(test, pred.boosted_ns, v1.boosted_ns);
+			KUNIT_EXPECT_EQ(test, pred.boosted_ns, 0);
+		}
+	}
+}
+
+/* all in a row with idle gaps, the way a user would run them */
+static void ufs_perf_pred_replay_mixed_test(struct kunit *test)
+{
+	struct pred_test_trace *trace = pred_test_trace_alloc(test);
+	struct pred_test_score v1 = {}, pred = {};
+	s64 heavy_ns = 0;
+	int nr_heavy = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pred_test_cases); i++) {
+		const struct pred_test_case *c = &pred_test_cases[i];
+
+		c->gen(trace, c->dur_in_ms * NSEC_PER_MSEC);
+		trace->time += 500 * NSEC_PER_MSEC;
+		if (c->heavy) {
+			heavy_ns += c->dur_in_ms * NSEC_PER_MSEC;
+			nr_heavy++;
+		}
+	}
+
+	pred_test_replay_v1(trace, &v1);
+	pred_test_replay_pred(trace, &pred);
+	pred_test_report(test, "mixed", &v1, &pred);
+
+	KUNIT_EXPECT_GT(test, pred.hits, v1.hits);
+	/* the energy proxy, boosted no longer than the heavy phases and their hold */
+	KUNIT_EXPECT_LE(test, pred.boosted_ns, heavy_ns +
+			nr_heavy * 100 * NSEC_PER_MSEC);
+}
+
+static void ufs_perf_pred_classify_test(struct kunit *test)
+{
+	struct ufs_perf_pred pred = {};
+	struct ufs_perf_pred_hist hist = {};
+	struct ufs_perf_pred_req req = {
+		.time = NSEC_PER_SEC,
+		.lba = 4096,
+		.len = SZ_128K,
+		.qd = 1,
+		.op = UFS_PERF_OP_R,
+	};
+	int i;
+
+	ufs_perf_pred_init_stats(&pred);
+
+	/* a sequential stream is caught after th_seq_run back to back reads */
+	for (i = 0; i < pred.th_seq_run; i++) {
+		KUNIT_EXPECT_EQ(test, PRED_NONE, ufs_perf_pred_classify(&pred, &hist, &req));
+		req.lba += SZ_128K >> SECTOR_SHIFT;
+		req.time += 10 * NSEC_PER_USEC;
+	}
+	KUNIT_EXPECT_TRUE(test, ufs_perf_pred_step(&pred, &hist, &req));
+	KUNIT_EXPECT_EQ(test, PRED_SEQ_READ, pred.class);
+
+	/* and held after it stops */
+	req.time += (pred.th_hold_in_ms - 1) * NSEC_PER_MSEC;
+	req.op = UFS_PERF_OP_W;
+	KUNIT_EXPECT_TRUE(test, ufs_perf_pred_step(&pred, &hist, &req));
+	req.time += 2 * NSEC_PER_MSEC;
+	KUNIT_EXPECT_FALSE(test, ufs_perf_pred_step(&pred, &hist, &req));
+
+	/* flushes in a window */
+	req.op = UFS_PERF_OP_S;
+	req.sync = true;
+	for (i = 1; i < pred.th_sync_count; i++) {
+		req.time += NSEC_PER_MSEC;
+		KUNIT_EXPECT_EQ(test, PRED_NONE, ufs_perf_pred_classify(&pred, &hist, &req));
+	}
+	KUNIT_EXPECT_EQ(test, PRED_SYNC_WRITE, ufs_perf_pred_classify(&pred, &hist, &req));
+}
+
+static struct kunit_case ufs_perf_pred_test_cases[] = {
+	KUNIT_CASE(ufs_perf_pred_classify_test),
+	KUNIT_CASE(ufs_perf_pred_replay_test),
+	KUNIT_CASE(ufs_perf_pred_replay_mixed_test),
+	{}
+};
+
+static struct kunit_suite ufs_perf_pred_test_suite = {
+	.name = "ufs_perf_pred",
+	.test_cases = ufs_perf_pred_test_cases,
+};
+
+kunit_test_suites(&ufs_perf_pred_test_suite);
+
+MODULE_LICENSE("GPL");
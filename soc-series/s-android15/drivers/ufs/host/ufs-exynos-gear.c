@@ -305,7 +305,6 @@ static void __resume(struct ufs_perf *perf)
 
 	spin_lock_irqsave(&perf->lock_handle, flags);
 	stat->start_count_time = -1LL;
-	stat->count = 0;
 	spin_unlock_irqrestore(&perf->lock_handle, flags);
 }
 
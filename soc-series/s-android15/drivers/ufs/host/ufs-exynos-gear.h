@@ -34,7 +34,6 @@ struct ufs_perf_v2 {
 
 	/* stats */
 	s64 start_count_time;
-	u32 count;
 	u32 req_size;
 	u8 o_traffic;
 	bool g_scale_en;
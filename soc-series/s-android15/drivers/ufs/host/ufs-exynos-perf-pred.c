@@ -0,0 +1,320 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Request pattern classifier for UFS performance mode
+ *
+ * Copyright (C) 2024 Samsung Electronics Co., Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * The v1 policy boosts only after a throughput threshold has been crossed
+ * for a while. This one looks at the shape of the last requests instead,
+ * a sequential read stream, a flood of small random reads or a burst of
+ * synchronous writes, and boosts from the first few of them. The boost is
+ * held for th_hold_in_ms after the last request that matched a pattern.
+ */
+#include <linux/blkdev.h>
+#include <linux/percpu.h>
+#include <linux/sizes.h>
+#include <kunit/visibility.h>
+#include <scsi/scsi_cmnd.h>
+#include <scsi/scsi_device.h>
+#include "ufs-exynos-perf.h"
+
+#include <trace/events/ufs_exynos_perf.h>
+
+void ufs_perf_pred_init_stats(struct ufs_perf_pred *pred)
+{
+	pred->th_seq_run = 8;
+	pred->th_seq_gap = 256;
+	pred->th_rand_size = SZ_16K;
+	pred->th_rand_count = 32;
+	pred->th_rand_qd = 4;
+	pred->th_sync_count = 4;
+	pred->th_window_in_us = 50000;
+	pred->th_hold_in_ms = 100;
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_pred_init_stats);
+
+ufs_pred_class ufs_perf_pred_classify(struct ufs_perf_pred *pred,
+				      struct ufs_perf_pred_hist *hist,
+				      const struct ufs_perf_pred_req *req)
+{
+	s64 window = (s64)pred->th_window_in_us * NSEC_PER_USEC;
+
+	/* counts are restarted every window, a slow stream never reaches */
+	if (req->time - hist->win_start > window) {
+		hist->win_start = req->time;
+		hist->seq_run = 0;
+		hist->rand_count = 0;
+		hist->sync_count = 0;
+		hist->max_qd = 0;
+	}
+	hist->max_qd = max(hist->max_qd, req->qd);
+
+	if (req->op == UFS_PERF_OP_R) {
+		if (req->lba >= hist->next_lba &&
+		    req->lba - hist->next_lba <= pred->th_seq_gap) {
+			hist->seq_run++;
+		} else {
+			hist->seq_run = 0;
+			if (req->len <= pred->th_rand_size)
+				hist->rand_count++;
+		}
+		hist->next_lba = req->lba + (req->len >> SECTOR_SHIFT);
+	}
+
+	if (req->sync)
+		hist->sync_count++;
+
+	if (hist->seq_run >= pred->th_seq_run)
+		return PRED_SEQ_READ;
+	if (hist->rand_count >= pred->th_rand_count ||
+	    (hist->max_qd >= pred->th_rand_qd &&
+	     hist->rand_count >= pred->th_rand_count / 2))
+		return PRED_RAND_READ;
+	if (hist->sync_count >= pred->th_sync_count)
+		return PRED_SYNC_WRITE;
+
+	return PRED_NONE;
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_pred_classify);
+
+/* returns whether the boost should be held after @req */
+bool ufs_perf_pred_step(struct ufs_perf_pred *pred,
+			struct ufs_perf_pred_hist *hist,
+			const struct ufs_perf_pred_req *req)
+{
+	ufs_pred_class class = ufs_perf_pred_classify(pred, hist, req);
+	s64 hold_until;
+
+	if (class != PRED_NONE) {
+		/* cpus racing here differ by a few ns, either one will do */
+		hold_until = req->time + (s64)pred->th_hold_in_ms * NSEC_PER_MSEC;
+		WRITE_ONCE(pred->class, class);
+		if (hold_until > READ_ONCE(pred->hold_until))
+			WRITE_ONCE(pred->hold_until, hold_until);
+	}
+
+	return req->time < READ_ONCE(pred->hold_until);
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_pred_step);
+
+static inline bool __v1_holds(struct ufs_perf_v1 *perf_v1)
+{
+	int index;
+
+	for (index = 0; index < CHUNK_NUM; index++) {
+		if (perf_v1->stats[index].freq_state == FREQ_REACH ||
+		    perf_v1->stats[index].freq_state == FREQ_DWELL)
+			return true;
+	}
+
+	return false;
+}
+
+/* post the same requests as the v1 policy and the gear scale */
+static policy_res __pred_ctrl(struct ufs_perf *perf, ctrl_op op)
+{
+	struct ufs_perf_v2 *stat = &perf->stat_v2;
+	traffic traffic = op == CTRL_OP_UP ? TRAFFIC_HIGH : TRAFFIC_LOW;
+	policy_res res = R_OK;
+	unsigned long flags;
+
+	spin_lock_irqsave(&perf->lock_handle, flags);
+	/* the v1 policy releases the DVFS request by itself, not the gear */
+	if (perf->ctrl_handle[__CTRL_REQ_DVFS] != op &&
+	    !(op == CTRL_OP_DOWN && __v1_holds(&perf->stat_v1))) {
+		perf->ctrl_handle[__CTRL_REQ_DVFS] = op;
+		res = R_CTRL;
+	}
+
+	if (perf->stat_bits & UPDATE_GEAR) {
+		stat->g_scale_en = op == CTRL_OP_UP;
+		if (stat->o_traffic != traffic) {
+			stat->o_traffic = traffic;
+			queue_work(stat->scale_wq, &stat->gear_work);
+		}
+	}
+	spin_unlock_irqrestore(&perf->lock_handle, flags);
+
+	trace_ufs_perf_lock("pred", op);
+
+	return res;
+}
+
+policy_res ufs_perf_update_pred(struct ufs_perf *perf, struct scsi_cmnd *scmd,
+				u32 len, ufs_perf_op op)
+{
+	struct ufs_perf_pred *pred = &perf->pred;
+	struct request *rq = scsi_cmd_to_rq(scmd);
+	struct ufs_perf_pred_req req;
+	policy_res res = R_OK;
+	unsigned long flags;
+	bool hold;
+
+	req.lba = blk_rq_pos(rq);
+	req.len = len;
+	req.qd = scsi_device_busy(scmd->device);
+	req.op = op;
+	req.sync = op == UFS_PERF_OP_S ||
+		(op == UFS_PERF_OP_W && (rq->cmd_flags & REQ_FUA));
+
+	/* issue can also run from softirq on this cpu */
+	local_irq_save(flags);
+	req.time = cpu_clock(smp_processor_id());
+	hold = ufs_perf_pred_step(pred, this_cpu_ptr(pred->hist), &req);
+	local_irq_restore(flags);
+
+	if (!hold || READ_ONCE(pred->boosted))
+		return res;
+
+	/*
+	 * If the timer is dropping the boost meanwhile, the hold just set is
+	 * lost, and the next request of the pattern boosts again.
+	 */
+	spin_lock_irqsave(&pred->lock, flags);
+	if (!pred->boosted) {
+		WRITE_ONCE(pred->boosted, true);
+		pred->boosts[READ_ONCE(pred->class)]++;
+		mod_timer(&pred->hold_timer,
+			  jiffies + msecs_to_jiffies(pred->th_hold_in_ms));
+		res = __pred_ctrl(perf, CTRL_OP_UP);
+	}
+	spin_unlock_irqrestore(&pred->lock, flags);
+
+	return res;
+}
+
+static void __hold_timer(struct timer_list *t)
+{
+	struct ufs_perf_pred *pred = from_timer(pred, t, hold_timer);
+	struct ufs_perf *perf = container_of(pred, struct ufs_perf, pred);
+	s64 time = cpu_clock(raw_smp_processor_id());
+	policy_res res = R_OK;
+	unsigned long flags;
+
+	s64 hold_until;
+
+	spin_lock_irqsave(&pred->lock, flags);
+	hold_until = READ_ONCE(pred->hold_until);
+	if (time < hold_until) {
+		/* extended by later requests */
+		mod_timer(&pred->hold_timer,
+			  jiffies + nsecs_to_jiffies(hold_until - time) + 1);
+	} else {
+		WRITE_ONCE(pred->boosted, false);
+		res = __pred_ctrl(perf, CTRL_OP_DOWN);
+	}
+	spin_unlock_irqrestore(&pred->lock, flags);
+
+	if (res == R_CTRL)
+		ufs_perf_wakeup(perf);
+}
+
+/* sysfs, /sys/kernel/ufs_perf_x/pred */
+#define __PRED_ATTR(_name)						\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	struct ufs_perf *perf = container_of(kobj, struct ufs_perf,	\
+					     sysfs_kobj);		\
+									\
+	return sysfs_emit(buf, "%u\n", perf->pred.th_##_name);		\
+}									\
+static ssize_t _name##_store(struct kobject *kobj,			\
+			     struct kobj_attribute *attr,		\
+			     const char *buf, size_t count)		\
+{									\
+	struct ufs_perf *perf = container_of(kobj, struct ufs_perf,	\
+					     sysfs_kobj);		\
+	u32 val;							\
+									\
+	if (kstrtou32(buf, 10, &val))					\
+		return -EINVAL;						\
+	WRITE_ONCE(perf->pred.th_##_name, val);				\
+									\
+	return count;							\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RW(_name)
+
+__PRED_ATTR(seq_run);
+__PRED_ATTR(seq_gap);
+__PRED_ATTR(rand_size);
+__PRED_ATTR(rand_count);
+__PRED_ATTR(rand_qd);
+__PRED_ATTR(sync_count);
+__PRED_ATTR(window_in_us);
+__PRED_ATTR(hold_in_ms);
+
+static ssize_t boosts_show(struct kobject *kobj, struct kobj_attribute *attr,
+			   char *buf)
+{
+	struct ufs_perf *perf = container_of(kobj, struct ufs_perf, sysfs_kobj);
+	struct ufs_perf_pred *pred = &perf->pred;
+
+	return sysfs_emit(buf, "seq_read %llu\nrand_read %llu\nsync_write %llu\n",
+			  pred->boosts[PRED_SEQ_READ],
+			  pred->boosts[PRED_RAND_READ],
+			  pred->boosts[PRED_SYNC_WRITE]);
+}
+static struct kobj_attribute boosts_attr = __ATTR_RO(boosts);
+
+static struct attribute *__pred_attrs[] = {
+	&seq_run_attr.attr,
+	&seq_gap_attr.attr,
+	&rand_size_attr.attr,
+	&rand_count_attr.attr,
+	&rand_qd_attr.attr,
+	&sync_count_attr.attr,
+	&window_in_us_attr.attr,
+	&hold_in_ms_attr.attr,
+	&boosts_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group __pred_group = {
+	.name	= "pred",
+	.attrs	= __pred_attrs,
+};
+
+int ufs_perf_init_pred(struct ufs_perf *perf)
+{
+	struct ufs_perf_pred *pred = &perf->pred;
+	int res = 0;
+
+	pred->hist = alloc_percpu(struct ufs_perf_pred_hist);
+	if (!pred->hist)
+		return -ENOMEM;
+
+	ufs_perf_pred_init_stats(pred);
+	spin_lock_init(&pred->lock);
+	timer_setup(&pred->hold_timer, __hold_timer, 0);
+
+	if (perf->sysfs_kobj.state_in_sysfs) {
+		res = sysfs_create_group(&perf->sysfs_kobj, &__pred_group);
+		if (res)
+			pr_err("Fail to create sysfs files: %d\n", res);
+	}
+
+	pred->enabled = true;
+
+	return res;
+}
+
+void ufs_perf_exit_pred(struct ufs_perf *perf)
+{
+	struct ufs_perf_pred *pred = &perf->pred;
+
+	if (!pred->enabled)
+		return;
+
+	pred->enabled = false;
+	del_timer_sync(&pred->hold_timer);
+	if (perf->sysfs_kobj.state_in_sysfs)
+		sysfs_remove_group(&perf->sysfs_kobj, &__pred_group);
+	free_percpu(pred->hist);
+	pred->hist = NULL;
+}
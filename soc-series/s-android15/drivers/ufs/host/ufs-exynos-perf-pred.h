@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Request pattern classifier for UFS performance mode
+ *
+ * Copyright (C) 2024 Samsung Electronics Co., Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+#ifndef _UFS_PERF_PRED_H_
+#define _UFS_PERF_PRED_H_
+
+#include <linux/timer.h>
+
+typedef enum {
+	PRED_NONE = 0,
+	PRED_SEQ_READ,
+	PRED_RAND_READ,
+	PRED_SYNC_WRITE,
+
+	PRED_NUM,
+} ufs_pred_class;
+
+struct ufs_perf_pred_req {
+	s64 time;		/* ns */
+	u64 lba;		/* in 512 byte sectors */
+	u32 len;		/* in bytes */
+	u32 qd;			/* commands outstanding on the lu */
+	u8 op;			/* ufs_perf_op */
+	bool sync;		/* flush or fua write */
+};
+
+/* per cpu, a stream is mostly issued from one cpu */
+struct ufs_perf_pred_hist {
+	u64 next_lba;
+	u32 seq_run;
+	s64 win_start;
+	u32 rand_count;
+	u32 sync_count;
+	u32 max_qd;
+};
+
+struct ufs_perf_pred {
+	bool enabled;
+
+	/* thresholds, accessible through sysfs */
+	u32 th_seq_run;		/* back to back reads in a stream */
+	u32 th_seq_gap;		/* in sectors, still counted as sequential */
+	u32 th_rand_size;	/* in bytes, larger reads are not random ones */
+	u32 th_rand_count;	/* random reads in a window */
+	u32 th_rand_qd;		/* with this qd, half of th_rand_count is enough */
+	u32 th_sync_count;	/* flushes and fua writes in a window */
+	u32 th_window_in_us;
+	u32 th_hold_in_ms;	/* hysteresis after the last classified request */
+
+	struct ufs_perf_pred_hist __percpu *hist;
+
+	/* decision, hold_until is updated without the lock */
+	ufs_pred_class class;
+	s64 hold_until;
+	bool boosted;
+	u64 boosts[PRED_NUM];
+
+	/* sync, only taken when boosted changes */
+	spinlock_t lock;
+
+	struct timer_list hold_timer;
+};
+
+#endif /* _UFS_PERF_PRED_H_ */
@@ -14,6 +14,7 @@
  */
 #include <linux/of.h>
 #include <linux/ems.h>
+#include <kunit/visibility.h>
 #include "ufs-exynos-perf.h"
 #include "ufs-cal-if.h"
 #include "ufs-exynos.h"
@@ -37,6 +38,10 @@ static int __ctrl_dvfs(struct ufs_perf *perf, ctrl_op op)
 	if (op != CTRL_OP_UP && op != CTRL_OP_DOWN)
 		return -1;
 
+	/* the classifier still holds the boost */
+	if (op == CTRL_OP_DOWN && READ_ONCE(perf->pred.boosted))
+		op = CTRL_OP_UP;
+
 	boost = op == CTRL_OP_UP ? 1 : 0;
 
 	emstune_set_sched_io_boost(boost);
@@ -163,30 +168,16 @@ static inline void __adjust_time(ufs_perf_stat_type *stat, s64 time)
 
 #define CALC_DENSITY(c, d)	((c) * 100000 / (d))
 #define GET_TIME_IN_US(ns)	((ns) / 1000)
-static void __update_v1_queued(struct ufs_perf_v1 *perf_v1, u32 size)
+int ufs_perf_v1_update_stat(ufs_perf_stat_type *stat, __chuck_type chunk,
+			    s64 time)
 {
-	//__chuck_type chunk = size >= SZ_256K ? CHUNK_SEQ : CHUNK_RAN;
-	__chuck_type chunk = size >= SZ_512K ? CHUNK_SEQ : CHUNK_RAN;
 	int ret = 0;
-
-	ufs_perf_stat_type *stat = &perf_v1->stats[chunk];
-	s64 time = cpu_clock(raw_smp_processor_id());
 	u64 interval;
 	u64 th_interval;
 	u64 duration;
 	u32 density = 0;
 	u32 count;
 
-	/*
-	 * There are only one case that we need to consider
-	 *
-	 * First, reset is intervened right after request done.
-	 * In this situation, stat update will start again a little bit less
-	 * than usual and this is not a big deal.
-	 * For scenarios to require high throughput, a sort of tuning is
-	 * required to prevent from frequent resets.
-	 */
-	del_timer(&perf_v1->reset_timer);
 	count = ++stat->s_count;
 	interval = GET_TIME_IN_US(time - stat->s_time_prev);
 	duration = GET_TIME_IN_US(time - stat->s_time_start);
@@ -266,9 +257,31 @@ static void __update_v1_queued(struct ufs_perf_v1 *perf_v1, u32 size)
 				 stat->freq_state,
 				 stat->s_time_start,
 				 ret);
-	perf_v1->chunk_prev = chunk;
 	if (count == 1)
 		stat->s_time_start = time;
+
+	return ret;
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_v1_update_stat);
+
+static void __update_v1_queued(struct ufs_perf_v1 *perf_v1, u32 size)
+{
+	//__chuck_type chunk = size >= SZ_256K ? CHUNK_SEQ : CHUNK_RAN;
+	__chuck_type chunk = size >= SZ_512K ? CHUNK_SEQ : CHUNK_RAN;
+	s64 time = cpu_clock(raw_smp_processor_id());
+
+	/*
+	 * There are only one case that we need to consider
+	 *
+	 * First, reset is intervened right after request done.
+	 * In this situation, stat update will start again a little bit less
+	 * than usual and this is not a big deal.
+	 * For scenarios to require high throughput, a sort of tuning is
+	 * required to prevent from frequent resets.
+	 */
+	del_timer(&perf_v1->reset_timer);
+	ufs_perf_v1_update_stat(&perf_v1->stats[chunk], chunk, time);
+	perf_v1->chunk_prev = chunk;
 }
 
 static void __update_v1_reset(struct ufs_perf_v1 *perf_v1)
@@ -525,6 +538,46 @@ static inline void __sysfs_exit(struct ufs_perf_v1 *perf_v1)
 	kobject_put(&perf_v1->sysfs_kobj);
 }
 
+void ufs_perf_v1_init_stats(ufs_perf_stat_type *stats, s64 time)
+{
+	int index;
+
+	for (index = 0; index < CHUNK_NUM; index++) {
+		stats[index].s_time_start = time;
+		stats[index].s_time_prev = time;
+		stats[index].freq_state = FREQ_RARE;
+		stats[index].s_count = 0;
+	}
+	stats[CHUNK_SEQ].th_reach_count = 20;
+	stats[CHUNK_SEQ].th_reach_interval_in_us = 10000;
+	/* N * 10000 / us */
+	stats[CHUNK_SEQ].th_reach_density = 500;
+	stats[CHUNK_SEQ].th_drop_count = 5;
+	stats[CHUNK_SEQ].th_drop_interval_in_us = 120000;
+	/* N * 10000 / us */
+	stats[CHUNK_SEQ].th_drop_density = 300;
+
+	stats[CHUNK_RAN].th_reach_count = 50;
+	stats[CHUNK_RAN].th_reach_interval_in_us = 5000;
+	/* N * 10000 / us */
+	stats[CHUNK_RAN].th_reach_density = 10000;
+	stats[CHUNK_RAN].th_drop_count = 5;
+	stats[CHUNK_RAN].th_drop_interval_in_us = 5000;
+	/* N * 10000 / us */
+	stats[CHUNK_RAN].th_drop_density = 5000;
+
+#if defined(CONFIG_SOC_S5E8855)
+	stats[CHUNK_SEQ].th_reach_count = 20;
+	stats[CHUNK_SEQ].th_reach_density = 200;
+	stats[CHUNK_SEQ].th_drop_count = 20;
+	stats[CHUNK_SEQ].th_drop_density = 100;
+
+	stats[CHUNK_RAN].th_drop_count = 50;
+	stats[CHUNK_RAN].th_drop_interval_in_us = 10000;
+#endif
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_v1_init_stats);
+
 int ufs_perf_init_v1(struct ufs_perf *perf)
 {
 	struct ufs_perf_v1 *perf_v1 = &perf->stat_v1;
@@ -557,39 +610,7 @@ int ufs_perf_init_v1(struct ufs_perf *perf)
 	timer_setup(&perf_v1->reset_timer, __reset_timer, 0);
 
 	/* stats */
-	for (index = 0; index < CHUNK_NUM; index++) {
-		perf_v1->stats[index].s_time_start = cpu_clock(raw_smp_processor_id());
-		perf_v1->stats[index].s_time_prev = perf_v1->stats[index].s_time_start;
-		perf_v1->stats[index].freq_state = FREQ_RARE;
-		perf_v1->stats[index].s_count = 0;
-	}
-	perf_v1->stats[CHUNK_SEQ].th_reach_count = 20;
-	perf_v1->stats[CHUNK_SEQ].th_reach_interval_in_us = 10000;
-	/* N * 10000 / us */
-	perf_v1->stats[CHUNK_SEQ].th_reach_density = 500;
-	perf_v1->stats[CHUNK_SEQ].th_drop_count = 5;
-	perf_v1->stats[CHUNK_SEQ].th_drop_interval_in_us = 120000;
-	/* N * 10000 / us */
-	perf_v1->stats[CHUNK_SEQ].th_drop_density = 300;
-
-	perf_v1->stats[CHUNK_RAN].th_reach_count = 50;
-	perf_v1->stats[CHUNK_RAN].th_reach_interval_in_us = 5000;
-	/* N * 10000 / us */
-	perf_v1->stats[CHUNK_RAN].th_reach_density = 10000;
-	perf_v1->stats[CHUNK_RAN].th_drop_count = 5;
-	perf_v1->stats[CHUNK_RAN].th_drop_interval_in_us = 5000;
-	/* N * 10000 / us */
-	perf_v1->stats[CHUNK_RAN].th_drop_density = 5000;
-
-#if defined(CONFIG_SOC_S5E8855)
-	perf_v1->stats[CHUNK_SEQ].th_reach_count = 20;
-	perf_v1->stats[CHUNK_SEQ].th_reach_density = 200;
-	perf_v1->stats[CHUNK_SEQ].th_drop_count = 20;
-	perf_v1->stats[CHUNK_SEQ].th_drop_density = 100;
-
-	perf_v1->stats[CHUNK_RAN].th_drop_count = 50;
-	perf_v1->stats[CHUNK_RAN].th_drop_interval_in_us = 10000;
-#endif
+	ufs_perf_v1_init_stats(perf_v1->stats, cpu_clock(raw_smp_processor_id()));
 
 	/* related to outside */
 	ecs_request_register("ufs_perf", NULL, ECS_MIN);
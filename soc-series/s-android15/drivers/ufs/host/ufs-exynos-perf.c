@@ -12,9 +12,13 @@
  *	Kiwoong <kwmad.kim@samsung.com>
  */
 #include <linux/of.h>
+#include <linux/percpu.h>
+#include <linux/sizes.h>
+#include <kunit/visibility.h>
 #include "ufs-exynos-perf.h"
 
 #include <scsi/scsi_cmnd.h>
+#include <scsi/scsi_proto.h>
 
 #define CREATE_TRACE_POINTS
 #include <linux/pm_qos.h>
@@ -96,6 +100,62 @@ static int ufs_perf_handler(void *data)
 	return 0;
 }
 
+static inline int ufs_perf_size_index(u32 len)
+{
+	if (len <= SZ_4K)
+		return UFS_PERF_SZ_4K;
+	if (len <= SZ_16K)
+		return UFS_PERF_SZ_16K;
+	if (len <= SZ_64K)
+		return UFS_PERF_SZ_64K;
+	if (len <= SZ_256K)
+		return UFS_PERF_SZ_256K;
+	return UFS_PERF_SZ_LARGE;
+}
+
+static inline int ufs_perf_lat_index(s64 us)
+{
+	if (us <= 0)
+		return 0;
+	return min_t(int, fls64(us), UFS_PERF_LAT_BUCKETS - 1);
+}
+
+/* upper bound in us of the bucket where @permille of the samples are reached */
+u32 ufs_perf_lat_percentile(const u64 *hist, u32 permille)
+{
+	u64 total = 0, sum = 0;
+	int i;
+
+	for (i = 0; i < UFS_PERF_LAT_BUCKETS; i++)
+		total += hist[i];
+	if (!total)
+		return 0;
+
+	for (i = 0; i < UFS_PERF_LAT_BUCKETS - 1; i++) {
+		sum += hist[i];
+		if (sum * 1000 >= total * permille)
+			break;
+	}
+
+	return 1U << i;
+}
+EXPORT_SYMBOL_IF_KUNIT(ufs_perf_lat_percentile);
+
+void ufs_perf_get_stat(struct ufs_perf *perf, struct ufs_perf_stat *sum)
+{
+	u64 *dst = (u64 *)sum;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		u64 *src = (u64 *)per_cpu_ptr(perf->stat, cpu);
+
+		for (i = 0; i < sizeof(*sum) / sizeof(u64); i++)
+			dst[i] += READ_ONCE(src[i]);
+	}
+}
+
 /* EXTERNAL FUNCTIONS */
 void ufs_perf_update(void *data, u32 qd, struct ufshcd_lrb *lrbp,
 		ufs_perf_op op)
@@ -104,24 +164,31 @@ void ufs_perf_update(void *data, u32 qd, struct ufshcd_lrb *lrbp,
 	policy_res res = R_OK;
 	unsigned long stat_bits = (unsigned long)perf->stat_bits;
 	struct scsi_cmnd *scmd = lrbp->cmd;
-	ktime_t time = ktime_get();
+	ktime_t time = 0;
 	int index;
-	struct ufs_perf_v2 *stat_v2 = &perf->stat_v2;
 	unsigned long len;
 
+	if (trace_ufs_perf_enabled())
+		time = ktime_get();
+
 	switch(op) {
 	case UFS_PERF_OP_R:
 	case UFS_PERF_OP_W:
 		len = be32_to_cpu(lrbp->ucd_req_ptr->sc.exp_data_transfer_len);
-		stat_v2->count += len;
 		break;
 
 	default:
 		len = scsi_cmd_to_rq(scmd)->__data_len;
-		stat_v2->count += len;
 		break;
 	}
 
+	this_cpu_inc(perf->stat->queued[op]);
+	this_cpu_add(perf->stat->bytes[op], len);
+
+	if (perf->pred.enabled && op != UFS_PERF_OP_NONE &&
+	    ufs_perf_update_pred(perf, scmd, len, op) == R_CTRL)
+		ufs_perf_wakeup(perf);
+
 	for_each_set_bit(index, &stat_bits, __UPDATE_MAX) {
 		if (!(BIT(index) & perf->stat_bits))
 			continue;
@@ -132,8 +199,43 @@ void ufs_perf_update(void *data, u32 qd, struct ufshcd_lrb *lrbp,
 			ufs_perf_wakeup(perf);
 	}
 
-	trace_ufs_perf("update", op, qd, ktime_to_us(ktime_sub(ktime_get(),
-					time)), res, len);
+	if (trace_ufs_perf_enabled())
+		trace_ufs_perf("update", op, qd, ktime_to_us(ktime_sub(ktime_get(),
+						time)), res, len);
+}
+
+/*
+ * Called from the completion of a SCSI command. The core stamps the issue and
+ * completion time of every lrb, so no clock is read here.
+ */
+void ufs_perf_complete(void *data, struct ufshcd_lrb *lrbp, u32 hwq)
+{
+	struct ufs_perf *perf = (struct ufs_perf *)data;
+	struct scsi_cmnd *scmd = lrbp->cmd;
+	ufs_perf_op op;
+	int lat;
+
+	switch (scmd->cmnd[0]) {
+	case READ_10:
+		op = UFS_PERF_OP_R;
+		break;
+	case WRITE_10:
+		op = UFS_PERF_OP_W;
+		break;
+	case SYNCHRONIZE_CACHE:
+		op = UFS_PERF_OP_S;
+		break;
+	default:
+		op = UFS_PERF_OP_NONE;
+		break;
+	}
+
+	lat = ufs_perf_lat_index(ktime_us_delta(lrbp->compl_time_stamp,
+						lrbp->issue_time_stamp));
+
+	this_cpu_inc(perf->stat->op_lat[op]
+		     [ufs_perf_size_index(blk_rq_bytes(scsi_cmd_to_rq(scmd)))][lat]);
+	this_cpu_inc(perf->stat->hwq_lat[min_t(u32, hwq, UFS_PERF_MAX_HWQ - 1)][lat]);
 }
 
 void ufs_perf_reset(void *data)
@@ -172,6 +274,130 @@ void ufs_perf_resume(void *data)
 	}
 }
 
+/* sysfs */
+static const char * const ufs_perf_op_names[UFS_PERF_OP_MAX] = {
+	"none", "read", "write", "flush",
+};
+
+static const char * const ufs_perf_size_names[UFS_PERF_SZ_NUM] = {
+	"4K", "16K", "64K", "256K", "large",
+};
+
+static ssize_t io_stat_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct ufs_perf *perf = container_of(kobj, struct ufs_perf, sysfs_kobj);
+	struct ufs_perf_stat *stat;
+	int op, size, len = 0;
+
+	stat = kzalloc(sizeof(*stat), GFP_KERNEL);
+	if (!stat)
+		return -ENOMEM;
+
+	ufs_perf_get_stat(perf, stat);
+
+	/* latencies in us */
+	len += sysfs_emit_at(buf, len, "%-6s %6s %12s %16s %8s %8s %8s\n", "op", "size",
+			     "count", "bytes", "p50", "p99", "p999");
+	for (op = UFS_PERF_OP_R; op < UFS_PERF_OP_MAX; op++) {
+		len += sysfs_emit_at(buf, len, "%-6s %6s %12llu %16llu\n", ufs_perf_op_names[op],
+				     "all", stat->queued[op], stat->bytes[op]);
+
+		for (size = 0; size < UFS_PERF_SZ_NUM; size++) {
+			const u64 *hist = stat->op_lat[op][size];
+			u64 count = 0;
+			int i;
+
+			for (i = 0; i < UFS_PERF_LAT_BUCKETS; i++)
+				count += hist[i];
+			if (!count)
+				continue;
+
+			len += sysfs_emit_at(buf, len, "%-6s %6s %12llu %16s %8u %8u %8u\n",
+					     ufs_perf_op_names[op], ufs_perf_size_names[size],
+					     count, "-",
+					     ufs_perf_lat_percentile(hist, 500),
+					     ufs_perf_lat_percentile(hist, 990),
+					     ufs_perf_lat_percentile(hist, 999));
+		}
+	}
+
+	kfree(stat);
+
+	return len;
+}
+static struct kobj_attribute io_stat_attr = __ATTR_RO(io_stat);
+
+static ssize_t hwq_latency_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	struct ufs_perf *perf = container_of(kobj, struct ufs_perf, sysfs_kobj);
+	struct ufs_perf_stat *stat;
+	int hwq, i, len = 0;
+
+	stat = kzalloc(sizeof(*stat), GFP_KERNEL);
+	if (!stat)
+		return -ENOMEM;
+
+	ufs_perf_get_stat(perf, stat);
+
+	/* latencies in us */
+	len += sysfs_emit_at(buf, len, "%-4s %12s %8s %8s %8s\n", "hwq", "count",
+			     "p50", "p99", "p999");
+	for (hwq = 0; hwq < UFS_PERF_MAX_HWQ; hwq++) {
+		const u64 *hist = stat->hwq_lat[hwq];
+		u64 count = 0;
+
+		for (i = 0; i < UFS_PERF_LAT_BUCKETS; i++)
+			count += hist[i];
+		if (!count)
+			continue;
+
+		len += sysfs_emit_at(buf, len, "%-4d %12llu %8u %8u %8u\n", hwq, count,
+				     ufs_perf_lat_percentile(hist, 500),
+				     ufs_perf_lat_percentile(hist, 990),
+				     ufs_perf_lat_percentile(hist, 999));
+	}
+
+	kfree(stat);
+
+	return len;
+}
+static struct kobj_attribute hwq_latency_attr = __ATTR_RO(hwq_latency);
+
+static const struct attribute *ufs_perf_sysfs_attrs[] = {
+	&io_stat_attr.attr,
+	&hwq_latency_attr.attr,
+	NULL,
+};
+
+static struct kobj_type ufs_perf_ktype = {
+	.sysfs_ops	= &kobj_sysfs_ops,
+};
+
+static int ufs_perf_sysfs_init(struct ufs_perf *perf)
+{
+	int error;
+
+	/* create a path of /sys/kernel/ufs_perf_x */
+	kobject_init(&perf->sysfs_kobj, &ufs_perf_ktype);
+	error = kobject_add(&perf->sysfs_kobj, kernel_kobj, "ufs_perf_%d", perf->id);
+	if (error) {
+		pr_err("Fail to register sysfs directory: %d\n", error);
+		goto fail_kobj;
+	}
+
+	error = sysfs_create_files(&perf->sysfs_kobj, ufs_perf_sysfs_attrs);
+	if (error) {
+		pr_err("Fail to create sysfs files: %d\n", error);
+		goto fail_kobj;
+	}
+
+	return 0;
+
+fail_kobj:
+	kobject_put(&perf->sysfs_kobj);
+	return error;
+}
+
 int ufs_perf_parse_cpu_clusters(struct ufs_perf *perf)
 {
 	struct device_node *cpus, *map, *cluster, *cpu_node;
@@ -345,6 +571,13 @@ bool ufs_perf_init(void **data, struct ufs_hba *hba)
 
 	perf = (struct ufs_perf *)(*data);
 
+	perf->stat = alloc_percpu(struct ufs_perf_stat);
+	if (!perf->stat) {
+		devm_kfree(hba->dev, perf);
+		*data = NULL;
+		goto out;
+	}
+
 	spin_lock_init(&perf->lock_handle);
 
 	perf->hba = hba;
@@ -379,11 +612,17 @@ bool ufs_perf_init(void **data, struct ufs_hba *hba)
 	}
 #endif
 
+	ufs_perf_sysfs_init(perf);
+
 	/* initial values, TODO: */
 	perf->stat_bits = UPDATE_V1;
 
 	/* register updates and ctrls */
 	ufs_perf_init_v1(perf);
+	if (of_find_property(np, "samsung,ufs-perf-pred", NULL)) {
+		dev_info(dev, "%s: enable ufs-perf-pred\n", __func__);
+		ufs_perf_init_pred(perf);
+	}
 	if (perf->gear_scale_sup) {
 		perf->stat_bits |= UPDATE_GEAR;
 		ufs_gear_scale_init(perf);
@@ -411,9 +650,12 @@ void ufs_perf_exit(void *data)
 	if (!perf)
 		return;
 
+	ufs_perf_exit_pred(perf);
 	ufs_perf_exit_v1(perf);
 	if (perf->gear_scale_sup)
 		ufs_gear_scale_exit(perf);
+	if (perf->sysfs_kobj.state_initialized)
+		kobject_put(&perf->sysfs_kobj);
 
 
 	if (perf && !IS_ERR(perf->handler)) {
@@ -445,6 +687,7 @@ void ufs_perf_exit(void *data)
 	hba = perf->hba;
 	devm_kfree(hba->dev, perf->pm_qos_cluster);
 	devm_kfree(hba->dev, perf->cluster_qos_value);
+	free_percpu(perf->stat);
 }
 
 void __ufs_perf_add_boost_mode_request(char *func, unsigned int line,
@@ -33,6 +33,7 @@
 
 #include "ufs-exynos-perf-v1.h"
 #include "ufs-exynos-gear.h"
+#include "ufs-exynos-perf-pred.h"
 
 typedef enum {
 	TRAFFIC_NONE = 0,
@@ -88,6 +89,31 @@ typedef enum {
 	CTRL_OP_NUM,
 } ctrl_op;
 
+/*
+ * Completion latency histograms. Bucket 0 is below 1us and bucket n counts
+ * [2^(n-1), 2^n) us, the last one everything above.
+ */
+#define UFS_PERF_LAT_BUCKETS	21
+#define UFS_PERF_MAX_HWQ	16
+
+enum {
+	UFS_PERF_SZ_4K = 0,
+	UFS_PERF_SZ_16K,
+	UFS_PERF_SZ_64K,
+	UFS_PERF_SZ_256K,
+	UFS_PERF_SZ_LARGE,
+
+	UFS_PERF_SZ_NUM,
+};
+
+/* per-cpu, summed up only when read */
+struct ufs_perf_stat {
+	u64 queued[UFS_PERF_OP_MAX];
+	u64 bytes[UFS_PERF_OP_MAX];
+	u64 op_lat[UFS_PERF_OP_MAX][UFS_PERF_SZ_NUM][UFS_PERF_LAT_BUCKETS];
+	u64 hwq_lat[UFS_PERF_MAX_HWQ][UFS_PERF_LAT_BUCKETS];
+};
+
 struct ufs_perf {
 	int id;
 
@@ -107,6 +133,8 @@ struct ufs_perf {
 
 	struct ufs_perf_v1 stat_v1;
 	struct ufs_perf_v2 stat_v2;
+	struct ufs_perf_pred pred;
+	struct ufs_perf_stat __percpu *stat;
 
 	policy_res (*update[__UPDATE_MAX])(struct ufs_perf *perf, u32 qd,
 						ufs_perf_op op,
@@ -150,6 +178,9 @@ struct ufs_perf {
 /* EXTERNAL FUNCTIONS */
 void ufs_perf_reset(void *data);
 void ufs_perf_update(void *data, u32 chunk_size, struct ufshcd_lrb *lrbp, ufs_perf_op op);
+void ufs_perf_complete(void *data, struct ufshcd_lrb *lrbp, u32 hwq);
+void ufs_perf_get_stat(struct ufs_perf *perf, struct ufs_perf_stat *sum);
+u32 ufs_perf_lat_percentile(const u64 *hist, u32 permille);
 void ufs_perf_resume(void *data);
 bool ufs_perf_init(void **data, struct ufs_hba *hba);
 void ufs_perf_exit(void *data);
@@ -158,6 +189,21 @@ void ufs_init_cpufreq_request(struct ufs_perf *perf, bool add_knob);
 /* from stats */
 int ufs_perf_init_v1(struct ufs_perf *perf);
 void ufs_perf_exit_v1(struct ufs_perf *perf);
+void ufs_perf_v1_init_stats(ufs_perf_stat_type *stats, s64 time);
+int ufs_perf_v1_update_stat(ufs_perf_stat_type *stat, __chuck_type chunk,
+			    s64 time);
+
+int ufs_perf_init_pred(struct ufs_perf *perf);
+void ufs_perf_exit_pred(struct ufs_perf *perf);
+policy_res ufs_perf_update_pred(struct ufs_perf *perf, struct scsi_cmnd *scmd,
+				u32 len, ufs_perf_op op);
+void ufs_perf_pred_init_stats(struct ufs_perf_pred *pred);
+ufs_pred_class ufs_perf_pred_classify(struct ufs_perf_pred *pred,
+				      struct ufs_perf_pred_hist *hist,
+				      const struct ufs_perf_pred_req *req);
+bool ufs_perf_pred_step(struct ufs_perf_pred *pred,
+			struct ufs_perf_pred_hist *hist,
+			const struct ufs_perf_pred_req *req);
 
 void ufs_gear_scale_init(struct ufs_perf *perf);
 void ufs_gear_scale_exit(struct ufs_perf *perf);
@@ -1439,6 +1439,15 @@ static void exynos_ufs_compl_nexus_t_xfer_req(void *data, struct ufs_hba *hba,
 	exynos_ufs_check_uac(hba, tag, (lrbp->cmd ? true : false));
 
 #if IS_ENABLED(CONFIG_SCSI_UFS_PERF)
+	if (ufs->perf && lrbp->cmd) {
+		u32 hwq_num = 0;
+
+		if (hba->mcq_enabled)
+			hwq_num = blk_mq_unique_tag_to_hwq(
+					blk_mq_unique_tag(scsi_cmd_to_rq(lrbp->cmd)));
+		ufs_perf_complete(ufs->perf, lrbp, hwq_num);
+	}
+
 	if (hba->mcq_enabled) {
 		if (!hba->clk_gating.active_reqs) {
 			if (ufs->perf)
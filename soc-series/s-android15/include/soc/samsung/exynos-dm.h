@@ -15,6 +15,7 @@
 
 #include <linux/irq_work.h>
 #include <linux/kthread.h>
+#include <linux/percpu-rwsem.h>
 #include <linux/sched.h>
 #include <linux/sched/types.h>
 #if IS_ENABLED(CONFIG_EXYNOS_ESCA_DVFS_MANAGER)
@@ -79,6 +80,26 @@ struct exynos_dm_constraint {
 #endif
 };
 
+#if IS_ENABLED(CONFIG_EXYNOS_DVFS_MANAGER)
+struct exynos_dm_call_stat {
+	u64			count;		// Calls serialized by the component lock
+	atomic64_t		fast;		// Calls which moved no constraint
+	u64			contended;	// Calls which waited for the component lock
+	u64			lat_sum;	// in ns, of serialized calls
+	u64			lat_max;
+};
+
+/* Domains connected by constraints, contiguous in domain_order */
+struct exynos_dm_comp {
+	struct mutex		lock;
+	seqcount_t		seq;		// Odd while frequencies or constraints move
+	int			start;		// First index in domain_order
+	int			end;		// Last index in domain_order + 1
+	bool			dirty;		// Any domain left to be evaluated
+	int			gen;		// dynamic_disable generation seen
+};
+#endif
+
 struct exynos_dm_data {
 	bool				available;		/* use for DVFS domain available */
 	int				dm_type;
@@ -99,6 +120,8 @@ struct exynos_dm_data {
 #if IS_ENABLED(CONFIG_EXYNOS_DVFS_MANAGER)
 	int			my_order;		// Scaling order in domain_order
 	int			indegree;		// Number of min masters
+	int			comp_id;		// Connected component
+	bool			dirty;			// To be evaluated by next propagation
 
 	u32			cur_freq;		// Current frequency
 	u32			next_target_freq;	// Next target frequency determined by current status
@@ -116,6 +139,8 @@ struct exynos_dm_data {
 	bool				fast_switch_post_in_progress;
 	struct irq_work			fast_switch_post_irq_work;
 	struct task_struct		*fast_switch_post_worker;
+
+	struct exynos_dm_call_stat	stat;
 #if IS_ENABLED(CONFIG_EXYNOS_ACPM) || IS_ENABLED(CONFIG_EXYNOS_ESCA)
 	bool				policy_use;
 #endif
@@ -124,7 +149,6 @@ struct exynos_dm_data {
 
 struct exynos_dm_device {
 	struct device			*dev;
-	struct mutex			lock;
 	int				domain_count;
 	int				*domain_order;
 	struct exynos_dm_data		*dm_data;
@@ -132,7 +156,10 @@ struct exynos_dm_device {
 #if IS_ENABLED(CONFIG_EXYNOS_DVFS_MANAGER)
 	int				constraint_domain_count;
 	unsigned int			fast_switch_ch;
+	struct exynos_dm_comp		*comps;		// Indexed by comp_id
+	struct percpu_rw_semaphore	topology_sem;	// Write locked while comps change
 #elif IS_ENABLED(CONFIG_EXYNOS_ESCA_DVFS_MANAGER)
+	struct mutex			lock;
 	unsigned int			dm_ch;
 	unsigned int			dm_req_ch;
 	unsigned int			dm_sync_ch;
@@ -5,6 +5,7 @@
  */
 
 #include <dt-bindings/soc/samsung/ems.h>
+#include <kunit/visibility.h>
 
 #include "ems.h"
 
@@ -652,7 +653,7 @@ out:
 	return ret;
 }
 
-static void take_util_snapshot(struct tp_env *env)
+VISIBLE_IF_KUNIT void take_util_snapshot(struct tp_env *env)
 {
 	int cpu;
 
@@ -693,6 +694,7 @@ static void take_util_snapshot(struct tp_env *env)
 		trace_ems_take_util_snapshot(cpu, env);
 	}
 }
+EXPORT_SYMBOL_IF_KUNIT(take_util_snapshot);
 
 static unsigned long prev_cpu_advantage(unsigned long cpu_util, unsigned long task_util)
 {
@@ -737,27 +739,70 @@ static int default_get_next_cap(struct tp_env *env, struct cpumask *cpus, int ds
 	return next_cap;
 }
 
-static unsigned int compute_system_energy(struct tp_env *env, int dst_cpu,
-		struct energy_backup *backup)
+static void fill_energy_state(struct tp_env *env, struct cs_domain *csd,
+		struct energy_state *states, int dst_cpu)
+{
+	int capacity;
+
+	capacity = cpufreq_get_next_cap(env, &csd->cpus, dst_cpu);
+	if (capacity < 0)
+		capacity = default_get_next_cap(env, &csd->cpus, dst_cpu);
+
+	et_fill_energy_state(env, &csd->cpus, states, capacity, dst_cpu);
+}
+
+/*
+ * Candidates are evaluated as a delta on the energy states without the task,
+ * which are built once per wakeup. It can be turned off to compare with.
+ */
+VISIBLE_IF_KUNIT bool ems_energy_baseline = true;
+EXPORT_SYMBOL_IF_KUNIT(ems_energy_baseline);
+
+/* too large for the wakeup stack, every caller of select_task_rq has irqs off */
+static DEFINE_PER_CPU(struct energy_baseline, energy_baseline);
+
+VISIBLE_IF_KUNIT void build_energy_baseline(struct tp_env *env, struct energy_baseline *base)
+{
+	struct cs_domain *csd;
+
+	memset(base->states, 0, sizeof(base->states));
+
+	list_for_each_entry(csd, &csd_head, list)
+		fill_energy_state(env, csd, base->states, INVALID_CPU);
+
+	et_prepare_energy_baseline(base);
+}
+EXPORT_SYMBOL_IF_KUNIT(build_energy_baseline);
+
+VISIBLE_IF_KUNIT unsigned int compute_system_energy(struct tp_env *env, int dst_cpu,
+		struct energy_backup *backup, struct energy_baseline *base)
 {
 	struct cs_domain *csd;
 	struct energy_state states[VENDOR_NR_CPUS] = { 0, };
+	int cpu;
+
+	if (base)
+		memcpy(states, base->states, sizeof(states));
 
 	list_for_each_entry(csd, &csd_head, list) {
-		int capacity;
+		/* only the coregroup of dst_cpu differs from the baseline */
+		if (base && !cpumask_test_cpu(dst_cpu, &csd->cpus))
+			continue;
 
-		capacity = cpufreq_get_next_cap(env, &csd->cpus, dst_cpu);
-		if (capacity < 0)
-			capacity = default_get_next_cap(env, &csd->cpus, dst_cpu);
+		/* et_fill_energy_state() may leave it untouched, as without the baseline */
+		if (base)
+			for_each_cpu(cpu, &csd->cpus)
+				memset(&states[cpu], 0, sizeof(states[cpu]));
 
-		et_fill_energy_state(env, &csd->cpus, states, capacity, dst_cpu);
+		fill_energy_state(env, csd, states, dst_cpu);
 	}
 
 	if (env->prev_cpu == dst_cpu)
 		states[dst_cpu].util = prev_cpu_advantage(states[dst_cpu].util, env->task_util);
 
-	return et_compute_system_energy(&csd_head, states, dst_cpu, backup);
+	return et_compute_system_energy(&csd_head, states, dst_cpu, backup, base);
 }
+EXPORT_SYMBOL_IF_KUNIT(compute_system_energy);
 
 static int find_min_util_cpu(struct tp_env *env, const struct cpumask *mask, bool among_idle)
 {
@@ -793,14 +838,21 @@ static int find_min_util_cpu(struct tp_env *env, const struct cpumask *mask, boo
 static int __find_energy_cpu(struct tp_env *env, const struct cpumask *candidates)
 {
 	struct energy_backup backup[VENDOR_NR_CPUS] = { 0, };
+	struct energy_baseline *base = NULL;
 	int cpu, energy_cpu = INVALID_CPU, min_util = INT_MAX;
 	unsigned int min_energy = UINT_MAX;
 
+	if (READ_ONCE(ems_energy_baseline)) {
+		lockdep_assert_irqs_disabled();
+		base = this_cpu_ptr(&energy_baseline);
+		build_energy_baseline(env, base);
+	}
+
 	for_each_cpu(cpu, candidates) {
 		unsigned int energy;
 		int cpu_util = env->cpu_stat[cpu].util_with;
 
-		energy = compute_system_energy(env, cpu, backup);
+		energy = compute_system_energy(env, cpu, backup, base);
 
 		trace_ems_compute_system_energy(env->p, candidates, cpu, energy);
 
@@ -1455,6 +1507,144 @@ out:
 	return cpumask_weight(&env->cpus_allowed);
 }
 
+/******************************************************************************
+ * fast track cache                                                           *
+ ******************************************************************************/
+/*
+ * Tiny tasks woken up over and over, like binder threads or audio callbacks,
+ * mostly end up on the same cpu. A placement made by the energy path is kept
+ * in the task and reused while the task class and cgroup are the same, no
+ * emstune set has been applied, the util of that cpu has not drifted and the
+ * cpu is still idle.
+ */
+#define FT_TASK_UTIL		(SCHED_CAPACITY_SCALE >> 5)
+#define FT_EXPIRE_NS		(8 * NSEC_PER_MSEC)
+
+/* It can be turned off to measure the full selection path. */
+VISIBLE_IF_KUNIT bool ems_fast_track = true;
+EXPORT_SYMBOL_IF_KUNIT(ems_fast_track);
+
+static atomic_t ft_gen;
+static DEFINE_PER_CPU(unsigned int, ft_cpu_gen);
+static DEFINE_PER_CPU(unsigned long, ft_cpu_util);
+
+static inline u32 fast_track_gen(int cpu)
+{
+	/* both only go up, so does the sum */
+	return atomic_read(&ft_gen) + READ_ONCE(per_cpu(ft_cpu_gen, cpu));
+}
+
+void fast_track_tick(struct rq *rq)
+{
+	int cpu = cpu_of(rq);
+	unsigned long util = ml_cpu_util(cpu);
+	unsigned long margin = capacity_cpu_orig(cpu) >> 4;
+
+	if (abs_diff(util, per_cpu(ft_cpu_util, cpu)) <= margin)
+		return;
+
+	per_cpu(ft_cpu_util, cpu) = util;
+	WRITE_ONCE(per_cpu(ft_cpu_gen, cpu), per_cpu(ft_cpu_gen, cpu) + 1);
+}
+
+void fast_track_task_init(struct task_struct *p)
+{
+	ems_ft_cpu(p) = INVALID_CPU;
+}
+
+static bool fast_track_cacheable(struct tp_env *env)
+{
+	/* the placement of these depends on the waker */
+	if (env->per_cpu_kthread || env->sync || env->cl_sync || env->cpu_sync)
+		return false;
+
+	if (env->task_util > FT_TASK_UTIL)
+		return false;
+
+	/* uclamp is not part of the key, so clamped tasks are never cached */
+	if (env->task_util_clamped != env->task_util || ml_uclamp_boosted(env->p))
+		return false;
+
+	/*
+	 * 32bit tasks are limited to system_32bit_el0_cpumask() with its own
+	 * fallback in find_cpus_allowed(), which the lookup does not redo.
+	 */
+	if (is_compat_thread(task_thread_info(env->p)))
+		return false;
+
+	return true;
+}
+
+static int fast_track_lookup(struct tp_env *env, u64 now)
+{
+	struct task_struct *p = env->p;
+	int cpu = ems_ft_cpu(p);
+
+	if (!READ_ONCE(ems_fast_track))
+		return INVALID_CPU;
+
+	if (!cpu_selected(cpu) || !fast_track_cacheable(env))
+		return INVALID_CPU;
+
+	if (now - ems_ft_ts(p) > FT_EXPIRE_NS)
+		return INVALID_CPU;
+
+	if (ems_ft_cgroup(p) != env->cgroup_idx || ems_ft_gen(p) != fast_track_gen(cpu))
+		return INVALID_CPU;
+
+	if (get_task_class(p) != NORMAL_CLASS || sysbusy_boost_task(p))
+		return INVALID_CPU;
+
+	if (!cpumask_test_cpu(cpu, p->cpus_ptr) || !cpu_active(cpu) ||
+	    !cpumask_test_cpu(cpu, ecs_cpus_allowed(p)) ||
+	    !cpumask_test_cpu(cpu, cpus_binding_mask(p)))
+		return INVALID_CPU;
+
+	if (!available_idle_cpu(cpu) || ems_rq_migrated(cpu_rq(cpu)))
+		return INVALID_CPU;
+
+	return cpu;
+}
+
+static void fast_track_update(struct tp_env *env, int cpu, u64 now)
+{
+	struct task_struct *p = env->p;
+
+	if (env->reason_of_selection == FAIR_CACHED)
+		return;
+
+	ems_ft_cpu(p) = INVALID_CPU;
+
+	/* other placements are shortcuts or fallbacks, not worth repeating */
+	if (env->reason_of_selection != FAIR_ENERGY)
+		return;
+
+	if (!cpu_selected(cpu) || !fast_track_cacheable(env) || !available_idle_cpu(cpu))
+		return;
+
+	ems_ft_cgroup(p) = env->cgroup_idx;
+	ems_ft_gen(p) = fast_track_gen(cpu);
+	ems_ft_ts(p) = now;
+	ems_ft_cpu(p) = cpu;
+}
+
+static int ft_emstune_notifier_call(struct notifier_block *nb,
+				unsigned long val, void *v)
+{
+	atomic_inc(&ft_gen);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block ft_emstune_notifier = {
+	.notifier_call = ft_emstune_notifier_call,
+};
+
+static void fast_track_init(void)
+{
+	emstune_register_notifier(&ft_emstune_notifier);
+}
+
 extern char *fair_causes_name[END_OF_FAIR_CAUSES];
 int ems_select_task_rq_fair(struct task_struct *p, int prev_cpu,
 			   int sd_flag, int wake_flag)
@@ -1476,6 +1666,13 @@ int ems_select_task_rq_fair(struct task_struct *p, int prev_cpu,
 	};
 	int target_cpu = INVALID_CPU;
 	int num_of_cpus;
+	u64 start = sched_clock();
+
+	target_cpu = fast_track_lookup(&env, start);
+	if (cpu_selected(target_cpu)) {
+		env.reason_of_selection = FAIR_CACHED;
+		goto out;
+	}
 
 	/* Find mandatory conditions for task allocation */
 	num_of_cpus = find_cpus_allowed(&env);
@@ -1531,11 +1728,13 @@ int ems_select_task_rq_fair(struct task_struct *p, int prev_cpu,
 	}
 
 out:
-	update_fair_stat(target_cpu, env.reason_of_selection);
+	fast_track_update(&env, target_cpu, start);
+	update_fair_stat(target_cpu, env.reason_of_selection, sched_clock() - start);
 	trace_ems_select_task_rq(&env, target_cpu, fair_causes_name[env.reason_of_selection]);
 
 	return target_cpu;
 }
+EXPORT_SYMBOL_IF_KUNIT(ems_select_task_rq_fair);
 
 int core_init(struct device_node *ems_dn)
 {
@@ -1569,6 +1768,7 @@ int core_init(struct device_node *ems_dn)
 	tex_init();
 	cpus_binding_init();
 	cpu_weight_init();
+	fast_track_init();
 
 	index = match_string(sched_feat_names, __SCHED_FEAT_NR, "TTWU_QUEUE");
 	if (index >= 0) {
@@ -162,6 +162,12 @@ struct energy_backup {
 	unsigned long energy;
 };
 
+/* energy states without the waking task, shared by all candidates of a wakeup */
+struct energy_baseline {
+	struct energy_state states[VENDOR_NR_CPUS];
+	unsigned long dsu_freq[VENDOR_NR_CPUS];	/* needed by each coregroup, at its first cpu */
+};
+
 #define MLT_MAX_CLUSTER_NUM	5
 #define invalid_cluster_id(id)	((id) < 0 || (id) >= MLT_MAX_CLUSTER_NUM)
 
@@ -203,7 +209,8 @@ enum mlt_uarch_tsk_raw {
 
 #define MLT_PERIOD_SIZE		(4 * NSEC_PER_MSEC)
 #define MLT_PERIOD_SIZE_MIN	(MLT_PERIOD_SIZE - (MLT_PERIOD_SIZE >> 4))
-#define MLT_PERIOD_COUNT	8
+#define MLT_PERIOD_COUNT	8	/* power of 2, periods are indexed with a mask */
+#define MLT_PERIOD_MASK		(MLT_PERIOD_COUNT - 1)
 #define MLT_IDLE_THR_TIME	(8 * NSEC_PER_MSEC)
 #define MLT_IRQ_LOAD_RATIO	(95)
 
@@ -227,14 +234,15 @@ enum mlt_value_type {
 };
 
 struct mlt_part {
+	/* updated on every switch and tick, kept within one cache line */
 	int		state;
 	int		cur_period;
 	int		active_period;
+	int		recent;
 	u64		period_start;
 	u64		last_updated;
-	int		periods[MLT_PERIOD_COUNT];
-	int		recent;
 	u64		contrib;
+	u16		periods[MLT_PERIOD_COUNT];	/* ring of 0 ~ SCHED_CAPACITY_SCALE */
 
 	int		load_history[MLT_LOAD_PERIOD_COUNT];
 	int		hist_idx;
@@ -277,7 +285,7 @@ struct mlt_cpu {
 	int			cluster;
 	u64			runtime_scale;
 
-	struct mlt_part		part;
+	struct mlt_part		part ____cacheline_aligned;
 	struct mlt_runnable	runnable;
 	struct mlt_uarch	uarch[MLT_UARCH_CPU_NUM];
 	struct mlt_uarch_raw	uarch_raw[MLT_RAW_CPU_NUM];
@@ -618,11 +626,12 @@ enum fair_causes {
 	FAIR_PERFORMANCE,
 	FAIR_SYNC,
 	FAIR_FAST_TRACK,
+	FAIR_CACHED,
 	FAIR_FAILED,
 	END_OF_FAIR_CAUSES,
 };
 
-extern void update_fair_stat(int cpu, enum fair_causes);
+extern void update_fair_stat(int cpu, enum fair_causes, u64 elapsed);
 extern void update_rt_stat(int cpu);
 
 /* Sysbusy */
@@ -707,6 +716,10 @@ struct ems_task_struct {
 #ifdef CONFIG_SCHED_EMS_TASK_GROUP
 	int			cgroup;
 #endif
+	s16			ft_cpu;
+	u16			ft_cgroup;
+	u32			ft_gen;
+	u64			ft_ts;
 
 	/* before refactoring mlt, put new items above here */
 	struct mlt_task		task_mlt;
@@ -755,6 +768,10 @@ extern DEFINE_PER_CPU(struct _rq_avd1, ems_runqueues);
 #define ems_yield_cnt(task)		(task_avd(task)->yield_cnt)
 #define ems_yield_last(task)		(task_avd(task)->yield_last)
 #define ems_busy_waiting(task)		(task_avd(task)->busy_waiting)
+#define ems_ft_cpu(task)		(task_avd(task)->ft_cpu)
+#define ems_ft_cgroup(task)		(task_avd(task)->ft_cgroup)
+#define ems_ft_gen(task)		(task_avd(task)->ft_gen)
+#define ems_ft_ts(task)			(task_avd(task)->ft_ts)
 #ifdef CONFIG_SCHED_EMS_TASK_GROUP
 #define ems_cgroup(task)		(task_avd(task)->cgroup)
 #endif
@@ -1031,6 +1048,21 @@ extern void dslt_new_task_wakeup(struct task_struct *p);
 extern void dslt_switch_sensitivity(int cpu, struct task_struct *prev, struct task_struct *next);
 extern int dslt_init(struct kobject *ems_kobj, struct device_node *dn);
 
+/* halo sleep length predictor, bucket i holds [2^i, 2^(i+1)) usec */
+#define HALO_PRED_BUCKETS	16
+struct halo_pred {
+	u32 weight[HALO_PRED_BUCKETS];	/* decaying hit count */
+	u32 avg_us[HALO_PRED_BUCKETS];	/* average sleep length in the bucket */
+	s64 last_ns;			/* end of the last decay period */
+};
+
+struct halo_pred_stat {
+	u64 cnt;
+	u64 over;			/* predicted longer than actual */
+	u64 under;			/* predicted shorter than actual */
+	u64 err_sum_us;
+};
+
 /*
  *EXTERN for IDLE SELECTION
  */
@@ -1122,8 +1154,10 @@ extern unsigned long et_freq_to_cap(int cpu, unsigned long freq);
 extern void et_update_freq(int cpu, unsigned long freq);
 extern void et_fill_energy_state(struct tp_env *env, struct cpumask *cpus,
 		struct energy_state *states, unsigned long capacity, int dsu_cpu);
+extern void et_prepare_energy_baseline(struct energy_baseline *base);
 extern unsigned long et_compute_system_energy(const struct list_head *csd_head,
-		struct energy_state *states, int target_cpu, struct energy_backup *backup);
+		struct energy_state *states, int target_cpu, struct energy_backup *backup,
+		struct energy_baseline *base);
 extern int et_get_table_index_by_ipc(struct tp_env *env);
 #else /* CONFIG_SCHED_EMS_FREQ_SELECT */
 static inline void ems_freq_select_init(struct platform_device *pdev) { };
@@ -1142,8 +1176,10 @@ static inline unsigned int et_cur_freq_idx(int cpu) { return 0; };
 static inline unsigned long et_cur_cap(int cpu) { return 1024; };
 static inline void et_fill_energy_state(struct tp_env *env, struct cpumask *cpus,
 		struct energy_state *states, unsigned long capacity, int dsu_cpu) { };
+static inline void et_prepare_energy_baseline(struct energy_baseline *base) { };
 static inline unsigned long et_compute_system_energy(const struct list_head *csd_head,
-		struct energy_state *states, int target_cpu, struct energy_backup *backup) { return 0; };
+		struct energy_state *states, int target_cpu, struct energy_backup *backup,
+		struct energy_baseline *base) { return 0; };
 static inline unsigned long et_max_cap(int cpu) { return capacity_cpu_orig(cpu); };
 #endif /* CONFIG_SCHED_EMS_FREQ_SELECT */
 
@@ -1206,6 +1242,8 @@ extern void tex_check_preempt_wakeup(struct rq *rq, struct task_struct *p,
 extern void tex_update(struct rq *rq);
 extern void tex_do_yield(struct task_struct *p);
 extern void tex_task_init(struct task_struct *p);
+extern void fast_track_task_init(struct task_struct *p);
+extern void fast_track_tick(struct rq *rq);
 
 extern void gsc_init(struct kobject *ems_kobj);
 extern void gsc_update_tick(void);
@@ -1275,6 +1313,8 @@ static inline int get_tex_level(struct task_struct *p) { return 0; };
 static inline void tex_update(struct rq *rq) { };
 static inline void tex_do_yield(struct task_struct *p) { };
 static inline void tex_task_init(struct task_struct *p) { };
+static inline void fast_track_task_init(struct task_struct *p) { };
+static inline void fast_track_tick(struct rq *rq) { };
 static inline void tex_check_preempt_wakeup(struct rq *rq, struct task_struct *p,
 		bool *preempt, bool *ignore) { };
 
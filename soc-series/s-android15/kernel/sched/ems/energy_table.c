@@ -123,6 +123,17 @@ static unsigned long get_needed_dsu_freq(struct energy_table *table, unsigned lo
 	return dsu_freq;
 }
 
+/* @cpu is the first cpu of its energy table */
+static unsigned long __get_needed_dsu_freq(struct energy_state *states, int cpu)
+{
+	struct energy_table *table = per_cpu_et(cpu);
+	unsigned long cpu_freq;
+
+	cpu_freq = states[cpu].frequency ? states[cpu].frequency : table->cur_freq;
+
+	return get_needed_dsu_freq(table, cpu_freq);
+}
+
 static unsigned long get_dynamic_power(unsigned long f, unsigned long v, unsigned long c, long i)
 {
 	/* dynamic power = coefficent * frequency * voltage^2 + intercept */
@@ -148,7 +159,11 @@ static unsigned long compute_dsu_energy(struct energy_state *state)
 	if (unlikely(!dsu_table))
 		return 0;
 
-	dp = get_dynamic_power(state->frequency, state->voltage, dsu_table->dynamic_coeff, 0);
+	/* dynamic_power is only filled when the state is a dsu opp */
+	dp = state->dynamic_power;
+	if (!dp)
+		dp = get_dynamic_power(state->frequency, state->voltage,
+				dsu_table->dynamic_coeff, 0);
 	e = dp << SCHED_CAPACITY_SHIFT;
 
 	trace_ems_compute_dsu_energy(state->frequency, state->voltage, dp, e);
@@ -198,11 +213,16 @@ static unsigned long compute_cpu_energy(const struct cpumask *cpus, struct energ
 	return energy;
 }
 
+/*
+ * If @base is given, the dsu frequency needed by a coregroup whose frequency
+ * is the same as in the baseline is taken from it instead of the constraint.
+ */
 static void update_energy_state(const struct cpumask *cpus,
-		struct energy_state *states, struct energy_state *dsu_state)
+		struct energy_state *states, struct energy_state *dsu_state,
+		struct energy_baseline *base)
 {
 	struct energy_table *table;
-	unsigned long cpu_volt, cpu_freq;
+	unsigned long cpu_volt;
 	unsigned long dsu_volt, dsu_freq = 0;
 	int cpu, rep_cpu, index;
 
@@ -218,8 +238,10 @@ static void update_energy_state(const struct cpumask *cpus,
 		if (cpu != cpumask_first(&table->cpus))
 			continue;
 
-		cpu_freq = states[cpu].frequency ? states[cpu].frequency : table->cur_freq;
-		dsu_freq = max(dsu_freq, get_needed_dsu_freq(table, cpu_freq));
+		if (base && states[cpu].frequency == base->states[cpu].frequency)
+			dsu_freq = max(dsu_freq, base->dsu_freq[cpu]);
+		else
+			dsu_freq = max(dsu_freq, __get_needed_dsu_freq(states, cpu));
 	}
 
 	/* 2. Find DSU voltage */
@@ -267,6 +289,9 @@ static void update_energy_state(const struct cpumask *cpus,
 
 	dsu_state->frequency = dsu_freq;
 	dsu_state->voltage = dsu_volt;
+	if (dsu_freq == dsu_table->states[index].frequency &&
+	    dsu_volt == dsu_table->states[index].voltage)
+		dsu_state->dynamic_power = dsu_table->states[index].dynamic_power;
 }
 
 int et_get_table_index_by_ipc(struct tp_env *env)
@@ -397,14 +422,29 @@ void et_fill_energy_state(struct tp_env *env, struct cpumask *cpus,
 	}
 }
 
+void et_prepare_energy_baseline(struct energy_baseline *base)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct energy_table *table = per_cpu_et(cpu);
+
+		if (cpu != cpumask_first(&table->cpus))
+			continue;
+
+		base->dsu_freq[cpu] = __get_needed_dsu_freq(base->states, cpu);
+	}
+}
+
 unsigned long et_compute_system_energy(const struct list_head *csd_head,
-		struct energy_state *states, int target_cpu, struct energy_backup *backup)
+		struct energy_state *states, int target_cpu, struct energy_backup *backup,
+		struct energy_baseline *base)
 {
-	struct energy_state dsu_state;
+	struct energy_state dsu_state = { 0, };
 	struct cs_domain *csd;
 	unsigned long energy = 0;
 
-	update_energy_state(cpu_possible_mask, states, &dsu_state);
+	update_energy_state(cpu_possible_mask, states, &dsu_state, base);
 
 	energy += compute_dsu_energy(&dsu_state);
 
@@ -729,6 +769,10 @@ void et_init_dsu_table(unsigned long *freq_table, unsigned int *volt_table, int
 	for (i = 0; i < size; i++) {
 		dsu_table->states[i].frequency = freq_table[i];
 		dsu_table->states[i].voltage = volt_table[i] / 1000;
+		dsu_table->states[i].dynamic_power = get_dynamic_power(
+				dsu_table->states[i].frequency,
+				dsu_table->states[i].voltage,
+				dsu_table->dynamic_coeff, 0);
 	}
 }
 EXPORT_SYMBOL_GPL(et_init_dsu_table);
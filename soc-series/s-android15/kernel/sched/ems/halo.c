@@ -12,6 +12,7 @@
 #include <linux/sched/clock.h>
 #include <linux/tick.h>
 #include <linux/hrtimer.h>
+#include <kunit/visibility.h>
 
 #include "ems.h"
 
@@ -128,6 +129,7 @@ struct halo_irqs {
 struct halo_tune {
 	struct cpumask cpus;
 	int expired_ratio;		/* def-timer expired time ratio */
+	int pred_ratio;			/* percentile of learned slen, 0 to disable */
 	struct kobject		kobj;
 };
 
@@ -143,6 +145,9 @@ struct halo_cpu {
 	s64 det_slen_ns;		/* determined sleep length to next event like(timer, tick, periodic irqs) */
 
 	struct halo_ipi hipi;		/* ipi history */
+	struct halo_pred hpred;		/* learned ipi sleep length */
+	struct halo_pred_stat hstat;	/* prediction error */
+	s64 pred_slen_ns;		/* sleep length predicted at last selection */
 	struct halo_tick htick;		/* tick information */
 	struct halo_sched hsched;	/* sched information */
 	struct halo_irqs hirqs;		/* periodic irqs list */
@@ -244,6 +249,116 @@ static s64 calc_periodic_slen(s64 last_update_ns, s64 period, s64 now)
 	return next_wakeup_ns - now;
 }
 
+/********************************************************************************
+ *				HALO PREDICTOR					*
+ *******************************************************************************/
+/*
+ * Sleep lengths to IPI wake-ups are kept in a log2 bucketed histogram whose
+ * weights lose 1/8 every PRED_DECAY_NS, so it follows phase changes within
+ * a few periods while remembering a bimodal pattern longer than time_hist
+ * does. Decaying by time rather than per sample keeps a CPU that rarely
+ * gets an IPI from predicting with a pattern that has long gone.
+ */
+#define PRED_DECAY_SHIFT	3
+#define PRED_DECAY_NS		(4 * NSEC_PER_MSEC)
+#define PRED_DECAY_MAX		64	/* (7/8)^64 of any weight is below IGNORE_NUM */
+#define PRED_WARMUP		(PULSE * 2)
+
+VISIBLE_IF_KUNIT int halo_pred_bucket(s64 slen_us)
+{
+	if (slen_us < 2)
+		return 0;
+
+	return min_t(int, ilog2(slen_us), HALO_PRED_BUCKETS - 1);
+}
+EXPORT_SYMBOL_IF_KUNIT(halo_pred_bucket);
+
+static void halo_pred_decay(struct halo_pred *hpred, s64 now)
+{
+	s64 periods = (now - hpred->last_ns) / PRED_DECAY_NS;
+	int i, n;
+
+	if (periods <= 0)
+		return;
+
+	if (periods >= PRED_DECAY_MAX) {
+		memset(hpred->weight, 0, sizeof(hpred->weight));
+		hpred->last_ns = now;
+		return;
+	}
+
+	/* keep the remainder, so frequent updates decay at the same rate */
+	hpred->last_ns += periods * PRED_DECAY_NS;
+
+	for (i = 0; i < HALO_PRED_BUCKETS; i++) {
+		for (n = 0; n < periods && hpred->weight[i]; n++)
+			hpred->weight[i] -= hpred->weight[i] >> PRED_DECAY_SHIFT;
+		if (hpred->weight[i] <= IGNORE_NUM)
+			hpred->weight[i] = 0;
+	}
+}
+
+VISIBLE_IF_KUNIT void halo_pred_update(struct halo_pred *hpred, s64 now, s64 slen_ns)
+{
+	s64 slen_us = clamp_t(s64, slen_ns / NSEC_PER_USEC, 0, U32_MAX);
+	int b = halo_pred_bucket(slen_us);
+
+	halo_pred_decay(hpred, now);
+
+	if (!hpred->weight[b])
+		hpred->avg_us[b] = slen_us;
+	else
+		hpred->avg_us[b] += (slen_us - (s64)hpred->avg_us[b]) >> 2;
+
+	hpred->weight[b] += PULSE;
+}
+EXPORT_SYMBOL_IF_KUNIT(halo_pred_update);
+
+/*
+ * halo_pred_predict - sleep length at @ratio percentile of the histogram
+ * return -1 if there are not enough samples yet
+ */
+VISIBLE_IF_KUNIT s64 halo_pred_predict(struct halo_pred *hpred, int ratio)
+{
+	u64 total = 0, target, sum = 0;
+	int i;
+
+	for (i = 0; i < HALO_PRED_BUCKETS; i++)
+		total += hpred->weight[i];
+
+	if (total < PRED_WARMUP)
+		return -1;
+
+	target = min(total, total * ratio / RATIO_UNIT);
+	for (i = 0; i < HALO_PRED_BUCKETS; i++) {
+		if (!hpred->weight[i])
+			continue;
+
+		sum += hpred->weight[i];
+		if (sum >= target)
+			break;
+	}
+
+	return (s64)hpred->avg_us[min(i, HALO_PRED_BUCKETS - 1)] * NSEC_PER_USEC;
+}
+EXPORT_SYMBOL_IF_KUNIT(halo_pred_predict);
+
+/* a prediction off by more than 1/4 of the actual sleep length is counted */
+VISIBLE_IF_KUNIT void halo_pred_account(struct halo_pred_stat *hstat,
+				s64 pred_ns, s64 actual_ns)
+{
+	s64 err_ns = pred_ns - actual_ns;
+
+	hstat->cnt++;
+	hstat->err_sum_us += abs(err_ns) / NSEC_PER_USEC;
+
+	if (err_ns > (actual_ns >> 2))
+		hstat->over++;
+	else if (-err_ns > (actual_ns >> 2))
+		hstat->under++;
+}
+EXPORT_SYMBOL_IF_KUNIT(halo_pred_account);
+
 /********************************************************************************
  *				HALO TIMER FUNC					*
  *******************************************************************************/
@@ -430,6 +545,7 @@ static void halo_update_ipi_history(int cpu, struct cpuidle_driver *drv,
 
 	/* applying last sleep length */
 	halo_update_time_hist(time_hist, now, hcpu->last_slen_ns);
+	halo_pred_update(&hcpu->hpred, now, hcpu->last_slen_ns);
 
 	/* get statics from time hist table with periodic duration, if there are valid data */
 	halo_get_time_hist_statics(time_hist, now, &min_ns, &max_ns, &avg_ns);
@@ -772,6 +888,24 @@ static int halo_get_valid_state(struct cpuidle_driver *drv,
 	return valid_cnt;
 }
 
+/*
+ * halo_ipi_slen - learned sleep length to next ipi if it is warmed up,
+ * if NOT the one from recent ipi history
+ */
+static s64 halo_ipi_slen(struct halo_cpu *hcpu)
+{
+	struct halo_tune *htune = hcpu->htune;
+	s64 slen;
+
+	if (htune && htune->pred_ratio) {
+		slen = halo_pred_predict(&hcpu->hpred, htune->pred_ratio);
+		if (slen >= 0)
+			return slen;
+	}
+
+	return hcpu->hipi.ipi_slen_ns;
+}
+
 /*
  * halo_compute_pred_slen - computing predicted sleep length
  */
@@ -780,7 +914,7 @@ static inline s64 halo_compute_pred_slen(struct halo_cpu *hcpu, struct cpuidle_d
 	if (hcpu->last_waker == WAKEUP_BY_IPI ||
 		hcpu->last_waker == WAKEUP_BY_DET ||
 		hcpu->last_waker == WAKEUP_BY_SKIP_REFLECT)
-		return hcpu->hipi.ipi_slen_ns;
+		return halo_ipi_slen(hcpu);
 	else if (hcpu->last_waker == WAKEUP_BY_HALO_TIMER_1ST) {
 	/*
 	 * When previous IPI prediction failed and second time timer hit ratio is high,
@@ -790,7 +924,7 @@ static inline s64 halo_compute_pred_slen(struct halo_cpu *hcpu, struct cpuidle_d
 		struct halo_sched *hsched = &hcpu->hsched;
 		if (hstate->hit > hstate->miss &&
 			hsched->avg_nr_run > VALID_RUNNABLE_DIFF)
-			return hcpu->hipi.ipi_slen_ns;
+			return halo_ipi_slen(hcpu);
 	}
 
 	return LLONG_MAX;
@@ -828,6 +962,8 @@ static int halo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
 	s64 now = local_clock();
 	enum selector selector = 0;
 
+	hcpu->pred_slen_ns = LLONG_MAX;
+
 	/* if valid count lower than two, we don't need to compute next state */
 	if (halo_get_valid_state(drv, dev, &candi_idx) < 2)
 		goto end;
@@ -874,6 +1010,8 @@ static int halo_select(struct cpuidle_driver *drv, struct cpuidle_device *dev,
 			deepest_idx = i;
 	}
 
+	hcpu->pred_slen_ns = min(pred_slen_ns, hcpu->det_slen_ns);
+
 	/* find c-state selector */
 	if (pred_slen_ns < hcpu->det_slen_ns) {
 		selector = BY_IPI;
@@ -951,6 +1089,11 @@ static void halo_reflect(struct cpuidle_device *dev, int state)
 		waker = WAKEUP_BY_IPI;
 	}
 
+	/* sleep cut by halo timer or poll tells nothing about the prediction */
+	if ((waker == WAKEUP_BY_IPI || waker == WAKEUP_BY_DET) &&
+			hcpu->pred_slen_ns != LLONG_MAX)
+		halo_pred_account(&hcpu->hstat, hcpu->pred_slen_ns, slen_ns);
+
 	trace_halo_reflect(dev->cpu, waker, slen_ns);
 	hcpu->last_slen_ns = slen_ns;
 	hcpu->last_waker = waker;
@@ -1027,6 +1170,44 @@ halo_show(expired_ratio);
 halo_store(expired_ratio);
 halo_attr_rw(expired_ratio);
 
+halo_show(pred_ratio);
+halo_store(pred_ratio);
+halo_attr_rw(pred_ratio);
+
+static ssize_t show_pred_stat(struct kobject *k, char *buf)
+{
+	struct halo_tune *htune = container_of(k, struct halo_tune, kobj);
+	int cpu, ret = 0;
+
+	ret += sprintf(buf + ret, "%4s %12s %12s %8s %8s\n",
+			"cpu", "count", "avg_err(us)", "over(%)", "under(%)");
+
+	for_each_cpu(cpu, &htune->cpus) {
+		struct halo_pred_stat *hstat = &get_hcpu(cpu)->hstat;
+		u64 cnt = hstat->cnt;
+
+		ret += sprintf(buf + ret, "%4d %12llu %12llu %8llu %8llu\n", cpu, cnt,
+				cnt ? div64_u64(hstat->err_sum_us, cnt) : 0,
+				cnt ? div64_u64(hstat->over * 100, cnt) : 0,
+				cnt ? div64_u64(hstat->under * 100, cnt) : 0);
+	}
+
+	return ret;
+}
+
+/* writing anything clears the statistics */
+static ssize_t store_pred_stat(struct kobject *k, const char *buf, size_t count)
+{
+	struct halo_tune *htune = container_of(k, struct halo_tune, kobj);
+	int cpu;
+
+	for_each_cpu(cpu, &htune->cpus)
+		memset(&get_hcpu(cpu)->hstat, 0, sizeof(struct halo_pred_stat));
+
+	return count;
+}
+halo_attr_rw(pred_stat);
+
 static ssize_t show_irqs_list(struct kobject *k, char *buf)
 {
 	struct halo_tune *htune = container_of(k, struct halo_tune, kobj);
@@ -1071,6 +1252,8 @@ static const struct sysfs_ops halo_sysfs_ops = {
 
 static struct attribute *halo_attrs[] = {
 	&expired_ratio_attr.attr,
+	&pred_ratio_attr.attr,
+	&pred_stat_attr.attr,
 	&irqs_list_attr.attr,
 	NULL
 };
@@ -1135,6 +1318,9 @@ static void halo_tunable_init(struct kobject *ems_kobj)
 		if (of_property_read_u32(child, "expired-ratio", &htune->expired_ratio))
 			htune->expired_ratio = RATIO_UNIT;
 
+		if (of_property_read_u32(child, "pred-ratio", &htune->pred_ratio))
+			htune->pred_ratio = 0;
+
 		if (kobject_init_and_add(&htune->kobj, &ktype_halo, halo_kobj,
 					"coregroup%d", cpumask_first(&htune->cpus)))
 			return;
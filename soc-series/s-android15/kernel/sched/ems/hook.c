@@ -122,6 +122,8 @@ static void ems_hook_scheduler_tick(void *data, struct rq *rq)
 
 	tex_update(rq);
 
+	fast_track_tick(rq);
+
 	lb_tick(rq);
 
 	ontime_migration();
@@ -243,6 +245,7 @@ static void ems_hook_find_new_ilb(void *data, struct cpumask *nohz_idle_cpus_mas
 static void ems_hook_sched_fork_init(void *data, struct task_struct *p)
 {
 	tex_task_init(p);
+	fast_track_task_init(p);
 	mlt_init_task(p);
 	ems_task_misfited(p) = 0;
 	ems_launch_task(p) = false;
@@ -4,6 +4,8 @@
  * Copyright (C) 2023 Samsung Electronics Co., Ltd
  * S.LSI, SoC Dev, APSW Team, CPUSW&Performance Part
  */
+#include <kunit/visibility.h>
+
 #include "ems.h"
 
 #include <trace/events/ems.h>
@@ -373,18 +375,21 @@ static void
 mlt_uarch_update_periods(struct mlt_env *env, int num_of_uarch,
 			int cur_period, int count, u32 *val)
 {
-	int idx;
+	bool active = env->part->state == ACTIVE;
+	int idx, c;
 
-	while (count--) {
-		cur_period = part_move_period(cur_period, 1);
+	for (idx = 0; idx < num_of_uarch; idx++) {
+		u32 *periods = env->uarch[idx].periods;
+		u32 value = active ? val[idx] : 0;
 
-		if (env->part->state == ACTIVE) {
-			for (idx = 0; idx < num_of_uarch; idx++)
-				env->uarch[idx].periods[cur_period] = val[idx];
-		} else {
-			for (idx = 0; idx < num_of_uarch; idx++)
-				env->uarch[idx].periods[cur_period] = 0;
+		if (count >= MLT_PERIOD_COUNT) {
+			for (c = 0; c < MLT_PERIOD_COUNT; c++)
+				periods[c] = value;
+			continue;
 		}
+
+		for (c = 1; c <= count; c++)
+			periods[part_move_period(cur_period, c)] = value;
 	}
 }
 
@@ -481,19 +486,29 @@ mlt_update_uarch(struct mlt_env *env, u64 now, u64 remain_t, int prd_cnt)
  ******************************************************************************/
 static inline int part_move_period(int period, int count)
 {
-	return (period + count + MLT_PERIOD_COUNT) % MLT_PERIOD_COUNT;
+	return (period + count) & MLT_PERIOD_MASK;
 }
 
+/*
+ * Fill @count periods after @cur_period at once. When the whole history
+ * has elapsed, as after a long sleep, every slot gets the same value.
+ */
 static void update_part_periods(struct mlt_part *part,
 			int cur_period, int count, int value)
 {
-	while (count--) {
-		cur_period = part_move_period(cur_period, 1);
-		if (part->state == ACTIVE)
-			part->periods[cur_period] = value;
-		else
-			part->periods[cur_period] = 0;
+	int c;
+
+	if (part->state != ACTIVE)
+		value = 0;
+
+	if (count >= MLT_PERIOD_COUNT) {
+		for (c = 0; c < MLT_PERIOD_COUNT; c++)
+			part->periods[c] = value;
+		return;
 	}
+
+	for (c = 1; c <= count; c++)
+		part->periods[part_move_period(cur_period, c)] = value;
 }
 
 static void part_recent_elapsed(struct mlt_part *part, int cur_period)
@@ -561,7 +576,7 @@ static void __update_part(struct mlt_part *part,
 	}
 }
 
-static void mlt_update(struct mlt_env *env, u64 now)
+VISIBLE_IF_KUNIT void mlt_update(struct mlt_env *env, u64 now)
 {
 	u64 contrib = 0, remain = 0;
 	int period_count = 0;
@@ -581,8 +596,14 @@ static void mlt_update(struct mlt_env *env, u64 now)
 	}
 
 	if (likely(now > part->period_start)) {
-		period_count = div64_u64_rem(now - part->period_start,
-					MLT_PERIOD_SIZE, &remain);
+		u64 elapsed = now - part->period_start;
+
+		/* most switches land in the current period, skip the division */
+		if (elapsed < MLT_PERIOD_SIZE)
+			remain = elapsed;
+		else
+			period_count = div64_u64_rem(elapsed,
+						MLT_PERIOD_SIZE, &remain);
 
 		/*
 		 * forcely update period_count when sched tick occured
@@ -608,6 +629,7 @@ static void mlt_update(struct mlt_env *env, u64 now)
 	if (env->next_state != MLT_STATE_NOCHANGE)
 		env->part->state = env->next_state;
 }
+EXPORT_SYMBOL_IF_KUNIT(mlt_update);
 
 /******************************************************************************
  *                           MULTI LOAD for RUNNABLE			      *
@@ -656,11 +678,35 @@ int mlt_get_runnable_cpu(int cpu)
 #define MLT_VALID_PERIOD(x)	((x) > -1 && (x) < MLT_PERIOD_COUNT)
 #define MLT_VALID_STATE(x)	((x) > -1 && (x) < CSTATE_MAX)
 #define MLT_VALID_LENGTH(x)	MLT_VALID_PERIOD((x - 1))
+/*
+ * Sum of @length periods up to @last. The ring is walked in at most two
+ * linear runs so that the compiler can vectorize the additions.
+ */
+static int mlt_part_sum(struct mlt_part *part, int last, int length)
+{
+	int first = part_move_period(last, 1 - length);
+	int idx, sum = 0;
+
+	if (!length)
+		return 0;
+
+	if (first > last) {
+		for (idx = first; idx < MLT_PERIOD_COUNT; idx++)
+			sum += part->periods[idx];
+		first = 0;
+	}
+
+	for (idx = first; idx <= last; idx++)
+		sum += part->periods[idx];
+
+	return sum;
+}
+
 /* return task's average ratio of given length from cur_period */
 int __mlt_avg_value(struct mlt_part *part, int length)
 {
 	int oldest_idx, idx = part->cur_period, value = 0;
-	int cnt, corrected_idx = 0;
+	int corrected_idx = 0;
 
 	if (unlikely(!MLT_VALID_LENGTH(length)))
 		return 0;
@@ -670,19 +716,17 @@ int __mlt_avg_value(struct mlt_part *part, int length)
 	 * If recent value is higher then oldest window value,
 	 * replace small value window with recent velue to incerease performance
 	 */
-	oldest_idx = mlt_period_with_delta(idx, -(length - 1));
+	oldest_idx = part_move_period(idx, -(length - 1));
 	if (part->periods[oldest_idx] < part->recent) {
 		corrected_idx = 1;
 		value = part->recent;
 	}
 
-	for (cnt = 0; cnt < (length - corrected_idx); cnt++) {
-		value += part->periods[idx];
-		idx = mlt_period_with_delta(idx, -1);
-	}
+	value += mlt_part_sum(part, idx, length - corrected_idx);
 
 	return value / length;
 }
+EXPORT_SYMBOL_IF_KUNIT(__mlt_avg_value);
 
 u64 __mlt_get_target_period_value(struct mlt_part *part, int target_period)
 {
@@ -25,6 +25,7 @@ char *fair_causes_name[END_OF_FAIR_CAUSES] = {
 	"performance",
 	"sync",
 	"fast-track",
+	"fast-track-cache",
 	"na"
 };
 
@@ -32,6 +33,8 @@ struct sched_stat {
 	unsigned int fair_sum;
 	unsigned int rt_sum;
 	unsigned int fair[END_OF_FAIR_CAUSES];
+	u64 fair_ns;		/* time spent in selecting cpu */
+	u64 fair_cached_ns;	/* part of fair_ns from fast track cache */
 };
 static DEFINE_PER_CPU(struct sched_stat, stats);
 
@@ -54,7 +57,7 @@ struct htask_param {
 };
 static DEFINE_PER_CPU(struct htask_param, ht_params);
 
-void update_fair_stat(int cpu, enum fair_causes i)
+void update_fair_stat(int cpu, enum fair_causes i, u64 elapsed)
 {
 	struct sched_stat *stat;
 
@@ -70,6 +73,9 @@ void update_fair_stat(int cpu, enum fair_causes i)
 
 	stat->fair_sum++;
 	stat->fair[i]++;
+	stat->fair_ns += elapsed;
+	if (i == FAIR_CACHED)
+		stat->fair_cached_ns += elapsed;
 }
 
 void update_rt_stat(int cpu)
@@ -138,6 +144,26 @@ static ssize_t sched_stat_show(struct device *dev,
 		ret += sprintf(buf + ret, "%10u ", stat->fair_sum);
 	}
 	ret += sprintf(buf + ret, "\n%s\n", line);
+
+	ret += sprintf(buf + ret, "%20s | ", "cache hit(%)");
+	for_each_possible_cpu(cpu) {
+		stat = per_cpu_ptr(&stats, cpu);
+		ret += sprintf(buf + ret, "%10u ", stat->fair_sum ?
+				stat->fair[FAIR_CACHED] * 100 / stat->fair_sum : 0);
+	}
+	ret += sprintf(buf + ret, "\n%20s | ", "avg latency(ns)");
+	for_each_possible_cpu(cpu) {
+		stat = per_cpu_ptr(&stats, cpu);
+		ret += sprintf(buf + ret, "%10llu ", stat->fair_sum ?
+				div_u64(stat->fair_ns, stat->fair_sum) : 0);
+	}
+	ret += sprintf(buf + ret, "\n%20s | ", "avg cached(ns)");
+	for_each_possible_cpu(cpu) {
+		stat = per_cpu_ptr(&stats, cpu);
+		ret += sprintf(buf + ret, "%10llu ", stat->fair[FAIR_CACHED] ?
+				div_u64(stat->fair_cached_ns, stat->fair[FAIR_CACHED]) : 0);
+	}
+	ret += sprintf(buf + ret, "\n%s\n", line);
 	ret += sprintf(buf + ret, "not_selected: %u\n\n", not_selected_fair);
 
 	ret += sprintf(buf + ret, "%s\n", line);
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * energy_test.c - Samsung EMS(Eynos Mobile Schedular) Driver for Kunit
+ *
+ * Copyright (C) 2024 Samsung Electronics Co., Ltd.
+ */
+
+#include <kunit/test.h>
+
+#include "ems.h"
+
+#include "energy_test.h"
+
+#define NR_WAKEUPS	10000
+
+/*
+ * average cost of a wakeup of current, in ns. Wakeups served from the fast
+ * track cache leave the cached placement and its timestamp alone.
+ */
+static u64 ems_energy_test_wakeup_cost(struct kunit *test, bool baseline,
+				       bool fast_track, int *hits)
+{
+	struct task_struct *p = current;
+	bool saved_baseline = ems_energy_baseline;
+	bool saved_fast_track = ems_fast_track;
+	unsigned long flags;
+	u64 start, ts, sum = 0;
+	int i, cpu;
+
+	ems_energy_baseline = baseline;
+	ems_fast_track = fast_track;
+	*hits = 0;
+
+	for (i = 0; i < NR_WAKEUPS; i++) {
+		raw_spin_lock_irqsave(&p->pi_lock, flags);
+		ts = ems_ft_ts(p);
+		start = ktime_get_ns();
+		cpu = ems_select_task_rq_fair(p, task_cpu(p), 0, 0);
+		sum += ktime_get_ns() - start;
+		if (ems_ft_cpu(p) == cpu && ems_ft_ts(p) == ts)
+			(*hits)++;
+		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+
+		KUNIT_EXPECT_TRUE(test, cpumask_test_cpu(cpu, cpu_possible_mask));
+	}
+
+	ems_energy_baseline = saved_baseline;
+	ems_fast_track = saved_fast_track;
+
+	return div64_u64(sum, NR_WAKEUPS);
+}
+
+static void ems_energy_test_select_task_rq_fair_cost(struct kunit *test)
+{
+	u64 full, delta, cached;
+	int hits;
+
+	/* warm up the caches for both */
+	ems_energy_test_wakeup_cost(test, true, false, &hits);
+
+	/* bypass the fast track cache, it would serve most of these */
+	full = ems_energy_test_wakeup_cost(test, false, false, &hits);
+	KUNIT_EXPECT_EQ(test, hits, 0);
+	delta = ems_energy_test_wakeup_cost(test, true, false, &hits);
+	KUNIT_EXPECT_EQ(test, hits, 0);
+	cached = ems_energy_test_wakeup_cost(test, true, true, &hits);
+
+	kunit_info(test, "select_task_rq_fair: full %llu ns, delta %llu ns per wakeup\n",
+			full, delta);
+	kunit_info(test, "select_task_rq_fair: fast track %llu ns per wakeup, %d/%d hits\n",
+			cached, hits, NR_WAKEUPS);
+}
+
+/* the delta on the baseline gives every candidate the energy of a full evaluation */
+static void ems_energy_test_baseline_equivalence(struct kunit *test)
+{
+	struct task_struct *p = current;
+	unsigned int full[VENDOR_NR_CPUS], delta[VENDOR_NR_CPUS];
+	struct energy_backup *full_backup, *delta_backup;
+	struct energy_baseline *base;
+	struct tp_env *env;
+	unsigned long flags;
+	int cpu;
+
+	env = kunit_kzalloc(test, sizeof(*env), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, env);
+	base = kunit_kzalloc(test, sizeof(*base), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, base);
+	full_backup = kunit_kcalloc(test, VENDOR_NR_CPUS, sizeof(*full_backup), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, full_backup);
+	delta_backup = kunit_kcalloc(test, VENDOR_NR_CPUS, sizeof(*delta_backup), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, delta_backup);
+
+	env->p = p;
+	env->cgroup_idx = cpuctl_task_group_idx(p);
+	env->prev_cpu = task_cpu(p);
+
+	/* both evaluations see the same snapshot */
+	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	take_util_snapshot(env);
+	build_energy_baseline(env, base);
+	for_each_cpu(cpu, cpu_active_mask) {
+		full[cpu] = compute_system_energy(env, cpu, full_backup, NULL);
+		delta[cpu] = compute_system_energy(env, cpu, delta_backup, base);
+	}
+	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+
+	for_each_cpu(cpu, cpu_active_mask)
+		KUNIT_EXPECT_EQ_MSG(test, full[cpu], delta[cpu], "energy of cpu%d", cpu);
+}
+
+static struct kunit_case ems_energy_test_cases[] = {
+	KUNIT_CASE(ems_energy_test_baseline_equivalence),
+	KUNIT_CASE_SLOW(ems_energy_test_select_task_rq_fair_cost),
+	{},
+};
+
+static struct kunit_suite ems_energy_test_suite = {
+	.name = "ems_energy",
+	.test_cases = ems_energy_test_cases,
+};
+
+kunit_test_suites(&ems_energy_test_suite);
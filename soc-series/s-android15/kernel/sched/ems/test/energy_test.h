@@ -0,0 +1,12 @@
+#ifndef _EMS_ENERGY_TEST_H
+#define _EMS_ENERGY_TEST_H
+
+extern bool ems_energy_baseline;
+extern bool ems_fast_track;
+
+extern void take_util_snapshot(struct tp_env *env);
+extern void build_energy_baseline(struct tp_env *env, struct energy_baseline *base);
+extern unsigned int compute_system_energy(struct tp_env *env, int dst_cpu,
+		struct energy_backup *backup, struct energy_baseline *base);
+
+#endif /* _EMS_ENERGY_TEST_H */
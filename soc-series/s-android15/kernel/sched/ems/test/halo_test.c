@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * halo_test.c - Samsung EMS(Eynos Mobile Schedular) Driver for Kunit
+ *
+ * Copyright (C) 2024 Samsung Electronics Co., Ltd.
+ */
+
+#include <kunit/test.h>
+
+#include "ems.h"
+
+#include "halo_test.h"
+
+/*
+ * An idle period in the form traced by halo_select/halo_reflect, the sleep
+ * length and the sleep length to next determined event (timer, tick or
+ * periodic irq). The wake-up was by IPI if it came before the latter.
+ */
+struct halo_trace {
+	u32 slen_us;
+	u32 det_us;
+};
+
+#define TRACE_LEN	512
+#define TRACE_WARMUP	16
+
+/* replay @trace through the predictor as halo_select/halo_reflect do */
+static void halo_test_replay(struct halo_pred *hpred, const struct halo_trace *trace,
+		int len, int ratio, struct halo_pred_stat *hstat)
+{
+	s64 now = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		s64 det_ns = (s64)trace[i].det_us * NSEC_PER_USEC;
+		s64 slen_ns = (s64)trace[i].slen_us * NSEC_PER_USEC;
+		s64 pred_ns = halo_pred_predict(hpred, ratio);
+
+		now += min(slen_ns, det_ns);
+
+		if (pred_ns < 0)
+			pred_ns = LLONG_MAX;
+		pred_ns = min(pred_ns, det_ns);
+
+		if (i >= TRACE_WARMUP)
+			halo_pred_account(hstat, pred_ns, slen_ns);
+
+		if (slen_ns < det_ns)
+			halo_pred_update(hpred, now, slen_ns);
+	}
+}
+
+/* up to +-5% of jitter, the same on every run */
+static u32 halo_test_jitter(u32 us, int i)
+{
+	return us + (s64)us * ((i * 7919) % 11 - 5) / 100;
+}
+
+static struct halo_trace *halo_test_alloc_trace(struct kunit *test)
+{
+	struct halo_trace *trace;
+
+	trace = kunit_kcalloc(test, TRACE_LEN, sizeof(*trace), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, trace);
+
+	return trace;
+}
+
+static void halo_test_pred_bucket(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 0, halo_pred_bucket(0));
+	KUNIT_EXPECT_EQ(test, 0, halo_pred_bucket(1));
+	KUNIT_EXPECT_EQ(test, 1, halo_pred_bucket(2));
+	KUNIT_EXPECT_EQ(test, 9, halo_pred_bucket(1000));
+	KUNIT_EXPECT_EQ(test, HALO_PRED_BUCKETS - 1, halo_pred_bucket(1 << 20));
+}
+
+static void halo_test_pred_account(struct kunit *test)
+{
+	struct halo_pred_stat hstat = { 0, };
+
+	halo_pred_account(&hstat, 1000 * NSEC_PER_USEC, 700 * NSEC_PER_USEC);
+	halo_pred_account(&hstat, 500 * NSEC_PER_USEC, 700 * NSEC_PER_USEC);
+	halo_pred_account(&hstat, 650 * NSEC_PER_USEC, 700 * NSEC_PER_USEC);
+
+	KUNIT_EXPECT_EQ(test, (u64)3, hstat.cnt);
+	KUNIT_EXPECT_EQ(test, (u64)1, hstat.over);
+	KUNIT_EXPECT_EQ(test, (u64)1, hstat.under);
+	KUNIT_EXPECT_EQ(test, (u64)550, hstat.err_sum_us);
+}
+
+static void halo_test_pred_warmup(struct kunit *test)
+{
+	struct halo_pred hpred = { 0, };
+
+	KUNIT_EXPECT_LT(test, halo_pred_predict(&hpred, 50), (s64)0);
+
+	halo_pred_update(&hpred, 3 * NSEC_PER_MSEC, 3000 * NSEC_PER_USEC);
+	halo_pred_update(&hpred, 6 * NSEC_PER_MSEC, 3000 * NSEC_PER_USEC);
+	halo_pred_update(&hpred, 9 * NSEC_PER_MSEC, 3000 * NSEC_PER_USEC);
+
+	KUNIT_EXPECT_EQ(test, (s64)3000 * NSEC_PER_USEC, halo_pred_predict(&hpred, 50));
+}
+
+/* the histogram forgets by elapsed time, not by the number of samples */
+static void halo_test_pred_decay(struct kunit *test)
+{
+	struct halo_pred hpred = { 0, };
+	s64 now = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		now += 1000 * NSEC_PER_USEC;
+		halo_pred_update(&hpred, now, 1000 * NSEC_PER_USEC);
+	}
+	KUNIT_EXPECT_EQ(test, (s64)1000 * NSEC_PER_USEC, halo_pred_predict(&hpred, 50));
+
+	/* one IPI after a long quiet period does not see the old pattern */
+	now += NSEC_PER_SEC;
+	halo_pred_update(&hpred, now, 3000 * NSEC_PER_USEC);
+	KUNIT_EXPECT_LT(test, halo_pred_predict(&hpred, 50), (s64)0);
+
+	now += 3000 * NSEC_PER_USEC;
+	halo_pred_update(&hpred, now, 3000 * NSEC_PER_USEC);
+	KUNIT_EXPECT_EQ(test, (s64)3000 * NSEC_PER_USEC, halo_pred_predict(&hpred, 50));
+}
+
+/* audio callback, an IPI every 2.67ms under an 8ms timer */
+static void halo_test_replay_periodic(struct kunit *test)
+{
+	struct halo_trace *trace = halo_test_alloc_trace(test);
+	struct halo_pred hpred = { 0, };
+	struct halo_pred_stat hstat = { 0, };
+	int i;
+
+	for (i = 0; i < TRACE_LEN; i++) {
+		trace[i].slen_us = halo_test_jitter(2667, i);
+		trace[i].det_us = 8000;
+	}
+
+	halo_test_replay(&hpred, trace, TRACE_LEN, 50, &hstat);
+
+	kunit_info(test, "periodic: over %llu under %llu of %llu, avg err %lluus\n",
+			hstat.over, hstat.under, hstat.cnt,
+			div64_u64(hstat.err_sum_us, hstat.cnt));
+
+	KUNIT_EXPECT_LE(test, (hstat.over + hstat.under) * 100, hstat.cnt * 5);
+}
+
+/* display frame, three short bursts and a long sleep to next vsync */
+static void halo_test_replay_bimodal(struct kunit *test)
+{
+	struct halo_trace *trace = halo_test_alloc_trace(test);
+	struct halo_pred hpred = { 0, };
+	struct halo_pred_stat hstat = { 0, };
+	int i;
+
+	for (i = 0; i < TRACE_LEN; i++) {
+		trace[i].slen_us = halo_test_jitter((i % 4) == 3 ? 15000 : 300, i);
+		trace[i].det_us = 16667;
+	}
+
+	/* the median keeps the shallow state for the bursts */
+	halo_test_replay(&hpred, trace, TRACE_LEN, 50, &hstat);
+
+	kunit_info(test, "bimodal: over %llu under %llu of %llu, avg err %lluus\n",
+			hstat.over, hstat.under, hstat.cnt,
+			div64_u64(hstat.err_sum_us, hstat.cnt));
+
+	KUNIT_EXPECT_LE(test, hstat.over * 100, hstat.cnt * 5);
+	KUNIT_EXPECT_LE(test, hstat.under * 100, hstat.cnt * 30);
+}
+
+/* the IPI interval changes from 1ms to 8ms in the middle */
+static void halo_test_replay_phase_change(struct kunit *test)
+{
+	struct halo_trace *trace = halo_test_alloc_trace(test);
+	struct halo_pred hpred = { 0, };
+	struct halo_pred_stat hstat = { 0, };
+	s64 pred_ns;
+	int i;
+
+	for (i = 0; i < TRACE_LEN; i++) {
+		trace[i].slen_us = halo_test_jitter(i < TRACE_LEN / 2 ? 1000 : 8000, i);
+		trace[i].det_us = 20000;
+	}
+
+	halo_test_replay(&hpred, trace, TRACE_LEN / 2 + TRACE_WARMUP, 50, &hstat);
+
+	pred_ns = halo_pred_predict(&hpred, 50);
+	KUNIT_EXPECT_GE(test, pred_ns, (s64)6000 * NSEC_PER_USEC);
+	KUNIT_EXPECT_LE(test, pred_ns, (s64)10000 * NSEC_PER_USEC);
+}
+
+static struct kunit_case halo_test_cases[] = {
+	KUNIT_CASE(halo_test_pred_bucket),
+	KUNIT_CASE(halo_test_pred_account),
+	KUNIT_CASE(halo_test_pred_warmup),
+	KUNIT_CASE(halo_test_pred_decay),
+	KUNIT_CASE(halo_test_replay_periodic),
+	KUNIT_CASE(halo_test_replay_bimodal),
+	KUNIT_CASE(halo_test_replay_phase_change),
+	{},
+};
+
+static struct kunit_suite halo_test_suite = {
+	.name = "ems_halo",
+	.test_cases = halo_test_cases,
+};
+
+kunit_test_suites(&halo_test_suite);
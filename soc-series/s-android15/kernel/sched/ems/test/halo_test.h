@@ -0,0 +1,9 @@
+#ifndef _EMS_HALO_TEST_H
+#define _EMS_HALO_TEST_H
+
+int halo_pred_bucket(s64 slen_us);
+void halo_pred_update(struct halo_pred *hpred, s64 now, s64 slen_ns);
+s64 halo_pred_predict(struct halo_pred *hpred, int ratio);
+void halo_pred_account(struct halo_pred_stat *hstat, s64 pred_ns, s64 actual_ns);
+
+#endif /* _EMS_HALO_TEST_H */
@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mlt_test.c - Samsung EMS(Eynos Mobile Schedular) Driver for Kunit
+ *
+ * Copyright (C) 2024 Samsung Electronics Co., Ltd.
+ */
+
+#include <kunit/test.h>
+#include <linux/perf_event.h>
+
+#include "ems.h"
+
+#include "mlt_test.h"
+
+#define T0		(1000 * MLT_PERIOD_SIZE)
+#define NR_SWITCHES	10000
+#define FULL		((int)SCHED_CAPACITY_SCALE)
+
+static void mlt_test_init(struct mlt_task *mlt, int state, u64 now)
+{
+	memset(mlt, 0, sizeof(*mlt));
+	mlt->part.state = state;
+	mlt->part.period_start = now;
+	mlt->part.last_updated = now;
+}
+
+/* update @mlt as mlt_update_task does, without the pmu */
+static void mlt_test_update(struct mlt_task *mlt, int next_state, u64 now)
+{
+	struct mlt_env env = {
+		.part = &mlt->part,
+		.uarch = mlt->uarch,
+		.raw = mlt->uarch_raw,
+		.next_state = next_state,
+		.update_uarch = false,
+		.is_task = true,
+		.tick = false,
+	};
+
+	mlt_update(&env, now);
+}
+
+/* the average as it was computed before the periods became a masked ring */
+static int mlt_test_ref_avg(struct mlt_part *part, int length)
+{
+	int idx = part->cur_period, value = 0;
+	int cnt, corrected_idx = 0;
+	int oldest_idx = (idx - (length - 1) + MLT_PERIOD_COUNT) % MLT_PERIOD_COUNT;
+
+	if (part->periods[oldest_idx] < part->recent) {
+		corrected_idx = 1;
+		value = part->recent;
+	}
+
+	for (cnt = 0; cnt < (length - corrected_idx); cnt++) {
+		value += part->periods[idx];
+		idx = (idx - 1 + MLT_PERIOD_COUNT) % MLT_PERIOD_COUNT;
+	}
+
+	return value / length;
+}
+
+static void mlt_test_rollover(struct mlt_task *mlt, struct kunit *test)
+{
+	struct mlt_part *part = &mlt->part;
+
+	/* one full period, two elapsed ones and a half period running */
+	mlt_test_init(mlt, ACTIVE, T0);
+	mlt_test_update(mlt, MLT_STATE_NOCHANGE, T0 + 3 * MLT_PERIOD_SIZE + MLT_PERIOD_SIZE / 2);
+
+	KUNIT_EXPECT_EQ(test, 3, part->cur_period);
+	KUNIT_EXPECT_EQ(test, 0, (int)part->periods[0]);
+	KUNIT_EXPECT_EQ(test, FULL, (int)part->periods[1]);
+	KUNIT_EXPECT_EQ(test, FULL, (int)part->periods[2]);
+	KUNIT_EXPECT_EQ(test, FULL, (int)part->periods[3]);
+	KUNIT_EXPECT_EQ(test, FULL / 2, part->recent);
+	KUNIT_EXPECT_EQ(test, 896, __mlt_avg_value(part, 4));
+}
+
+static void mlt_test_update_periods(struct kunit *test)
+{
+	struct mlt_task *mlt = kunit_kzalloc(test, sizeof(*mlt), GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, mlt);
+
+	mlt_test_rollover(mlt, test);
+}
+
+static void mlt_test_update_long_sleep(struct kunit *test)
+{
+	struct mlt_task *mlt = kunit_kzalloc(test, sizeof(*mlt), GFP_KERNEL);
+	struct mlt_part *part;
+	u64 now = T0 + 3 * MLT_PERIOD_SIZE + MLT_PERIOD_SIZE / 2;
+	int c;
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, mlt);
+	part = &mlt->part;
+
+	mlt_test_rollover(mlt, test);
+	mlt_test_update(mlt, INACTIVE, now);
+
+	/* more periods than the history has elapsed, all of them idle */
+	mlt_test_update(mlt, ACTIVE, now + 20 * MLT_PERIOD_SIZE);
+
+	KUNIT_EXPECT_EQ(test, 7, part->cur_period);
+	KUNIT_EXPECT_EQ(test, ACTIVE, part->state);
+	KUNIT_EXPECT_EQ(test, 0, part->recent);
+	for (c = 0; c < MLT_PERIOD_COUNT; c++)
+		KUNIT_EXPECT_EQ(test, 0, (int)part->periods[c]);
+
+	/* and as many running */
+	now += 20 * MLT_PERIOD_SIZE;
+	mlt_test_update(mlt, MLT_STATE_NOCHANGE, now + 12 * MLT_PERIOD_SIZE);
+
+	KUNIT_EXPECT_EQ(test, 3, part->cur_period);
+	for (c = 0; c < MLT_PERIOD_COUNT; c++)
+		KUNIT_EXPECT_EQ(test, FULL, (int)part->periods[c]);
+	KUNIT_EXPECT_EQ(test, FULL,
+			__mlt_avg_value(part, MLT_PERIOD_COUNT));
+}
+
+static void mlt_test_avg_value(struct kunit *test)
+{
+	struct mlt_part part = { 0, };
+	int cur, length, i, c;
+
+	for (i = 0; i < 64; i++) {
+		for (c = 0; c < MLT_PERIOD_COUNT; c++)
+			part.periods[c] = (i * 131 + c * 577) % (FULL + 1);
+		part.recent = (i * 389) % (FULL + 1);
+
+		for (cur = 0; cur < MLT_PERIOD_COUNT; cur++) {
+			part.cur_period = cur;
+			for (length = 1; length <= MLT_PERIOD_COUNT; length++)
+				KUNIT_EXPECT_EQ(test, mlt_test_ref_avg(&part, length),
+						__mlt_avg_value(&part, length));
+		}
+	}
+
+	KUNIT_EXPECT_EQ(test, 0, __mlt_avg_value(&part, 0));
+	KUNIT_EXPECT_EQ(test, 0, __mlt_avg_value(&part, MLT_PERIOD_COUNT + 1));
+}
+
+/* cpu cycles of current, falls back to ns where the counter is not there */
+static struct perf_event *mlt_test_create_counter(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HARDWARE,
+		.config = PERF_COUNT_HW_CPU_CYCLES,
+		.size = sizeof(struct perf_event_attr),
+		.exclude_idle = 1,
+	};
+	struct perf_event *pe;
+
+	pe = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	if (IS_ERR(pe))
+		return NULL;
+
+	return pe;
+}
+
+static u64 mlt_test_now(struct perf_event *pe)
+{
+	u64 val;
+
+	if (!pe || perf_event_read_local(pe, &val, NULL, NULL))
+		return sched_clock();
+
+	return val;
+}
+
+/*
+ * Replay the updates done by mlt_task_switch between two tasks sharing a
+ * cpu, with run lengths from a fraction of a period to a few periods and
+ * an idle gap long enough to wrap the history every 64 switches.
+ */
+static void mlt_test_switch_cost(struct kunit *test)
+{
+	struct mlt_task *prev, *next, *cpu;
+	struct perf_event *pe = mlt_test_create_counter();
+	u64 now = T0, start, sum = 0;
+	unsigned long flags;
+	int i, avg = 0;
+
+	prev = kunit_kzalloc(test, sizeof(*prev), GFP_KERNEL);
+	next = kunit_kzalloc(test, sizeof(*next), GFP_KERNEL);
+	cpu = kunit_kzalloc(test, sizeof(*cpu), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, prev);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, next);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, cpu);
+
+	mlt_test_init(prev, ACTIVE, now);
+	mlt_test_init(next, INACTIVE, now);
+	mlt_test_init(cpu, ACTIVE, now);
+
+	for (i = 0; i < NR_SWITCHES; i++) {
+		now += (i % 64) ? (MLT_PERIOD_SIZE / 8) * (1 + (i * 7919) % 24) :
+				  20 * MLT_PERIOD_SIZE;
+
+		local_irq_save(flags);
+		start = mlt_test_now(pe);
+		mlt_test_update(prev, INACTIVE, now);
+		mlt_test_update(next, ACTIVE, now);
+		mlt_test_update(cpu, ACTIVE, now);
+		avg += __mlt_avg_value(&cpu->part, MLT_PERIOD_COUNT);
+		sum += mlt_test_now(pe) - start;
+		local_irq_restore(flags);
+
+		swap(prev, next);
+	}
+
+	KUNIT_EXPECT_GE(test, avg, 0);
+	kunit_info(test, "mlt: %llu %s per switch\n", div64_u64(sum, NR_SWITCHES),
+			pe ? "cycles" : "ns");
+
+	if (pe)
+		perf_event_release_kernel(pe);
+}
+
+static struct kunit_case mlt_test_cases[] = {
+	KUNIT_CASE(mlt_test_update_periods),
+	KUNIT_CASE(mlt_test_update_long_sleep),
+	KUNIT_CASE(mlt_test_avg_value),
+	KUNIT_CASE_SLOW(mlt_test_switch_cost),
+	{},
+};
+
+static struct kunit_suite mlt_test_suite = {
+	.name = "ems_mlt",
+	.test_cases = mlt_test_cases,
+};
+
+kunit_test_suites(&mlt_test_suite);
@@ -0,0 +1,7 @@
+#ifndef _EMS_MLT_TEST_H
+#define _EMS_MLT_TEST_H
+
+void mlt_update(struct mlt_env *env, u64 now);
+int __mlt_avg_value(struct mlt_part *part, int length);
+
+#endif /* _EMS_MLT_TEST_H */